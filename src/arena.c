@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdalign.h>//alignof
+#include <string.h>//memset
+#include "arena.h"
+#include "error.h"
+#include "util.h"
+
+/**
+ * @brief Every block is aligned as malloc would do it
+ */
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+/**
+ * @brief Round a size up to the next multiple of ARENA_ALIGNMENT
+ */
+#define ARENA_ROUND_UP(size)\
+    (((size) + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+int arena_create(arena_t* arena, size_t size){
+
+    M_REQUIRE_NON_NULL(arena);
+    M_REQUIRE(size != 0, ERR_BAD_PARAMETER, "Size (%zu) is 0", size);
+
+    zero_init_ptr(arena);
+    //The memory is allocated by the first block
+    arena->size = ARENA_ROUND_UP(size);
+
+    return ERR_NONE;
+}
+
+void* arena_alloc(arena_t* arena, size_t size){
+
+    if(arena == NULL || arena->size == 0 || size == 0){
+        return NULL;
+    }
+
+    const size_t rounded = ARENA_ROUND_UP(size);
+    if(rounded > arena->size - arena->top){
+        ++arena->fallbacks;
+        return NULL;
+    }
+    if(arena->memory == NULL && (arena->memory = aligned_alloc(ARENA_ALIGNMENT, arena->size)) == NULL){
+        ++arena->fallbacks;
+        return NULL;
+    }
+
+    void* block = arena->memory + arena->top;
+    arena->top += rounded;
+    ++arena->live;
+    ++arena->allocations;
+
+    if(arena->top > arena->high_water){
+        arena->high_water = arena->top;
+    }
+
+    return block;
+}
+
+int arena_contains(const arena_t* arena, const void* ptr){
+
+    if(arena == NULL || arena->memory == NULL || ptr == NULL){
+        return 0;
+    }
+
+    const uint8_t* p = ptr;
+    return p >= arena->memory && p < arena->memory + arena->size;
+}
+
+void arena_release(arena_t* arena, void* ptr){
+
+    if(arena_contains(arena, ptr) && arena->live > 0){
+        --arena->live;
+    }
+}
+
+int arena_reset(arena_t* arena){
+
+    M_REQUIRE_NON_NULL(arena);
+    if(arena->live != 0){
+        ++arena->failed_resets;
+        M_EXIT_ERR(ERR_BAD_PARAMETER, "%zu blocks are still in use", arena->live);
+    }
+
+    arena->top = 0;
+    ++arena->resets;
+
+    return ERR_NONE;
+}
+
+void arena_free(arena_t* arena){
+
+    if(arena != NULL){
+        free(arena->memory);
+        zero_init_ptr(arena);
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/**
+ * @file arena.h
+ * @brief Bump-pointer arena for short-lived allocations (rendering temporaries)
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint8_t, uint64_t
+#include <stddef.h>//size_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Default size of the arena of a gameboy (enough for the temporaries of a whole frame)
+ */
+#define ARENA_DEFAULT_SIZE (1 << 23)
+
+/**
+ * @brief Arena data structure.
+ *        Memory is handed out by moving top forward and is only given back all at once by arena_reset.
+ */
+typedef struct {
+    uint8_t* memory;
+    size_t size;
+    size_t top; //first free byte
+    size_t live; //number of blocks handed out and not released yet
+
+    //Statistics
+    size_t high_water; //biggest value top has ever reached
+    uint64_t allocations; //number of blocks served by the arena
+    uint64_t fallbacks; //number of blocks that did not fit in the arena
+    uint64_t resets; //number of successful resets
+    uint64_t failed_resets; //number of resets refused because some blocks were still in use
+} arena_t;
+
+/**
+ * @brief Creates an arena, its memory being only allocated by its first block
+ *        (an arena never used costs nothing)
+ *
+ * @param arena arena to create
+ * @param size size in bytes of the arena
+ * @return error code
+ */
+int arena_create(arena_t* arena, size_t size);
+
+/**
+ * @brief Allocates a block in the arena
+ *
+ * @param arena arena to allocate from
+ * @param size size in bytes of the block
+ * @return pointer to the block or NULL if it does not fit in the arena, or if the memory of the arena
+ *         cannot be allocated (counted as fallback)
+ */
+void* arena_alloc(arena_t* arena, size_t size);
+
+/**
+ * @brief Tells whether a pointer was allocated from the arena
+ *
+ * @param arena the arena
+ * @param ptr pointer to test
+ * @return 1 if ptr points inside the arena, 0 otherwise
+ */
+int arena_contains(const arena_t* arena, const void* ptr);
+
+/**
+ * @brief Releases a block of the arena (memory is only reclaimed on arena_reset)
+ *
+ * @param arena the arena
+ * @param ptr block to release
+ */
+void arena_release(arena_t* arena, void* ptr);
+
+/**
+ * @brief Reclaims the whole arena
+ *
+ * @param arena arena to reset
+ * @return error code (ERR_BAD_PARAMETER if some blocks are still in use, in which case nothing is done
+ *         but counting the failed reset)
+ */
+int arena_reset(arena_t* arena);
+
+/**
+ * @brief Frees an arena
+ *
+ * @param arena arena to free
+ */
+void arena_free(arena_t* arena);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,325 @@
+#include <stdlib.h>
+#include <unistd.h>//sysconf
+#include "batch.h"
+#include "clone.h"
+#include "error.h"
+#include "util.h"
+
+/**
+ * @brief Completes a future, waking up those waiting for it
+ */
+static void batch_complete(batch_future_t* future, int error){
+    pthread_mutex_lock(&future->lock);
+    future->done = 1;
+    future->error = error;
+    pthread_cond_broadcast(&future->completed);
+    pthread_mutex_unlock(&future->lock);
+}
+
+/**
+ * @brief Queues a task at the back of the deque of a worker
+ */
+static void batch_push(batch_t* batch, batch_worker_t* worker, size_t task){
+    pthread_mutex_lock(&worker->lock);
+    worker->tasks[(worker->first + worker->count) % batch->nb_instances] = task;
+    ++worker->count;
+    pthread_mutex_unlock(&worker->lock);
+
+    pthread_mutex_lock(&batch->lock);
+    ++batch->queued;
+    pthread_cond_signal(&batch->work);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+/**
+ * @brief Takes a task for a worker: the last one it queued (its instance being the one in its caches),
+ *        or else the oldest one of another worker
+ */
+static bit_t batch_take(batch_t* batch, batch_worker_t* worker, size_t* task){
+
+    pthread_mutex_lock(&worker->lock);
+    bit_t found = worker->count > 0;
+    if(found){
+        --worker->count;
+        *task = worker->tasks[(worker->first + worker->count) % batch->nb_instances];
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    for(size_t i = 1; !found && i < batch->nb_workers; ++i){
+        batch_worker_t* const victim = &batch->workers[(worker->index + i) % batch->nb_workers];
+        pthread_mutex_lock(&victim->lock);
+        found = victim->count > 0;
+        if(found){
+            *task = victim->tasks[victim->first];
+            victim->first = (victim->first + 1) % batch->nb_instances;
+            --victim->count;
+            ++worker->steals;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    if(found){
+        pthread_mutex_lock(&batch->lock);
+        --batch->queued;
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return found;
+}
+
+/**
+ * @brief Runs an instance until the next frame boundary, after giving it its input.
+ *        Its temporaries come from the arena of the worker: none outlives the run, so a single arena per thread
+ *        serves all the instances, instead of one each.
+ */
+static int batch_step(batch_worker_t* worker, batch_instance_t* instance, size_t index){
+
+    gameboy_t* const gameboy = &instance->gameboy;
+    const uint64_t frame = gameboy->cycles / FRAME_TOTAL_CYCLES;
+    if(instance->input != NULL){
+        M_EXIT_IF_ERR(instance->input(gameboy, index, frame, instance->input_data));
+    }
+
+    M_EXIT_IF_ERR(gameboy_set_arena(gameboy, &worker->arena));
+    const int err = gameboy_run_until(gameboy, (frame + 1) * FRAME_TOTAL_CYCLES);
+    gameboy_set_arena(gameboy, NULL);
+    //Frames do not end at VBlank, where the gameboy resets its arena
+    if(worker->arena.live == 0){
+        M_EXIT_IF_ERR(arena_reset(&worker->arena));
+    }
+
+    return err;
+}
+
+/**
+ * @brief Thread of the pool: runs a frame per task, queuing the next frame of the instance on its own deque,
+ *        until the batch is closing and no task is left
+ */
+static void* batch_worker(void* arg){
+
+    batch_worker_t* const worker = arg;
+    batch_t* const batch = worker->batch;
+
+    for(;;){
+        size_t task = 0;
+        if(batch_take(batch, worker, &task)){
+            batch_instance_t* const instance = &batch->instances[task];
+            const int err = batch_step(worker, instance, task);
+            ++worker->frames;
+            --instance->remaining;
+            if(err == ERR_NONE && instance->remaining > 0){
+                batch_push(batch, worker, task);
+            } else {
+                batch_complete(&instance->future, err);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&batch->lock);
+        while(batch->queued == 0 && !batch->closing){
+            pthread_cond_wait(&batch->work, &batch->lock);
+        }
+        const bit_t stop = batch->queued == 0;
+        pthread_mutex_unlock(&batch->lock);
+        if(stop){
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Stops the threads started, then frees everything else of a batch (being created or not)
+ */
+static void batch_release(batch_t* batch, size_t started){
+
+    pthread_mutex_lock(&batch->lock);
+    batch->closing = 1;
+    pthread_cond_broadcast(&batch->work);
+    pthread_mutex_unlock(&batch->lock);
+    for(size_t w = 0; w < started; ++w){
+        pthread_join(batch->workers[w].thread, NULL);
+    }
+
+    for(size_t w = 0; w < batch->nb_workers; ++w){
+        pthread_mutex_destroy(&batch->workers[w].lock);
+        free(batch->workers[w].tasks);
+        arena_free(&batch->workers[w].arena);
+    }
+    for(size_t i = 0; i < batch->nb_instances; ++i){
+        gameboy_free(&batch->instances[i].gameboy);
+        pthread_cond_destroy(&batch->instances[i].future.completed);
+        pthread_mutex_destroy(&batch->instances[i].future.lock);
+    }
+    pthread_cond_destroy(&batch->work);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->workers);
+    free(batch->instances);
+    zero_init_ptr(batch);
+}
+
+int batch_create(batch_t* batch, const char* rom, gameboy_accuracy_t accuracy, size_t instances, size_t threads){
+
+    M_REQUIRE_NON_NULL(batch);
+    M_REQUIRE_NON_NULL(rom);
+    M_REQUIRE(instances > 0, ERR_BAD_PARAMETER, "No instance in the batch%s", "");
+    M_REQUIRE(threads <= BATCH_MAX_THREADS, ERR_BAD_PARAMETER, "Too many threads (%zu > %d)", threads, BATCH_MAX_THREADS);
+
+    if(threads == 0){
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores < 1 ? 1 : cores > BATCH_MAX_THREADS ? BATCH_MAX_THREADS : (size_t) cores;
+    }
+
+    zero_init_ptr(batch);
+    batch->instances = calloc(instances, sizeof(batch_instance_t));
+    batch->workers = calloc(threads, sizeof(batch_worker_t));
+    if(batch->instances == NULL || batch->workers == NULL){
+        free(batch->instances);
+        free(batch->workers);
+        zero_init_ptr(batch);
+        M_EXIT_ERR(ERR_MEM, "Cannot allocate a batch of %zu instances", instances);
+    }
+    batch->nb_instances = instances;
+    batch->nb_workers = threads;
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->work, NULL);
+    for(size_t i = 0; i < instances; ++i){
+        pthread_mutex_init(&batch->instances[i].future.lock, NULL);
+        pthread_cond_init(&batch->instances[i].future.completed, NULL);
+        batch->instances[i].future.done = 1;
+    }
+    int err = ERR_NONE;
+    for(size_t w = 0; w < threads; ++w){
+        batch->workers[w].batch = batch;
+        batch->workers[w].index = w;
+        pthread_mutex_init(&batch->workers[w].lock, NULL);
+        batch->workers[w].tasks = calloc(instances, sizeof(size_t));
+        if(batch->workers[w].tasks == NULL){
+            err = ERR_MEM;
+        }
+        if(err == ERR_NONE){
+            err = arena_create(&batch->workers[w].arena, ARENA_DEFAULT_SIZE);
+        }
+    }
+
+    //The first gameboy is created, the others are clones of it (a clone takes microseconds)
+    if(err == ERR_NONE){
+        err = gameboy_create(&batch->instances[0].gameboy, rom, accuracy);
+    }
+    for(size_t i = 1; err == ERR_NONE && i < instances; ++i){
+        err = gameboy_clone(&batch->instances[i].gameboy, &batch->instances[0].gameboy);
+    }
+
+    size_t started = 0;
+    while(err == ERR_NONE && started < threads){
+        if(pthread_create(&batch->workers[started].thread, NULL, batch_worker, &batch->workers[started]) != 0){
+            err = ERR_MEM;
+        } else {
+            ++started;
+        }
+    }
+
+    if(err != ERR_NONE){
+        batch_release(batch, started);
+        M_EXIT_ERR(err, "Cannot create a batch of %zu instances running %s on %zu threads", instances, rom, threads);
+    }
+
+    return ERR_NONE;
+}
+
+gameboy_t* batch_gameboy(batch_t* batch, size_t index){
+    return batch == NULL || index >= batch->nb_instances ? NULL : &batch->instances[index].gameboy;
+}
+
+int batch_set_input(batch_t* batch, size_t index, batch_input_t input, void* data){
+
+    M_REQUIRE_NON_NULL(batch);
+    M_REQUIRE(index < batch->nb_instances, ERR_BAD_PARAMETER, "No instance %zu", index);
+
+    batch->instances[index].input = input;
+    batch->instances[index].input_data = data;
+
+    return ERR_NONE;
+}
+
+int batch_submit(batch_t* batch, size_t index, uint64_t frames, batch_future_t** future){
+
+    M_REQUIRE_NON_NULL(batch);
+    M_REQUIRE(index < batch->nb_instances, ERR_BAD_PARAMETER, "No instance %zu", index);
+    M_REQUIRE(frames > 0, ERR_BAD_PARAMETER, "No frame to run%s", "");
+
+    batch_instance_t* const instance = &batch->instances[index];
+    pthread_mutex_lock(&instance->future.lock);
+    const bit_t done = instance->future.done;
+    if(done){
+        instance->future.done = 0;
+        instance->future.error = ERR_NONE;
+    }
+    pthread_mutex_unlock(&instance->future.lock);
+    M_REQUIRE(done, ERR_BAD_PARAMETER, "Instance %zu is still running", index);
+
+    instance->remaining = frames;
+    if(future != NULL){
+        *future = &instance->future;
+    }
+    //Spread over the deques, the idle workers stealing from the busy ones
+    batch_push(batch, &batch->workers[index % batch->nb_workers], index);
+
+    return ERR_NONE;
+}
+
+bit_t batch_future_done(batch_future_t* future){
+
+    if(future == NULL){
+        return 1;
+    }
+
+    pthread_mutex_lock(&future->lock);
+    const bit_t done = future->done;
+    pthread_mutex_unlock(&future->lock);
+
+    return done;
+}
+
+int batch_future_wait(batch_future_t* future){
+
+    M_REQUIRE_NON_NULL(future);
+
+    pthread_mutex_lock(&future->lock);
+    while(!future->done){
+        pthread_cond_wait(&future->completed, &future->lock);
+    }
+    const int err = future->error;
+    pthread_mutex_unlock(&future->lock);
+
+    return err;
+}
+
+int batch_run_all(batch_t* batch, uint64_t frames){
+
+    M_REQUIRE_NON_NULL(batch);
+    M_REQUIRE_NON_NULL(batch->instances);
+
+    int err = ERR_NONE;
+    size_t submitted = 0;
+    while(err == ERR_NONE && submitted < batch->nb_instances){
+        err = batch_submit(batch, submitted, frames, NULL);
+        submitted += err == ERR_NONE;
+    }
+    //Those submitted are waited for, even after an error
+    for(size_t i = 0; i < submitted; ++i){
+        const int instance_err = batch_future_wait(&batch->instances[i].future);
+        if(err == ERR_NONE){
+            err = instance_err;
+        }
+    }
+
+    return err;
+}
+
+void batch_free(batch_t* batch){
+    if(batch != NULL && batch->instances != NULL){
+        batch_release(batch, batch->nb_workers);
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+/**
+ * @file batch.h
+ * @brief Batch executor: many independent gameboys stepped one frame per task
+ *        by a pool of threads stealing the tasks of each other
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+#include <pthread.h>
+
+#include "bit.h"//bit_t
+#include "gameboy.h"//gameboy_t
+#include "arena.h"//arena_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BATCH_MAX_THREADS 256
+
+/**
+ * @brief Input of an instance, called on the thread that runs it just before each of its frames
+ *        (it may press or release the keys of gameboy->pad, see joypad.h)
+ *
+ * @param gameboy the gameboy of the instance
+ * @param index index of the instance
+ * @param frame the frame about to run (cycles / FRAME_TOTAL_CYCLES)
+ * @param data data given with the callback
+ * @return error code (any error stops the instance, its future completing with it)
+ */
+typedef int (*batch_input_t)(gameboy_t* gameboy, size_t index, uint64_t frame, void* data);
+
+/**
+ * @brief Completion of the frames submitted to an instance
+ */
+typedef struct {
+    pthread_mutex_t lock; //protects what follows
+    pthread_cond_t completed;
+    bit_t done; //the frames submitted were all run, or the instance stopped on an error
+    int error; //error the instance stopped on (ERR_NONE if none)
+} batch_future_t;
+
+/**
+ * @brief Gameboy of the batch, with what it still has to run
+ */
+typedef struct {
+    gameboy_t gameboy;
+    batch_input_t input; //NULL for none
+    void* input_data;
+    uint64_t remaining; //frames still to run (only touched by the thread running the instance)
+    batch_future_t future;
+} batch_instance_t;
+
+struct batch_;
+
+/**
+ * @brief Thread of the pool, and its deque of tasks (indices of instances to run one frame of).
+ *        It takes its own tasks from the back, and steals those of the others from the front.
+ */
+typedef struct {
+    struct batch_* batch;
+    size_t index;
+    pthread_t thread;
+
+    pthread_mutex_t lock; //protects the deque
+    size_t* tasks; //ring of as many tasks as instances (an instance has at most one task queued)
+    size_t first; //front of the deque
+    size_t count; //tasks in the deque
+
+    arena_t arena; //rendering temporaries of the frames it runs, whatever their instance (see gameboy_set_arena())
+
+    //Statistics (only written by the thread)
+    uint64_t frames; //frames run
+    uint64_t steals; //tasks taken from the deques of the other threads
+} batch_worker_t;
+
+/**
+ * @brief Batch executor data structure.
+ *        There is no global state: batches (and the gameboys of a batch) are independent of each other.
+ */
+typedef struct batch_ {
+    batch_instance_t* instances;
+    size_t nb_instances;
+    batch_worker_t* workers;
+    size_t nb_workers;
+
+    pthread_mutex_t lock; //protects what follows
+    pthread_cond_t work; //a task was queued, or the batch is closing
+    size_t queued; //tasks in the deques
+    bit_t closing;
+} batch_t;
+
+/**
+ * @brief Creates a batch of gameboys running a ROM, all in their initial state, and starts its threads
+ *
+ * @param batch batch to create
+ * @param rom ROM the gameboys run
+ * @param accuracy accuracy tier of the gameboys (see gameboy_create())
+ * @param instances number of gameboys
+ * @param threads number of threads of the pool (0 for one per core), at most BATCH_MAX_THREADS
+ * @return error code
+ */
+int batch_create(batch_t* batch, const char* rom, gameboy_accuracy_t accuracy, size_t instances, size_t threads);
+
+/**
+ * @brief Gives the gameboy of an instance, to be used only while its future is done
+ *
+ * @param batch the batch
+ * @param index index of the instance
+ * @return the gameboy (NULL if there is none)
+ */
+gameboy_t* batch_gameboy(batch_t* batch, size_t index);
+
+/**
+ * @brief Sets the input of an instance, while its future is done
+ *
+ * @param batch the batch
+ * @param index index of the instance
+ * @param input callback (NULL for none)
+ * @param data data given to the callback
+ * @return error code
+ */
+int batch_set_input(batch_t* batch, size_t index, batch_input_t input, void* data);
+
+/**
+ * @brief Has an instance run frames, one task per frame, while the caller goes on
+ *
+ * @param batch the batch
+ * @param index index of the instance, the future of which is done
+ * @param frames number of frames to run (up to the next frame boundary for the first one)
+ * @param future (output, optional) the future of the instance, done when the frames were run
+ * @return error code
+ */
+int batch_submit(batch_t* batch, size_t index, uint64_t frames, batch_future_t** future);
+
+/**
+ * @brief Tells whether a future is done, without waiting
+ *
+ * @param future the future
+ * @return 1 if it is done (or NULL)
+ */
+bit_t batch_future_done(batch_future_t* future);
+
+/**
+ * @brief Waits until a future is done
+ *
+ * @param future the future
+ * @return the error the instance stopped on (ERR_NONE if none)
+ */
+int batch_future_wait(batch_future_t* future);
+
+/**
+ * @brief Runs frames on all the instances and waits until they are done
+ *
+ * @param batch the batch, the futures of which are all done
+ * @param frames number of frames to run on each instance
+ * @return the first error of an instance (by index), ERR_NONE if none
+ */
+int batch_run_all(batch_t* batch, uint64_t frames);
+
+/**
+ * @brief Stops the threads once the tasks queued are done, and frees the gameboys
+ *
+ * @param batch batch to free
+ */
+void batch_free(batch_t* batch);
+
+#ifdef __cplusplus
+}
+#endif
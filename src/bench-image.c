@@ -0,0 +1,173 @@
+/**
+ * @file bench-image.c
+ * @brief Microbenchmark of image_line_map_colors() against the former
+ *        mask-based implementation (kept here as reference)
+ *
+ * @date 2021
+ */
+
+#include "error.h"
+#include "util.h"
+#include "image.h"
+#include "bit_vector.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_LINE_SIZE 256 // a whole background line
+#define BENCH_LINES 64
+#define BENCH_ROUNDS 200
+#define NANOSECONDS_IN_SECONDS 1000000000.0
+
+// ======================================================================
+/**
+ * @brief Former implementation of image_line_map_colors (one mask per colour,
+ *        each built from copies of the planes)
+ */
+static int image_line_map_colors_reference(image_line_t* output, image_line_t iml, palette_t map)
+{
+    M_REQUIRE_NON_NULL(output);
+
+    if (map == DEFAULT_PALETTE) {
+        output->lsb = bit_vector_cpy(iml.lsb);
+        output->msb = bit_vector_cpy(iml.msb);
+        output->opacity = bit_vector_cpy(iml.opacity);
+        return ERR_NONE;
+    }
+
+    output->lsb = bit_vector_create(iml.lsb->size, 0);
+    output->msb = bit_vector_create(iml.msb->size, 0);
+    output->opacity = bit_vector_cpy(iml.opacity);
+
+    for (size_t i = 0; i < PALETTE_COLOR_COUNT; ++i) {
+        bit_vector_t* mask = NULL;
+
+        const bit_t color_bit_0 = (bit_t) (map & (1 << (i * 2    )));
+        const bit_t color_bit_1 = (bit_t) (map & (1 << (i * 2 + 1)));
+
+        if (color_bit_0 || color_bit_1) {
+            switch (i) {
+            case 0: {
+                bit_vector_t* tmp = bit_vector_not(bit_vector_cpy(iml.lsb));
+                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), tmp);
+                bit_vector_free(&tmp);
+            } break;
+
+            case 1:
+                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), iml.lsb);
+                break;
+
+            case 2:
+                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.lsb)), iml.msb);
+                break;
+
+            case 3:
+                mask = bit_vector_and(bit_vector_cpy(iml.lsb), iml.msb);
+                break;
+            }
+
+            if (mask == NULL) {
+                image_line_free(output);
+                return ERR_MEM;
+            }
+
+            if (color_bit_0) output->lsb = bit_vector_or(output->lsb, mask);
+            if (color_bit_1) output->msb = bit_vector_or(output->msb, mask);
+
+            bit_vector_free(&mask);
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+static int same_line(image_line_t iml1, image_line_t iml2)
+{
+    const size_t words = (iml1.msb->size + IMAGE_LINE_WORD_BITS - 1) / IMAGE_LINE_WORD_BITS;
+    for (size_t i = 0; i < words; ++i) {
+        if (iml1.msb->content[i] != iml2.msb->content[i] ||
+            iml1.lsb->content[i] != iml2.lsb->content[i] ||
+            iml1.opacity->content[i] != iml2.opacity->content[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// ======================================================================
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / NANOSECONDS_IN_SECONDS;
+}
+
+// ======================================================================
+typedef int (*map_colors_t)(image_line_t*, image_line_t, palette_t);
+
+static double time_map_colors(map_colors_t map_colors, image_line_t* lines)
+{
+    const double start = now();
+    for (size_t round = 0; round < BENCH_ROUNDS; ++round) {
+        for (size_t palette = 0; palette < 256; ++palette) {
+            image_line_t out;
+            map_colors(&out, lines[palette % BENCH_LINES], (palette_t) palette);
+            image_line_free(&out);
+        }
+    }
+    return (now() - start) * NANOSECONDS_IN_SECONDS / (BENCH_ROUNDS * 256.0);
+}
+
+// ======================================================================
+int main(void)
+{
+    image_line_t lines[BENCH_LINES];
+    zero_init_var(lines);
+
+    srand(42);
+    for (size_t i = 0; i < BENCH_LINES; ++i) {
+        M_EXIT_IF_ERR(image_line_create(lines + i, BENCH_LINE_SIZE - i % 2 * 3)); // also sizes that are not multiples of 32
+        for (size_t w = 0; w < BENCH_LINE_SIZE / IMAGE_LINE_WORD_BITS; ++w) {
+            M_EXIT_IF_ERR(image_line_set_word(lines + i, w, (uint32_t) rand(), (uint32_t) rand()));
+        }
+        // keep the unused bits of the last word at zero
+        const size_t used = lines[i].msb->size % IMAGE_LINE_WORD_BITS;
+        if (used != 0) {
+            const size_t last = lines[i].msb->size / IMAGE_LINE_WORD_BITS;
+            const uint32_t mask = (UINT32_C(1) << used) - 1;
+            lines[i].msb->content[last] &= mask;
+            lines[i].lsb->content[last] &= mask;
+            lines[i].opacity->content[last] &= mask;
+        }
+    }
+
+    int mismatches = 0;
+    for (size_t palette = 0; palette < 256; ++palette) {
+        for (size_t i = 0; i < BENCH_LINES; ++i) {
+            image_line_t expected, result;
+            M_EXIT_IF_ERR(image_line_map_colors_reference(&expected, lines[i], (palette_t) palette));
+            M_EXIT_IF_ERR(image_line_map_colors(&result, lines[i], (palette_t) palette));
+            if (!same_line(expected, result)) {
+                fprintf(stderr, "mismatch for palette 0x%02zX on line %zu\n", palette, i);
+                ++mismatches;
+            }
+            image_line_free(&expected);
+            image_line_free(&result);
+        }
+    }
+
+    const double reference = time_map_colors(image_line_map_colors_reference, lines);
+    const double sliced = time_map_colors(image_line_map_colors, lines);
+
+    printf("image_line_map_colors (%d pixels, all palettes)\n", BENCH_LINE_SIZE);
+    printf("  reference : %8.1f ns/line\n", reference);
+    printf("  bit-sliced: %8.1f ns/line (x%.1f)\n", sliced, reference / sliced);
+
+    for (size_t i = 0; i < BENCH_LINES; ++i) {
+        image_line_free(lines + i);
+    }
+
+    return mismatches == 0 ? 0 : 1;
+}
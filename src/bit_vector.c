@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <inttypes.h>//for uint32_t and int64_t
 #include <string.h>//for memset
+#include <stddef.h>//for max_align_t
 #include "bit_vector.h"
 #include "util.h"//for zero_init_ptr
 #include "image.h"//for IMAGE_LINE_WORD_BITS
@@ -25,6 +26,25 @@ void bit_vector_extract_multiple32(const bit_vector_t* pbv, int64_t index, size_
 void bit_vector_extract_not_multiple32(const bit_vector_t* pbv, int64_t index, size_t size, bit_vector_t* result);
 int printBinary(uint32_t number);
 
+/**
+ * @brief Arena the bit vectors of the current thread are allocated from (NULL for malloc)
+ */
+static _Thread_local arena_t* current_arena = NULL;
+
+/**
+ * @brief Header in front of each bit vector: the arena it was allocated from (NULL for malloc),
+ *        so that it is given back to its own arena whichever arena is in use when it is freed
+ */
+typedef union {
+    arena_t* owner;
+    max_align_t alignment; //the vector that follows stays aligned as malloc would do it
+} bit_vector_header_t;
+
+/**
+ * @brief Header of a bit vector
+ */
+#define BIT_VECTOR_HEADER(pbv) ((bit_vector_header_t*) (pbv) - 1)
+
 /**
  * @brief Compute logical XOR of two uint32_t
  * @param a first operand
@@ -109,14 +129,27 @@ bit_vector_t* bit_vector_create(size_t size, bit_t value){
     
     bit_vector_t* result = NULL;
     
-    //Allocates memory for the structure
-    if( numberOfElements > (((SIZE_MAX-sizeof(bit_vector_t))/sizeof(uint32_t)) +1) || (result= malloc(sizeof(bit_vector_t) + (numberOfElements-1) * sizeof(uint32_t)))==NULL){
+    //Allocates memory for the structure (from the arena if there is one and it is not full)
+    if( numberOfElements > (((SIZE_MAX-sizeof(bit_vector_t))/sizeof(uint32_t)) +1)){
         fprintf(stderr, "The memory allocation for the vector failed\n");
         return NULL;
     }
     
+    const size_t bytes = sizeof(bit_vector_t) + (numberOfElements-1) * sizeof(uint32_t);
+    bit_vector_header_t* header = arena_alloc(current_arena, sizeof(bit_vector_header_t) + bytes);
+    arena_t* owner = current_arena;
+    if(header == NULL){
+        owner = NULL;
+        if((header = malloc(sizeof(bit_vector_header_t) + bytes)) == NULL){
+            fprintf(stderr, "The memory allocation for the vector failed\n");
+            return NULL;
+        }
+    }
+    header->owner = owner;
+    result = (bit_vector_t*) (header + 1);
+    
     //Initialize all memory to 0
-    memset(result, 0, sizeof(bit_vector_t) + (numberOfElements-1) * sizeof(uint32_t)); //We use memset instead of zero_init_ptr, because it would not initialize data outside th struct (it would only intilaize content[0])
+    memset(result, 0, bytes); //We use memset instead of zero_init_ptr, because it would not initialize data outside th struct (it would only intilaize content[0])
     result->size=size;
     
     if(value == 1){
@@ -257,21 +290,22 @@ bit_vector_t* bit_vector_extract_wrap_ext(const bit_vector_t* pbv, int64_t index
     bit_vector_t* result = bit_vector_resize(firstRightShifted, size);//Resize it to the right size
     bit_vector_free(&firstRightShifted);
     M_REQUIRE_NOT_NULL_RETURN_NULL(result);
+    //From here, result is freed before returning NULL: a leaked temporary would keep the arena from being reset
     
     size_t alreadyPlacedBits = min(pbv->size-numberBitsShiftRight, size);
     size_t copyNumber = INT_DIVISION_CEILING(size-alreadyPlacedBits,pbv->size);//Number of copies we have to do
     //Do the wrapping
     for(size_t i=0;i<copyNumber;++i){
         bit_vector_t* extendedCopy= bit_vector_resize(pbv,size);//extended copy on size
-        M_REQUIRE_NOT_NULL_RETURN_NULL(extendedCopy);
-
         bit_vector_t* shiftedCopy= bit_vector_shift(extendedCopy,i*pbv->size+alreadyPlacedBits);//shift to the left
 		bit_vector_free(&extendedCopy);
-        M_REQUIRE_NOT_NULL_RETURN_NULL(shiftedCopy);
 
         bit_vector_t* tmp = bit_vector_or(result, shiftedCopy); //We use tmp to be able to free shiftedCopy if an error occured in or operation
         bit_vector_free(&shiftedCopy);
-        M_REQUIRE_NOT_NULL_RETURN_NULL(tmp);
+        if(tmp == NULL){
+            bit_vector_free(&result);
+            return NULL;
+        }
     }
     
     maskLastUnusedBits(result);
@@ -350,10 +384,28 @@ int bit_vector_println(const char* prefix, const bit_vector_t* pbv){
     return totalChar;
 }
 
+arena_t* bit_vector_use_arena(arena_t* arena){
+    
+    arena_t* previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+int bit_vector_in_arena(const bit_vector_t* pbv){
+    
+    return pbv != NULL && BIT_VECTOR_HEADER(pbv)->owner != NULL;
+}
+
 void bit_vector_free(bit_vector_t** pbv){
     
-    if(pbv!=NULL){
-        free(*pbv);
+    if(pbv!=NULL && *pbv!=NULL){
+        bit_vector_header_t* const header = BIT_VECTOR_HEADER(*pbv);
+        if(header->owner != NULL){
+            arena_release(header->owner, header);
+        }
+        else {
+            free(header);
+        }
         *pbv=NULL;
     }
 }
@@ -13,6 +13,7 @@ extern "C" {
 #endif
 
 #include "bit.h"
+#include "arena.h"
 
 #include <stddef.h> // for size_t
 #include <stdint.h> // int64_t
@@ -145,6 +146,24 @@ int bit_vector_print(const bit_vector_t* pbv);
  */
 int bit_vector_println(const char* prefix, const bit_vector_t* pbv);
 
+//=========================================================================
+/**
+ * @brief Make the next bit vectors created by the calling thread come from an arena
+ *        (falls back to malloc when the arena is full)
+ * @param arena arena to allocate from, NULL to only use malloc
+ * @return the arena used before the call
+ */
+arena_t* bit_vector_use_arena(arena_t* arena);
+
+//=========================================================================
+/**
+ * @brief Tells whether a bit vector lives in an arena
+ *        (such a vector must not be kept after the arena is reset)
+ * @param pbv pointer to bit vector
+ * @return 1 if pbv was allocated from an arena, 0 otherwise (or if pbv is NULL)
+ */
+int bit_vector_in_arena(const bit_vector_t* pbv);
+
 //=========================================================================
 /**
  * @brief Frees a bit vector
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blargg.h"
+#include "gameboy.h"
+#include "pacing.h"
+#include "error.h"
+#include "util.h"
+
+#define BLARGG_FAILED_FRAMES 10 //frames emulated after "Failed", for the details that follow it
+
+static const char* const verdict_names[BLARGG_VERDICTS] = {
+    "PASSED", "FAILED", "TIMEOUT"
+};
+
+/**
+ * @brief Verdict printed so far (BLARGG_TIMEOUT while there is none)
+ */
+static blargg_verdict_t blargg_verdict(const char* output){
+    return strstr(output, "Passed") != NULL ? BLARGG_PASSED
+           : strstr(output, "Failed") != NULL ? BLARGG_FAILED : BLARGG_TIMEOUT;
+}
+
+/**
+ * @brief Emulates the test once a serial log is set, filling the result but its output
+ */
+static int blargg_emulate(gameboy_t* gameboy, FILE* log, char** output, uint64_t max_cycles, blargg_result_t* result){
+
+    M_EXIT_IF_ERR(gameboy_set_render_period(gameboy, LCDC_RENDER_OFF));
+
+    const uint64_t start = pacing_now();
+    uint64_t end = max_cycles;
+    while(gameboy->cycles < end){
+        M_EXIT_IF_ERR(gameboy_run_until(gameboy, end - gameboy->cycles > FRAME_TOTAL_CYCLES ?
+                                        gameboy->cycles + FRAME_TOTAL_CYCLES : end));
+        M_REQUIRE(fflush(log) == 0, ERR_IO, "Cannot log the serial port%s", "");
+        if(result->verdict == BLARGG_TIMEOUT && *output != NULL){
+            result->verdict = blargg_verdict(*output);
+            result->cycles = gameboy->cycles;
+            if(result->verdict == BLARGG_PASSED){
+                end = gameboy->cycles;
+            }
+            else if(result->verdict == BLARGG_FAILED && end - gameboy->cycles > BLARGG_FAILED_FRAMES * FRAME_TOTAL_CYCLES){
+                end = gameboy->cycles + BLARGG_FAILED_FRAMES * FRAME_TOTAL_CYCLES;
+            }
+        }
+    }
+    if(result->verdict == BLARGG_TIMEOUT){
+        result->cycles = gameboy->cycles;
+    }
+    result->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+
+    return ERR_NONE;
+}
+
+int blargg_run(const char* rom, gameboy_accuracy_t accuracy, uint64_t max_cycles, blargg_result_t* result){
+
+    M_REQUIRE_NON_NULL(rom);
+    M_REQUIRE_NON_NULL(result);
+
+    zero_init_ptr(result);
+    result->verdict = BLARGG_TIMEOUT;
+
+    gameboy_t* const gameboy = calloc(1, sizeof(gameboy_t));
+    M_EXIT_IF_NULL(gameboy, sizeof(gameboy_t));
+    int err = gameboy_create(gameboy, rom, accuracy);
+
+    char* output = NULL;
+    size_t size = 0;
+    FILE* log = NULL;
+    if(err == ERR_NONE){
+        log = open_memstream(&output, &size);
+        err = log == NULL ? ERR_MEM : gameboy_set_serial_log(gameboy, log);
+    }
+    if(err == ERR_NONE){
+        err = blargg_emulate(gameboy, log, &output, max_cycles, result);
+    }
+
+    gameboy_free(gameboy);
+    free(gameboy);
+    if(log != NULL){
+        fclose(log);
+    }
+    if(err == ERR_NONE){
+        result->output = output;
+        result->size = size;
+    }
+    else{
+        free(output);
+    }
+
+    return err;
+}
+
+void blargg_result_free(blargg_result_t* result){
+    if(result != NULL){
+        free(result->output);
+        result->output = NULL;
+        result->size = 0;
+    }
+}
+
+const char* blargg_verdict_name(blargg_verdict_t verdict){
+    return verdict < BLARGG_VERDICTS ? verdict_names[verdict] : NULL;
+}
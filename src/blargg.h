@@ -0,0 +1,68 @@
+#pragma once
+
+/**
+ * @file blargg.h
+ * @brief Runs a blargg test ROM headless, until it prints its verdict on the serial port
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+
+#include "gameboy.h"//gameboy_accuracy_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLARGG_DEFAULT_MAX_CYCLES 50000000 // a bit more than the slowest test needs (about 48 guest seconds)
+
+/**
+ * @brief Verdict of a test ROM
+ */
+typedef enum {
+    BLARGG_PASSED, BLARGG_FAILED, BLARGG_TIMEOUT,
+    BLARGG_VERDICTS
+} blargg_verdict_t;
+
+/**
+ * @brief Result of a test ROM
+ */
+typedef struct {
+    blargg_verdict_t verdict;
+    uint64_t cycles; //cycles emulated until the verdict
+    double seconds; //time taken by the emulation
+    char* output; //text printed on the serial port (null terminated, owned by the result)
+    size_t size; //length of output
+} blargg_result_t;
+
+/**
+ * @brief Runs a test ROM until it prints "Passed" or "Failed" (checked once a frame), or until a number of cycles
+ *
+ * @param rom the test ROM
+ * @param accuracy accuracy tier of the emulation
+ * @param max_cycles cycles after which the test times out
+ * @param result (output) the result, to free with blargg_result_free()
+ * @return error code
+ */
+int blargg_run(const char* rom, gameboy_accuracy_t accuracy, uint64_t max_cycles, blargg_result_t* result);
+
+/**
+ * @brief Frees the output of a result
+ *
+ * @param result result to free
+ */
+void blargg_result_free(blargg_result_t* result);
+
+/**
+ * @brief Name of a verdict
+ *
+ * @param verdict the verdict
+ * @return the name, NULL if there is no such verdict
+ */
+const char* blargg_verdict_name(blargg_verdict_t verdict);
+
+#ifdef __cplusplus
+}
+#endif
@@ -38,3 +38,18 @@ int bootrom_bus_listener(gameboy_t* gameboy, addr_t addr){
 
 	return ERR_NONE;
 }
+
+int bootrom_map(gameboy_t* gameboy, bit_t boot){
+	M_REQUIRE_NON_NULL(gameboy);
+	
+	if(boot && !gameboy->boot){
+		M_EXIT_IF_ERR(bootrom_init(&gameboy->bootrom));
+		M_EXIT_IF_ERR_DO_SOMETHING(bootrom_plug(&gameboy->bootrom, gameboy->bus), component_free(&gameboy->bootrom));
+		gameboy->boot = 1;
+	}
+	else if(!boot && gameboy->boot){
+		M_EXIT_IF_ERR(bootrom_bus_listener(gameboy, REG_BOOT_ROM_DISABLE));
+	}
+	
+	return ERR_NONE;
+}
@@ -81,6 +81,15 @@ int bootrom_init(component_t* c);
  */
 int bootrom_bus_listener(gameboy_t* gameboy, addr_t addr);
 
+/**
+ * @brief Maps the boot ROM (a new one) or the cartridge at the start of the bus
+ *
+ * @param gameboy gameboy
+ * @param boot 1 for the boot ROM, 0 for the cartridge (as if the boot ROM had been disabled)
+ * @return error code
+ */
+int bootrom_map(gameboy_t* gameboy, bit_t boot);
+
 #ifdef __cplusplus
 }
 #endif
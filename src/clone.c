@@ -0,0 +1,323 @@
+#include <stdint.h>//uintptr_t
+#include <string.h>//memcpy
+
+#include "clone.h"
+#include "gameboy.h"
+#include "bootrom.h"
+#include "component.h"
+#include "image.h"
+#include "arena.h"
+#include "error.h"
+#include "util.h"
+
+//The memories of the components, of the cartridge, of the boot ROM and of the high RAM, and the cpu (IE and IF)
+#define CLONE_MAX_BLOCKS (GB_NB_COMPONENTS + 4)
+
+/**
+ * @brief Block of a gameboy the bus points into, and its copy in the clone
+ */
+typedef struct {
+    uintptr_t from;
+    size_t size;
+    data_t* to;
+} clone_block_t;
+
+/**
+ * @brief Free the clone if an error occured and return the error
+ */
+#define CLONE_FREE_IF_ERROR(err, clone) \
+    do { \
+        const int clone_err = (err); \
+        if(clone_err != ERR_NONE){ \
+            gameboy_free(clone); \
+            return clone_err; \
+        } \
+    } while(0)
+
+/**
+ * @brief Gives up the pointers a copy of the gameboy structure shares with the gameboy,
+ *        so that freeing the clone never frees the gameboy
+ */
+static void clone_disown(gameboy_t* clone){
+
+    for(size_t i = 0; i < GB_NB_COMPONENTS; ++i){
+        clone->components[i].mem = NULL;
+    }
+    clone->cartridge.c.mem = NULL;
+    clone->bootrom.mem = NULL;
+    clone->cpu.high_ram.mem = NULL;
+    zero_init_var(clone->screen.display);
+    zero_init_var(clone->arena);
+    clone->shared_arena = NULL;
+    clone->serial = NULL;
+    clone->movie = NULL;
+    clone->trace = NULL;
+}
+
+/**
+ * @brief Copies the memory of a component into a new one (plugged where the component is), noting the block
+ */
+static int clone_memory(component_t* c, const component_t* from, clone_block_t* blocks, size_t* count){
+
+    if(from->mem == NULL){
+        //No memory (the boot ROM once disabled)
+        return ERR_NONE;
+    }
+    M_REQUIRE_NON_NULL(from->mem->memory);
+
+    M_EXIT_IF_ERR(component_create(c, from->mem->size));
+    c->start = from->start;
+    c->end = from->end;
+    memcpy(c->mem->memory, from->mem->memory, from->mem->size);
+
+    blocks[*count].from = (uintptr_t) from->mem->memory;
+    blocks[*count].size = from->mem->size;
+    blocks[*count].to = c->mem->memory;
+    ++*count;
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Finds the block of the gameboy a pointer points into
+ */
+static int clone_find(uintptr_t pointer, const clone_block_t* blocks, size_t count, const clone_block_t** block){
+
+    size_t b = 0;
+    while(b < count && pointer - blocks[b].from >= blocks[b].size){
+        ++b;
+    }
+    M_REQUIRE(b < count, ERR_ADDRESS, "Pointer %p out of the memories of the gameboy", (void*) pointer);
+    *block = &blocks[b];
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Moves the pointers of the bus into the blocks of the gameboy to their copies
+ */
+static int clone_bus(bus_t bus, const clone_block_t* blocks, size_t count){
+
+    //The bus points into the same block for long runs of addresses
+    const clone_block_t* block = &blocks[0];
+    for(size_t addr = 0; addr < BUS_SIZE; ++addr){
+        const uintptr_t p = (uintptr_t) bus[addr];
+        if(p - block->from >= block->size){
+            if(p == 0){
+                continue;
+            }
+            M_EXIT_IF_ERR(clone_find(p, blocks, count, &block));
+        }
+        bus[addr] = block->to + (p - block->from);
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Checks that a memory of a gameboy can be copied to the one of another gameboy
+ */
+static int copy_check(const component_t* to, const component_t* from){
+
+    M_REQUIRE_NON_NULL(to->mem);
+    M_REQUIRE_NON_NULL(from->mem);
+    M_REQUIRE(to->mem->size == from->mem->size, ERR_BAD_PARAMETER, "Memory of %zu bytes instead of %zu",
+              to->mem->size, from->mem->size);
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Copies the lines of a display to another one of the same size
+ */
+static int copy_display(image_t* to, const image_t* from){
+
+    M_REQUIRE_NON_NULL(to->content);
+    M_REQUIRE_NON_NULL(from->content);
+    M_REQUIRE(to->height == from->height, ERR_BAD_PARAMETER, "Display of %zu lines instead of %zu", to->height, from->height);
+
+    for(size_t y = 0; y < from->height; ++y){
+        M_EXIT_IF_ERR(image_set_line(to, y, from->content[y]));
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Copies a memory of a gameboy to the one of another gameboy, where it is plugged on the bus,
+ *        all of it (map NULL) or only its part in the blocks written
+ */
+static void copy_blocks(component_t* to, const component_t* from, const dirty_map_t* map){
+
+    if(map == NULL){
+        memcpy(to->mem->memory, from->mem->memory, from->mem->size);
+        return;
+    }
+
+    const size_t start = from->start;
+    const size_t end = from->end;
+    for(size_t block = start >> DIRTY_BLOCK_BITS; block <= end >> DIRTY_BLOCK_BITS; ++block){
+        if(dirty_block(map, block)){
+            const size_t first = block << DIRTY_BLOCK_BITS > start ? block << DIRTY_BLOCK_BITS : start;
+            const size_t last = ((block + 1) << DIRTY_BLOCK_BITS) - 1 < end ? ((block + 1) << DIRTY_BLOCK_BITS) - 1 : end;
+            memcpy(to->mem->memory + (first - start), from->mem->memory + (first - start), last - first + 1);
+        }
+    }
+}
+
+/**
+ * @brief Puts a gameboy in the state of another one, copying all of the memories (map NULL)
+ *        or only the blocks written
+ */
+static int copy_gameboy(gameboy_t* to, const gameboy_t* from, const dirty_map_t* map){
+
+    //Checked (and the display copied) before anything else changes
+    for(size_t i = 0; i < GB_NB_COMPONENTS; ++i){
+        M_EXIT_IF_ERR(copy_check(&to->components[i], &from->components[i]));
+    }
+    M_EXIT_IF_ERR(copy_check(&to->cartridge.c, &from->cartridge.c));
+    M_EXIT_IF_ERR(copy_check(&to->cpu.high_ram, &from->cpu.high_ram));
+    M_EXIT_IF_ERR(copy_display(&to->screen.display, &from->screen.display));
+
+    M_EXIT_IF_ERR(bootrom_map(to, from->boot));
+    for(size_t i = 0; i < GB_NB_COMPONENTS; ++i){
+        copy_blocks(&to->components[i], &from->components[i], map);
+    }
+    copy_blocks(&to->cartridge.c, &from->cartridge.c, map);
+    if(from->boot){
+        copy_blocks(&to->bootrom, &from->bootrom, map);
+    }
+    copy_blocks(&to->cpu.high_ram, &from->cpu.high_ram, map);
+
+    to->cycles = from->cycles;
+    to->frames = from->frames;
+    to->last_ly = from->last_ly;
+    to->accuracy = from->accuracy;
+    #ifdef PROFILE
+    to->profile = from->profile;
+    #endif
+
+    //The structures as they are, but for their pointers.
+    //The caches of the screen were filled from the same memories: they stay valid.
+    cpu_t cpu = from->cpu;
+    cpu.bus = to->cpu.bus;
+    cpu.high_ram = to->cpu.high_ram;
+    to->cpu = cpu;
+
+    gbtimer_t timer = from->timer;
+    timer.cpu = to->timer.cpu;
+    to->timer = timer;
+
+    cpu_t* const screen_cpu = to->screen.cpu;
+    const image_t display = to->screen.display;
+    memcpy(&to->screen, &from->screen, sizeof(lcdc_t));
+    to->screen.cpu = screen_cpu;
+    to->screen.display = display;
+
+    joypad_t pad = from->pad;
+    pad.cpu = to->pad.cpu;
+    pad.p_P1 = to->pad.p_P1;
+    to->pad = pad;
+
+    return ERR_NONE;
+}
+
+int gameboy_clone(gameboy_t* clone, const gameboy_t* gameboy){
+
+    M_REQUIRE_NON_NULL(clone);
+    M_REQUIRE_NON_NULL(gameboy);
+    M_REQUIRE(clone != gameboy, ERR_BAD_PARAMETER, "Cannot clone a gameboy into itself%s", "");
+    M_REQUIRE_NON_NULL(gameboy->screen.display.content);
+
+    //The whole structure at once: the bus and the state of the cpu, timer, screen and joypad
+    memcpy(clone, gameboy, sizeof(gameboy_t));
+    clone_disown(clone);
+
+    clone_block_t blocks[CLONE_MAX_BLOCKS];
+    size_t count = 0;
+    for(size_t i = 0; i < GB_NB_COMPONENTS; ++i){
+        CLONE_FREE_IF_ERROR(clone_memory(&clone->components[i], &gameboy->components[i], blocks, &count), clone);
+    }
+    CLONE_FREE_IF_ERROR(clone_memory(&clone->cartridge.c, &gameboy->cartridge.c, blocks, &count), clone);
+    CLONE_FREE_IF_ERROR(clone_memory(&clone->bootrom, &gameboy->bootrom, blocks, &count), clone);
+    CLONE_FREE_IF_ERROR(clone_memory(&clone->cpu.high_ram, &gameboy->cpu.high_ram, blocks, &count), clone);
+    blocks[count].from = (uintptr_t) &gameboy->cpu;
+    blocks[count].size = sizeof(cpu_t);
+    blocks[count].to = (data_t*) &clone->cpu;
+    ++count;
+
+    //The echo RAM points into the work RAM, IE and IF into the cpu
+    CLONE_FREE_IF_ERROR(clone_bus(clone->bus, blocks, count), clone);
+    if(clone->pad.p_P1 != NULL){
+        const clone_block_t* block = NULL;
+        CLONE_FREE_IF_ERROR(clone_find((uintptr_t) clone->pad.p_P1, blocks, count, &block), clone);
+        clone->pad.p_P1 = block->to + ((uintptr_t) clone->pad.p_P1 - block->from);
+    }
+    clone->cpu.bus = &clone->bus;
+    clone->timer.cpu = &clone->cpu;
+    clone->screen.cpu = &clone->cpu;
+    clone->pad.cpu = &clone->cpu;
+
+    CLONE_FREE_IF_ERROR(image_create(&clone->screen.display, LCD_WIDTH, gameboy->screen.display.height), clone);
+    CLONE_FREE_IF_ERROR(copy_display(&clone->screen.display, &gameboy->screen.display), clone);
+    CLONE_FREE_IF_ERROR(arena_create(&clone->arena, gameboy->arena.size), clone);
+
+    return ERR_NONE;
+}
+
+int gameboy_copy(gameboy_t* to, const gameboy_t* from){
+
+    M_REQUIRE_NON_NULL(to);
+    M_REQUIRE_NON_NULL(from);
+
+    return to == from ? ERR_NONE : copy_gameboy(to, from, NULL);
+}
+
+int gameboy_copy_dirty(gameboy_t* to, const gameboy_t* from){
+
+    M_REQUIRE_NON_NULL(to);
+    M_REQUIRE_NON_NULL(from);
+    if(to == from){
+        return ERR_NONE;
+    }
+
+    //What either of them wrote since they were in the same state
+    dirty_map_t map = from->cpu.dirty;
+    M_EXIT_IF_ERR(dirty_merge(&map, &to->cpu.dirty));
+    //The writes to the echo RAM are the ones of the work RAM
+    for(size_t block = ECHO_RAM_START >> DIRTY_BLOCK_BITS; block <= ECHO_RAM_END >> DIRTY_BLOCK_BITS; ++block){
+        if(dirty_block(&map, block)){
+            dirty_mark(&map, (addr_t) ((block << DIRTY_BLOCK_BITS) - (ECHO_RAM_START - WORK_RAM_START)));
+        }
+    }
+    //P1 is also written by the joypad, outside of the bus write path
+    dirty_mark(&map, REG_P1);
+    //A boot ROM mapped again is a new one
+    if(to->boot != from->boot){
+        M_EXIT_IF_ERR(dirty_mark_range(&map, BOOT_ROM_START, MEM_SIZE(BOOT_ROM)));
+    }
+
+    return copy_gameboy(to, from, &map);
+}
+
+size_t gameboy_clone_bytes(const gameboy_t* gameboy){
+
+    if(gameboy == NULL){
+        return 0;
+    }
+
+    const component_t* memories[] = {
+        &gameboy->components[WORK_RAM_INDEX], &gameboy->components[REGISTERS_INDEX],
+        &gameboy->components[EXTERN_RAM_INDEX], &gameboy->components[VIDEO_RAM_INDEX],
+        &gameboy->components[GRAPH_RAM_INDEX], &gameboy->components[USELESS_INDEX],
+        &gameboy->cartridge.c, &gameboy->bootrom, &gameboy->cpu.high_ram
+    };
+    size_t bytes = sizeof(gameboy_t);
+    for(size_t i = 0; i < sizeof(memories) / sizeof(memories[0]); ++i){
+        bytes += memories[i]->mem == NULL ? 0 : memories[i]->mem->size;
+    }
+    //msb, lsb and opacity of each line
+    bytes += gameboy->screen.display.height * 3 * (sizeof(bit_vector_t) + LCD_WIDTH / 8);
+
+    return bytes;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/**
+ * @file clone.h
+ * @brief Forking of running gameboys: a clone is one copy of the gameboy structure
+ *        (its bus included) and of its memories, the pointers into them moved to the copies
+ *
+ * @date 2021
+ */
+
+#include <stddef.h>//size_t
+
+#include "gameboy.h"//gameboy_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Creates a gameboy independent of another one, in the same state:
+ *        both run exactly the same from there.
+ *        The clone has its own arena (only allocated once it renders), and neither the arena set with gameboy_set_arena(),
+ *        the serial log, the movie nor the trace of the gameboy
+ *        (see gameboy_set_serial_log(), gameboy_set_movie() and gameboy_set_trace()).
+ *
+ * @param clone gameboy to create (to be freed with gameboy_free())
+ * @param gameboy the gameboy, between two runs
+ * @return error code
+ */
+int gameboy_clone(gameboy_t* clone, const gameboy_t* gameboy);
+
+/**
+ * @brief Puts a gameboy in the state of another one, created from a cartridge of the same size,
+ *        without allocating anything but a boot ROM that has to be mapped again.
+ *        The gameboy keeps its arenas, serial log, movie and trace.
+ *
+ * @param to the gameboy to put in the state, between two runs
+ * @param from the gameboy the state of which is copied, between two runs
+ * @return error code
+ */
+int gameboy_copy(gameboy_t* to, const gameboy_t* from);
+
+/**
+ * @brief As gameboy_copy(), but only copies the blocks of memory written in either gameboy (see dirty.h)
+ *        since their dirty maps were cleared, the gameboys being in the same state then.
+ *        A copy gives to the dirty map of from: clearing both maps after it keeps the next copy small.
+ *
+ * @param to the gameboy to put in the state, between two runs
+ * @param from the gameboy the state of which is copied, between two runs
+ * @return error code
+ */
+int gameboy_copy_dirty(gameboy_t* to, const gameboy_t* from);
+
+/**
+ * @brief Gives the bytes a clone of a gameboy copies (its arena, not copied, excluded)
+ *
+ * @param gameboy the gameboy
+ * @return the number of bytes (0 if gameboy is NULL)
+ */
+size_t gameboy_clone_bytes(const gameboy_t* gameboy);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,12 +17,25 @@
 #include <inttypes.h> // PRIX8
 #include <stdio.h> // fprintf
 
+/**
+ * @brief Tells whether an address is out of reach of the cpu, a bulk OAM DMA holding OAM and its source:
+ *        the cpu then sees neither the copy done ahead of time nor can change what the DMA would still copy
+ */
+static inline bit_t cpu_bus_held(const cpu_t* cpu, addr_t addr){
+    return cpu->DMA_running && ((addr >= GRAPH_RAM_START && addr <= GRAPH_RAM_END)
+                                || (addr >= cpu->DMA_from && addr - cpu->DMA_from < DMA_SIZE));
+}
+
 // ==== see cpu-storage.h ========================================
 data_t cpu_read_at_idx(const cpu_t* cpu, addr_t addr){
     
     M_REQUIRE_NOT_NULL_RETURN(cpu, 0);
     M_REQUIRE_NOT_NULL_RETURN(cpu->bus, 0);
     
+    if(cpu_bus_held(cpu, addr)){
+        return 0xFF;
+    }
+    
     data_t data=0;
     int err=bus_read(*(cpu->bus), addr, &data);
 
@@ -40,6 +53,9 @@ addr_t cpu_read16_at_idx(const cpu_t* cpu, addr_t addr){
     M_REQUIRE_NOT_NULL_RETURN(cpu, 0);
     M_REQUIRE_NOT_NULL_RETURN(cpu->bus, 0);
 
+    if(cpu_bus_held(cpu, addr) || cpu_bus_held(cpu, (addr_t) (addr + 1))){
+        return merge8(cpu_read_at_idx(cpu, addr), cpu_read_at_idx(cpu, (addr_t) (addr + 1)));
+    }
     
     addr_t data=0;
     int err=bus_read16(*(cpu->bus), addr, &data);
@@ -58,8 +74,14 @@ int cpu_write_at_idx(cpu_t* cpu, addr_t addr, data_t data){
     M_REQUIRE_NON_NULL(cpu);
     M_REQUIRE_NON_NULL(cpu->bus);
     
+    if(cpu_bus_held(cpu, addr)){
+        return ERR_NONE;
+    }
+    
     //Store the adress in the listener of the cpu
     cpu->write_listener = addr;
+    cpu->write_listener16 = 0;
+    dirty_mark(&cpu->dirty, addr);
     
     return bus_write(*(cpu->bus), addr, data);
 }
@@ -70,8 +92,16 @@ int cpu_write16_at_idx(cpu_t* cpu, addr_t addr, addr_t data16){
     M_REQUIRE_NON_NULL(cpu);
     M_REQUIRE_NON_NULL(cpu->bus);
     
-    //Store the adress in the listener of the cpu
+    if(cpu_bus_held(cpu, addr) || cpu_bus_held(cpu, (addr_t) (addr + 1))){
+        M_EXIT_IF_ERR(cpu_write_at_idx(cpu, addr, lsb8(data16)));
+        return cpu_write_at_idx(cpu, (addr_t) (addr + 1), msb8(data16));
+    }
+    
+    //Store the adress in the listener of the cpu, and that the next one was written too
     cpu->write_listener = addr;
+    cpu->write_listener16 = 1;
+    dirty_mark(&cpu->dirty, addr);
+    dirty_mark(&cpu->dirty, (addr_t) (addr + 1));
     
     return bus_write16(*(cpu->bus), addr, data16);
 }
@@ -18,6 +18,7 @@ extern "C" {
 
 /**
  * @brief Reads data from the bus at a given adress
+ *        (0xFF in OAM and in the source of a bulk OAM DMA while it is running, see cpu_t)
  *
  * @param cpu cpu to read from
  * @param addr address to read at
@@ -40,6 +41,7 @@ data_t cpu_read_at_idx(const cpu_t* cpu, addr_t addr);
 
 /**
  * @brief Reads 16bit data from the bus at a given adress
+ *        (each byte as cpu_read_at_idx() reads it)
  *
  * @param cpu cpu to read from
  * @param addr address to read at
@@ -56,6 +58,7 @@ addr_t cpu_read16_at_idx(const cpu_t* cpu, addr_t addr);
 
 /**
  * @brief Write data to the bus at a given adress
+ *        (dropped in OAM and in the source of a bulk OAM DMA while it is running, see cpu_t)
  *
  * @param cpu cpu to write to
  * @param addr address to write at
@@ -70,6 +73,7 @@ int cpu_write_at_idx(cpu_t* cpu, addr_t addr, data_t data);
 
 /**
  * @brief Write 16bit data to the bus at a given adress
+ *        (each byte as cpu_write_at_idx() writes it)
  *
  * @param cpu cpu to write to
  * @param addr address to write at
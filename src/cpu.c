@@ -341,6 +341,7 @@ static int cpu_do_cycle(cpu_t* cpu)
             instruction = instruction_direct[opcode];//Convert opcode to instruction
         }
         M_EXIT_IF_ERR(cpu_dispatch(&instruction, cpu));//Execute the instruction
+        ++cpu->instructions;
     }
     return ERR_NONE;
     
@@ -357,6 +358,7 @@ int cpu_cycle(cpu_t* cpu)
     
     //Initialize write_listener to 0
     cpu->write_listener = 0;
+    cpu->write_listener16 = 0;
     
     if(cpu->idle_time!=0){
         --cpu->idle_time;
@@ -376,6 +378,32 @@ int cpu_cycle(cpu_t* cpu)
     return ERR_NONE;
 }
 
+uint64_t cpu_idle_cycles(const cpu_t* cpu){
+	
+	if(cpu == NULL){
+		return 0;
+	}
+	if(cpu->idle_time != 0){
+		return cpu->idle_time;
+	}
+	//What cpu_cycle checks
+	return cpu->HALT && !(GET_INTERRUPTS(cpu)) ? CPU_IDLE_FOREVER : 0;
+}
+
+int cpu_skip_cycles(cpu_t* cpu, uint64_t cycles){
+	
+	M_REQUIRE_NON_NULL(cpu);
+	M_REQUIRE(cycles <= cpu_idle_cycles(cpu), ERR_BAD_PARAMETER, "The cpu is not idle for %" PRIu64 " cycles", cycles);
+	
+	cpu->write_listener = 0;
+	cpu->write_listener16 = 0;
+	if(cpu->idle_time != 0){
+		cpu->idle_time = (uint8_t)(cpu->idle_time - cycles);
+	}
+	
+	return ERR_NONE;
+}
+
 void cpu_request_interrupt(cpu_t* cpu, interrupt_t i){
 	
 	if(cpu == NULL){
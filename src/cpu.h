@@ -15,6 +15,7 @@ extern "C" {
 #include "alu.h"//alu_output_t
 #include "memory.h"//data_t and addr_t
 #include "bus.h"//bus_t
+#include "dirty.h"//dirty_map_t
 //=========================================================================
 /**
  * @brief Type to represent CPU interupts
@@ -79,9 +80,20 @@ typedef struct {
     addr_t write_listener;
 
 	uint8_t idle_time;
+	
+	uint64_t instructions; //instructions executed (interrupts excluded)
+	
+	dirty_map_t dirty; //blocks of the bus written since the map was cleared
+	
+	bit_t DMA_running; //a bulk OAM DMA holds OAM and its source during this cycle (see lcdc_DMA_running())
+	addr_t DMA_from; //start of the source of that DMA
+	
+	bit_t write_listener16; //the write at write_listener was 16 bits wide: write_listener + 1 was written too
         
 } cpu_t;
 
+#define CPU_IDLE_FOREVER UINT64_MAX
+
 //=========================================================================
 /**
  * @brief Run one CPU cycle
@@ -127,6 +139,27 @@ void cpu_free(cpu_t* cpu);
 void cpu_request_interrupt(cpu_t* cpu, interrupt_t i);
 
 
+/**
+ * @brief Number of the next cycles in which the cpu neither executes anything nor accesses the bus:
+ *        the rest of the current instruction, or CPU_IDLE_FOREVER while it is halted without any pending interrupt
+ *        (until something else requests one)
+ *
+ * @param cpu the cpu
+ * @return the number of cycles (0 if the cpu is not idle, or cpu is NULL)
+ */
+uint64_t cpu_idle_cycles(const cpu_t* cpu);
+
+
+/**
+ * @brief Runs cycles of the cpu at once, as that many calls to cpu_cycle() would
+ *
+ * @param cpu the cpu
+ * @param cycles the number of cycles, at most cpu_idle_cycles()
+ * @return error code
+ */
+int cpu_skip_cycles(cpu_t* cpu, uint64_t cycles);
+
+
 #ifdef __cplusplus
 }
 #endif
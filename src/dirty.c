@@ -0,0 +1,59 @@
+#include <string.h>//memset
+
+#include "dirty.h"
+#include "error.h"
+#include "util.h"
+
+int dirty_mark_range(dirty_map_t* map, addr_t start, size_t size){
+
+    M_REQUIRE_NON_NULL(map);
+    M_REQUIRE((size_t) start + size <= BUS_SIZE, ERR_ADDRESS, "Range of %zu addresses from 0x%04X out of the bus", size, start);
+
+    if(size > 0){
+        const size_t last = ((size_t) start + size - 1) >> DIRTY_BLOCK_BITS;
+        for(size_t block = (size_t) start >> DIRTY_BLOCK_BITS; block <= last; ++block){
+            map->words[block / DIRTY_WORD_BITS] |= (uint64_t) 1 << (block % DIRTY_WORD_BITS);
+        }
+    }
+
+    return ERR_NONE;
+}
+
+void dirty_mark_all(dirty_map_t* map){
+    if(map != NULL){
+        memset(map->words, 0xFF, sizeof(map->words));
+    }
+}
+
+void dirty_clear(dirty_map_t* map){
+    if(map != NULL){
+        zero_init_ptr(map);
+    }
+}
+
+int dirty_merge(dirty_map_t* map, const dirty_map_t* other){
+
+    M_REQUIRE_NON_NULL(map);
+    M_REQUIRE_NON_NULL(other);
+
+    for(size_t w = 0; w < DIRTY_WORDS; ++w){
+        map->words[w] |= other->words[w];
+    }
+
+    return ERR_NONE;
+}
+
+size_t dirty_count(const dirty_map_t* map){
+
+    size_t count = 0;
+    if(map != NULL){
+        for(size_t w = 0; w < DIRTY_WORDS; ++w){
+            //One bit set dropped at each step
+            for(uint64_t word = map->words[w]; word != 0; word &= word - 1){
+                ++count;
+            }
+        }
+    }
+
+    return count;
+}
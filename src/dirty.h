@@ -0,0 +1,100 @@
+#pragma once
+
+/**
+ * @file dirty.h
+ * @brief Dirty tracking of the bus: a bit per block of DIRTY_BLOCK_SIZE addresses,
+ *        set by the writes to the bus (see cpu_write_at_idx()) until the map is cleared
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+
+#include "bit.h"//bit_t
+#include "bus.h"//BUS_SIZE
+#include "memory.h"//addr_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DIRTY_BLOCK_BITS 6
+#define DIRTY_BLOCK_SIZE (1 << DIRTY_BLOCK_BITS) //64 bytes: a few blocks cover what a frame writes
+#define DIRTY_BLOCKS (BUS_SIZE / DIRTY_BLOCK_SIZE)
+#define DIRTY_WORD_BITS 64
+#define DIRTY_WORDS (DIRTY_BLOCKS / DIRTY_WORD_BITS)
+
+/**
+ * @brief Blocks of the bus written since the map was last cleared
+ */
+typedef struct {
+    uint64_t words[DIRTY_WORDS]; //bit b % DIRTY_WORD_BITS of word b / DIRTY_WORD_BITS is set if block b was written
+} dirty_map_t;
+
+/**
+ * @brief Marks the block of an address as written (the hot path: no check)
+ *
+ * @param map the map
+ * @param addr the address written
+ */
+static inline void dirty_mark(dirty_map_t* map, addr_t addr){
+    const size_t block = (size_t) addr >> DIRTY_BLOCK_BITS;
+    map->words[block / DIRTY_WORD_BITS] |= (uint64_t) 1 << (block % DIRTY_WORD_BITS);
+}
+
+/**
+ * @brief Tells whether a block was written
+ *
+ * @param map the map
+ * @param block the block (its first address is block * DIRTY_BLOCK_SIZE)
+ * @return 1 if it was written since the map was cleared
+ */
+static inline bit_t dirty_block(const dirty_map_t* map, size_t block){
+    return (map->words[block / DIRTY_WORD_BITS] >> (block % DIRTY_WORD_BITS)) & 1;
+}
+
+/**
+ * @brief Marks the blocks of a range of addresses as written
+ *
+ * @param map the map
+ * @param start first address written
+ * @param size number of addresses written (up to the end of the bus)
+ * @return error code
+ */
+int dirty_mark_range(dirty_map_t* map, addr_t start, size_t size);
+
+/**
+ * @brief Marks the whole bus as written (its memories were replaced at once)
+ *
+ * @param map the map
+ */
+void dirty_mark_all(dirty_map_t* map);
+
+/**
+ * @brief Clears the map: no block is written any more
+ *
+ * @param map the map
+ */
+void dirty_clear(dirty_map_t* map);
+
+/**
+ * @brief Merges the blocks written in a map into another one
+ *
+ * @param map the map to merge into
+ * @param other the map the written blocks of which are added
+ * @return error code
+ */
+int dirty_merge(dirty_map_t* map, const dirty_map_t* other);
+
+/**
+ * @brief Gives the number of blocks written
+ *
+ * @param map the map
+ * @return the number of blocks (0 if map is NULL)
+ */
+size_t dirty_count(const dirty_map_t* map);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>//strcmp
+#include <inttypes.h>//PRIu64
 #include "component.h"
 #include "bus.h"
 #include "error.h"
@@ -9,11 +11,10 @@
 #include "cartridge.h"
 #include "ourError.h"
 #include "cpu.h"
-
-#ifdef BLARGG
 #include "cpu-storage.h" //cpu_read_at_idx
 #include "memory.h" //data_t
-#endif
+#include "arena.h"
+#include "bit_vector.h"
 
 /**
  * @brief Create a component and plug it
@@ -45,13 +46,36 @@
 #ifdef BLARGG
 static int blargg_bus_listener(gameboy_t* gameboy, addr_t addr);
 #endif
+//Time taken by the subsystems, only measured with -DPROFILE
+#ifdef PROFILE
+#define PROFILE_START() \
+	uint64_t profile_start = profile_ticks()
+#define PROFILE_STEP(gameboy, subsystem) \
+	profile_start = profile_add(&(gameboy)->profile, subsystem, profile_start)
+#else
+#define PROFILE_START() \
+	do {} while(0)
+#define PROFILE_STEP(gameboy, subsystem) \
+	do {} while(0)
+#endif
+
+static const char* const accuracy_names[GB_ACCURACIES] = {
+	"cycle", "instruction", "scanline"
+};
 
-int gameboy_create(gameboy_t* gameboy,const char* filename){
+static int gameboy_run(gameboy_t* gameboy, uint64_t cycle);
+static int gameboy_run_batched(gameboy_t* gameboy, uint64_t cycle);
+static void gameboy_frame_listener(gameboy_t* gameboy);
+static int gameboy_trace_cycle(gameboy_t* gameboy);
+
+int gameboy_create(gameboy_t* gameboy,const char* filename, gameboy_accuracy_t accuracy){
     
     M_REQUIRE_NON_NULL(gameboy);
+    M_REQUIRE(accuracy < GB_ACCURACIES, ERR_BAD_PARAMETER, "Unknown accuracy %d", (int) accuracy);
     zero_init_ptr(gameboy);//Initialize all fields of gameboy to 0, arrays included
     //Set boot to 1 to initialize the gameboy
     gameboy->boot = 1;
+    gameboy->accuracy = accuracy;
    
     //WorkRam
     CREATE_AND_PLUG(WORK_RAM, gameboy);
@@ -101,74 +125,343 @@ int gameboy_create(gameboy_t* gameboy,const char* filename){
     //Initialize the screen and plug it
     GAMEBOY_FREE_IF_ERROR(lcdc_init(gameboy),gameboy);
     GAMEBOY_FREE_IF_ERROR(lcdc_plug(&(gameboy->screen), gameboy->bus),gameboy);
+    //Not stepped at each cycle of a line
+    gameboy->screen.scanline = accuracy == GB_ACCURACY_SCANLINE;
+    gameboy->screen.bulk_DMA = accuracy == GB_ACCURACY_SCANLINE;
     
     //Initialize the joypad
     GAMEBOY_FREE_IF_ERROR(joypad_init_and_plug(&(gameboy->pad),&(gameboy->cpu)),gameboy);
     
+    //Arena for the temporaries of the screen
+    GAMEBOY_FREE_IF_ERROR(arena_create(&gameboy->arena, ARENA_DEFAULT_SIZE), gameboy);
+    
+    #ifdef PROFILE
+    GAMEBOY_FREE_IF_ERROR(profile_init(&gameboy->profile), gameboy);
+    #endif
+    
     return ERR_NONE;
 }
 
 void gameboy_free(gameboy_t* gameboy){
     if(gameboy!=NULL){
-				
+        //No need to unplug the components one by one: the bus is cleared with the rest of the gameboy below
         for (size_t i=0;i<GB_NB_COMPONENTS;++i){
-			M_PRINT_IF_ERROR(bus_unplug(gameboy->bus, &(gameboy->components[i])), "Could not unplug a component");
 			component_free(&(gameboy->components[i]));
         }
         
-        // Also set the pointers in the bus in the range of echoRam to NULL
-        for (size_t i=ECHO_RAM_START;i<=ECHO_RAM_END;++i){
-            gameboy->bus[i]=NULL;
-        }
-        
-        M_PRINT_IF_ERROR(bus_unplug(gameboy->bus, &(gameboy->cartridge.c)), "Could not unplug cartridge");
         cartridge_free(&(gameboy->cartridge));
-        //In case an error occures while bootrom is plugged in
-        M_PRINT_IF_ERROR(bus_unplug(gameboy->bus, &(gameboy->bootrom)), "Could not unplug bootrom");
         component_free(&gameboy->bootrom);
-        
+        component_free(&gameboy->cpu.high_ram);
+
         lcdc_free(&gameboy->screen);
+        arena_free(&gameboy->arena);
         
         zero_init_ptr(gameboy);
     }
 }
 
+/**
+ * @brief Arena of the rendering temporaries of a gameboy: the one set with gameboy_set_arena(), or else its own
+ *
+ * @param gameboy the gameboy
+ * @return the arena
+ */
+static inline arena_t* gameboy_arena(gameboy_t* gameboy){
+	return gameboy->shared_arena != NULL ? gameboy->shared_arena : &gameboy->arena;
+}
+
 int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle){
 	
 	M_REQUIRE_NON_NULL(gameboy);
 	
-	for(uint64_t i=gameboy->cycles; i<cycle; ++i){
-		
-		
-		#ifdef BLARGG
-		//Throw a VBlank interrupt every 17’556 cycles
-		if((gameboy->cycles>0) && ((gameboy->cycles % CYCLES_GAMEBOY_DRAW) == 0)){
-			cpu_request_interrupt(&(gameboy->cpu), VBLANK);
+	arena_t* previousArena = bit_vector_use_arena(gameboy_arena(gameboy));
+	int err = ERR_NONE;
+	//Stops at each event of the movie, so that the joypad gets it at the exact cycle it was recorded
+	uint64_t event = 0;
+	while(err == ERR_NONE && movie_next_cycle(gameboy->movie, &event) && event < cycle){
+		if(event > gameboy->cycles){
+			err = gameboy->accuracy == GB_ACCURACY_CYCLE ? gameboy_run(gameboy, event) : gameboy_run_batched(gameboy, event);
 		}
-		#endif
+		if(err == ERR_NONE){
+			err = movie_play(gameboy->movie, &gameboy->pad, gameboy->cycles);
+		}
+	}
+	if(err == ERR_NONE){
+		err = gameboy->accuracy == GB_ACCURACY_CYCLE ? gameboy_run(gameboy, cycle) : gameboy_run_batched(gameboy, cycle);
+	}
+	bit_vector_use_arena(previousArena);
+	
+	return err;
+}
+
+int gameboy_set_render_period(gameboy_t* gameboy, unsigned int period){
+	
+	M_REQUIRE_NON_NULL(gameboy);
+	
+	gameboy->screen.render_period = period;
+	
+	return ERR_NONE;
+}
+
+int gameboy_set_serial_log(gameboy_t* gameboy, FILE* serial){
+	
+	M_REQUIRE_NON_NULL(gameboy);
+	
+	gameboy->serial = serial;
+	
+	return ERR_NONE;
+}
+
+int gameboy_set_arena(gameboy_t* gameboy, arena_t* arena){
+	
+	M_REQUIRE_NON_NULL(gameboy);
+	
+	gameboy->shared_arena = arena;
+	
+	return ERR_NONE;
+}
+
+int gameboy_set_movie(gameboy_t* gameboy, movie_t* movie){
+	
+	M_REQUIRE_NON_NULL(gameboy);
+	
+	gameboy->movie = movie;
+	
+	return ERR_NONE;
+}
+
+int gameboy_set_trace(gameboy_t* gameboy, trace_t* trace){
+	
+	M_REQUIRE_NON_NULL(gameboy);
+	
+	gameboy->trace = trace;
+	
+	return ERR_NONE;
+}
+
+int gameboy_profile_print(const gameboy_t* gameboy, FILE* output){
+	
+	M_REQUIRE_NON_NULL(gameboy);
+	M_REQUIRE_NON_NULL(output);
+	
+	#ifdef PROFILE
+	return profile_print(&gameboy->profile, output);
+	#else
+	return ERR_NOT_IMPLEMENTED;
+	#endif
+}
+
+const char* gameboy_accuracy_name(gameboy_accuracy_t accuracy){
+	return accuracy < GB_ACCURACIES ? accuracy_names[accuracy] : NULL;
+}
+
+int gameboy_accuracy_parse(const char* name, gameboy_accuracy_t* accuracy){
+	
+	M_REQUIRE_NON_NULL(name);
+	M_REQUIRE_NON_NULL(accuracy);
+	
+	for(gameboy_accuracy_t a = GB_ACCURACY_CYCLE; a < GB_ACCURACIES; ++a){
+		if(!strcmp(name, accuracy_names[a])){
+			*accuracy = a;
+			return ERR_NONE;
+		}
+	}
+	
+	M_EXIT_ERR(ERR_BAD_PARAMETER, "Unknown accuracy %s", name);
+}
+
+int gameboy_export_frame(const gameboy_t* gameboy, uint8_t* pixels, size_t stride, image_format_t format,
+                         unsigned int scale, const uint32_t colors[PALETTE_COLOR_COUNT]){
+	
+	M_REQUIRE_NON_NULL(gameboy);
+	
+	return image_export(&gameboy->screen.display, pixels, stride, format, scale, colors);
+}
+
+/**
+ * @brief Tells the subsystems that the cpu wrote a byte
+ *
+ * @param gameboy the gameboy
+ * @param addr address of the byte
+ * @return error code
+ */
+static inline int gameboy_bus_listeners(gameboy_t* gameboy, addr_t addr){
+	
+	M_EXIT_IF_ERR(bootrom_bus_listener(gameboy, addr));
+	M_EXIT_IF_ERR(timer_bus_listener(&gameboy->timer, addr));
+	M_EXIT_IF_ERR(lcdc_bus_listener(&(gameboy->screen), addr));
+	M_EXIT_IF_ERR(joypad_bus_listener(&(gameboy->pad), addr));
+	if(gameboy->serial != NULL && addr == REG_SB){
+		fputc(cpu_read_at_idx(&gameboy->cpu, REG_SB), gameboy->serial);
+	}
+	
+	#ifdef BLARGG
+	M_EXIT_IF_ERR(blargg_bus_listener(gameboy, addr));
+	#endif
+	
+	return ERR_NONE;
+}
+
+/**
+ * @brief Runs one cycle of all the subsystems of the gameboy
+ *
+ * @param gameboy the gameboy
+ * @return error code
+ */
+static inline int gameboy_cycle(gameboy_t* gameboy){
+	
+	#ifdef BLARGG
+	//Throw a VBlank interrupt every 17’556 cycles
+	if((gameboy->cycles>0) && ((gameboy->cycles % CYCLES_GAMEBOY_DRAW) == 0)){
+		cpu_request_interrupt(&(gameboy->cpu), VBLANK);
+	}
+	#endif
+	
+	PROFILE_START();
+	M_EXIT_IF_ERR(lcdc_cycle(&(gameboy->screen), gameboy->cycles));
+	gameboy_frame_listener(gameboy);
+	PROFILE_STEP(gameboy, PROFILE_LCDC);
+
+	M_EXIT_IF_ERR(timer_cycle(&gameboy->timer));
+	PROFILE_STEP(gameboy, PROFILE_TIMER);
+	//A DMA copied at once holds OAM and its source until the cycle by cycle copy would be over,
+	//for the cpu only (the other subsystems keep their bus)
+	if(gameboy->screen.bulk_DMA && lcdc_DMA_running(&gameboy->screen, gameboy->cycles)){
+		gameboy->cpu.DMA_from = (addr_t) (cpu_read_at_idx(&gameboy->cpu, REG_DMA) << 8);
+		gameboy->cpu.DMA_running = 1;
+	}
+	const int err = gameboy->trace != NULL ? gameboy_trace_cycle(gameboy) : cpu_cycle(&(gameboy->cpu));
+	gameboy->cpu.DMA_running = 0;
+	M_EXIT_IF_ERR(err);
+	++(gameboy->cycles);
+	PROFILE_STEP(gameboy, PROFILE_CPU);
+	M_EXIT_IF_ERR(gameboy_bus_listeners(gameboy, gameboy->cpu.write_listener));
+	if(gameboy->cpu.write_listener16){
+		M_EXIT_IF_ERR(gameboy_bus_listeners(gameboy, (addr_t) (gameboy->cpu.write_listener + 1)));
+	}
+	PROFILE_STEP(gameboy, PROFILE_LISTENERS);
+	
+	return ERR_NONE;
+}
+
+/**
+ * @brief Runs the gameboy until a given cycle, one cycle at a time (the arena must already be in use)
+ *
+ * @param gameboy the gameboy
+ * @param cycle cycle to run until
+ * @return error code
+ */
+static int gameboy_run(gameboy_t* gameboy, uint64_t cycle){
+	
+	while(gameboy->cycles < cycle){
+		M_EXIT_IF_ERR(gameboy_cycle(gameboy));
+	}
+	
+	return ERR_NONE;
+}
+
+/**
+ * @brief Runs the gameboy until a given cycle, skipping at once the cycles in which only the timer counts
+ *        (the cpu being idle or halted, before the next event of the screen and the next change of TIMA).
+ *        The other cycles are run as by gameboy_run(), so that the states are the same at every cycle
+ *        (but the VBlanks -DBLARGG throws, which assume the cycles are all run)
+ *
+ * @param gameboy the gameboy
+ * @param cycle cycle to run until
+ * @return error code
+ */
+static int gameboy_run_batched(gameboy_t* gameboy, uint64_t cycle){
+	
+	while(gameboy->cycles < cycle){
 		
-		M_EXIT_IF_ERR(lcdc_cycle(&(gameboy->screen), gameboy->cycles));
-
-        M_EXIT_IF_ERR(timer_cycle(&gameboy->timer));
-		M_EXIT_IF_ERR(cpu_cycle(&(gameboy->cpu)));
-		++(gameboy->cycles);
-		M_EXIT_IF_ERR(bootrom_bus_listener(gameboy, gameboy->cpu.write_listener));
-        M_EXIT_IF_ERR(timer_bus_listener(&gameboy->timer, gameboy->cpu.write_listener));
-        M_EXIT_IF_ERR(lcdc_bus_listener(&(gameboy->screen), gameboy->cpu.write_listener));
-        M_EXIT_IF_ERR(joypad_bus_listener(&(gameboy->pad), gameboy->cpu.write_listener));
+		uint64_t skip = cpu_idle_cycles(&gameboy->cpu);
+		if(skip == CPU_IDLE_FOREVER){
+			//Halted: woken up by the interrupts of the timer and of the screen, or of the joypad between two runs
+			skip = timer_idle_cycles(&gameboy->timer);
+		}
+		const uint64_t event = lcdc_next_event(&gameboy->screen);
+		const uint64_t end = event < cycle ? event : cycle;
+		if(end <= gameboy->cycles){
+			skip = 0;
+		}
+		else if(skip > end - gameboy->cycles){
+			skip = end - gameboy->cycles;
+		}
 		
-        #ifdef BLARGG
-        M_EXIT_IF_ERR(blargg_bus_listener(gameboy, gameboy->cpu.write_listener));
-        #endif
-        
+		if(skip == 0){
+			M_EXIT_IF_ERR(gameboy_cycle(gameboy));
+		}
+		else{
+			PROFILE_START();
+			M_EXIT_IF_ERR(timer_advance(&gameboy->timer, skip));
+			PROFILE_STEP(gameboy, PROFILE_TIMER);
+			M_EXIT_IF_ERR(cpu_skip_cycles(&gameboy->cpu, skip));
+			gameboy->cycles += skip;
+			PROFILE_STEP(gameboy, PROFILE_CPU);
+		}
 	}
-
 	
+	return ERR_NONE;
+}
 
+/**
+ * @brief Runs a cycle of the cpu, and traces the instruction it executed, if any
+ *        (the state is taken before the cycle, an instruction only starting once the cpu is no longer idle)
+ *
+ * @param gameboy the gameboy
+ * @return error code
+ */
+static int gameboy_trace_cycle(gameboy_t* gameboy){
+	
+	cpu_t* const cpu = &gameboy->cpu;
+	const uint64_t instructions = cpu->instructions;
+	trace_entry_t entry;
+	if(cpu->idle_time == 0){
+		entry.cycle = gameboy->cycles;
+		entry.PC = cpu->PC;
+		entry.opcode = cpu_read_at_idx(cpu, cpu->PC);
+		entry.AF = cpu->AF;
+		entry.BC = cpu->BC;
+		entry.DE = cpu->DE;
+		entry.HL = cpu->HL;
+		entry.SP = cpu->SP;
+	}
+	
+	M_EXIT_IF_ERR(cpu_cycle(cpu));
+	
+	if(cpu->instructions != instructions){
+		M_EXIT_IF_ERR(trace_record(gameboy->trace, &entry));
+	}
 	
 	return ERR_NONE;
 }
 
+/**
+ * @brief Counts frames and resets the arena when the screen enters VBlank
+ *        (no rendering temporary is alive between two lcdc cycles)
+ *
+ * @param gameboy the gameboy
+ */
+static void gameboy_frame_listener(gameboy_t* gameboy){
+	
+	const data_t ly = cpu_read_at_idx(&(gameboy->cpu), REG_LY);
+	
+	if(ly == LCD_HEIGHT && gameboy->last_ly != LCD_HEIGHT){
+		++(gameboy->frames);
+		#ifdef PROFILE
+		profile_end_frame(&gameboy->profile);
+		#endif
+		//Fails (and keeps the arena) only if some temporaries leaked: the arena then fills up
+		//and the temporaries are served by malloc, which is reported once
+		arena_t* const arena = gameboy_arena(gameboy);
+		if(arena_reset(arena) != ERR_NONE && arena->failed_resets == 1){
+			fprintf(stderr, "Warning: %zu rendering temporaries leaked at frame %" PRIu64 ", the arena cannot be reset until they are freed\n",
+			        arena->live, gameboy->frames);
+		}
+	}
+	gameboy->last_ly = ly;
+}
+
 #ifdef BLARGG
 static int blargg_bus_listener(gameboy_t* gameboy, addr_t addr){
 	M_REQUIRE_NON_NULL(gameboy);
@@ -18,6 +18,13 @@
 #include "cartridge.h"//cartridge_t
 #include "lcdc.h"//lcdc_t
 #include "joypad.h"//
+#include "arena.h"//arena_t
+#include "movie.h"//movie_t
+#include "trace.h"//trace_t
+#ifdef PROFILE
+#include "profile.h"//profile_t
+#endif
+#include <stdio.h>//FILE
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +38,20 @@ extern "C" {
 #define GRAPH_RAM_INDEX 4
 #define USELESS_INDEX 5
 
+/**
+ * @brief Accuracy tiers of the emulation, chosen when the gameboy is created
+ */
+typedef enum {
+    GB_ACCURACY_CYCLE, //every subsystem runs at every cycle
+    GB_ACCURACY_INSTRUCTION, //the timer and the screen only run at their events between two instructions (same states as GB_ACCURACY_CYCLE)
+    GB_ACCURACY_SCANLINE, //as GB_ACCURACY_INSTRUCTION, but OAM DMAs are copied at once and the lines of a frame are drawn at once
+                          //when VBlank starts, each with the LCDC registers it had at mode 3 (the modes, LY and the interrupts are
+                          //as in GB_ACCURACY_CYCLE). Not preserved: reads of OAM or of the DMA source during a DMA, register writes
+                          //during mode 3, VRAM and OAM writes in the middle of a frame (also seen by the lines above them), and the display
+                          //between two VBlanks (the previous frame, e.g. after the screen is switched on).
+                          //Tetris and flappyboy keep the same game and frames (see unit-test-lockstep)
+    GB_ACCURACIES
+} gameboy_accuracy_t;
 
 /**
  * @brief Game Boy data structure.
@@ -49,6 +70,17 @@ typedef struct gameboy_{
     bit_t boot;
     lcdc_t screen;
     joypad_t pad;
+    uint64_t frames; //number of VBlanks the screen went through
+    data_t last_ly; //value of LY at the previous cycle, to detect VBlanks
+    arena_t arena; //rendering temporaries, reset at each VBlank
+    gameboy_accuracy_t accuracy;
+    FILE* serial; //if not NULL, where the bytes written to the serial port are logged
+    movie_t* movie; //if not NULL, key events played at the cycles they are stamped with
+    trace_t* trace; //if not NULL, where the instructions are traced
+    arena_t* shared_arena; //if not NULL, used instead of arena (see gameboy_set_arena())
+    #ifdef PROFILE
+    profile_t profile; //time taken by the subsystems
+    #endif
 } gameboy_t;
 
 // Number of Game Boy cycles per second (= 2^20)
@@ -61,8 +93,11 @@ typedef struct gameboy_{
  * @brief Creates a gameboy
  *
  * @param gameboy pointer to gameboy to create
+ * @param filename the ROM of the cartridge
+ * @param accuracy accuracy tier of the emulation
+ * @return error code
  */
-int gameboy_create(gameboy_t* gameboy, const char* filename);
+int gameboy_create(gameboy_t* gameboy, const char* filename, gameboy_accuracy_t accuracy);
 
 /**
  * @brief Destroys a gameboy
@@ -73,9 +108,100 @@ void gameboy_free(gameboy_t* gameboy);
 
 /**
  * @brief Runs a gamefor for/until a given cycle
+ *        (bit vectors created meanwhile by the calling thread come from the arena of the gameboy, see gameboy_set_arena())
  */
 int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle);
 
+/**
+ * @brief Chooses which frames are rendered in the display of the screen.
+ *        The screen keeps its exact timing (modes, LY, STAT, interrupts, DMA) whatever the choice.
+ *
+ * @param gameboy the gameboy
+ * @param period LCDC_RENDER_ALL to render every frame, N to render one frame out of N,
+ *        LCDC_RENDER_OFF to render nothing (headless)
+ * @return error code
+ */
+int gameboy_set_render_period(gameboy_t* gameboy, unsigned int period);
+
+/**
+ * @brief Logs the bytes written to the serial port (SB) in a file
+ *
+ * @param gameboy the gameboy
+ * @param serial where to log the bytes (NULL to stop logging)
+ * @return error code
+ */
+int gameboy_set_serial_log(gameboy_t* gameboy, FILE* serial);
+
+/**
+ * @brief Plays a movie: gameboy_run_until() gives each event of the movie to the joypad
+ *        right before the cycle it is stamped with (events already late are given at once)
+ *
+ * @param gameboy the gameboy
+ * @param movie the movie, owned by the caller (NULL to stop playing)
+ * @return error code
+ */
+int gameboy_set_movie(gameboy_t* gameboy, movie_t* movie);
+
+/**
+ * @brief Traces the instructions the CPU executes (the interrupts are not traced)
+ *
+ * @param gameboy the gameboy
+ * @param trace the open trace, owned by the caller (NULL to stop tracing)
+ * @return error code
+ */
+int gameboy_set_trace(gameboy_t* gameboy, trace_t* trace);
+
+/**
+ * @brief Has the rendering temporaries come from an arena of the caller instead of the gameboy's own,
+ *        e.g. one arena per thread running many gameboys one after the other.
+ *        The arena is reset at the VBlanks of the gameboy; it must not be used by anything else while the gameboy runs.
+ *
+ * @param gameboy the gameboy
+ * @param arena the arena, owned by the caller (NULL to use the arena of the gameboy again)
+ * @return error code
+ */
+int gameboy_set_arena(gameboy_t* gameboy, arena_t* arena);
+
+/**
+ * @brief Prints the time the subsystems took (see profile_print()), if compiled with -DPROFILE
+ *
+ * @param gameboy the gameboy
+ * @param output where to print
+ * @return error code (ERR_NOT_IMPLEMENTED without -DPROFILE)
+ */
+int gameboy_profile_print(const gameboy_t* gameboy, FILE* output);
+
+/**
+ * @brief Name of an accuracy tier ("cycle", "instruction" or "scanline")
+ *
+ * @param accuracy the accuracy tier
+ * @return the name, NULL if there is no such tier
+ */
+const char* gameboy_accuracy_name(gameboy_accuracy_t accuracy);
+
+/**
+ * @brief Finds an accuracy tier from its name
+ *
+ * @param name the name (see gameboy_accuracy_name())
+ * @param accuracy (output) the accuracy tier
+ * @return error code (ERR_BAD_PARAMETER if there is no such tier)
+ */
+int gameboy_accuracy_parse(const char* name, gameboy_accuracy_t* accuracy);
+
+/**
+ * @brief Converts the current frame of the screen to pixels (see image_export())
+ *
+ * @param gameboy the gameboy
+ * @param pixels buffer of at least LCD_HEIGHT * scale rows
+ * @param stride bytes between the start of two rows of pixels
+ * @param format pixel format
+ * @param scale integer scale factor, from 1 to IMAGE_EXPORT_MAX_SCALE
+ * @param colors colors (0xRRGGBB) of the 4 pixel values, NULL for shades of grey
+ * @return error code
+ */
+int gameboy_export_frame(const gameboy_t* gameboy, uint8_t* pixels, size_t stride, image_format_t format,
+                         unsigned int scale, const uint32_t colors[PALETTE_COLOR_COUNT]);
+
 
 
 /**
@@ -111,6 +237,7 @@ int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle);
 
 // Memory-mapped "IO" registers
 #define BLARGG_REG      0xFF01
+#define REG_SB          0xFF01 //serial transfer data
 
 #define REGS_LCDC_START 0xFF40
 #define REGS_LCDC_END   0xFF4C
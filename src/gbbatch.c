@@ -0,0 +1,228 @@
+/**
+ * @file gbbatch.c
+ * @brief Batch runner: emulates many instances of a ROM on a pool of threads (see batch.h),
+ *        and reports how the throughput scales with the number of threads
+ *
+ * @date 2021
+ */
+
+#include "batch.h"
+#include "gameboy.h"
+#include "joypad.h"
+#include "image.h"
+#include "pacing.h"
+#include "util.h"  // for zero_init_var()
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // for PRIu64, PRIx64
+
+#define GBBATCH_DEFAULT_INSTANCES 64
+#define GBBATCH_DEFAULT_FRAMES 60
+#define GBBATCH_DEFAULT_MAX_THREADS 64
+#define GBBATCH_INPUT_PERIOD 40 //frames between two presses of A by an instance
+
+/**
+ * @brief Options of a run
+ */
+typedef struct {
+    const char* rom;
+    size_t instances;
+    uint64_t frames; //frames each instance emulates
+    size_t max_threads; //threads of the last run (doubled from 1)
+    bit_t single; //only one run, with max_threads threads (0 for one per core)
+    bit_t headless;
+    gameboy_accuracy_t accuracy;
+} gbbatch_options_t;
+
+// ======================================================================
+static void usage(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s rom.gb [--instances N] [--frames N] [--max-threads N | --threads N]\n"
+            "          [--accuracy cycle|instruction|scanline] [--headless]\n", pgm);
+    fprintf(stderr, "          (%d instances of %d frames, on 1, 2, 4, ... up to %d threads by default;\n"
+            "          --threads N runs once on N threads, 0 for one per core)\n",
+            GBBATCH_DEFAULT_INSTANCES, GBBATCH_DEFAULT_FRAMES, GBBATCH_DEFAULT_MAX_THREADS);
+    fprintf(stderr, "examples: %s tetris.gb\n", pgm);
+    fprintf(stderr, "          %s tetris.gb --instances 1000 --frames 10 --threads 0 --headless\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Parses the command line, returns ERR_BAD_PARAMETER on misuse
+ */
+static int parse_options(int argc, char* argv[], gbbatch_options_t* options)
+{
+    zero_init_ptr(options);
+    options->instances = GBBATCH_DEFAULT_INSTANCES;
+    options->frames = GBBATCH_DEFAULT_FRAMES;
+    options->max_threads = GBBATCH_DEFAULT_MAX_THREADS;
+    options->accuracy = GB_ACCURACY_CYCLE;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            M_REQUIRE(options->rom == NULL, ERR_BAD_PARAMETER, "two ROMs given (%s)", arg);
+            options->rom = arg;
+            continue;
+        }
+        if (!strcmp(arg, "--headless")) {
+            options->headless = 1;
+            continue;
+        }
+        M_REQUIRE(i + 1 < argc, ERR_BAD_PARAMETER, "missing value of option %s", arg);
+        const char* value = argv[++i];
+        if (!strcmp(arg, "--instances")) {
+            options->instances = strtoul(value, NULL, 10);
+        } else if (!strcmp(arg, "--frames")) {
+            options->frames = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--max-threads")) {
+            options->max_threads = strtoul(value, NULL, 10);
+        } else if (!strcmp(arg, "--threads")) {
+            options->max_threads = strtoul(value, NULL, 10);
+            options->single = 1;
+        } else if (!strcmp(arg, "--accuracy")) {
+            M_EXIT_IF_ERR(gameboy_accuracy_parse(value, &options->accuracy));
+        } else {
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", arg);
+        }
+    }
+
+    M_REQUIRE(options->rom != NULL, ERR_BAD_PARAMETER, "please provide a ROM%s", "");
+    M_REQUIRE(options->instances > 0 && options->frames > 0, ERR_BAD_PARAMETER, "nothing to run%s", "");
+    M_REQUIRE(options->max_threads <= BATCH_MAX_THREADS && (options->single || options->max_threads > 0),
+              ERR_BAD_PARAMETER, "bad number of threads (%zu)", options->max_threads);
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Input of the instances: each one presses A every GBBATCH_INPUT_PERIOD frames, at its own phase
+ */
+static int gbbatch_input(gameboy_t* gameboy, size_t index, uint64_t frame, void* data)
+{
+    (void) data;
+
+    const uint64_t phase = (frame + 7 * index) % GBBATCH_INPUT_PERIOD;
+    if (phase == 0) {
+        return joypad_key_pressed(&gameboy->pad, A_KEY);
+    }
+    if (phase == GBBATCH_INPUT_PERIOD / 2) {
+        return joypad_key_released(&gameboy->pad, A_KEY);
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Checksum of the screens and work RAMs of all the instances, the same whatever the number of threads
+ */
+static int gbbatch_hash(batch_t* batch, uint64_t* hash)
+{
+    *hash = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < batch->nb_instances; ++i) {
+        const gameboy_t* const gameboy = batch_gameboy(batch, i);
+        uint64_t screen = 0;
+        M_EXIT_IF_ERR(image_hash(&gameboy->screen.display, &screen));
+        *hash = (*hash ^ screen) * UINT64_C(1099511628211);
+        const memory_t* const ram = gameboy->components[WORK_RAM_INDEX].mem;
+        for (size_t b = 0; b < ram->size; ++b) {
+            *hash = (*hash ^ ram->memory[b]) * UINT64_C(1099511628211);
+        }
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Runs all the instances on a number of threads (the creation of the batch not being timed)
+ */
+static int gbbatch_run(const gbbatch_options_t* options, size_t threads, double* seconds, uint64_t* hash,
+                       uint64_t* steals, size_t* workers)
+{
+    batch_t batch;
+    M_EXIT_IF_ERR(batch_create(&batch, options->rom, options->accuracy, options->instances, threads));
+
+    int err = ERR_NONE;
+    for (size_t i = 0; err == ERR_NONE && i < options->instances; ++i) {
+        err = batch_set_input(&batch, i, gbbatch_input, NULL);
+        if (err == ERR_NONE && options->headless) {
+            err = gameboy_set_render_period(batch_gameboy(&batch, i), LCDC_RENDER_OFF);
+        }
+    }
+
+    const uint64_t start = pacing_now();
+    if (err == ERR_NONE) {
+        err = batch_run_all(&batch, options->frames);
+    }
+    *seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+
+    *steals = 0;
+    for (size_t w = 0; w < batch.nb_workers; ++w) {
+        *steals += batch.workers[w].steals;
+    }
+    *workers = batch.nb_workers;
+    if (err == ERR_NONE) {
+        err = gbbatch_hash(&batch, hash);
+    }
+
+    batch_free(&batch);
+    return err;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    gbbatch_options_t options;
+    if (parse_options(argc, argv, &options) != ERR_NONE) {
+        usage(argv[0], "bad arguments");
+        return ERR_BAD_PARAMETER;
+    }
+
+    const double frames = (double) options.instances * (double) options.frames;
+    printf("%s: %zu instances of %" PRIu64 " frames (%s)\n", options.rom, options.instances, options.frames,
+           gameboy_accuracy_name(options.accuracy));
+
+    int err = ERR_NONE;
+    bit_t mismatch = 0;
+    bit_t first = 1;
+    double reference = 0; //seconds of the first run
+    uint64_t reference_hash = 0;
+    size_t threads = options.single ? options.max_threads : 1;
+    for (;;) {
+        double seconds = 0;
+        uint64_t hash = 0;
+        uint64_t steals = 0;
+        size_t workers = 0;
+        err = gbbatch_run(&options, threads, &seconds, &hash, &steals, &workers);
+        if (err != ERR_NONE) {
+            break;
+        }
+        if (first) {
+            first = 0;
+            reference = seconds;
+            reference_hash = hash;
+        }
+        mismatch |= hash != reference_hash;
+
+        printf("threads %3zu: %9.3f s  %9.0f frames/s  (x%.2f)  speedup %5.2f  steals %8" PRIu64 "  hash %016" PRIx64 "%s\n",
+               workers, seconds, frames / seconds, frames * FRAME_TOTAL_CYCLES / seconds / GB_CYCLES_PER_S,
+               reference / seconds, steals, hash, hash != reference_hash ? "  MISMATCH" : "");
+        fflush(stdout);
+
+        if (options.single || threads >= options.max_threads) {
+            break;
+        }
+        threads = 2 * threads < options.max_threads ? 2 * threads : options.max_threads;
+    }
+
+    if (err != ERR_NONE) {
+        fprintf(stderr, "error: %s\n", ERR_MESSAGES[err - ERR_NONE]);
+        return err;
+    }
+    return mismatch;
+}
@@ -0,0 +1,711 @@
+/**
+ * @file gbbench.c
+ * @brief Benchmark suite: fixed workloads with pinned inputs, timed over repetitions,
+ *        reported as JSON and compared against a baseline
+ *
+ * @date 2021
+ */
+
+#include "gameboy.h"
+#include "movie.h"
+#include "blargg.h"
+#include "savestate.h"
+#include "clone.h"
+#include "rewind.h"
+#include "image.h"
+#include "bit_vector.h"
+#include "pacing.h"
+#include "util.h"  // for zero_init_var()
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // for PRIx64
+
+#define BENCH_DEFAULT_FRAMES 600
+#define BENCH_DEFAULT_REPETITIONS 5
+#define BENCH_DEFAULT_THRESHOLD 10.0 // percent (about the noise of a busy machine)
+#define BENCH_MAX_REPETITIONS 100
+#define BENCH_MAX_WORKLOADS 64
+#define BENCH_NAME_SIZE 64
+#define BENCH_LINE_SIZE 256
+
+#define BENCH_GAMES_DIR "../games/"
+#define BENCH_BLARGG_DIR "tests/data/blargg_roms/"
+#define BENCH_BOOT_MAX_CYCLES 10000000
+#define BENCH_STATE_FRAMES 300 // on the title screen
+#define BENCH_REWIND_FRAMES (30 * 60) // as gbsimulator
+#define BENCH_REWIND_KEYFRAME_PERIOD 60
+#define BENCH_REWIND_BUDGET ((size_t) 64 << 20)
+
+#define BENCH_MICRO_ROUNDS 5000
+#define BENCH_LINE_BITS 256 // a whole background line
+
+/**
+ * @brief Options of the suite
+ */
+typedef struct {
+    uint64_t frames; //frames emulated by the game workloads
+    size_t repetitions;
+    const char* output; //JSON file (NULL for stdout)
+    const char* baseline; //JSON file of a former run (NULL for none)
+    double threshold; //slowdown of the median, in percent, above which a workload regressed
+    const char* only; //prefix of the names of the workloads to run (NULL for all)
+} bench_options_t;
+
+/**
+ * @brief Result of one repetition of a workload
+ */
+typedef struct {
+    double seconds;
+    uint64_t cycles; //guest cycles emulated (0 for the microbenchmarks)
+    uint64_t hash; //checksum of the result, the same at each repetition unless the emulation changed
+    uint64_t bytes; //bytes copied at each round of the microbenchmarks that copy gameboys,
+                    //or each frame of the snapshot workloads (0 otherwise)
+} bench_sample_t;
+
+/**
+ * @brief Workload of the suite
+ */
+typedef struct bench_workload_ {
+    const char* name;
+    const char* rom; //NULL for the microbenchmarks
+    int (*run)(const struct bench_workload_* workload, const bench_options_t* options, bench_sample_t* sample);
+    gameboy_accuracy_t accuracy; //accuracy tier of the gameboy workloads
+} bench_workload_t;
+
+/**
+ * @brief Statistics of the repetitions of a workload
+ */
+typedef struct {
+    double median;
+    double p95;
+    double min;
+    uint64_t cycles;
+    uint64_t hash;
+    uint64_t bytes;
+    bit_t stable; //all the repetitions gave the same hash
+} bench_stats_t;
+
+/**
+ * @brief Median of a former run
+ */
+typedef struct {
+    char name[BENCH_NAME_SIZE];
+    double median;
+} bench_baseline_t;
+
+// ======================================================================
+static void usage(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s [--frames N] [--repetitions N] [--output file.json]"
+            " [--baseline file.json] [--threshold percent] [--only name]\n", pgm);
+    fprintf(stderr, "          (%d frames, %d repetitions and a threshold of %.0f%% by default)\n",
+            BENCH_DEFAULT_FRAMES, BENCH_DEFAULT_REPETITIONS, BENCH_DEFAULT_THRESHOLD);
+    fprintf(stderr, "examples: %s --output bench.json\n", pgm);
+    fprintf(stderr, "          %s --baseline bench_baseline.json --only blargg\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Parses the command line, returns ERR_BAD_PARAMETER on misuse
+ */
+static int parse_options(int argc, char* argv[], bench_options_t* options)
+{
+    zero_init_ptr(options);
+    options->frames = BENCH_DEFAULT_FRAMES;
+    options->repetitions = BENCH_DEFAULT_REPETITIONS;
+    options->threshold = BENCH_DEFAULT_THRESHOLD;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        M_REQUIRE(i + 1 < argc, ERR_BAD_PARAMETER, "missing value of option %s", arg);
+        const char* value = argv[++i];
+        if (!strcmp(arg, "--frames")) {
+            options->frames = strtoull(value, NULL, 10);
+            M_REQUIRE(options->frames > 0, ERR_BAD_PARAMETER, "bad number of frames (%s)", value);
+        } else if (!strcmp(arg, "--repetitions")) {
+            options->repetitions = strtoul(value, NULL, 10);
+            M_REQUIRE(options->repetitions > 0 && options->repetitions <= BENCH_MAX_REPETITIONS, ERR_BAD_PARAMETER,
+                      "bad number of repetitions (%s)", value);
+        } else if (!strcmp(arg, "--output")) {
+            options->output = value;
+        } else if (!strcmp(arg, "--baseline")) {
+            options->baseline = value;
+        } else if (!strcmp(arg, "--threshold")) {
+            options->threshold = strtod(value, NULL);
+            M_REQUIRE(options->threshold > 0, ERR_BAD_PARAMETER, "bad threshold (%s)", value);
+        } else if (!strcmp(arg, "--only")) {
+            options->only = value;
+        } else {
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", arg);
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Pinned inputs of the games: gets through the title screen, then plays a few keys
+ */
+static int bench_game_movie(movie_t* movie)
+{
+    static const struct {
+        uint64_t frame;
+        gb_key_t key;
+        bit_t pressed;
+    } inputs[] = {
+        { 400, START_KEY, 1 }, { 410, START_KEY, 0 },
+        { 460, START_KEY, 1 }, { 470, START_KEY, 0 },
+        { 500, A_KEY, 1 },     { 505, A_KEY, 0 },
+        { 520, LEFT_KEY, 1 },  { 530, LEFT_KEY, 0 },
+        { 550, A_KEY, 1 },     { 555, A_KEY, 0 },
+        { 570, DOWN_KEY, 1 },  { 590, DOWN_KEY, 0 }
+    };
+
+    M_EXIT_IF_ERR(movie_init(movie));
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+        const input_event_t event = { inputs[i].frame * FRAME_TOTAL_CYCLES, inputs[i].key, inputs[i].pressed };
+        M_EXIT_IF_ERR_DO_SOMETHING(movie_record(movie, event), movie_free(movie));
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Emulates a game for the frames asked for, with the screen rendered and the pinned inputs,
+ *        pushing each frame in a rewind buffer if one is given,
+ *        and copying the blocks it wrote in a snapshot if one is given (see gameboy_copy_dirty())
+ */
+static int bench_game_run(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample,
+                          rewind_t* rewind, gameboy_t* snapshot)
+{
+    gameboy_t gb;
+    zero_init_var(gb);
+    M_EXIT_IF_ERR(gameboy_create(&gb, workload->rom, workload->accuracy));
+
+    movie_t movie;
+    M_EXIT_IF_ERR_DO_SOMETHING(bench_game_movie(&movie), gameboy_free(&gb));
+    int err = gameboy_set_movie(&gb, &movie);
+    if (err == ERR_NONE && snapshot != NULL) {
+        err = gameboy_clone(snapshot, &gb);
+        dirty_clear(&gb.cpu.dirty);
+        dirty_clear(&snapshot->cpu.dirty);
+    }
+
+    uint64_t dirty_bytes = 0;
+    const uint64_t start = pacing_now();
+    for (uint64_t frame = 1; err == ERR_NONE && frame <= options->frames; ++frame) {
+        err = gameboy_run_until(&gb, frame * FRAME_TOTAL_CYCLES);
+        if (err == ERR_NONE && rewind != NULL) err = rewind_push(rewind, &gb);
+        if (err == ERR_NONE && snapshot != NULL) {
+            dirty_bytes += dirty_count(&gb.cpu.dirty) * DIRTY_BLOCK_SIZE;
+            err = gameboy_copy_dirty(snapshot, &gb);
+            dirty_clear(&gb.cpu.dirty);
+            dirty_clear(&snapshot->cpu.dirty);
+        }
+    }
+    sample->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+    sample->cycles = gb.cycles;
+    if (snapshot != NULL && options->frames > 0) {
+        sample->bytes = dirty_bytes / options->frames;
+    }
+
+    if (err == ERR_NONE) {
+        err = image_hash(snapshot != NULL ? &snapshot->screen.display : &gb.screen.display, &sample->hash);
+    }
+
+    movie_free(&movie);
+    gameboy_free(&gb);
+    return err;
+}
+
+// ======================================================================
+static int bench_game(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    return bench_game_run(workload, options, sample, NULL, NULL);
+}
+
+// ======================================================================
+/**
+ * @brief As bench_game(), keeping the frames to rewind as gbsimulator does
+ */
+static int bench_rewind(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    rewind_t rewind;
+    M_EXIT_IF_ERR(rewind_create(&rewind, BENCH_REWIND_FRAMES, BENCH_REWIND_KEYFRAME_PERIOD, BENCH_REWIND_BUDGET));
+    const int err = bench_game_run(workload, options, sample, &rewind, NULL);
+    rewind_free(&rewind);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief As bench_game(), keeping a snapshot of each frame up to date with the blocks the frame wrote
+ */
+static int bench_snapshot(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    gameboy_t* snapshot = calloc(1, sizeof(gameboy_t));
+    M_EXIT_IF_NULL(snapshot, sizeof(gameboy_t));
+    const int err = bench_game_run(workload, options, sample, NULL, snapshot);
+    gameboy_free(snapshot);
+    free(snapshot);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Emulates a blargg test ROM until it prints its verdict on the serial port
+ */
+static int bench_blargg(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    (void) options;
+
+    blargg_result_t result;
+    M_EXIT_IF_ERR(blargg_run(workload->rom, workload->accuracy, BLARGG_DEFAULT_MAX_CYCLES, &result));
+    sample->seconds = result.seconds;
+    sample->cycles = result.cycles;
+
+    if (result.verdict != BLARGG_PASSED) {
+        fprintf(stderr, "%s did not pass:\n%s\n", workload->name, result.output);
+    }
+
+    // the checksum is the output of the test
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < result.size; ++i) {
+        hash = (hash ^ (uint8_t) result.output[i]) * UINT64_C(1099511628211);
+    }
+    sample->hash = hash;
+
+    blargg_result_free(&result);
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Emulates the boot ROM sequence (scrolling logo) until the cartridge takes over
+ */
+static int bench_boot(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    (void) options;
+
+    gameboy_t gb;
+    zero_init_var(gb);
+    M_EXIT_IF_ERR(gameboy_create(&gb, workload->rom, workload->accuracy));
+
+    int err = ERR_NONE;
+    const uint64_t start = pacing_now();
+    while (err == ERR_NONE && gb.boot && gb.cycles < BENCH_BOOT_MAX_CYCLES) {
+        err = gameboy_run_until(&gb, gb.cycles + FRAME_TOTAL_CYCLES);
+    }
+    sample->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+    sample->cycles = gb.cycles;
+
+    if (err == ERR_NONE) {
+        err = image_hash(&gb.screen.display, &sample->hash);
+    }
+
+    gameboy_free(&gb);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Saves the state of a game and loads it back (see savestate.h), the microbenchmark rounds asked for
+ */
+static int bench_state(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    (void) options;
+
+    gameboy_t gb;
+    zero_init_var(gb);
+    M_EXIT_IF_ERR(gameboy_create(&gb, workload->rom, workload->accuracy));
+    int err = gameboy_run_until(&gb, BENCH_STATE_FRAMES * FRAME_TOTAL_CYCLES);
+
+    gameboy_state_t* state = malloc(sizeof(gameboy_state_t));
+    if (state == NULL) err = ERR_MEM;
+
+    const uint64_t start = pacing_now();
+    for (size_t round = 0; err == ERR_NONE && round < BENCH_MICRO_ROUNDS; ++round) {
+        err = gameboy_save_state(&gb, state);
+        if (err == ERR_NONE) err = gameboy_load_state(&gb, state);
+    }
+    sample->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+
+    if (err == ERR_NONE) {
+        err = image_hash(&gb.screen.display, &sample->hash);
+    }
+
+    free(state);
+    gameboy_free(&gb);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Clones a game and frees the clone (see clone.h), the microbenchmark rounds asked for
+ */
+static int bench_clone(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    (void) options;
+
+    gameboy_t* gameboys = calloc(2, sizeof(gameboy_t));
+    M_EXIT_IF_NULL(gameboys, 2 * sizeof(gameboy_t));
+    int err = gameboy_create(&gameboys[0], workload->rom, workload->accuracy);
+    if (err == ERR_NONE) err = gameboy_run_until(&gameboys[0], BENCH_STATE_FRAMES * FRAME_TOTAL_CYCLES);
+
+    const uint64_t start = pacing_now();
+    for (size_t round = 0; err == ERR_NONE && round < BENCH_MICRO_ROUNDS; ++round) {
+        err = gameboy_clone(&gameboys[1], &gameboys[0]);
+        if (err == ERR_NONE) gameboy_free(&gameboys[1]);
+    }
+    sample->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+    sample->bytes = gameboy_clone_bytes(&gameboys[0]);
+
+    if (err == ERR_NONE) {
+        err = image_hash(&gameboys[0].screen.display, &sample->hash);
+    }
+
+    gameboy_free(&gameboys[0]);
+    free(gameboys);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Copies a game into another gameboy (see clone.h), the microbenchmark rounds asked for
+ */
+static int bench_copy(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    (void) options;
+
+    gameboy_t* gameboys = calloc(2, sizeof(gameboy_t));
+    M_EXIT_IF_NULL(gameboys, 2 * sizeof(gameboy_t));
+    int err = gameboy_create(&gameboys[0], workload->rom, workload->accuracy);
+    if (err == ERR_NONE) err = gameboy_run_until(&gameboys[0], BENCH_STATE_FRAMES * FRAME_TOTAL_CYCLES);
+    if (err == ERR_NONE) err = gameboy_clone(&gameboys[1], &gameboys[0]);
+
+    const uint64_t start = pacing_now();
+    for (size_t round = 0; err == ERR_NONE && round < BENCH_MICRO_ROUNDS; ++round) {
+        err = gameboy_copy(&gameboys[1], &gameboys[0]);
+    }
+    sample->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+
+    if (err == ERR_NONE) {
+        err = image_hash(&gameboys[1].screen.display, &sample->hash);
+    }
+
+    gameboy_free(&gameboys[0]);
+    gameboy_free(&gameboys[1]);
+    free(gameboys);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Random line of BENCH_LINE_BITS pixels (always the same ones)
+ */
+static int bench_random_line(image_line_t* line, unsigned int seed)
+{
+    srand(seed);
+    M_EXIT_IF_ERR(image_line_create(line, BENCH_LINE_BITS));
+    for (size_t w = 0; w < BENCH_LINE_BITS / IMAGE_LINE_WORD_BITS; ++w) {
+        M_EXIT_IF_ERR_DO_SOMETHING(image_line_set_word(line, w, (uint32_t) rand(), (uint32_t) rand()),
+                                   image_line_free(line));
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Operations of bit vectors the rendering uses (shifts, extractions, logical operations)
+ */
+static int bench_bit_vector(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    (void) workload;
+    (void) options;
+
+    image_line_t a, b;
+    M_EXIT_IF_ERR(bench_random_line(&a, 1));
+    M_EXIT_IF_ERR_DO_SOMETHING(bench_random_line(&b, 2), image_line_free(&a));
+
+    int err = ERR_NONE;
+    uint64_t hash = 0;
+    const uint64_t start = pacing_now();
+    for (size_t round = 0; err == ERR_NONE && round < BENCH_MICRO_ROUNDS; ++round) {
+        bit_vector_t* v = bit_vector_extract_wrap_ext(a.msb, (int64_t) (round % BENCH_LINE_BITS), LCD_WIDTH);
+        bit_vector_t* w = bit_vector_shift(b.lsb, (int64_t) (round % 16) - 8);
+        bit_vector_t* x = bit_vector_extract_zero_ext(w, (int64_t) (round % 64) - 32, LCD_WIDTH);
+        if (v == NULL || x == NULL || w == NULL) {
+            err = ERR_MEM;
+        } else {
+            bit_vector_xor(bit_vector_and(bit_vector_not(v), x), x);
+            hash = hash * 31 + v->content[round % (LCD_WIDTH / IMAGE_LINE_WORD_BITS)];
+        }
+        bit_vector_free(&v);
+        bit_vector_free(&w);
+        bit_vector_free(&x);
+    }
+    sample->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+    sample->hash = hash;
+
+    image_line_free(&a);
+    image_line_free(&b);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Operations of images the rendering and the display use (palettes, layers, export, hash)
+ */
+static int bench_image(const bench_workload_t* workload, const bench_options_t* options, bench_sample_t* sample)
+{
+    (void) workload;
+    (void) options;
+
+    image_line_t a, b;
+    M_EXIT_IF_ERR(bench_random_line(&a, 3));
+    M_EXIT_IF_ERR_DO_SOMETHING(bench_random_line(&b, 4), image_line_free(&a));
+
+    image_t frame;
+    int err = image_create(&frame, LCD_WIDTH, LCD_HEIGHT);
+    uint8_t* pixels = malloc(LCD_WIDTH * LCD_HEIGHT * IMAGE_RGB);
+    if (pixels == NULL) err = ERR_MEM;
+
+    uint64_t hash = 0;
+    const uint64_t start = pacing_now();
+    for (size_t round = 0; err == ERR_NONE && round < BENCH_MICRO_ROUNDS; ++round) {
+        const size_t y = round % LCD_HEIGHT;
+        image_line_t mapped, below, line;
+        zero_init_var(mapped);
+        zero_init_var(below);
+        zero_init_var(line);
+        err = image_line_map_colors(&mapped, a, (palette_t) round);
+        if (err == ERR_NONE) err = image_line_below(&below, mapped, b);
+        if (err == ERR_NONE) err = image_line_extract_wrap_ext(&line, below, (int64_t) (round % BENCH_LINE_BITS), LCD_WIDTH);
+        if (err == ERR_NONE) err = image_set_line(&frame, y, line);
+        // a whole frame is displayed every LCD_HEIGHT lines
+        if (err == ERR_NONE && y == LCD_HEIGHT - 1) {
+            uint64_t frame_hash = 0;
+            err = image_export(&frame, pixels, LCD_WIDTH * IMAGE_RGB, IMAGE_RGB, 1, NULL);
+            if (err == ERR_NONE) err = image_hash(&frame, &frame_hash);
+            hash ^= frame_hash + pixels[round % (LCD_WIDTH * LCD_HEIGHT)];
+        }
+        image_line_free(&mapped);
+        image_line_free(&below);
+        image_line_free(&line);
+    }
+    sample->seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+    sample->hash = hash;
+
+    free(pixels);
+    image_free(&frame);
+    image_line_free(&a);
+    image_line_free(&b);
+    return err;
+}
+
+// ======================================================================
+static const bench_workload_t workloads[] = {
+    { "tetris",                   BENCH_GAMES_DIR "tetris.gb",                       bench_game,   GB_ACCURACY_CYCLE },
+    { "flappyboy",                BENCH_GAMES_DIR "flappyboy.gb",                    bench_game,   GB_ACCURACY_CYCLE },
+    { "tetris+rewind",            BENCH_GAMES_DIR "tetris.gb",                       bench_rewind, GB_ACCURACY_CYCLE },
+    { "flappyboy+rewind",         BENCH_GAMES_DIR "flappyboy.gb",                    bench_rewind, GB_ACCURACY_CYCLE },
+    { "tetris+snapshot",          BENCH_GAMES_DIR "tetris.gb",                       bench_snapshot, GB_ACCURACY_CYCLE },
+    { "flappyboy+snapshot",       BENCH_GAMES_DIR "flappyboy.gb",                    bench_snapshot, GB_ACCURACY_CYCLE },
+    { "tetris@instruction",       BENCH_GAMES_DIR "tetris.gb",                       bench_game,   GB_ACCURACY_INSTRUCTION },
+    { "flappyboy@instruction",    BENCH_GAMES_DIR "flappyboy.gb",                    bench_game,   GB_ACCURACY_INSTRUCTION },
+    { "tetris@scanline",          BENCH_GAMES_DIR "tetris.gb",                       bench_game,   GB_ACCURACY_SCANLINE },
+    { "flappyboy@scanline",       BENCH_GAMES_DIR "flappyboy.gb",                    bench_game,   GB_ACCURACY_SCANLINE },
+    { "blargg/01-special",        BENCH_BLARGG_DIR "01-special.gb",                  bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/02-interrupts",     BENCH_BLARGG_DIR "02-interrupts.gb",               bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/03-op sp,hl",       BENCH_BLARGG_DIR "03-op sp,hl.gb",                 bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/04-op r,imm",       BENCH_BLARGG_DIR "04-op r,imm.gb",                 bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/05-op rp",          BENCH_BLARGG_DIR "05-op rp.gb",                    bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/06-ld r,r",         BENCH_BLARGG_DIR "06-ld r,r.gb",                   bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/07-jr,jp,call,ret,rst", BENCH_BLARGG_DIR "07-jr,jp,call,ret,rst.gb",   bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/08-misc instrs",    BENCH_BLARGG_DIR "08-misc instrs.gb",              bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/09-op r,r",         BENCH_BLARGG_DIR "09-op r,r.gb",                   bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/10-bit ops",        BENCH_BLARGG_DIR "10-bit ops.gb",                  bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/11-op a,(hl)",      BENCH_BLARGG_DIR "11-op a,(hl).gb",                bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/instr_timing",      BENCH_BLARGG_DIR "instr_timing.gb",                bench_blargg, GB_ACCURACY_CYCLE },
+    { "blargg/11-op a,(hl)@instruction", BENCH_BLARGG_DIR "11-op a,(hl).gb",         bench_blargg, GB_ACCURACY_INSTRUCTION },
+    { "blargg/11-op a,(hl)@scanline", BENCH_BLARGG_DIR "11-op a,(hl).gb",            bench_blargg, GB_ACCURACY_SCANLINE },
+    { "boot",                     BENCH_GAMES_DIR "tetris.gb",                       bench_boot,   GB_ACCURACY_CYCLE },
+    { "boot@instruction",         BENCH_GAMES_DIR "tetris.gb",                       bench_boot,   GB_ACCURACY_INSTRUCTION },
+    { "boot@scanline",            BENCH_GAMES_DIR "tetris.gb",                       bench_boot,   GB_ACCURACY_SCANLINE },
+    { "savestate",                BENCH_GAMES_DIR "tetris.gb",                       bench_state,  GB_ACCURACY_CYCLE },
+    { "clone",                    BENCH_GAMES_DIR "tetris.gb",                       bench_clone,  GB_ACCURACY_CYCLE },
+    { "copy",                     BENCH_GAMES_DIR "tetris.gb",                       bench_copy,   GB_ACCURACY_CYCLE },
+    { "bit_vector",               NULL,                                              bench_bit_vector, GB_ACCURACY_CYCLE },
+    { "image",                    NULL,                                              bench_image,  GB_ACCURACY_CYCLE }
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+// ======================================================================
+static int compare_doubles(const void* a, const void* b)
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// ======================================================================
+/**
+ * @brief Runs a workload the repetitions asked for; median and 95th percentile (nearest rank) of the times
+ */
+static int bench_run(const bench_workload_t* workload, const bench_options_t* options, bench_stats_t* stats)
+{
+    double seconds[BENCH_MAX_REPETITIONS];
+    zero_init_ptr(stats);
+    stats->stable = 1;
+
+    for (size_t r = 0; r < options->repetitions; ++r) {
+        bench_sample_t sample;
+        zero_init_var(sample);
+        M_EXIT_IF_ERR(workload->run(workload, options, &sample));
+        seconds[r] = sample.seconds;
+        if (r > 0 && sample.hash != stats->hash) {
+            stats->stable = 0;
+        }
+        stats->hash = sample.hash;
+        stats->cycles = sample.cycles;
+        stats->bytes = sample.bytes;
+    }
+
+    const size_t n = options->repetitions;
+    qsort(seconds, n, sizeof(double), compare_doubles);
+    stats->median = n % 2 ? seconds[n / 2] : (seconds[n / 2 - 1] + seconds[n / 2]) / 2;
+    stats->p95 = seconds[(95 * n + 99) / 100 - 1];
+    stats->min = seconds[0];
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Reads the medians of a JSON file written by this program (one workload per line)
+ */
+static int read_baseline(const char* filename, bench_baseline_t baseline[BENCH_MAX_WORKLOADS], size_t* count)
+{
+    FILE* file = fopen(filename, "r");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for reading\n", filename);
+
+    *count = 0;
+    char line[BENCH_LINE_SIZE];
+    while (*count < BENCH_MAX_WORKLOADS && fgets(line, sizeof(line), file) != NULL) {
+        bench_baseline_t* const entry = &baseline[*count];
+        if (sscanf(line, " { \"name\": \"%63[^\"]\", \"median\": %lf", entry->name, &entry->median) == 2) {
+            ++*count;
+        }
+    }
+    fclose(file);
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Median of a workload in the baseline, 0 if it is not there
+ */
+static double baseline_median(const bench_baseline_t* baseline, size_t count, const char* name)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (!strcmp(baseline[i].name, name)) return baseline[i].median;
+    }
+    return 0;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    bench_options_t options;
+    if (parse_options(argc, argv, &options) != ERR_NONE) {
+        usage(argv[0], "bad arguments");
+        return ERR_BAD_PARAMETER;
+    }
+
+    bench_baseline_t baseline[BENCH_MAX_WORKLOADS];
+    size_t baseline_count = 0;
+    if (options.baseline != NULL && read_baseline(options.baseline, baseline, &baseline_count) != ERR_NONE) {
+        fprintf(stderr, "cannot read the baseline %s\n", options.baseline);
+        return ERR_IO;
+    }
+
+    FILE* output = options.output != NULL ? fopen(options.output, "w") : stdout;
+    if (output == NULL) {
+        fprintf(stderr, "cannot write %s\n", options.output);
+        return ERR_IO;
+    }
+
+    fprintf(output, "{\n  \"frames\": %" PRIu64 ",\n  \"repetitions\": %zu,\n  \"threshold\": %.1f,\n  \"workloads\": [\n",
+            options.frames, options.repetitions, options.threshold);
+
+    int err = ERR_NONE;
+    size_t regressions = 0;
+    const char* separator = "";
+    for (size_t i = 0; err == ERR_NONE && i < WORKLOAD_COUNT; ++i) {
+        const bench_workload_t* const workload = &workloads[i];
+        if (options.only != NULL && strncmp(workload->name, options.only, strlen(options.only))) {
+            continue;
+        }
+
+        bench_stats_t stats;
+        err = bench_run(workload, &options, &stats);
+        if (err != ERR_NONE) {
+            fprintf(stderr, "%s failed: %s\n", workload->name, ERR_MESSAGES[err - ERR_NONE]);
+            break;
+        }
+
+        fprintf(output, "%s    { \"name\": \"%s\", \"median\": %.6f, \"p95\": %.6f, \"min\": %.6f, "
+                "\"cycles\": %" PRIu64 ", \"hash\": \"%016" PRIx64 "\", \"stable\": %s",
+                separator, workload->name, stats.median, stats.p95, stats.min,
+                stats.cycles, stats.hash, stats.stable ? "true" : "false");
+        if (workload->rom != NULL) {
+            fprintf(output, ", \"accuracy\": \"%s\"", gameboy_accuracy_name(workload->accuracy));
+        }
+        if (stats.bytes > 0) {
+            fprintf(output, ", \"bytes\": %" PRIu64, stats.bytes);
+        }
+        fprintf(stderr, "%-32s median %9.3f ms  p95 %9.3f ms", workload->name, stats.median * 1000, stats.p95 * 1000);
+        if (stats.cycles > 0) {
+            fprintf(stderr, "  (x%.2f)", (double) stats.cycles / stats.median / GB_CYCLES_PER_S);
+        }
+        if (stats.bytes > 0 && stats.cycles > 0) {
+            fprintf(stderr, "  (%" PRIu64 " bytes/frame)", stats.bytes);
+        } else if (stats.bytes > 0) {
+            fprintf(stderr, "  (%.0f/s, %" PRIu64 " bytes each)", BENCH_MICRO_ROUNDS / stats.median, stats.bytes);
+        }
+        if (!stats.stable) {
+            fprintf(stderr, "  UNSTABLE HASH");
+        }
+
+        const double reference = baseline_median(baseline, baseline_count, workload->name);
+        if (reference > 0) {
+            const double change = 100 * (stats.median - reference) / reference;
+            const bit_t regressed = change > options.threshold;
+            regressions += regressed;
+            fprintf(output, ", \"baseline\": %.6f, \"change\": %.2f, \"regression\": %s",
+                    reference, change, regressed ? "true" : "false");
+            fprintf(stderr, "  %+6.1f%%%s", change, regressed ? "  REGRESSION" : "");
+        }
+        fprintf(output, " }");
+        fprintf(stderr, "\n");
+        separator = ",\n";
+    }
+
+    fprintf(output, "\n  ],\n  \"regressions\": %zu\n}\n", regressions);
+    if (output != stdout) fclose(output);
+
+    if (err != ERR_NONE) return err;
+    if (regressions > 0) {
+        fprintf(stderr, "%zu workload(s) more than %.1f%% slower than the baseline\n", regressions, options.threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file gblockstep.c
+ * @brief Differential runner: runs a ROM on a reference and a candidate engine side by side,
+ *        and stops at the first cycle after which their states differ
+ *
+ * @date 2021
+ */
+
+#include "lockstep.h"
+#include "gameboy.h"
+#include "pacing.h"
+#include "util.h"  // for zero_init_var()
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // for PRIu64
+
+#define GBLOCKSTEP_DEFAULT_FRAMES 600
+
+/**
+ * @brief Options of a run
+ */
+typedef struct {
+    const char* rom;
+    const char* movie; //movie both gameboys play (NULL for none)
+    uint64_t frames;
+    uint64_t period; //cycles between two comparisons of the cpus
+    uint64_t memory_period; //comparisons of the cpus between two comparisons of the memory
+    lockstep_config_t configs[LOCKSTEP_GAMEBOYS];
+} gblockstep_options_t;
+
+// ======================================================================
+static void usage(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s rom.gb [--frames N] [--movie file] [--every N] [--memory-every N]\n"
+            "          [--reference options] [--candidate options]\n", pgm);
+    fprintf(stderr, "          (%d frames, cpus compared after every cycle, memory every %d comparisons by default)\n",
+            GBLOCKSTEP_DEFAULT_FRAMES, LOCKSTEP_DEFAULT_MEMORY_PERIOD);
+    fprintf(stderr, "options:  comma separated list of headless, render=N (one frame out of N), bulk-dma,\n"
+            "          accuracy=cycle|instruction|scanline\n");
+    fprintf(stderr, "          (by default, every frame is rendered, DMAs are copied cycle by cycle, and every cycle is run)\n");
+    fprintf(stderr, "examples: %s tetris.gb --candidate headless --every 1000\n", pgm);
+    fprintf(stderr, "          %s tetris.gb --candidate bulk-dma --memory-every 1   (exits with 1 on a mismatch)\n", pgm);
+    fprintf(stderr, "          %s tetris.gb --candidate accuracy=instruction\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Parses the engine options of a gameboy
+ */
+static int parse_config(const char* text, lockstep_config_t* config)
+{
+    char options[64];
+    M_REQUIRE(strlen(text) < sizeof(options), ERR_BAD_PARAMETER, "options too long (%s)", text);
+    strcpy(options, text);
+
+    char* saved = NULL;
+    for (char* option = strtok_r(options, ",", &saved); option != NULL; option = strtok_r(NULL, ",", &saved)) {
+        if (!strcmp(option, "headless")) {
+            config->render_period = LCDC_RENDER_OFF;
+        } else if (!strncmp(option, "render=", strlen("render="))) {
+            config->render_period = (unsigned int) strtoul(option + strlen("render="), NULL, 10);
+        } else if (!strcmp(option, "bulk-dma")) {
+            config->bulk_DMA = 1;
+        } else if (!strncmp(option, "accuracy=", strlen("accuracy="))) {
+            M_EXIT_IF_ERR(gameboy_accuracy_parse(option + strlen("accuracy="), &config->accuracy));
+        } else {
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown engine option %s", option);
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Parses the command line, returns ERR_BAD_PARAMETER on misuse
+ */
+static int parse_options(int argc, char* argv[], gblockstep_options_t* options)
+{
+    zero_init_ptr(options);
+    options->frames = GBLOCKSTEP_DEFAULT_FRAMES;
+    options->period = 1;
+    options->memory_period = LOCKSTEP_DEFAULT_MEMORY_PERIOD;
+    options->configs[LOCKSTEP_REFERENCE].render_period = LCDC_RENDER_ALL;
+    options->configs[LOCKSTEP_CANDIDATE].render_period = LCDC_RENDER_ALL;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            M_REQUIRE(options->rom == NULL, ERR_BAD_PARAMETER, "two ROMs given (%s)", arg);
+            options->rom = arg;
+            continue;
+        }
+        M_REQUIRE(i + 1 < argc, ERR_BAD_PARAMETER, "missing value of option %s", arg);
+        const char* value = argv[++i];
+        if (!strcmp(arg, "--frames")) {
+            options->frames = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--every")) {
+            options->period = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--memory-every")) {
+            options->memory_period = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--movie")) {
+            options->movie = value;
+        } else if (!strcmp(arg, "--reference")) {
+            M_EXIT_IF_ERR(parse_config(value, &options->configs[LOCKSTEP_REFERENCE]));
+        } else if (!strcmp(arg, "--candidate")) {
+            M_EXIT_IF_ERR(parse_config(value, &options->configs[LOCKSTEP_CANDIDATE]));
+        } else {
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", arg);
+        }
+    }
+
+    M_REQUIRE(options->rom != NULL, ERR_BAD_PARAMETER, "please provide a ROM%s", "");
+    M_REQUIRE(options->period > 0 && options->memory_period > 0, ERR_BAD_PARAMETER, "null period%s", "");
+    return ERR_NONE;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    gblockstep_options_t options;
+    if (parse_options(argc, argv, &options) != ERR_NONE) {
+        usage(argv[0], "bad arguments");
+        return ERR_BAD_PARAMETER;
+    }
+
+    // two gameboys are too large for the stack
+    lockstep_t* lockstep = calloc(1, sizeof(lockstep_t));
+    if (lockstep == NULL) {
+        fprintf(stderr, "cannot allocate the gameboys\n");
+        return ERR_MEM;
+    }
+
+    lockstep_mismatch_t mismatch;
+    zero_init_var(mismatch);
+    const uint64_t start = pacing_now();
+    int err = lockstep_create(lockstep, options.rom, options.movie, options.configs, options.period,
+                              options.memory_period);
+    if (err == ERR_NONE) {
+        err = lockstep_run(lockstep, options.frames * FRAME_TOTAL_CYCLES, &mismatch);
+    }
+    const double seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+
+    if (err == ERR_NONE) {
+        const gameboy_t* const reference = &lockstep->gameboys[LOCKSTEP_REFERENCE];
+        printf("%s: %" PRIu64 " cycles, %" PRIu64 " instructions in %.3f s (%.0f instructions/s),"
+               " %" PRIu64 " comparisons\n", options.rom, reference->cycles, reference->cpu.instructions, seconds,
+               (double) reference->cpu.instructions / seconds, lockstep->comparisons);
+        lockstep_mismatch_print(stdout, &mismatch);
+    } else {
+        fprintf(stderr, "error: %s\n", ERR_MESSAGES[err - ERR_NONE]);
+    }
+
+    lockstep_free(lockstep);
+    free(lockstep);
+
+    return err != ERR_NONE ? err : mismatch.found;
+}
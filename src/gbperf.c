@@ -0,0 +1,168 @@
+/**
+ * @file gbperf.c
+ * @brief Hardware performance counters of the emulation: IPC, branch and cache misses
+ *        per emulated frame and per guest instruction
+ *
+ * @date 2021
+ */
+
+#include "gameboy.h"
+#include "movie.h"
+#include "perf_counters.h"
+#include "pacing.h"
+#include "util.h"  // for zero_init_var()
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // for PRIu64
+
+#define GBPERF_DEFAULT_FRAMES 600
+
+/**
+ * @brief Options of a run
+ */
+typedef struct {
+    const char* rom;
+    uint64_t frames;
+    const char* movie; //movie to play (NULL for none)
+    bit_t no_render; //the screen is not rendered
+    gameboy_accuracy_t accuracy;
+} gbperf_options_t;
+
+// ======================================================================
+static void usage(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s rom.gb [--frames N] [--movie file] [--no-render] [--accuracy cycle|instruction|scanline]\n", pgm);
+    fprintf(stderr, "          (%d frames by default)\n", GBPERF_DEFAULT_FRAMES);
+    fprintf(stderr, "examples: %s tetris.gb --frames 3600\n", pgm);
+    fprintf(stderr, "          %s tetris.gb --no-render   (the CPU and the bus without the rendering)\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Parses the command line, returns ERR_BAD_PARAMETER on misuse
+ */
+static int parse_options(int argc, char* argv[], gbperf_options_t* options)
+{
+    zero_init_ptr(options);
+    options->frames = GBPERF_DEFAULT_FRAMES;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            M_REQUIRE(options->rom == NULL, ERR_BAD_PARAMETER, "two ROMs given (%s)", arg);
+            options->rom = arg;
+        } else if (!strcmp(arg, "--no-render")) {
+            options->no_render = 1;
+        } else {
+            M_REQUIRE(i + 1 < argc, ERR_BAD_PARAMETER, "missing value of option %s", arg);
+            const char* value = argv[++i];
+            if (!strcmp(arg, "--frames")) {
+                options->frames = strtoull(value, NULL, 10);
+                M_REQUIRE(options->frames > 0, ERR_BAD_PARAMETER, "bad number of frames (%s)", value);
+            } else if (!strcmp(arg, "--movie")) {
+                options->movie = value;
+            } else if (!strcmp(arg, "--accuracy")) {
+                M_EXIT_IF_ERR(gameboy_accuracy_parse(value, &options->accuracy));
+            } else {
+                M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", arg);
+            }
+        }
+    }
+
+    M_REQUIRE(options->rom != NULL, ERR_BAD_PARAMETER, "please provide a ROM%s", "");
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Prints the counters, per frame and per guest instruction
+ */
+static void print_counters(const perf_counters_t* counters, uint64_t frames, uint64_t instructions)
+{
+    if (counters->error != 0) {
+        fprintf(stderr, "some counters are unavailable (%s): perf_event_paranoid, container or virtual machine?\n",
+                strerror(counters->error));
+    }
+
+    printf("%-14s %16s %14s %18s\n", "counter", "total", "per frame", "per guest instr.");
+    for (perf_counter_t c = PERF_INSTRUCTIONS; c < PERF_COUNTERS; ++c) {
+        if (perf_counters_available(counters, c)) {
+            const double value = (double) counters->values[c];
+            printf("%-14s %16" PRIu64 " %14.1f %18.2f\n", perf_counter_name(c), counters->values[c],
+                   value / (double) frames, instructions > 0 ? value / (double) instructions : 0);
+        } else {
+            printf("%-14s %16s\n", perf_counter_name(c), "unavailable");
+        }
+    }
+
+    if (perf_counters_available(counters, PERF_INSTRUCTIONS) && perf_counters_available(counters, PERF_CYCLES)
+        && counters->values[PERF_CYCLES] > 0) {
+        printf("IPC %.2f\n", (double) counters->values[PERF_INSTRUCTIONS] / (double) counters->values[PERF_CYCLES]);
+    }
+}
+
+// ======================================================================
+/**
+ * @brief Emulates the frames asked for, counting the events of each gameboy_run_until()
+ */
+static int run(const gbperf_options_t* options, gameboy_t* gb)
+{
+    perf_counters_t counters;
+    M_EXIT_IF_ERR(perf_counters_open(&counters));
+    int err = gameboy_set_render_period(gb, options->no_render ? LCDC_RENDER_OFF : LCDC_RENDER_ALL);
+
+    const uint64_t start = pacing_now();
+    for (uint64_t frame = 1; err == ERR_NONE && frame <= options->frames; ++frame) {
+        err = perf_counters_start(&counters);
+        if (err == ERR_NONE) err = gameboy_run_until(gb, frame * FRAME_TOTAL_CYCLES);
+        if (err == ERR_NONE) err = perf_counters_stop(&counters);
+    }
+    const double seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+
+    if (err == ERR_NONE) {
+        printf("%s (%s): %" PRIu64 " frames, %" PRIu64 " cycles, %" PRIu64 " guest instructions in %.3f s (x%.2f)\n",
+               options->rom, gameboy_accuracy_name(options->accuracy), options->frames, gb->cycles, gb->cpu.instructions, seconds,
+               (double) gb->cycles / seconds / GB_CYCLES_PER_S);
+        print_counters(&counters, options->frames, gb->cpu.instructions);
+    }
+
+    perf_counters_close(&counters);
+    return err;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    gbperf_options_t options;
+    if (parse_options(argc, argv, &options) != ERR_NONE) {
+        usage(argv[0], "bad arguments");
+        return ERR_BAD_PARAMETER;
+    }
+
+    gameboy_t gb;
+    zero_init_var(gb);
+    int err = gameboy_create(&gb, options.rom, options.accuracy);
+
+    movie_t movie;
+    zero_init_var(movie);
+    if (err == ERR_NONE && options.movie != NULL) {
+        err = movie_load(&movie, options.movie);
+        if (err == ERR_NONE) err = gameboy_set_movie(&gb, &movie);
+    }
+
+    if (err == ERR_NONE) {
+        err = run(&options, &gb);
+    } else {
+        fprintf(stderr, "cannot start: %s\n", ERR_MESSAGES[err - ERR_NONE]);
+    }
+
+    movie_free(&movie);
+    gameboy_free(&gb);
+
+    return err;
+}
@@ -0,0 +1,391 @@
+/**
+ * @file gbrun.c
+ * @brief Headless Game Boy runner: emulates a ROM for a budget of frames or cycles, without any GUI
+ *
+ * @date 2021
+ */
+
+#include "gameboy.h"
+#include "joypad.h"
+#include "image.h"
+#include "pacing.h"
+#include "movie.h"
+#include "savestate.h"
+#include "util.h"  // for zero_init_var()
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // for PRIx64
+#include <signal.h> // for SIGUSR1
+#include <errno.h> // for ERANGE
+#include <ctype.h> // for isdigit()
+
+#define GBRUN_DEFAULT_FRAMES 600
+
+/**
+ * @brief Options of a run
+ */
+typedef struct {
+    const char* rom;
+    uint64_t frames; //frames to emulate (0 to use the cycle budget)
+    uint64_t cycles; //cycles to emulate (0 to use the frame budget)
+    const char* script; //input script (see usage())
+    const char* movie; //movie to play (see movie.h)
+    const char* hashes; //where to write the hash of every frame
+    const char* pgm; //where to write the last frame
+    const char* dump; //where to write the work RAM at the end
+    const char* serial; //where to log the serial port
+    const char* load_state; //state to start from (see savestate.h)
+    const char* save_state; //where to save the state at the end
+    gameboy_accuracy_t accuracy;
+} gbrun_options_t;
+
+// set by SIGUSR1: the profile is printed at the end of the current frame
+static volatile sig_atomic_t profile_requested = 0;
+
+// ======================================================================
+static void request_profile(int signal_number)
+{
+    (void) signal_number;
+    profile_requested = 1;
+}
+
+// ======================================================================
+static void usage(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s rom.gb [--frames N | --cycles N] [--input script | --movie file]"
+            " [--hashes file] [--pgm file] [--dump file] [--serial file] [--accuracy cycle|instruction|scanline]"
+            " [--load-state file] [--save-state file]\n", pgm);
+    fprintf(stderr, "          (%d frames by default, counted from the loaded state if any)\n", GBRUN_DEFAULT_FRAMES);
+    fprintf(stderr, "input script: one \"<frame> <key> press|release\" per line, sorted by frame, and # comments\n");
+    fprintf(stderr, "          (the key is pressed or released at the start of the frame,\n");
+    fprintf(stderr, "          frames being counted from the loaded state if any),\n");
+    fprintf(stderr, "          keys: RIGHT LEFT UP DOWN A B SELECT START\n");
+    fprintf(stderr, "when compiled with -DPROFILE, the time of the subsystems is printed on SIGUSR1 and at exit\n");
+    fprintf(stderr, "examples: %s tetris.gb --frames 3600 --hashes hashes.txt\n", pgm);
+    fprintf(stderr, "          %s cpu_instrs.gb --cycles 100000000 --serial /dev/stdout\n", pgm);
+    fprintf(stderr, "          %s tetris.gb --frames 300 --save-state tetris.state\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Parses a positive decimal number, which must be the whole value, returns ERR_BAD_PARAMETER otherwise
+ */
+static int parse_count(const char* value, uint64_t* count)
+{
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    M_REQUIRE(isdigit((unsigned char) value[0]) && end != value && *end == '\0' && errno != ERANGE && parsed > 0,
+              ERR_BAD_PARAMETER, "bad number (%s)", value);
+
+    *count = parsed;
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Parses the command line, returns ERR_BAD_PARAMETER on misuse
+ */
+static int parse_options(int argc, char* argv[], gbrun_options_t* options)
+{
+    zero_init_ptr(options);
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            M_REQUIRE(options->rom == NULL, ERR_BAD_PARAMETER, "two ROMs given (%s)", arg);
+            options->rom = arg;
+            continue;
+        }
+
+        M_REQUIRE(i + 1 < argc, ERR_BAD_PARAMETER, "missing value of option %s", arg);
+        const char* value = argv[++i];
+        if (!strcmp(arg, "--frames")) {
+            M_EXIT_IF_ERR(parse_count(value, &options->frames));
+        } else if (!strcmp(arg, "--cycles")) {
+            M_EXIT_IF_ERR(parse_count(value, &options->cycles));
+        } else if (!strcmp(arg, "--input")) {
+            options->script = value;
+        } else if (!strcmp(arg, "--movie")) {
+            options->movie = value;
+        } else if (!strcmp(arg, "--hashes")) {
+            options->hashes = value;
+        } else if (!strcmp(arg, "--pgm")) {
+            options->pgm = value;
+        } else if (!strcmp(arg, "--dump")) {
+            options->dump = value;
+        } else if (!strcmp(arg, "--serial")) {
+            options->serial = value;
+        } else if (!strcmp(arg, "--accuracy")) {
+            M_EXIT_IF_ERR(gameboy_accuracy_parse(value, &options->accuracy));
+        } else if (!strcmp(arg, "--load-state")) {
+            options->load_state = value;
+        } else if (!strcmp(arg, "--save-state")) {
+            options->save_state = value;
+        } else {
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", arg);
+        }
+    }
+
+    M_REQUIRE(options->rom != NULL, ERR_BAD_PARAMETER, "please provide a ROM%s", "");
+    M_REQUIRE(options->frames == 0 || options->cycles == 0, ERR_BAD_PARAMETER,
+              "give either a frame or a cycle budget%s", "");
+    M_REQUIRE(options->script == NULL || options->movie == NULL, ERR_BAD_PARAMETER,
+              "give either an input script or a movie%s", "");
+    if (options->frames == 0 && options->cycles == 0) {
+        options->frames = GBRUN_DEFAULT_FRAMES;
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Reports a bad line of an input script, returns ERR_BAD_PARAMETER
+ */
+static int script_error(size_t number, const char* line, const char* reason)
+{
+    fprintf(stderr, "input script, line %zu: %s: \"%s\"\n", number, reason, line);
+    return ERR_BAD_PARAMETER;
+}
+
+// ======================================================================
+/**
+ * @brief Reads the events of an input script from an open file, as a movie whose events are at the start of their frame,
+ *        frames being counted from a cycle. Its lines are the ones of movies (see movie_parse_line()).
+ */
+static int script_read(FILE* file, uint64_t origin, movie_t* movie)
+{
+    char line[MOVIE_LINE_SIZE];
+    for (size_t number = 1; fgets(line, sizeof(line), file) != NULL; ++number) {
+        const bit_t whole = line[strlen(line) - 1] == '\n' || feof(file);
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!whole) {
+            return script_error(number, line, "line too long");
+        }
+
+        // the same lines as in movies, stamped with frames
+        input_event_t event;
+        bit_t found = 0;
+        const char* reason = NULL;
+        if (movie_parse_line(line, &event, &found, &reason) != ERR_NONE) {
+            return script_error(number, line, reason);
+        }
+        if (!found) {
+            continue;
+        }
+        if (event.cycle > (UINT64_MAX - origin) / FRAME_TOTAL_CYCLES) {
+            return script_error(number, line, "frame too far");
+        }
+        event.cycle = origin + event.cycle * FRAME_TOTAL_CYCLES;
+        if (movie->size > 0 && movie->events[movie->size - 1].cycle > event.cycle) {
+            return script_error(number, line, "frame before the previous event");
+        }
+        M_EXIT_IF_ERR(movie_record(movie, event));
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Reads an input script (see usage()) as a movie, its frames being counted from a cycle
+ */
+static int script_load(const char* filename, uint64_t origin, movie_t* movie)
+{
+    FILE* file = fopen(filename, "r");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for reading\n", filename);
+
+    M_EXIT_IF_ERR_DO_SOMETHING(movie_init(movie), fclose(file));
+    const int err = script_read(file, origin, movie);
+    fclose(file);
+
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Writes the current frame as a binary PGM (greys)
+ */
+static int write_pgm(const char* filename, const gameboy_t* gb)
+{
+    uint8_t pixels[LCD_WIDTH * LCD_HEIGHT];
+    M_EXIT_IF_ERR(gameboy_export_frame(gb, pixels, LCD_WIDTH, IMAGE_GREY, 1, NULL));
+
+    FILE* file = fopen(filename, "wb");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for writing (binary mode)\n", filename);
+
+    fprintf(file, "P5\n%d %d\n255\n", LCD_WIDTH, LCD_HEIGHT);
+    const size_t check = fwrite(pixels, 1, sizeof(pixels), file);
+    fclose(file);
+
+    M_EXIT_IF(check != sizeof(pixels), ERR_IO, "was unable to write the frame in file \"%s\"\n", filename);
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Writes the work RAM in a file
+ */
+static int write_dump(const char* filename, const gameboy_t* gb)
+{
+    const memory_t* ram = gb->components[WORK_RAM_INDEX].mem;
+    M_REQUIRE_NON_NULL(ram);
+
+    FILE* file = fopen(filename, "wb");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for writing (binary mode)\n", filename);
+
+    const size_t check = fwrite(ram->memory, 1, ram->size, file);
+    fclose(file);
+
+    M_EXIT_IF(check != ram->size, ERR_IO, "was unable to dump the work RAM in file \"%s\"\n", filename);
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Puts the gameboy in the state saved in a file
+ */
+static int load_state(const char* filename, gameboy_t* gb)
+{
+    gameboy_state_t* state = malloc(sizeof(gameboy_state_t));
+    M_EXIT_IF_NULL(state, sizeof(gameboy_state_t));
+
+    int err = gameboy_state_read(state, filename);
+    if (err == ERR_NONE) err = gameboy_load_state(gb, state);
+
+    free(state);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Saves the state of the gameboy in a file
+ */
+static int save_state(const char* filename, const gameboy_t* gb)
+{
+    gameboy_state_t* state = malloc(sizeof(gameboy_state_t));
+    M_EXIT_IF_NULL(state, sizeof(gameboy_state_t));
+
+    int err = gameboy_save_state(gb, state);
+    if (err == ERR_NONE) err = gameboy_state_write(state, filename);
+
+    free(state);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Emulates the ROM frame by frame from its current cycle, with the outputs asked for
+ */
+static int run(const gbrun_options_t* options, gameboy_t* gb, FILE* hashes)
+{
+    const uint64_t origin = gb->cycles;
+    const uint64_t budget = origin + (options->cycles > 0 ? options->cycles
+                                      : options->frames * FRAME_TOTAL_CYCLES);
+
+    // the screen is only rendered if a frame is looked at
+    M_EXIT_IF_ERR(gameboy_set_render_period(gb, hashes != NULL || options->pgm != NULL
+                                            ? LCDC_RENDER_ALL : LCDC_RENDER_OFF));
+
+    const uint64_t start = pacing_now();
+    uint64_t frame = 0;
+    while (gb->cycles < budget) {
+        ++frame;
+        const uint64_t end = origin + frame * FRAME_TOTAL_CYCLES;
+        M_EXIT_IF_ERR(gameboy_run_until(gb, end < budget ? end : budget));
+
+        if (profile_requested) {
+            profile_requested = 0;
+            if (gameboy_profile_print(gb, stderr) == ERR_NOT_IMPLEMENTED) {
+                fprintf(stderr, "no profile: compiled without -DPROFILE\n");
+            }
+        }
+
+        if (hashes != NULL) {
+            uint64_t hash = 0;
+            M_EXIT_IF_ERR(image_hash(&gb->screen.display, &hash));
+            fprintf(hashes, "%" PRIu64 " %016" PRIx64 "\n", frame, hash);
+        }
+    }
+    const double seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+
+    fprintf(stderr, "%" PRIu64 " cycles, %" PRIu64 " frames in %.3f s: %.0f cycles/s, %.1f frames/s (x%.2f)\n",
+            gb->cycles - origin, frame, seconds, (double) (gb->cycles - origin) / seconds, (double) frame / seconds,
+            (double) (gb->cycles - origin) / seconds / GB_CYCLES_PER_S);
+
+    // nothing to print without -DPROFILE
+    gameboy_profile_print(gb, stderr);
+
+    if (options->pgm != NULL) {
+        M_EXIT_IF_ERR(write_pgm(options->pgm, gb));
+    }
+    if (options->dump != NULL) {
+        M_EXIT_IF_ERR(write_dump(options->dump, gb));
+    }
+    if (options->save_state != NULL) {
+        M_EXIT_IF_ERR(save_state(options->save_state, gb));
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    gbrun_options_t options;
+    if (parse_options(argc, argv, &options) != ERR_NONE) {
+        usage(argv[0], "bad arguments");
+        return ERR_BAD_PARAMETER;
+    }
+
+    gameboy_t gb;
+    zero_init_var(gb);
+    int err = gameboy_create(&gb, options.rom, options.accuracy);
+    signal(SIGUSR1, request_profile);
+
+    FILE* hashes = NULL;
+    FILE* serial = NULL;
+    movie_t movie;
+    zero_init_var(movie);
+
+    if (err == ERR_NONE && options.load_state != NULL) {
+        err = load_state(options.load_state, &gb);
+    }
+    if (err == ERR_NONE && options.hashes != NULL) {
+        hashes = fopen(options.hashes, "w");
+        if (hashes == NULL) err = ERR_IO;
+    }
+    if (err == ERR_NONE && options.serial != NULL) {
+        serial = fopen(options.serial, "wb");
+        if (serial == NULL) err = ERR_IO;
+        else err = gameboy_set_serial_log(&gb, serial);
+    }
+    if (err == ERR_NONE && (options.script != NULL || options.movie != NULL)) {
+        // script frames are counted from the loaded state, like --frames;
+        // movies are stamped with the cycles they were recorded at, and their events before a loaded state were already played
+        err = options.script != NULL ? script_load(options.script, gb.cycles, &movie) : movie_load(&movie, options.movie);
+        if (err == ERR_NONE) err = movie_seek(&movie, gb.cycles);
+        if (err == ERR_NONE) err = gameboy_set_movie(&gb, &movie);
+    }
+
+    if (err == ERR_NONE) {
+        err = run(&options, &gb, hashes);
+    } else {
+        fprintf(stderr, "cannot start: %s\n", ERR_MESSAGES[err - ERR_NONE]);
+    }
+
+    movie_free(&movie);
+    if (serial != NULL) fclose(serial);
+    if (hashes != NULL) fclose(hashes);
+    gameboy_free(&gb);
+
+    return err;
+}
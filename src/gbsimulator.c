@@ -1,11 +1,18 @@
 #include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <string.h>
 #include "sidlib.h"
 #include "gameboy.h"
 #include "error.h"
 #include "ourError.h"
 #include "image.h"
 #include "joypad.h"
-#include <sys/time.h>
+#include "triple_buffer.h"
+#include "input_queue.h"
+#include "pacing.h"
+#include "movie.h"
+#include "rewind.h"
 
 
 // Key press bits
@@ -18,19 +25,29 @@
 #define MY_KEY_SELECT_BIT    0x14
 #define MY_KEY_START_BIT     0x18
 
-#define REFRESH_TIME 40 //Time between each image refresh in ms : 25Hz refresh rate
+#define REFRESH_TIME 16 //Time between each image refresh in ms : about 60Hz refresh rate
 #define WINDOW_SCALE 3
-#define MICROSECONDS_IN_SECONDS 1000000
 
-#define MAX_COLOR_VALUE 255
+#define FRAME_STRIDE (3 * WINDOW_SCALE * LCD_WIDTH) //RGB
+#define FRAME_BYTES (FRAME_STRIDE * WINDOW_SCALE * LCD_HEIGHT)
+#define FRAME_NANOSECONDS ((uint64_t) FRAME_TOTAL_CYCLES * PACING_NANOSECONDS_IN_SECONDS / GB_CYCLES_PER_S) //about 16.74 ms
+#define PAUSE_NANOSECONDS 10000000
+#define PACING_REPORT_FRAMES 600 //about every 10 s
+#define REFRESH_NANOSECONDS ((uint64_t) REFRESH_TIME * 1000000)
 
-#define GREY_SCALE_CONVERSION(pixel)\
-    (MAX_COLOR_VALUE - 85 * pixel)
+// Turbo mode
+#define TURBO_UNLIMITED 0
+#define TURBO_SPEED_COUNT (sizeof(turbo_speeds) / sizeof(turbo_speeds[0]))
+#define TURBO_REPORT_NANOSECONDS PACING_NANOSECONDS_IN_SECONDS
 
-#define PRESS_KEY(gameboy, symbol)\
+// Rewind: the last 30 s, a keyframe every second
+#define REWIND_FRAMES (30 * 60)
+#define REWIND_KEYFRAME_PERIOD 60
+#define REWIND_BUDGET ((size_t) 64 << 20)
+
+#define PRESS_KEY(symbol)\
 do { \
-    int err=joypad_key_pressed(&(gameboy.pad), symbol ##_KEY);\
-    if(err!=ERR_NONE){\
+    if(push_key(symbol ##_KEY, 1)!=ERR_NONE){\
         fprintf(stderr, "Could not press " #symbol"\n");\
         return FALSE;\
     }\
@@ -39,10 +56,9 @@ do { \
     }\
    } while(0)
 
-#define RELEASE_KEY(gameboy, symbol)\
+#define RELEASE_KEY(symbol)\
 do { \
-    int err=joypad_key_released(&(gameboy.pad), symbol ##_KEY);\
-    if(err!=ERR_NONE){\
+    if(push_key(symbol ##_KEY, 0)!=ERR_NONE){\
         fprintf(stderr, "Could not release " #symbol"\n");\
         return FALSE;\
     }\
@@ -51,58 +67,212 @@ do { \
     }\
    } while(0)
 
-//global variable for gameboy
+//global variable for gameboy, only used by the emulation thread once it is started
 gameboy_t gameboy;
-struct timeval start;
-struct timeval paused;
-
-uint64_t get_time_in_GB_cyles_since(struct timeval* from){
-    struct timeval currentTime;
-    if(gettimeofday(&currentTime,NULL)!=0){
-        fprintf(stderr, "Could not get time of day");
-        return 0;
+
+//Key events given to the gameboy, if recorded (only used by the emulation thread once it is started)
+movie_t movie;
+bit_t recording;
+
+//Last frames, to step back to (only used by the emulation thread once it is started)
+rewind_t history;
+
+//Shared between the GTK thread and the emulation thread
+triple_buffer_t frames; //frames completed by the emulation thread
+input_queue_t inputs; //joypad events for the emulation thread
+atomic_uint_fast64_t emulated_cycles; //cycle the emulation thread will start its next frame at
+atomic_bool paused;
+atomic_bool quit;
+atomic_uint turbo; //index in turbo_speeds of the speed asked for
+atomic_bool rewinding; //the frames are stepped back instead of emulated
+
+//Speeds the turbo key goes through, in multiples of GB_CYCLES_PER_S
+static const unsigned int turbo_speeds[] = { 1, 2, 4, TURBO_UNLIMITED };
+
+// ======================================================================
+/**
+ * @brief Sends a joypad event to the emulation thread, at the next frame
+ */
+static int push_key(gb_key_t key, bit_t pressed)
+{
+    const input_event_t event = { atomic_load(&emulated_cycles), key, pressed };
+    return input_queue_push(&inputs, event);
+}
+
+// ======================================================================
+/**
+ * @brief Gives the joypad the events received up to the current cycle (and records them at this cycle)
+ */
+static int apply_inputs(void)
+{
+    input_event_t event;
+    while(input_queue_pop(&inputs, &event)){
+        event.cycle = gameboy.cycles;
+        if(recording){
+            M_EXIT_IF_ERR(movie_record(&movie, event));
+        }
+        if(event.pressed){
+            M_EXIT_IF_ERR(joypad_key_pressed(&gameboy.pad, event.key));
+        }
+        else{
+            M_EXIT_IF_ERR(joypad_key_released(&gameboy.pad, event.key));
+        }
     }
-    
-    if(timercmp(&currentTime, from, >)==0){//Return non zero if current time strictly greater than from and 0 otherwise
-		fprintf(stderr, "from >= currentTime");
-        return 0;
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Achieved speed of the emulation since the last report
+ */
+typedef struct {
+    uint64_t time;
+    uint64_t cycles;
+    uint64_t frames;
+} speed_report_t;
+
+static void speed_report_start(speed_report_t* report, const pacer_t* pacer)
+{
+    report->time = pacing_now();
+    report->cycles = gameboy.cycles;
+    report->frames = pacer->frames;
+}
+
+static void speed_report_print(speed_report_t* report, const pacer_t* pacer)
+{
+    const double seconds = (double) (pacing_now() - report->time) / PACING_NANOSECONDS_IN_SECONDS;
+    const double cycles = (double) (gameboy.cycles - report->cycles) / seconds;
+    fprintf(stderr, "speed x%.2f (%.0f cycles/s), %.1f frames/s\n",
+            cycles / GB_CYCLES_PER_S, cycles, (double) (pacer->frames - report->frames) / seconds);
+    speed_report_start(report, pacer);
+}
+
+// ======================================================================
+/**
+ * @brief Changes the speed of the emulation
+ */
+static void set_speed(pacer_t* pacer, unsigned int speed)
+{
+    if(speed == TURBO_UNLIMITED){
+        fprintf(stderr, "turbo: unlimited\n");
+        pacer_set_period(pacer, PACING_UNLIMITED);
+    }
+    else{
+        if(speed == 1){
+            fprintf(stderr, "turbo: off\n");
+        }
+        else{
+            fprintf(stderr, "turbo: x%u\n", speed);
+        }
+        pacer_set_period(pacer, FRAME_NANOSECONDS / speed);
     }
-    struct timeval delta;
-    timersub(&currentTime, from, &delta);//Calculate difference between current time and from
-    
-    return delta.tv_sec * OUR_GB_CYCLES_PER_S +  (delta.tv_usec * OUR_GB_CYCLES_PER_S) / MICROSECONDS_IN_SECONDS;
-    
 }
 
 // ======================================================================
-static void set_grey(guchar* pixels, int row, int col, int width, guchar grey)
+/**
+ * @brief Steps back to the frame before (nothing if there is none left),
+ *        and drops the key events recorded after it
+ */
+static int step_back(void)
 {
-    const size_t i = (size_t) (3 * (row * width + col)); // 3 = RGB
-    pixels[i+2] = pixels[i+1] = pixels[i] = grey;
+    if(rewind_available(&history) == 0){
+        return ERR_NONE;
+    }
+
+    M_EXIT_IF_ERR(rewind_step_back(&history, &gameboy));
+    if(recording){
+        M_EXIT_IF_ERR(movie_truncate(&movie, gameboy.cycles));
+    }
+    atomic_store(&emulated_cycles, gameboy.cycles);
+
+    return ERR_NONE;
 }
 
 // ======================================================================
-static void generate_image(guchar* pixels, int height, int width)
+/**
+ * @brief Emulates the gameboy frame by frame (or steps it back while rewinding),
+ *        at the speed asked for, publishing the frames to display
+ */
+static void* emulation_thread(void* arg)
 {
-    uint64_t cycleNumber = get_time_in_GB_cyles_since(&start);
+    pacer_t* pacer = arg;
+    pacer_restart(pacer);
+
+    unsigned int speed = 0; //index in turbo_speeds
+    uint64_t presented = 0; //time the last frame was published
+    speed_report_t report;
+    speed_report_start(&report, pacer);
 
-    if(gameboy_run_until(&gameboy, cycleNumber)!=ERR_NONE){
-        fprintf(stderr, "Error in gameboy_run_until");
+    while(!atomic_load(&quit)){
+
+        if(atomic_load(&paused)){
+            pacing_sleep(PAUSE_NANOSECONDS);
+            pacer_restart(pacer);
+            speed_report_start(&report, pacer);
+            continue;
+        }
+
+        if(atomic_load(&turbo) != speed){
+            speed = atomic_load(&turbo);
+            set_speed(pacer, turbo_speeds[speed]);
+            speed_report_start(&report, pacer);
+        }
+
+        //In turbo mode, only the frames the display has time to show are rendered
+        const bit_t present = speed == 0 || pacing_now() - presented >= REFRESH_NANOSECONDS;
+        gameboy_set_render_period(&gameboy, present ? LCDC_RENDER_ALL : LCDC_RENDER_OFF);
+
+        pacer_frame_start(pacer);
+        if(atomic_load(&rewinding)){
+            //The state of the frame before comes with its display
+            if(step_back() != ERR_NONE){
+                fprintf(stderr, "Error stepping back\n");
+                break;
+            }
+        }
+        else{
+            //Runs until the end of the current frame
+            const uint64_t frame_end = (gameboy.cycles / FRAME_TOTAL_CYCLES + 1) * FRAME_TOTAL_CYCLES;
+            if(apply_inputs() != ERR_NONE || gameboy_run_until(&gameboy, frame_end) != ERR_NONE){
+                fprintf(stderr, "Error in gameboy_run_until\n");
+                break;
+            }
+            atomic_store(&emulated_cycles, gameboy.cycles);
+            if(rewind_push(&history, &gameboy) != ERR_NONE){
+                fprintf(stderr, "Error keeping the frame to rewind\n");
+                break;
+            }
+        }
+
+        if(present){
+            M_PRINT_IF_ERROR(gameboy_export_frame(&gameboy, triple_buffer_back(&frames), FRAME_STRIDE, IMAGE_RGB, WINDOW_SCALE, NULL), "Error exporting image");
+            M_PRINT_IF_ERROR(triple_buffer_publish(&frames), "Error publishing image");
+            presented = pacing_now();
+        }
+
+        //Waits for the deadline of the next frame
+        pacer_frame_end(pacer);
+        if(pacer->frames % PACING_REPORT_FRAMES == 0){
+            pacer_print(pacer, stderr);
+        }
+        if(speed != 0 && pacing_now() - report.time >= TURBO_REPORT_NANOSECONDS){
+            speed_report_print(&report, pacer);
+        }
     }
-    
-    uint8_t pixelColor=0;
-
-    for(size_t y=0;y<height;++y){
-         for(size_t x=0;x<width;++x){
-             
-             //We only need to recompute the value every WINDOW_SCALE values
-             if(x%WINDOW_SCALE == 0 || y%WINDOW_SCALE == 0){
-                 M_PRINT_IF_ERROR(image_get_pixel(&pixelColor, &(gameboy.screen.display), x/WINDOW_SCALE, y/WINDOW_SCALE), "Error reading image");
-             }
-             set_grey(pixels, y, x, width, GREY_SCALE_CONVERSION(pixelColor));
-         }
+
+    return NULL;
+}
+
+// ======================================================================
+static void generate_image(guchar* pixels, int height, int width)
+{
+    if(width != WINDOW_SCALE*LCD_WIDTH || height != WINDOW_SCALE*LCD_HEIGHT){
+        fprintf(stderr, "Unexpected image size %dx%d\n", width, height);
+        return;
     }
     
+    //Last frame completed by the emulation thread (sidlib images are RGB, without padding between rows)
+    memcpy(pixels, triple_buffer_front(&frames, NULL), FRAME_BYTES);
 }
 
 // ======================================================================
@@ -123,64 +293,65 @@ static gboolean keypress_handler(guint keyval, gpointer data)
             
         case GDK_KEY_Up:{
 			do_key(UP);
-            PRESS_KEY(gameboy,UP);
+            PRESS_KEY(UP);
         }
 
         case GDK_KEY_Down:{
             do_key(DOWN);
-            PRESS_KEY(gameboy,DOWN);
+            PRESS_KEY(DOWN);
         }
 
         case GDK_KEY_Right:{
             do_key(RIGHT);
-            PRESS_KEY(gameboy,RIGHT);
+            PRESS_KEY(RIGHT);
         }
 
         case GDK_KEY_Left:{
             do_key(LEFT);
-            PRESS_KEY(gameboy,LEFT);
+            PRESS_KEY(LEFT);
         }
 
         case 'A':
         case 'a':{
             do_key(A);
-            PRESS_KEY(gameboy,A);
+            PRESS_KEY(A);
         }
             
         case 'S':
         case 's':{
             do_key(B);
-            PRESS_KEY(gameboy,B);
+            PRESS_KEY(B);
         }
         
         case 'O':
         case 'o':{
             do_key(SELECT);
-            PRESS_KEY(gameboy,SELECT);
+            PRESS_KEY(SELECT);
         }
             
         case 'I':
         case 'i':{
             do_key(START);
-            PRESS_KEY(gameboy,START);
+            PRESS_KEY(START);
         }
             
-        //Handle pause
+        //Turbo: next speed
+        case 'T':
+        case 't':{
+            atomic_store(&turbo, (atomic_load(&turbo) + 1) % TURBO_SPEED_COUNT);
+            return TRUE;
+        }
+            
+        //Rewind, while the key is held
+        case 'R':
+        case 'r':{
+            atomic_store(&rewinding, true);
+            return TRUE;
+        }
+            
+        //Handle pause (the timer is not switched yet)
         case GDK_KEY_space:{
-            if( psd->timeout_id>0){
-				if(gettimeofday(&paused, NULL)!=0){
-					fprintf(stderr, "Could not get time of day");
-                }
-            }
-            else {
-                struct timeval currentTime;
-                if(gettimeofday(&currentTime,NULL)!=0){
-                    fprintf(stderr, "Could not get time of day");
-                }
-                
-                timersub(&currentTime, &paused, &paused);//Mesure time spent since paused and store it in store
-                timeradd(&start, &paused, &start);
-            }
+            atomic_store(&paused, psd->timeout_id>0);
         }
     }
 
@@ -205,45 +376,51 @@ static gboolean keyrelease_handler(guint keyval, gpointer data)
     switch(keyval) {
         case GDK_KEY_Up:{
             do_key(UP);
-            RELEASE_KEY(gameboy,UP);
+            RELEASE_KEY(UP);
         }
 
         case GDK_KEY_Down:{
             do_key(DOWN);
-            RELEASE_KEY(gameboy,DOWN);
+            RELEASE_KEY(DOWN);
         }
 
         case GDK_KEY_Right:{
             do_key(RIGHT);
-            RELEASE_KEY(gameboy,RIGHT);
+            RELEASE_KEY(RIGHT);
         }
 
         case GDK_KEY_Left:{
             do_key(LEFT);
-            RELEASE_KEY(gameboy,LEFT);
+            RELEASE_KEY(LEFT);
         }
 
         case 'A':
         case 'a':{
             do_key(A);
-            RELEASE_KEY(gameboy,A);
+            RELEASE_KEY(A);
         }
         case 'S':
         case 's':{
             do_key(B);
-            RELEASE_KEY(gameboy,B);
+            RELEASE_KEY(B);
         }
         
         case 'O':
         case 'o':{
             do_key(SELECT);
-            RELEASE_KEY(gameboy,SELECT);
+            RELEASE_KEY(SELECT);
         }
             
         case 'I':
         case 'i':{
             do_key(START);
-            RELEASE_KEY(gameboy,START);
+            RELEASE_KEY(START);
+        }
+            
+        case 'R':
+        case 'r':{
+            atomic_store(&rewinding, false);
+            return TRUE;
         }
     }
 
@@ -255,23 +432,58 @@ static gboolean keyrelease_handler(guint keyval, gpointer data)
 int main(int argc, char *argv[]){
 
     if (argc < 2) {
-        fprintf(stderr, "please provide input_file");
+        fprintf(stderr, "please provide input_file (and optionally a file to record the inputs as a movie)");
         return 1;
     }
 
     const char* const filename = argv[1];
+    const char* const movie_file = argc > 2 ? argv[2] : NULL;
+    
+    atomic_init(&emulated_cycles, 0);
+    atomic_init(&paused, false);
+    atomic_init(&quit, false);
+    atomic_init(&turbo, 0);
+    atomic_init(&rewinding, false);
+    M_EXIT_IF_ERR(input_queue_init(&inputs));
+    M_EXIT_IF_ERR(triple_buffer_create(&frames, FRAME_BYTES));
+    M_EXIT_IF_ERR_DO_SOMETHING(gameboy_create(&gameboy, filename, GB_ACCURACY_CYCLE), triple_buffer_free(&frames));//gameboy is already freed when there is an error
+    recording = movie_file != NULL;
+    if(recording){
+        M_EXIT_IF_ERR_DO_SOMETHING(movie_init(&movie), gameboy_free(&gameboy); triple_buffer_free(&frames));
+    }
     
-    gettimeofday(&start, NULL);//Initialize start with current time at beginning of simulation
-    timerclear(&paused);//Reset pause to EPOCH
+    M_EXIT_IF_ERR_DO_SOMETHING(rewind_create(&history, REWIND_FRAMES, REWIND_KEYFRAME_PERIOD, REWIND_BUDGET), movie_free(&movie); gameboy_free(&gameboy); triple_buffer_free(&frames));
     
-    M_EXIT_IF_ERR(gameboy_create(&gameboy, filename));//gameboy is already freed when there is an error
+    pacer_t pacer;
+    M_EXIT_IF_ERR_DO_SOMETHING(pacer_init(&pacer, FRAME_NANOSECONDS, PACING_DEFAULT_CATCH_UP), rewind_free(&history); movie_free(&movie); gameboy_free(&gameboy); triple_buffer_free(&frames));
+    
+    pthread_t emulation;
+    if(pthread_create(&emulation, NULL, emulation_thread, &pacer) != 0){
+        fprintf(stderr, "Could not start emulation\n");
+        rewind_free(&history);
+        movie_free(&movie);
+        gameboy_free(&gameboy);
+        triple_buffer_free(&frames);
+        return 1;
+    }
         
     sd_launch(&argc, &argv,
               sd_init(filename, WINDOW_SCALE*LCD_WIDTH, WINDOW_SCALE*LCD_HEIGHT, REFRESH_TIME,
                       generate_image, keypress_handler, keyrelease_handler));
     
+    atomic_store(&quit, true);
+    pthread_join(emulation, NULL);
+    pacer_print(&pacer, stderr);
+    gameboy_profile_print(&gameboy, stderr); //nothing without -DPROFILE
     
+    if(recording){
+        M_PRINT_IF_ERROR(movie_save(&movie, movie_file), "Error saving the movie");
+        fprintf(stderr, "%zu key events recorded in %s\n", movie.size, movie_file);
+        movie_free(&movie);
+    }
+    rewind_free(&history);
     gameboy_free(&gameboy);
+    triple_buffer_free(&frames);
     
     return 0;
 }
@@ -0,0 +1,208 @@
+/**
+ * @file gbtrace.c
+ * @brief Instruction traces: records the trace of a ROM, finds the first instruction where two traces diverge
+ *
+ * @date 2021
+ */
+
+#include "gameboy.h"
+#include "movie.h"
+#include "trace.h"
+#include "pacing.h"
+#include "util.h"  // for zero_init_var()
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // for PRIu64
+
+#define GBTRACE_DEFAULT_FRAMES 60
+#define GBTRACE_DEFAULT_COUNT 20
+
+// ======================================================================
+static void usage(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s record rom.gb trace.gbt [--frames N] [--movie file] [--compress]\n", pgm);
+    fprintf(stderr, "          %s diff first.gbt second.gbt\n", pgm);
+    fprintf(stderr, "          %s dump trace.gbt [--from N] [--count N]\n", pgm);
+    fprintf(stderr, "          (%d frames recorded, %d instructions dumped by default)\n",
+            GBTRACE_DEFAULT_FRAMES, GBTRACE_DEFAULT_COUNT);
+    fprintf(stderr, "examples: %s record tetris.gb good.gbt --frames 600 --compress\n", pgm);
+    fprintf(stderr, "          %s diff good.gbt bad.gbt   (exits with 1 if they diverge)\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Reads the value of option i (ERR_BAD_PARAMETER if it has none)
+ */
+static int option_value(int argc, char* argv[], int* i, uint64_t* value)
+{
+    M_REQUIRE(*i + 1 < argc, ERR_BAD_PARAMETER, "missing value of option %s", argv[*i]);
+    ++*i;
+    *value = strtoull(argv[*i], NULL, 10);
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Records the trace of the first frames of a ROM
+ */
+static int record(int argc, char* argv[])
+{
+    M_REQUIRE(argc >= 4, ERR_BAD_PARAMETER, "record needs a ROM and a trace%s", "");
+    const char* const rom = argv[2];
+    const char* const filename = argv[3];
+    uint64_t frames = GBTRACE_DEFAULT_FRAMES;
+    const char* movie_file = NULL;
+    bit_t compress = 0;
+    for (int i = 4; i < argc; ++i) {
+        if (!strcmp(argv[i], "--frames")) {
+            M_EXIT_IF_ERR(option_value(argc, argv, &i, &frames));
+        } else if (!strcmp(argv[i], "--movie") && i + 1 < argc) {
+            movie_file = argv[++i];
+        } else if (!strcmp(argv[i], "--compress")) {
+            compress = 1;
+        } else {
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", argv[i]);
+        }
+    }
+
+    gameboy_t gb;
+    zero_init_var(gb);
+    movie_t movie;
+    zero_init_var(movie);
+    trace_t trace;
+    zero_init_var(trace);
+
+    int err = gameboy_create(&gb, rom, GB_ACCURACY_CYCLE);
+    if (err == ERR_NONE) err = gameboy_set_render_period(&gb, LCDC_RENDER_OFF);
+    if (err == ERR_NONE && movie_file != NULL) {
+        err = movie_load(&movie, movie_file);
+        if (err == ERR_NONE) err = gameboy_set_movie(&gb, &movie);
+    }
+    if (err == ERR_NONE) {
+        err = trace_open(&trace, filename, compress);
+        if (err == ERR_NONE) {
+            err = gameboy_set_trace(&gb, &trace);
+            const uint64_t start = pacing_now();
+            if (err == ERR_NONE) err = gameboy_run_until(&gb, frames * FRAME_TOTAL_CYCLES);
+            const int close_err = trace_close(&trace);
+            if (err == ERR_NONE) err = close_err;
+            const double seconds = (double) (pacing_now() - start) / PACING_NANOSECONDS_IN_SECONDS;
+            if (err == ERR_NONE) {
+                printf("%s: %" PRIu64 " instructions in %" PRIu64 " bytes (%.2f bytes per instruction), %.3f s,"
+                       " %" PRIu64 " waits for the writer\n", filename, trace.entries, trace.bytes,
+                       trace.entries > 0 ? (double) trace.bytes / (double) trace.entries : 0, seconds, trace.waits);
+            }
+        }
+    }
+
+    movie_free(&movie);
+    gameboy_free(&gb);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Prints the first divergence of two traces
+ */
+static int diff(int argc, char* argv[], bit_t* diverged)
+{
+    M_REQUIRE(argc == 4, ERR_BAD_PARAMETER, "diff needs two traces%s", "");
+
+    trace_reader_t first;
+    trace_reader_t second;
+    M_EXIT_IF_ERR(trace_reader_open(&first, argv[2]));
+    M_EXIT_IF_ERR_DO_SOMETHING(trace_reader_open(&second, argv[3]), trace_reader_close(&first));
+
+    trace_divergence_t divergence;
+    const int err = trace_diff(&first, &second, &divergence);
+    trace_reader_close(&first);
+    trace_reader_close(&second);
+    M_EXIT_IF_ERR(err);
+
+    *diverged = divergence.diverged;
+    if (!divergence.diverged) {
+        printf("identical traces (%" PRIu64 " instructions)\n", divergence.index);
+        return ERR_NONE;
+    }
+
+    printf("traces diverge at instruction %" PRIu64 "\n", divergence.index);
+    if (divergence.has_common) {
+        printf("last common: ");
+        trace_entry_print(stdout, &divergence.common);
+    }
+    const char* const names[2] = { argv[2], argv[3] };
+    const bit_t ended[2] = { divergence.first_ended, divergence.second_ended };
+    const trace_entry_t* const entries[2] = { &divergence.first, &divergence.second };
+    for (size_t i = 0; i < 2; ++i) {
+        printf("%s: ", names[i]);
+        if (ended[i]) {
+            printf("end of the trace\n");
+        } else {
+            trace_entry_print(stdout, entries[i]);
+        }
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Prints some instructions of a trace
+ */
+static int dump(int argc, char* argv[])
+{
+    M_REQUIRE(argc >= 3, ERR_BAD_PARAMETER, "dump needs a trace%s", "");
+    uint64_t from = 0;
+    uint64_t count = GBTRACE_DEFAULT_COUNT;
+    for (int i = 3; i < argc; ++i) {
+        if (!strcmp(argv[i], "--from")) {
+            M_EXIT_IF_ERR(option_value(argc, argv, &i, &from));
+        } else if (!strcmp(argv[i], "--count")) {
+            M_EXIT_IF_ERR(option_value(argc, argv, &i, &count));
+        } else {
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", argv[i]);
+        }
+    }
+
+    trace_reader_t reader;
+    M_EXIT_IF_ERR(trace_reader_open(&reader, argv[2]));
+    int err = ERR_NONE;
+    bit_t end = 0;
+    for (uint64_t i = 0; err == ERR_NONE && !end && i < from + count; ++i) {
+        trace_entry_t entry;
+        err = trace_reader_next(&reader, &entry, &end);
+        if (err == ERR_NONE && !end && i >= from) {
+            printf("%" PRIu64 ": ", i);
+            trace_entry_print(stdout, &entry);
+        }
+    }
+    trace_reader_close(&reader);
+
+    return err;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    int err = ERR_BAD_PARAMETER;
+    bit_t diverged = 0;
+    if (argc >= 2 && !strcmp(argv[1], "record")) {
+        err = record(argc, argv);
+    } else if (argc >= 2 && !strcmp(argv[1], "diff")) {
+        err = diff(argc, argv, &diverged);
+    } else if (argc >= 2 && !strcmp(argv[1], "dump")) {
+        err = dump(argc, argv);
+    }
+
+    if (err == ERR_BAD_PARAMETER) {
+        usage(argv[0], "bad arguments");
+    } else if (err != ERR_NONE) {
+        fprintf(stderr, "error: %s\n", ERR_MESSAGES[err - ERR_NONE]);
+    }
+
+    return err != ERR_NONE ? err : diverged;
+}
@@ -114,87 +114,62 @@ int image_line_extract_wrap_ext(image_line_t* output, image_line_t iml, int64_t
     return valid(output);
 }
 
+// ======================================================================
+#define palette_bit(map, color, bit) \
+    ((((map) >> (2 * (color) + (bit))) & 1) ? UINT32_MAX : 0)
+
 // ======================================================================
 int image_line_map_colors(image_line_t* output, image_line_t iml, palette_t map)
 {
     M_REQUIRE_NON_NULL(output);
     M_REQUIRE_NON_NULL_IMAGE_LINE(iml);
+    M_REQUIRE((iml.msb->size == iml.lsb->size), ERR_BAD_PARAMETER,
+              "Incorrect sizes in image_line (%zu, %zu)", iml.lsb->size, iml.msb->size);
 
-    if (map == DEFAULT_PALETTE) {
 #define do_imlc(I, X) \
-        I->X = bit_vector_cpy(iml.X)
+    I->X = bit_vector_cpy(iml.X)
 
-        do_image_line(output);
+    do_image_line(output);
 #undef do_imlc
-        return ERR_NONE;
-    }
-
-    output->lsb = bit_vector_create(iml.lsb->size, 0);
-    output->msb = bit_vector_create(iml.msb->size, 0);
-    output->opacity = bit_vector_cpy(iml.opacity);
-
-    for (size_t i = 0; i < PALETTE_COLOR_COUNT; ++i) {
-        bit_vector_t* mask = NULL;
-
-        const bit_t color_bit_0 = (bit_t) (map & (1 << (i * 2    )));
-        const bit_t color_bit_1 = (bit_t) (map & (1 << (i * 2 + 1)));
-
-        if (color_bit_0 || color_bit_1) {
-            switch (i) {
-            case 0: {
-                bit_vector_t* tmp = bit_vector_not(bit_vector_cpy(iml.lsb));
-
-                if (tmp == NULL) {
-                    image_line_free(output);
-                    return ERR_MEM;
-                }
-
-                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), tmp);
-                bit_vector_free(&tmp);
-            } break;
-
-            case 1: {
-                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), iml.lsb);
-            } break;
-
-            case 2: {
-                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.lsb)), iml.msb);
-            } break;
-
-            case 3: {
-                mask = bit_vector_and(bit_vector_cpy(iml.lsb), iml.msb);
-            } break;
-            }
 
-            if (mask == NULL) {
-                image_line_free(output);
-                return ERR_MEM;
-            }
-
-            if (color_bit_0) {
-                output->lsb = bit_vector_or(output->lsb, mask);
-
-                if (output->lsb == NULL) {
-                    image_line_free(output);
-                    return ERR_MEM;
-                }
-            }
-
-            if (color_bit_1) {
-                output->msb = bit_vector_or(output->msb, mask);
+    const int error = valid(output);
+    if (error != ERR_NONE || map == DEFAULT_PALETTE) {
+        return error;
+    }
 
-                if (output->msb == NULL) {
-                    image_line_free(output);
-                    return ERR_MEM;
-                }
-            }
+    // Bit-sliced mapping: each new plane is the union of the masks of the colours
+    // whose palette entry has that bit set (all ones or all zeros per colour).
+    const uint32_t lsb_of[PALETTE_COLOR_COUNT] = {
+        palette_bit(map, 0, 0), palette_bit(map, 1, 0), palette_bit(map, 2, 0), palette_bit(map, 3, 0)
+    };
+    const uint32_t msb_of[PALETTE_COLOR_COUNT] = {
+        palette_bit(map, 0, 1), palette_bit(map, 1, 1), palette_bit(map, 2, 1), palette_bit(map, 3, 1)
+    };
+
+    const size_t words = size_to_content_size(iml.msb->size);
+    for (size_t i = 0; i < words; ++i) {
+        const uint32_t m = iml.msb->content[i];
+        const uint32_t l = iml.lsb->content[i];
+        const uint32_t color0 = ~m & ~l;
+        const uint32_t color1 = ~m &  l;
+        const uint32_t color2 =  m & ~l;
+        const uint32_t color3 =  m &  l;
+
+        output->lsb->content[i] = (color0 & lsb_of[0]) | (color1 & lsb_of[1]) | (color2 & lsb_of[2]) | (color3 & lsb_of[3]);
+        output->msb->content[i] = (color0 & msb_of[0]) | (color1 & msb_of[1]) | (color2 & msb_of[2]) | (color3 & msb_of[3]);
+    }
 
-            bit_vector_free(&mask);
-        }
+    // colour 0 also sets the unused bits of the last word: clear them again
+    const size_t used_bits = iml.msb->size % IMAGE_LINE_WORD_BITS;
+    if (used_bits != 0) {
+        const uint32_t mask = (UINT32_C(1) << used_bits) - 1;
+        output->lsb->content[words - 1] &= mask;
+        output->msb->content[words - 1] &= mask;
     }
 
     return ERR_NONE;
 }
+#undef palette_bit
 
 // ======================================================================
 int image_line_below_with_opacity(image_line_t* output, image_line_t iml1, image_line_t iml2, bit_vector_t* p_opacity)
@@ -345,6 +320,109 @@ int image_get_pixel(uint8_t* output, image_t* pim, size_t x, size_t y)
     return ERR_NONE;
 }
 
+// ======================================================================
+#define EXPORT_RED(color)   ((uint8_t) ((color) >> 16))
+#define EXPORT_GREEN(color) ((uint8_t) ((color) >> 8))
+#define EXPORT_BLUE(color)  ((uint8_t) (color))
+#define EXPORT_OPAQUE 0xFF
+#define EXPORT_RUN_MAX (IMAGE_RGBA * IMAGE_EXPORT_MAX_SCALE)
+
+int image_export(const image_t* pim, uint8_t* pixels, size_t stride, image_format_t format,
+                 unsigned int scale, const uint32_t colors[PALETTE_COLOR_COUNT])
+{
+    M_REQUIRE_NON_NULL(pim);
+    M_REQUIRE_NON_NULL(pim->content);
+    M_REQUIRE_NON_NULL(pixels);
+    M_REQUIRE(format == IMAGE_GREY || format == IMAGE_RGB || format == IMAGE_RGBA, ERR_BAD_PARAMETER, "Invalid format %d", format);
+    M_REQUIRE(scale >= 1 && scale <= IMAGE_EXPORT_MAX_SCALE, ERR_BAD_PARAMETER, "Invalid scale %u", scale);
+
+    static const uint32_t greys[PALETTE_COLOR_COUNT] = IMAGE_EXPORT_GREYS;
+    if (colors == NULL) colors = greys;
+
+    // each color, already repeated scale times
+    const size_t run = (size_t) format * scale;
+    uint8_t runs[PALETTE_COLOR_COUNT][EXPORT_RUN_MAX] = { { 0 } };
+    for (size_t c = 0; c < PALETTE_COLOR_COUNT; ++c) {
+        const uint8_t r = EXPORT_RED(colors[c]), g = EXPORT_GREEN(colors[c]), b = EXPORT_BLUE(colors[c]);
+        const uint8_t pixel[IMAGE_RGBA] = { r, g, b, EXPORT_OPAQUE };
+        // luminance (ITU-R BT.601), exact for greys
+        const uint8_t grey = (uint8_t) ((77 * r + 150 * g + 29 * b) >> 8);
+        for (size_t k = 0; k < scale; ++k) {
+            memcpy(runs[c] + k * (size_t) format, format == IMAGE_GREY ? &grey : pixel, (size_t) format);
+        }
+    }
+
+    for (size_t y = 0; y < pim->height; ++y) {
+        M_REQUIRE_NON_NULL_IMAGE_LINE(pim->content[y]);
+        const bit_vector_t* msb = pim->content[y].msb;
+        const bit_vector_t* lsb = pim->content[y].lsb;
+        M_REQUIRE(stride >= msb->size * run, ERR_BAD_PARAMETER, "Stride %zu is too small", stride);
+
+        uint8_t* const row = pixels + y * scale * stride;
+        uint8_t* out = row;
+        // far enough from the end of the row, EXPORT_RUN_MAX bytes are copied (a single vector store),
+        // the bytes after the pixel being overwritten by the next pixels
+        const size_t whole = msb->size > EXPORT_RUN_MAX ? msb->size - EXPORT_RUN_MAX : 0;
+        uint32_t m = 0, l = 0;
+        for (size_t x = 0; x < msb->size; ++x) {
+            if (x % IMAGE_LINE_WORD_BITS == 0) {
+                m = msb->content[index_to_content_index(x)];
+                l = lsb->content[index_to_content_index(x)];
+            }
+            const uint8_t* color = runs[(m & 1) << 1 | (l & 1)];
+            if (x < whole) {
+                memcpy(out, color, EXPORT_RUN_MAX);
+            } else {
+                memcpy(out, color, run);
+            }
+            out += run;
+            m >>= 1;
+            l >>= 1;
+        }
+
+        // the other rows of the pixel are the same
+        for (size_t k = 1; k < scale; ++k) {
+            memcpy(row + k * stride, row, msb->size * run);
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+#define FNV_OFFSET_BASIS UINT64_C(14695981039346656037)
+#define FNV_PRIME        UINT64_C(1099511628211)
+
+/**
+ * @brief Adds the bytes of the words of a bit vector to a FNV-1a hash (in the same order on every host)
+ */
+static uint64_t hash_bit_vector(uint64_t hash, const bit_vector_t* pbv)
+{
+    for (size_t i = 0; i < size_to_content_size(pbv->size); ++i) {
+        for (size_t byte = 0; byte < sizeof(uint32_t); ++byte) {
+            hash = (hash ^ ((pbv->content[i] >> (8 * byte)) & 0xFF)) * FNV_PRIME;
+        }
+    }
+    return hash;
+}
+
+int image_hash(const image_t* pim, uint64_t* hash)
+{
+    M_REQUIRE_NON_NULL(pim);
+    M_REQUIRE_NON_NULL(pim->content);
+    M_REQUIRE_NON_NULL(hash);
+
+    uint64_t h = FNV_OFFSET_BASIS;
+    for (size_t y = 0; y < pim->height; ++y) {
+        M_REQUIRE_NON_NULL_IMAGE_LINE(pim->content[y]);
+        h = hash_bit_vector(h, pim->content[y].msb);
+        h = hash_bit_vector(h, pim->content[y].lsb);
+    }
+    *hash = h;
+
+    return ERR_NONE;
+}
+
 // ======================================================================
 int image_own_line_content(image_t* pim, size_t y, image_line_t line)
 {
@@ -354,6 +432,13 @@ int image_own_line_content(image_t* pim, size_t y, image_line_t line)
     M_REQUIRE_NON_NULL_IMAGE_LINE(line);
     M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(pim->content[y], line);
 
+    // Lines built from the arena do not survive its reset: keep our own vectors and copy the values
+    if (bit_vector_in_arena(line.msb) || bit_vector_in_arena(line.lsb) || bit_vector_in_arena(line.opacity)) {
+        const int error = image_set_line(pim, y, line);
+        image_line_free(&line);
+        return error;
+    }
+
 #define do_imlc(I, X) \
     bit_vector_free(&(I->content[y].X)); \
     I->content[y].X = line.X
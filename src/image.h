@@ -36,6 +36,21 @@ typedef struct image_line_ image_line_t;
 
 #define IMAGE_LINE_WORD_BITS 32
 
+//=========================================================================
+/**
+ * @brief Pixel formats of exported images (the value is the number of bytes per pixel)
+ */
+typedef enum {
+    IMAGE_GREY = 1,
+    IMAGE_RGB  = 3,
+    IMAGE_RGBA = 4
+} image_format_t;
+
+#define IMAGE_EXPORT_MAX_SCALE 4
+
+// Colors (0xRRGGBB) of the exported pixels, from color 0 to color 3
+#define IMAGE_EXPORT_GREYS { 0xFFFFFF, 0xAAAAAA, 0x555555, 0x000000 }
+
 
 //=========================================================================
 /**
@@ -178,6 +193,29 @@ int image_get_pixel(uint8_t* output, image_t* pim, size_t x, size_t y);
  */
 int image_own_line_content(image_t* pim, size_t y, image_line_t line);
 
+//=========================================================================
+/**
+ * @brief Converts a whole image to pixels in one pass, each pixel repeated scale times in both directions
+ * @param pim pointer to image
+ * @param pixels buffer of at least height * scale rows
+ * @param stride bytes between the start of two rows of pixels (at least width * scale * format)
+ * @param format pixel format (IMAGE_GREY uses the luminance of the colors)
+ * @param scale integer scale factor, from 1 to IMAGE_EXPORT_MAX_SCALE
+ * @param colors colors (0xRRGGBB) of the 4 pixel values, NULL for IMAGE_EXPORT_GREYS
+ * @return Error code
+ */
+int image_export(const image_t* pim, uint8_t* pixels, size_t stride, image_format_t format,
+                 unsigned int scale, const uint32_t colors[PALETTE_COLOR_COUNT]);
+
+//=========================================================================
+/**
+ * @brief Hash of the pixels of an image (FNV-1a), to compare frames quickly
+ * @param pim pointer to image
+ * @param hash (output) the hash
+ * @return Error code
+ */
+int image_hash(const image_t* pim, uint64_t* hash);
+
 //=========================================================================
 /**
  * @brief Free image
@@ -0,0 +1,52 @@
+#include "input_queue.h"
+#include "error.h"
+#include "util.h"
+
+#define INPUT_QUEUE_INDEX(count) ((count) & (INPUT_QUEUE_SIZE - 1))
+
+int input_queue_init(input_queue_t* queue){
+
+    M_REQUIRE_NON_NULL(queue);
+
+    zero_init_var(queue->events);
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+
+    return ERR_NONE;
+}
+
+int input_queue_push(input_queue_t* queue, input_event_t event){
+
+    M_REQUIRE_NON_NULL(queue);
+
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if(tail - head == INPUT_QUEUE_SIZE){
+        return ERR_MEM;
+    }
+
+    queue->events[INPUT_QUEUE_INDEX(tail)] = event;
+    //Release: the event is written before the consumer sees it
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    return ERR_NONE;
+}
+
+int input_queue_pop(input_queue_t* queue, input_event_t* event){
+
+    if(queue == NULL || event == NULL){
+        return 0;
+    }
+
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if(head == tail){
+        return 0;
+    }
+
+    *event = queue->events[INPUT_QUEUE_INDEX(head)];
+    //Release: the slot is read before the producer writes it again
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return 1;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+/**
+ * @file input_queue.h
+ * @brief Lock-free single producer, single consumer queue of joypad events
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+#include <stdatomic.h>//atomic_size_t
+
+#include "bit.h"//bit_t
+#include "joypad.h"//gb_key_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Capacity of the queue (a power of 2)
+ */
+#define INPUT_QUEUE_SIZE 64
+
+/**
+ * @brief Joypad event, timestamped in guest cycles
+ */
+typedef struct {
+    uint64_t cycle; //cycle of the gameboy at which the event happens
+    gb_key_t key;
+    bit_t pressed; //1 if the key is pressed, 0 if it is released
+} input_event_t;
+
+/**
+ * @brief Input queue data structure.
+ *        Only one thread pushes and only one thread pops.
+ */
+typedef struct {
+    input_event_t events[INPUT_QUEUE_SIZE];
+    atomic_size_t head; //number of events popped
+    atomic_size_t tail; //number of events pushed
+} input_queue_t;
+
+/**
+ * @brief Initializes an empty input queue
+ *
+ * @param queue queue to initialize
+ * @return error code
+ */
+int input_queue_init(input_queue_t* queue);
+
+/**
+ * @brief Adds an event at the end of the queue (producer only)
+ *
+ * @param queue the queue
+ * @param event the event
+ * @return error code (ERR_MEM if the queue is full, in which case the event is dropped)
+ */
+int input_queue_push(input_queue_t* queue, input_event_t event);
+
+/**
+ * @brief Removes the first event of the queue (consumer only)
+ *
+ * @param queue the queue
+ * @param event (output) the event
+ * @return 1 if an event was removed, 0 if the queue is empty (or a parameter is NULL)
+ */
+int input_queue_pop(input_queue_t* queue, input_event_t* event);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,930 @@
+#include <stdlib.h>//qsort
+#include <inttypes.h>//PRIu64
+#include <string.h>//memcmp
+#include "lcdc.h"
+#include "gameboy.h"
+#include "error.h"
+#include "util.h"
+#include "bus.h"
+#include "bit.h"
+#include "cpu.h"
+#include "cpu-storage.h"
+#include "memory.h"
+#include "image.h"
+#include "bit_vector.h"
+
+/**
+ * @brief Modes of the LCD controler (written in the 2 lowest bits of STAT)
+ */
+#define MODE_H_BLANK 0
+#define MODE_V_BLANK 1
+#define MODE_OAM     2
+#define MODE_DRAW    3
+
+/**
+ * @brief Bit of STAT enabling the LCD_STAT interrupt when entering mode m (only for modes 0 to 2)
+ */
+#define STAT_REG_INT_MODE_BIT(m) ((m) + 3)
+
+/**
+ * @brief Value of next_cycle while the screen is off
+ */
+#define LCDC_OFF_CYCLE ((uint64_t) -1)
+
+/**
+ * @brief Tile numbers are signed when the tiles come from TILE_SRC_ADDR_HIGH
+ */
+#define TILE_INDEX_OFFSET_HIGH 0x80
+
+// Sprite attributes
+
+#define SPRITE_Y_INDEX    0
+#define SPRITE_X_INDEX    1
+#define SPRITE_TILE_INDEX 2
+#define SPRITE_ATTR_INDEX 3
+
+#define SPRITE_ATTR_BEHIND_MASK  0x80
+#define SPRITE_ATTR_Y_FLIP_MASK  0x40
+#define SPRITE_ATTR_X_FLIP_MASK  0x20
+#define SPRITE_ATTR_PALETTE_MASK 0x10
+
+/**
+ * @brief Reads a byte of the bus
+ */
+#define READ(lcd, addr) cpu_read_at_idx((lcd)->cpu, addr)
+
+/**
+ * @brief Reads a byte of the attributes of a sprite in OAM
+ */
+#define SPRITE_READ(lcd, sprite, index) READ(lcd, GRAPH_RAM_START + (sprite) * SPRITE_SIZE + (index))
+
+static int lcdc_next(lcdc_t* lcd, uint64_t cycle);
+static void lcdc_oam_written(lcdc_t* lcd, addr_t addr);
+static int lcdc_DMA_step(lcdc_t* lcd);
+static int lcdc_DMA_copy(lcdc_t* lcd);
+static int lcdc_draw_line(lcdc_t* lcd, data_t ly);
+static int lcdc_draw_frame(lcdc_t* lcd, data_t count);
+static int lcdc_build_line(lcdc_t* lcd, image_line_t* output, data_t ly);
+
+// ======================================================================
+int lcdc_init(gameboy_t* gb){
+
+    M_REQUIRE_NON_NULL(gb);
+
+    lcdc_t* lcd = &gb->screen;
+    zero_init_ptr(lcd);
+
+    lcd->cpu = &gb->cpu;
+    lcd->on = (READ(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK) != 0;
+    lcd->next_cycle = LCDC_OFF_CYCLE;
+    lcd->on_cycle = lcd->on ? 0 : LCDC_OFF_CYCLE;
+    //No DMA pending
+    lcd->DMA_to = GRAPH_RAM_END + 1;
+    lcd->render_period = LCDC_RENDER_ALL;
+
+    M_EXIT_IF_ERR(image_create(&lcd->display, LCD_WIDTH, LCD_HEIGHT));
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+void lcdc_free(lcdc_t* lcd){
+    if(lcd != NULL){
+        image_free(&lcd->display);
+    }
+}
+
+// ======================================================================
+int lcdc_plug(lcdc_t* lcd, bus_t bus){
+
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE_NON_NULL(bus);
+
+    //Registers are in the REGISTERS component of the gameboy, nothing to plug
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writes a register of the LCD controler
+ *        (directly on the bus, so that it is not seen by the bus listeners)
+ */
+static int lcdc_write(lcdc_t* lcd, addr_t addr, data_t data){
+    dirty_mark(&lcd->cpu->dirty, addr);
+    return bus_write(*(lcd->cpu->bus), addr, data);
+}
+
+/**
+ * @brief Writes the mode in STAT and requests the LCD_STAT interrupt if it is enabled for this mode
+ */
+static int lcdc_set_mode(lcdc_t* lcd, data_t mode){
+
+    data_t stat = READ(lcd, REG_STAT);
+    stat = (data_t)((stat & ~STAT_REG_MODE_MASK) | (mode & STAT_REG_MODE_MASK));
+    M_EXIT_IF_ERR(lcdc_write(lcd, REG_STAT, stat));
+
+    if(mode <= MODE_OAM && bit_get(stat, STAT_REG_INT_MODE_BIT(mode))){
+        cpu_request_interrupt(lcd->cpu, LCD_STAT);
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Updates the LYC=LY bit of STAT and requests the LCD_STAT interrupt if they are equal and it is enabled
+ */
+static int lcdc_update_lyc(lcdc_t* lcd){
+
+    const bit_t equal = READ(lcd, REG_LY) == READ(lcd, REG_LYC);
+    data_t stat = READ(lcd, REG_STAT);
+    bit_edit(&stat, STAT_REG_LYC_EQ_LY_BIT, equal);
+    M_EXIT_IF_ERR(lcdc_write(lcd, REG_STAT, stat));
+
+    if(equal && bit_get(stat, STAT_REG_INT_LYC_BIT)){
+        cpu_request_interrupt(lcd->cpu, LCD_STAT);
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writes LY and updates STAT accordingly
+ */
+static int lcdc_set_ly(lcdc_t* lcd, data_t ly){
+
+    M_EXIT_IF_ERR(lcdc_write(lcd, REG_LY, ly));
+    return lcdc_update_lyc(lcd);
+}
+
+// ======================================================================
+int lcdc_cycle(lcdc_t* lcd, uint64_t cycle){
+
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE(cycle <= lcd->next_cycle, ERR_BAD_PARAMETER, "Cycle %" PRIu64 " is after the next lcdc cycle (%" PRIu64 ")", cycle, lcd->next_cycle);
+    lcd->cycle = cycle;
+
+    //OAM DMA: one byte per cycle
+    if(lcd->DMA_to <= GRAPH_RAM_END){
+        M_EXIT_IF_ERR(lcdc_DMA_step(lcd));
+    }
+
+    if(cycle == lcd->next_cycle){
+        M_EXIT_IF_ERR(lcdc_next(lcd, cycle));
+    }
+    else if(lcd->next_cycle == LCDC_OFF_CYCLE && (READ(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK)){
+        //The screen has just been switched on
+        lcd->on_cycle = cycle;
+        lcd->next_cycle = cycle;
+        M_EXIT_IF_ERR(lcdc_next(lcd, cycle));
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Handles the event the LCD controler is waiting for (start of one of the modes of a line)
+ *
+ * @param lcd LCD controler
+ * @param cycle current cycle (equal to next_cycle)
+ * @return error code
+ */
+static int lcdc_next(lcdc_t* lcd, uint64_t cycle){
+
+    const uint64_t frame_cycle = (cycle - lcd->on_cycle) % FRAME_TOTAL_CYCLES;
+    if(frame_cycle == 0){
+        lcd->window_y = 0;
+        ++lcd->frames;
+    }
+
+    const data_t ly = (data_t)(frame_cycle / LINE_TOTAL_CYCLES);
+    const uint64_t line_cycle = frame_cycle % LINE_TOTAL_CYCLES;
+
+    //VBlank lines
+    if(ly >= LCD_HEIGHT){
+        M_REQUIRE(line_cycle == 0, ERR_BAD_PARAMETER, "Cycle %" PRIu64 " of a VBlank line", line_cycle);
+
+        if(ly == LCD_HEIGHT){
+            if(lcd->scanline){
+                M_EXIT_IF_ERR(lcdc_draw_frame(lcd, LCD_HEIGHT));
+            }
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, MODE_V_BLANK));
+            cpu_request_interrupt(lcd->cpu, VBLANK);
+        }
+        M_EXIT_IF_ERR(lcdc_set_ly(lcd, ly));
+        lcd->next_cycle += LINE_TOTAL_CYCLES;
+
+        return ERR_NONE;
+    }
+
+    switch(line_cycle){
+        case LINE_MODE_2_START_CYCLE:{
+            M_EXIT_IF_ERR(lcdc_set_ly(lcd, ly));
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, MODE_OAM));
+            lcd->next_cycle += LINE_MODE_2_CYCLES;
+        }break;
+
+        case LINE_MODE_3_START_CYCLE:{
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, MODE_DRAW));
+            if(lcd->scanline){
+                //The line is drawn with the others at VBlank, with the registers it has now
+                for(addr_t i = 0; i < LCDC_LINE_REGS; ++i){
+                    lcd->line_regs[ly][i] = READ(lcd, REG_LCDC + i);
+                }
+            }
+            else{
+                M_EXIT_IF_ERR(lcdc_draw_line(lcd, ly));
+            }
+            lcd->next_cycle += LINE_MODE_3_CYCLES;
+        }break;
+
+        case LINE_MODE_0_START_CYCLE:{
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, MODE_H_BLANK));
+            lcd->next_cycle += LINE_MODE_0_CYCLES;
+        }break;
+
+        default:
+            M_EXIT_ERR(ERR_BAD_PARAMETER, "Cycle %" PRIu64 " is not the start of a mode", line_cycle);
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Updates the tile cache and the versions of the memory after a byte was written
+ *
+ * @param lcd LCD controler
+ * @param addr address of the byte
+ */
+static void lcdc_memory_written(lcdc_t* lcd, addr_t addr){
+
+    if(addr >= TILE_DATA_START && addr <= TILE_DATA_END){
+        const size_t tile = (size_t)(addr - TILE_DATA_START) / TILE_SIZE;
+        if(lcd->tiles.valid[tile]){
+            lcd->tiles.valid[tile] = 0;
+            ++lcd->tiles.invalidations;
+        }
+        ++lcd->lines.tiles_version;
+    }
+    else if(addr >= TILE_ADDR_BASE_LOW && addr <= TILE_MAP_END){
+        ++lcd->lines.map_versions[(addr - TILE_ADDR_BASE_LOW) / TILE_LINE_SIZE];
+    }
+    else if(addr >= GRAPH_RAM_START && addr <= GRAPH_RAM_END){
+        ++lcd->lines.oam_version;
+        lcdc_oam_written(lcd, addr);
+    }
+}
+
+/**
+ * @brief Copies one byte of an OAM DMA, from DMA_from to DMA_to, and advances both
+ *
+ * @param lcd LCD controler
+ * @return error code
+ */
+static int lcdc_DMA_step(lcdc_t* lcd){
+
+    const data_t data = READ(lcd, lcd->DMA_from);
+    //Most DMAs copy the same sprites again
+    const bit_t changed = READ(lcd, lcd->DMA_to) != data;
+    M_EXIT_IF_ERR(lcdc_write(lcd, lcd->DMA_to, data));
+    if(changed){
+        ++lcd->lines.oam_version;
+        lcdc_oam_written(lcd, lcd->DMA_to);
+    }
+    ++lcd->DMA_from;
+    ++lcd->DMA_to;
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Copies a whole OAM DMA at once, from DMA_from
+ *
+ * @param lcd LCD controler
+ * @return error code
+ */
+static int lcdc_DMA_copy(lcdc_t* lcd){
+
+    bus_t* bus = lcd->cpu->bus;
+    const data_t* from = (*bus)[lcd->DMA_from];
+    data_t* to = (*bus)[GRAPH_RAM_START];
+
+    //Components are contiguous in memory, but the source page might span several of them
+    if(from == NULL || to == NULL || (*bus)[lcd->DMA_from + DMA_SIZE - 1] != from + DMA_SIZE - 1){
+        for(lcd->DMA_to = GRAPH_RAM_START; lcd->DMA_to <= GRAPH_RAM_END; ){
+            M_EXIT_IF_ERR(lcdc_DMA_step(lcd));
+        }
+        return ERR_NONE;
+    }
+
+    //Most DMAs copy the same sprites again
+    if(memcmp(to, from, DMA_SIZE) == 0){
+        return ERR_NONE;
+    }
+
+    data_t old[DMA_SIZE];
+    memcpy(old, to, DMA_SIZE);
+    memcpy(to, from, DMA_SIZE);
+    M_EXIT_IF_ERR(dirty_mark_range(&lcd->cpu->dirty, GRAPH_RAM_START, DMA_SIZE));
+
+    ++lcd->lines.oam_version;
+    for(size_t i = 0; i < DMA_SIZE; ++i){
+        if(old[i] != to[i]){
+            lcdc_oam_written(lcd, (addr_t)(GRAPH_RAM_START + i));
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+int lcdc_bus_listener(lcdc_t* lcd, addr_t addr){
+
+    M_REQUIRE_NON_NULL(lcd);
+
+    switch(addr){
+        case REG_LCDC:{
+            const bit_t on = (READ(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK) != 0;
+            //Switched off
+            if(lcd->on && !on){
+                const data_t ly = READ(lcd, REG_LY);
+                if(lcd->scanline && ly < LCD_HEIGHT){
+                    //The lines which reached mode 3 would have been drawn already
+                    const data_t mode = READ(lcd, REG_STAT) & STAT_REG_MODE_MASK;
+                    M_EXIT_IF_ERR(lcdc_draw_frame(lcd, (data_t)(mode == MODE_OAM ? ly : ly + 1)));
+                }
+                M_EXIT_IF_ERR(lcdc_set_mode(lcd, MODE_H_BLANK));
+                M_EXIT_IF_ERR(lcdc_set_ly(lcd, 0));
+                lcd->next_cycle = LCDC_OFF_CYCLE;
+            }
+            lcd->on = on;
+        }break;
+
+        case REG_LYC:{
+            M_EXIT_IF_ERR(lcdc_update_lyc(lcd));
+        }break;
+
+        case REG_DMA:{
+            lcd->DMA_from = (addr_t)(READ(lcd, REG_DMA) << 8);
+            //Copied during the next DMA_SIZE cycles
+            lcd->DMA_end = lcd->cycle + DMA_SIZE;
+            if(lcd->bulk_DMA){
+                M_EXIT_IF_ERR(lcdc_DMA_copy(lcd));
+            }
+            else{
+                lcd->DMA_to = GRAPH_RAM_START;
+            }
+        }break;
+
+        default:{
+            lcdc_memory_written(lcd, addr);
+        }break;
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+bit_t lcdc_DMA_running(const lcdc_t* lcd, uint64_t cycle){
+    return lcd != NULL && cycle < lcd->DMA_end;
+}
+
+// ======================================================================
+uint64_t lcdc_next_event(const lcdc_t* lcd){
+
+    if(lcd == NULL){
+        return 0;
+    }
+    //OAM DMA: one byte per cycle; screen switched on: started at the next cycle
+    if(lcd->DMA_to <= GRAPH_RAM_END ||
+       (lcd->next_cycle == LCDC_OFF_CYCLE && (READ(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK))){
+        return lcd->cycle + 1;
+    }
+    return lcd->next_cycle;
+}
+
+// ======================================================================
+void lcdc_invalidate_tiles(lcdc_t* lcd){
+    if(lcd != NULL){
+        for(size_t t = 0; t < TILE_COUNT; ++t){
+            lcd->tiles.invalidations += lcd->tiles.valid[t];
+            lcd->tiles.valid[t] = 0;
+        }
+        zero_init_var(lcd->lines.valid);
+        lcd->sprites.height = 0;
+    }
+}
+
+/**
+ * @brief Reverses the order of the bits of a byte
+ *        (in video RAM the leftmost pixel of a tile row is the most significant bit)
+ */
+static data_t reverse_bits(data_t b){
+
+    data_t reversed = 0;
+    for(int i = 0; i < 8; ++i){
+        bit_edit(&reversed, 7 - i, bit_get(b, i));
+    }
+    return reversed;
+}
+
+/**
+ * @brief Gets a row of a tile in display order, decoding the tile if it is not in the cache
+ *
+ * @param lcd LCD controler
+ * @param addr address of the row in video RAM (the tile and row are deduced from it)
+ * @param msb (output) most significant bits of the row
+ * @param lsb (output) least significant bits of the row
+ */
+static void lcdc_tile_row(lcdc_t* lcd, addr_t addr, data_t* msb, data_t* lsb){
+
+    tile_cache_t* cache = &lcd->tiles;
+    const size_t tile = (size_t)(addr - TILE_DATA_START) / TILE_SIZE;
+    const size_t row = (size_t)(addr % TILE_SIZE) / 2;
+
+    if(cache->valid[tile]){
+        ++cache->hits;
+    }
+    else{
+        ++cache->misses;
+        const addr_t start = (addr_t)(TILE_DATA_START + tile * TILE_SIZE);
+        for(size_t r = 0; r < TILE_ROWS; ++r){
+            cache->lsb[tile][r] = reverse_bits(READ(lcd, start + 2 * r));
+            cache->msb[tile][r] = reverse_bits(READ(lcd, start + 2 * r + 1));
+        }
+        cache->valid[tile] = 1;
+    }
+
+    *msb = cache->msb[tile][row];
+    *lsb = cache->lsb[tile][row];
+}
+
+/**
+ * @brief Builds (without colors mapping) a line of the background or of the window
+ *
+ * @param lcd LCD controler
+ * @param output line to build
+ * @param map tile map to use (TILE_ADDR_BASE_LOW or TILE_ADDR_BASE_HIGH)
+ * @param y line in the tile map
+ * @param nb_tiles number of tiles of the line (multiple of 4)
+ * @return error code
+ */
+static int lcdc_build_bg_line(lcdc_t* lcd, image_line_t* output, addr_t map, data_t y, size_t nb_tiles){
+
+    const bit_t low_source = (READ(lcd, REG_LCDC) & LCDC_REG_TILE_SOURCE_MASK) != 0;
+    const addr_t source = low_source ? TILE_SRC_ADDR_LOW : TILE_SRC_ADDR_HIGH;
+    const addr_t map_line = (addr_t)(map + (y / TILE_ROWS) * TILE_LINE_SIZE);
+    const size_t row = y % TILE_ROWS;
+
+    M_EXIT_IF_ERR(image_line_create(output, nb_tiles * TILE_ROWS));
+
+    for(size_t i = 0; i < nb_tiles / sizeof(uint32_t); ++i){
+        uint32_t msb = 0;
+        uint32_t lsb = 0;
+        for(size_t j = 0; j < sizeof(uint32_t); ++j){
+            data_t tile = READ(lcd, map_line + i * sizeof(uint32_t) + j);
+            if(!low_source){
+                tile = (data_t)(tile + TILE_INDEX_OFFSET_HIGH);
+            }
+            data_t tile_msb = 0;
+            data_t tile_lsb = 0;
+            lcdc_tile_row(lcd, (addr_t)(source + tile * TILE_SIZE + row * 2), &tile_msb, &tile_lsb);
+            msb |= (uint32_t) tile_msb << (j * 8);
+            lsb |= (uint32_t) tile_lsb << (j * 8);
+        }
+        M_EXIT_IF_ERR_DO_SOMETHING(image_line_set_word(output, i, msb, lsb), image_line_free(output));
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Compares two sprites of a line (by x coordinate, then by index in OAM)
+ */
+static int sprite_compare(const void* a, const void* b){
+
+    const uint16_t s1 = *(const uint16_t*) a;
+    const uint16_t s2 = *(const uint16_t*) b;
+
+    return s1 < s2 ? -1 : (s1 > s2 ? 1 : 0);
+}
+
+/**
+ * @brief Adds or removes a sprite from the lines it is on, which have to be sorted again
+ *
+ * @param lists sprite lists
+ * @param sprite index of the sprite in OAM
+ * @param on 1 to add the sprite, 0 to remove it
+ */
+static void sprite_lists_cover(sprite_lists_t* lists, size_t sprite, bit_t on){
+
+    //The sprites with OAM y < 16 are on no line (first line after wrapping around)
+    const data_t first = (data_t)(lists->y[sprite] - SPRITE_Y_OFFSET);
+    const uint64_t mask = UINT64_C(1) << sprite;
+
+    for(size_t ly = first; ly < (size_t) first + lists->height && ly < LCD_HEIGHT; ++ly){
+        if(on){
+            lists->on_line[ly] |= mask;
+        }
+        else{
+            lists->on_line[ly] &= ~mask;
+        }
+        lists->dirty[ly] = 1;
+    }
+}
+
+/**
+ * @brief Updates the sprite lists after a byte of OAM changed
+ *
+ * @param lcd LCD controler
+ * @param addr address of the byte
+ */
+static void lcdc_oam_written(lcdc_t* lcd, addr_t addr){
+
+    sprite_lists_t* lists = &lcd->sprites;
+    const size_t sprite = (size_t)(addr - GRAPH_RAM_START) / SPRITE_SIZE;
+
+    //Everything is computed again at the next lookup anyway
+    if(lists->height == 0){
+        return;
+    }
+
+    switch((addr - GRAPH_RAM_START) % SPRITE_SIZE){
+        case SPRITE_Y_INDEX:{
+            sprite_lists_cover(lists, sprite, 0);
+            lists->y[sprite] = READ(lcd, addr);
+            sprite_lists_cover(lists, sprite, 1);
+        }break;
+
+        case SPRITE_X_INDEX:{
+            //Same lines, other order
+            sprite_lists_cover(lists, sprite, 1);
+        }break;
+
+        default:
+            break;
+    }
+}
+
+// ======================================================================
+int lcdc_line_sprites(lcdc_t* lcd, data_t ly, data_t sprites[SPRITES_PER_LINE], size_t* count){
+
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE_NON_NULL(sprites);
+    M_REQUIRE_NON_NULL(count);
+    M_REQUIRE(ly < LCD_HEIGHT, ERR_BAD_PARAMETER, "Line %u is not on the display", ly);
+
+    sprite_lists_t* lists = &lcd->sprites;
+
+    //First lookup or new size of sprites: the lines of every sprite are computed again
+    const data_t height = SPRITE_HEIGHT(READ(lcd, REG_LCDC));
+    if(lists->height != height){
+        zero_init_var(lists->on_line);
+        lists->height = height;
+        for(size_t s = 0; s < SPRITE_COUNT; ++s){
+            lists->y[s] = SPRITE_READ(lcd, s, SPRITE_Y_INDEX);
+            sprite_lists_cover(lists, s, 1);
+        }
+        for(size_t l = 0; l < LCD_HEIGHT; ++l){
+            lists->dirty[l] = 1;
+        }
+    }
+
+    if(lists->dirty[ly]){
+        //The first sprites in OAM, then ordered by x coordinate (x in the high byte, index in the low byte)
+        uint16_t keys[SPRITES_PER_LINE];
+        size_t n = 0;
+        for(size_t s = 0; s < SPRITE_COUNT && n < SPRITES_PER_LINE; ++s){
+            if(lists->on_line[ly] & (UINT64_C(1) << s)){
+                keys[n++] = (uint16_t)(SPRITE_READ(lcd, s, SPRITE_X_INDEX) << 8 | s);
+            }
+        }
+
+        qsort(keys, n, sizeof(uint16_t), sprite_compare);
+
+        for(size_t i = 0; i < n; ++i){
+            lists->sprites[ly][i] = lsb8(keys[i]);
+        }
+        lists->count[ly] = (data_t) n;
+        lists->dirty[ly] = 0;
+        ++lists->rebuilds;
+    }
+
+    for(size_t i = 0; i < lists->count[ly]; ++i){
+        sprites[i] = lists->sprites[ly][i];
+    }
+    *count = lists->count[ly];
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Builds the line of the sprites (with colors mapped)
+ *
+ * @param lcd LCD controler
+ * @param output line to build
+ * @param sprites sprites of the line, ordered by priority
+ * @param count number of sprites
+ * @param ly the line
+ * @param front_only 1 to skip the sprites that are behind the background
+ * @return error code
+ */
+static int lcdc_build_sprites_line(lcdc_t* lcd, image_line_t* output, const data_t* sprites, size_t count, data_t ly, bit_t front_only){
+
+    M_EXIT_IF_ERR(image_line_create(output, LCD_WIDTH));
+    const data_t lcdc = READ(lcd, REG_LCDC);
+
+    for(size_t i = 0; i < count; ++i){
+        const data_t attr = SPRITE_READ(lcd, sprites[i], SPRITE_ATTR_INDEX);
+        if(front_only && (attr & SPRITE_ATTR_BEHIND_MASK)){
+            continue;
+        }
+
+        const data_t x = (data_t)(SPRITE_READ(lcd, sprites[i], SPRITE_X_INDEX) - SPRITE_X_OFFSET);
+        const data_t y = (data_t)(SPRITE_READ(lcd, sprites[i], SPRITE_Y_INDEX) - SPRITE_Y_OFFSET);
+        data_t row = (data_t)(ly - y);
+        if(attr & SPRITE_ATTR_Y_FLIP_MASK){
+            row = (data_t)(SPRITE_HEIGHT(lcdc) - 1 - row);
+        }
+
+        //As in the provided controller, SPRITE_ATTR_X_FLIP_MASK is not taken into account
+        const data_t tile = SPRITE_READ(lcd, sprites[i], SPRITE_TILE_INDEX);
+        data_t msb = 0;
+        data_t lsb = 0;
+        lcdc_tile_row(lcd, (addr_t)(TILE_SRC_ADDR_LOW + tile * TILE_SIZE + row * 2), &msb, &lsb);
+
+        image_line_t sprite;
+        zero_init_var(sprite);
+        M_EXIT_IF_ERR_DO_SOMETHING(image_line_create(&sprite, LCD_WIDTH), image_line_free(output));
+
+        image_line_t tmp;
+        zero_init_var(tmp);
+        int err = image_line_set_word(&sprite, 0, msb, lsb);
+        if(err == ERR_NONE){
+            err = image_line_shift(&tmp, sprite, x);
+        }
+        image_line_free(&sprite);
+
+        if(err == ERR_NONE){
+            const palette_t palette = READ(lcd, (attr & SPRITE_ATTR_PALETTE_MASK) ? REG_OBP1 : REG_OBP0);
+            err = image_line_map_colors(&sprite, tmp, palette);
+            image_line_free(&tmp);
+        }
+
+        //Sprites already drawn have priority
+        if(err == ERR_NONE){
+            err = image_line_below(&tmp, sprite, *output);
+            image_line_free(&sprite);
+        }
+
+        image_line_free(output);
+        M_EXIT_IF_ERR(err);
+        *output = tmp;
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Tells whether the window is on a line (provided the background is on)
+ *
+ * @param lcd LCD controler
+ * @param lcdc value of the LCDC register
+ * @param ly the line
+ * @return 1 if the window is on the line, 0 otherwise
+ */
+static bit_t lcdc_window_on_line(lcdc_t* lcd, data_t lcdc, data_t ly){
+
+    const data_t wx = (data_t)(READ(lcd, REG_WX) - WINDOW_OFFSET_X);
+    return READ(lcd, REG_WX) >= WINDOW_OFFSET_X && wx < LCD_WIDTH && (lcdc & LCDC_REG_WIN_MASK) && ly >= READ(lcd, REG_WY);
+}
+
+/**
+ * @brief Builds a line of the display (background, window and sprites)
+ *
+ * @param lcd LCD controler
+ * @param output line to build (left empty if the background is off)
+ * @param ly the line
+ * @return error code
+ */
+static int lcdc_build_line(lcdc_t* lcd, image_line_t* output, data_t ly){
+
+    const data_t lcdc = READ(lcd, REG_LCDC);
+    if(!(lcdc & LCDC_REG_BG_MASK)){
+        return ERR_NONE;
+    }
+
+    image_line_t line;
+    zero_init_var(line);
+    image_line_t tmp;
+    zero_init_var(tmp);
+
+    //Background
+    const addr_t bg_map = (lcdc & LCDC_REG_BG_AREA_MASK) ? TILE_ADDR_BASE_HIGH : TILE_ADDR_BASE_LOW;
+    M_EXIT_IF_ERR(lcdc_build_bg_line(lcd, &line, bg_map, (data_t)(READ(lcd, REG_SCY) + ly), TILE_LINE_SIZE));
+    int err = image_line_extract_wrap_ext(&tmp, line, READ(lcd, REG_SCX), LCD_WIDTH);
+    image_line_free(&line);
+    M_EXIT_IF_ERR(err);
+    err = image_line_map_colors(output, tmp, READ(lcd, REG_BGP));
+    image_line_free(&tmp);
+    M_EXIT_IF_ERR(err);
+
+    //Window
+    if(lcdc_window_on_line(lcd, lcdc, ly)){
+        const data_t wx = (data_t)(READ(lcd, REG_WX) - WINDOW_OFFSET_X);
+        const addr_t win_map = (lcdc & LCDC_REG_WIN_AREA_MASK) ? TILE_ADDR_BASE_HIGH : TILE_ADDR_BASE_LOW;
+        M_EXIT_IF_ERR(lcdc_build_bg_line(lcd, &line, win_map, lcd->window_y, VISIBLE_LINE_SIZE));
+        err = image_line_map_colors(&tmp, line, READ(lcd, REG_BGP));
+        image_line_free(&line);
+        if(err == ERR_NONE){
+            err = image_line_shift(&line, tmp, wx);
+            image_line_free(&tmp);
+        }
+        if(err == ERR_NONE){
+            err = image_line_join(&tmp, line, *output, wx);
+            image_line_free(&line);
+        }
+        image_line_free(output);
+        M_EXIT_IF_ERR(err);
+        *output = tmp;
+        ++lcd->window_y;
+    }
+
+    //Sprites
+    if(lcdc & LCDC_REG_OBJ_MASK){
+        data_t sprites[SPRITES_PER_LINE];
+        size_t count = 0;
+        M_EXIT_IF_ERR(lcdc_line_sprites(lcd, ly, sprites, &count));
+
+        image_line_t front;
+        zero_init_var(front);
+        M_EXIT_IF_ERR(lcdc_build_sprites_line(lcd, &line, sprites, count, ly, 0));
+        M_EXIT_IF_ERR_DO_SOMETHING(lcdc_build_sprites_line(lcd, &front, sprites, count, ly, 1), image_line_free(&line));
+
+        //Sprites behind the background are only visible where the background has color 0
+        bit_vector_t* transparent = bit_vector_not(bit_vector_cpy(line.opacity));
+        bit_vector_t* opacity = bit_vector_or(bit_vector_cpy(output->opacity), transparent);
+        bit_vector_free(&transparent);
+
+        err = image_line_below_with_opacity(&tmp, line, *output, opacity);
+        bit_vector_free(&opacity);
+        image_line_free(&line);
+        image_line_free(output);
+        if(err == ERR_NONE){
+            *output = tmp;
+            err = image_line_below(&tmp, *output, front);
+            image_line_free(output);
+        }
+        image_line_free(&front);
+        M_EXIT_IF_ERR(err);
+        *output = tmp;
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Index in map_versions of a row of a tile map
+ */
+static size_t map_row_index(data_t lcdc, data_t area_mask, data_t y){
+    return (size_t)((lcdc & area_mask) ? TILE_ADDR_BASE_HIGH - TILE_ADDR_BASE_LOW : 0) / TILE_LINE_SIZE + y / TILE_ROWS;
+}
+
+/**
+ * @brief Computes the key of a line
+ *
+ * @param lcd LCD controler
+ * @param key (output) key of the line
+ * @param ly the line
+ * @return 1 if the window is on the line, 0 otherwise
+ */
+static bit_t lcdc_line_key(lcdc_t* lcd, line_key_t* key, data_t ly){
+
+    const line_tracker_t* lines = &lcd->lines;
+    zero_init_ptr(key); //also the padding, keys are compared with memcmp
+
+    key->lcdc = READ(lcd, REG_LCDC);
+    key->scy = READ(lcd, REG_SCY);
+    key->scx = READ(lcd, REG_SCX);
+    key->bgp = READ(lcd, REG_BGP);
+    key->obp0 = READ(lcd, REG_OBP0);
+    key->obp1 = READ(lcd, REG_OBP1);
+    key->wy = READ(lcd, REG_WY);
+    key->wx = READ(lcd, REG_WX);
+    key->bg_map_version = lines->map_versions[map_row_index(key->lcdc, LCDC_REG_BG_AREA_MASK, (data_t)(key->scy + ly))];
+    key->tiles_version = lines->tiles_version;
+
+    //Same conditions as lcdc_build_line
+    const bit_t window = (key->lcdc & LCDC_REG_BG_MASK) && lcdc_window_on_line(lcd, key->lcdc, ly);
+    if(window){
+        key->window_y = lcd->window_y;
+        key->win_map_version = lines->map_versions[map_row_index(key->lcdc, LCDC_REG_WIN_AREA_MASK, lcd->window_y)];
+    }
+    if(key->lcdc & LCDC_REG_OBJ_MASK){
+        key->oam_version = lines->oam_version;
+    }
+
+    return window;
+}
+
+/**
+ * @brief Tells whether two lines have the same content
+ */
+static bit_t same_line(image_line_t iml1, image_line_t iml2){
+
+    const size_t words = (iml1.msb->size + IMAGE_LINE_WORD_BITS - 1) / IMAGE_LINE_WORD_BITS;
+    for(size_t i = 0; i < words; ++i){
+        if(iml1.msb->content[i] != iml2.msb->content[i] ||
+           iml1.lsb->content[i] != iml2.lsb->content[i] ||
+           iml1.opacity->content[i] != iml2.opacity->content[i]){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Draws a line of the display, unless it is the same as when it was last drawn
+ *
+ * @param lcd LCD controler
+ * @param ly the line
+ * @return error code
+ */
+static int lcdc_draw_line(lcdc_t* lcd, data_t ly){
+
+    //Frame not rendered (frames - 1 is the index of the current frame): only the line of the window has to be followed
+    if(lcd->render_period == LCDC_RENDER_OFF || (lcd->frames - 1) % lcd->render_period != 0){
+        if((READ(lcd, REG_LCDC) & LCDC_REG_BG_MASK) && lcdc_window_on_line(lcd, READ(lcd, REG_LCDC), ly)){
+            ++lcd->window_y;
+        }
+        return ERR_NONE;
+    }
+
+    line_tracker_t* lines = &lcd->lines;
+    line_key_t key;
+    const bit_t window = lcdc_line_key(lcd, &key, ly);
+    const bit_t unchanged = lines->valid[ly] && memcmp(&key, &lines->keys[ly], sizeof(key)) == 0;
+
+    if(unchanged){
+        ++lines->skipped;
+        if(!lines->verify){
+            //What lcdc_build_line would have done
+            if(window){
+                ++lcd->window_y;
+            }
+            return ERR_NONE;
+        }
+    }
+
+    image_line_t line;
+    zero_init_var(line);
+    M_EXIT_IF_ERR(lcdc_build_line(lcd, &line, ly));
+    ++lines->rendered;
+    lines->keys[ly] = key;
+    lines->valid[ly] = 1;
+
+    //Nothing is drawn while the background is off: the line keeps its previous content
+    if(line.lsb != NULL){
+        if(unchanged && !same_line(line, lcd->display.content[ly])){
+            ++lines->mismatches;
+        }
+        M_EXIT_IF_ERR(image_own_line_content(&lcd->display, ly, line));
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writes the registers REG_LCDC to REG_WX directly in memory
+ *        (neither seen by the bus listeners nor marked dirty: they are always written back)
+ */
+static int lcdc_load_line_regs(lcdc_t* lcd, const data_t regs[LCDC_LINE_REGS]){
+    for(addr_t i = 0; i < LCDC_LINE_REGS; ++i){
+        M_EXIT_IF_ERR(bus_write(*(lcd->cpu->bus), (addr_t)(REG_LCDC + i), regs[i]));
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Draws the first lines of a frame (scanline mode), each with the registers it had at mode 3
+ *
+ * @param lcd LCD controler
+ * @param count number of lines to draw
+ * @return error code
+ */
+static int lcdc_draw_frame(lcdc_t* lcd, data_t count){
+
+    data_t current[LCDC_LINE_REGS];
+    for(addr_t i = 0; i < LCDC_LINE_REGS; ++i){
+        current[i] = READ(lcd, REG_LCDC + i);
+    }
+
+    int err = ERR_NONE;
+    for(data_t ly = 0; ly < count && err == ERR_NONE; ++ly){
+        err = lcdc_load_line_regs(lcd, lcd->line_regs[ly]);
+        if(err == ERR_NONE){
+            err = lcdc_draw_line(lcd, ly);
+        }
+    }
+
+    M_EXIT_IF_ERR(lcdc_load_line_regs(lcd, current));
+    return err;
+}
@@ -35,6 +35,9 @@ extern "C" {
 #define REG_WY   0xFF4A
 #define REG_WX   0xFF4B
 
+//Registers read when a line is drawn (kept for each line in scanline mode)
+#define LCDC_LINE_REGS (REG_WX - REG_LCDC + 1)
+
 // Misc constants
 
 #define LCD_WIDTH  160
@@ -90,10 +93,122 @@ extern "C" {
 #define VISIBLE_LINE_SIZE 20
 
 
+// Tile cache
+
+#define TILE_DATA_START 0x8000
+#define TILE_DATA_END   0x97FF
+
+#define TILE_COUNT ((TILE_DATA_END - TILE_DATA_START + 1) / TILE_SIZE) // 384 tiles
+#define TILE_ROWS  8
+
+
+// Line tracking
+
+#define TILE_MAP_END  0x9FFF
+#define TILE_MAP_ROWS ((TILE_MAP_END - TILE_ADDR_BASE_LOW + 1) / TILE_LINE_SIZE) // 64 (32 for each of the 2 maps)
+
+
 // Window
 
 #define WINDOW_OFFSET_X  7
 
+
+// Sprites (object attribute memory)
+
+#define SPRITE_COUNT     40
+#define SPRITE_SIZE      4 // sprite size in OAM (in bytes)
+#define SPRITES_PER_LINE 10
+
+#define SPRITE_Y_OFFSET 16
+#define SPRITE_X_OFFSET 8
+
+#define SPRITE_HEIGHT(lcdc) (((lcdc) & LCDC_REG_OBJ_SIZE_MASK) ? 2 * TILE_ROWS : TILE_ROWS)
+
+
+// OAM DMA
+
+#define DMA_SIZE 160 // bytes copied, one per cycle
+
+
+// Rendering
+
+#define LCDC_RENDER_OFF 0 // render period of a headless screen
+#define LCDC_RENDER_ALL 1 // render period to render every frame
+
+// ======================================================================
+/**
+ * @brief Tiles of the video RAM, decoded once for all.
+ *        Rows are stored in display order (leftmost pixel in bit 0).
+ *        An entry is invalidated whenever one of the 16 bytes of its tile is written.
+ */
+typedef struct {
+    data_t msb[TILE_COUNT][TILE_ROWS];
+    data_t lsb[TILE_COUNT][TILE_ROWS];
+    bit_t valid[TILE_COUNT];
+
+    //Statistics
+    uint64_t hits; //rows read from a valid entry
+    uint64_t misses; //rows the tile of which had to be decoded
+    uint64_t invalidations; //valid entries dropped by a write
+} tile_cache_t;
+
+// ======================================================================
+/**
+ * @brief Everything a line of the display depends on.
+ *        Memory is represented by version counters, increased by each write to it.
+ */
+typedef struct {
+    data_t lcdc;
+    data_t scy;
+    data_t scx;
+    data_t bgp;
+    data_t obp0;
+    data_t obp1;
+    data_t wy;
+    data_t wx;
+    data_t window_y; //0 if the window is not on the line
+    uint32_t bg_map_version; //version of the row of the background map used
+    uint32_t win_map_version; //version of the row of the window map used (0 if the window is not on the line)
+    uint32_t tiles_version;
+    uint32_t oam_version; //0 if the sprites are off
+} line_key_t;
+
+/**
+ * @brief Dirty tracking of the lines of the display:
+ *        a line is only rendered again if its key changed since it was last rendered.
+ */
+typedef struct {
+    line_key_t keys[LCD_HEIGHT]; //key of the last render of each line
+    bit_t valid[LCD_HEIGHT];
+    uint32_t map_versions[TILE_MAP_ROWS];
+    uint32_t tiles_version;
+    uint32_t oam_version;
+
+    bit_t verify; //if set, unchanged lines are rendered anyway and compared to the display
+
+    //Statistics
+    uint64_t rendered; //lines rendered
+    uint64_t skipped; //unchanged lines (not rendered unless verify is set)
+    uint64_t mismatches; //unchanged lines that did not match their render (verify only)
+} line_tracker_t;
+
+// ======================================================================
+/**
+ * @brief Sprites of each line of the display, kept up to date by the writes to OAM
+ */
+typedef struct {
+    uint64_t on_line[LCD_HEIGHT]; //bit s is set if sprite s is on the line
+    data_t y[SPRITE_COUNT]; //y of the sprites (as in OAM) when on_line was computed
+    data_t height; //height of the sprites when on_line was computed (0 if it must be computed again)
+
+    data_t sprites[LCD_HEIGHT][SPRITES_PER_LINE]; //sprites of each line, in priority order
+    data_t count[LCD_HEIGHT];
+    bit_t dirty[LCD_HEIGHT]; //sprites must be computed again from on_line
+
+    //Statistics
+    uint64_t rebuilds; //lists computed again
+} sprite_lists_t;
+
 // ======================================================================
 /**
  * @brief lcdc type
@@ -105,8 +220,18 @@ typedef struct {
     uint64_t on_cycle;
     addr_t   DMA_from;
     addr_t   DMA_to;
+    uint64_t DMA_end; //first cycle after the last OAM DMA
+    bit_t    bulk_DMA; //OAM DMAs are copied at once when REG_DMA is written
+    bit_t    scanline; //the lines of a frame are drawn at once when VBlank starts, with the registers they had at mode 3
+    uint64_t cycle; //last cycle run
     image_t  display;
     data_t   window_y;
+    tile_cache_t tiles;
+    line_tracker_t lines;
+    sprite_lists_t sprites;
+    unsigned int render_period; //only one frame out of render_period is rendered in display (none if LCDC_RENDER_OFF)
+    uint64_t frames; //number of frames started since the screen was created
+    data_t   line_regs[LCD_HEIGHT][LCDC_LINE_REGS]; //REG_LCDC to REG_WX when each line entered mode 3 (scanline mode only)
 } lcdc_t;
 
 
@@ -154,6 +279,49 @@ int lcdc_cycle(lcdc_t* lcd, uint64_t cycle);
  */
 int lcdc_bus_listener(lcdc_t* lcd, addr_t addr);
 
+
+/**
+ * @brief Gets the sprites of a line
+ *
+ * @param lcd LCD controler
+ * @param ly the line
+ * @param sprites (output) indices in OAM of the (at most SPRITES_PER_LINE) sprites of the line, in priority order
+ * @param count (output) number of sprites
+ * @return error code
+ */
+int lcdc_line_sprites(lcdc_t* lcd, data_t ly, data_t sprites[SPRITES_PER_LINE], size_t* count);
+
+
+/**
+ * @brief Tells whether an OAM DMA is still running at a given cycle
+ *        (if the DMA was copied at once, the cpu then reaches neither OAM nor the source: see DMA_running in cpu_t)
+ *
+ * @param lcd LCD controler
+ * @param cycle the cycle
+ * @return 1 if a DMA is running, 0 otherwise (also if lcd is NULL)
+ */
+bit_t lcdc_DMA_running(const lcdc_t* lcd, uint64_t cycle);
+
+
+/**
+ * @brief Gives the next cycle at which lcdc_cycle() does something:
+ *        lcdc_cycle() may be skipped for all the cycles before it (as long as the registers are not written)
+ *
+ * @param lcd LCD controler
+ * @return the cycle (UINT64_MAX while the screen is off, 0 if lcd is NULL)
+ */
+uint64_t lcdc_next_event(const lcdc_t* lcd);
+
+
+/**
+ * @brief Invalidates the whole tile cache and forces all the lines to be rendered again
+ *        and their sprites to be selected again
+ *        (needed after the video RAM or OAM was written without going through the cpu)
+ *
+ * @param lcd LCD controler
+ */
+void lcdc_invalidate_tiles(lcdc_t* lcd);
+
 #ifdef __cplusplus
 }
 #endif
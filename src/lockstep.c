@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>//memcmp
+#include <inttypes.h>//PRIu64, PRIX16
+#include "lockstep.h"
+#include "error.h"
+#include "util.h"
+
+/**
+ * @brief Creates gameboy i with its options (and its own copy of the movie)
+ */
+static int lockstep_setup(lockstep_t* lockstep, size_t i){
+
+    gameboy_t* const gameboy = &lockstep->gameboys[i];
+    M_EXIT_IF_ERR(gameboy_create(gameboy, lockstep->rom, lockstep->configs[i].accuracy));
+    M_EXIT_IF_ERR(gameboy_set_render_period(gameboy, lockstep->configs[i].render_period));
+    if(lockstep->configs[i].bulk_DMA){
+        gameboy->screen.bulk_DMA = 1;
+    }
+
+    if(lockstep->movie != NULL){
+        M_EXIT_IF_ERR(movie_load(&lockstep->movies[i], lockstep->movie));
+        M_EXIT_IF_ERR(gameboy_set_movie(gameboy, &lockstep->movies[i]));
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Frees the gameboys and their movies
+ */
+static void lockstep_free_gameboys(lockstep_t* lockstep){
+    for(size_t i = 0; i < LOCKSTEP_GAMEBOYS; ++i){
+        gameboy_free(&lockstep->gameboys[i]);
+        movie_free(&lockstep->movies[i]);
+    }
+}
+
+/**
+ * @brief (Re)creates both gameboys and runs them until a given cycle, without comparing them
+ */
+static int lockstep_restart(lockstep_t* lockstep, uint64_t cycle){
+
+    lockstep_free_gameboys(lockstep);
+    for(size_t i = 0; i < LOCKSTEP_GAMEBOYS; ++i){
+        M_EXIT_IF_ERR(lockstep_setup(lockstep, i));
+        M_EXIT_IF_ERR(gameboy_run_until(&lockstep->gameboys[i], cycle));
+    }
+
+    return ERR_NONE;
+}
+
+int lockstep_create(lockstep_t* lockstep, const char* rom, const char* movie,
+                    const lockstep_config_t configs[LOCKSTEP_GAMEBOYS], uint64_t period, uint64_t memory_period){
+
+    M_REQUIRE_NON_NULL(lockstep);
+    M_REQUIRE_NON_NULL(rom);
+    M_REQUIRE_NON_NULL(configs);
+    M_REQUIRE(period > 0 && memory_period > 0, ERR_BAD_PARAMETER, "Null period (%" PRIu64 ", %" PRIu64 ")",
+              period, memory_period);
+
+    zero_init_ptr(lockstep);
+    lockstep->rom = rom;
+    lockstep->movie = movie;
+    lockstep->configs[LOCKSTEP_REFERENCE] = configs[LOCKSTEP_REFERENCE];
+    lockstep->configs[LOCKSTEP_CANDIDATE] = configs[LOCKSTEP_CANDIDATE];
+    lockstep->period = period;
+    lockstep->memory_period = memory_period;
+
+    M_EXIT_IF_ERR_DO_SOMETHING(lockstep_restart(lockstep, 0), lockstep_free_gameboys(lockstep));
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Adds a difference if the values differ
+ */
+static void lockstep_add(lockstep_mismatch_t* mismatch, const char* name, addr_t address,
+                         uint64_t reference, uint64_t candidate){
+    if(reference == candidate){
+        return;
+    }
+    if(mismatch->count < LOCKSTEP_MAX_DIFFERENCES){
+        lockstep_difference_t* const difference = &mismatch->differences[mismatch->count];
+        difference->name = name;
+        difference->address = address;
+        difference->reference = reference;
+        difference->candidate = candidate;
+    }
+    ++mismatch->count;
+    mismatch->found = 1;
+}
+
+/**
+ * @brief Adds the bytes that differ between the memories of two components
+ */
+static void lockstep_compare_component(lockstep_mismatch_t* mismatch, const component_t* reference,
+                                       const component_t* candidate){
+    if(reference->mem == NULL || candidate->mem == NULL || reference->mem->memory == NULL
+       || candidate->mem->memory == NULL){
+        return;
+    }
+
+    lockstep_add(mismatch, "size", reference->start, reference->mem->size, candidate->mem->size);
+    const size_t size = reference->mem->size < candidate->mem->size ? reference->mem->size : candidate->mem->size;
+    if(memcmp(reference->mem->memory, candidate->mem->memory, size) != 0){
+        for(size_t i = 0; i < size; ++i){
+            lockstep_add(mismatch, NULL, (addr_t) (reference->start + i), reference->mem->memory[i],
+                         candidate->mem->memory[i]);
+        }
+    }
+}
+
+int lockstep_compare(const gameboy_t* reference, const gameboy_t* candidate, bit_t memory,
+                     lockstep_mismatch_t* mismatch){
+
+    M_REQUIRE_NON_NULL(reference);
+    M_REQUIRE_NON_NULL(candidate);
+    M_REQUIRE_NON_NULL(mismatch);
+
+    zero_init_ptr(mismatch);
+    mismatch->cycle = reference->cycles;
+    mismatch->instruction = reference->cpu.instructions;
+
+    const cpu_t* const r = &reference->cpu;
+    const cpu_t* const c = &candidate->cpu;
+    lockstep_add(mismatch, "cycles", 0, reference->cycles, candidate->cycles);
+    lockstep_add(mismatch, "instructions", 0, r->instructions, c->instructions);
+    lockstep_add(mismatch, "PC", 0, r->PC, c->PC);
+    lockstep_add(mismatch, "AF", 0, r->AF, c->AF);
+    lockstep_add(mismatch, "BC", 0, r->BC, c->BC);
+    lockstep_add(mismatch, "DE", 0, r->DE, c->DE);
+    lockstep_add(mismatch, "HL", 0, r->HL, c->HL);
+    lockstep_add(mismatch, "SP", 0, r->SP, c->SP);
+    lockstep_add(mismatch, "IME", 0, r->IME, c->IME);
+    lockstep_add(mismatch, "IE", 0, r->IE, c->IE);
+    lockstep_add(mismatch, "IF", 0, r->IF, c->IF);
+    lockstep_add(mismatch, "HALT", 0, r->HALT, c->HALT);
+    lockstep_add(mismatch, "idle_time", 0, r->idle_time, c->idle_time);
+    lockstep_add(mismatch, "timer", 0, reference->timer.counter, candidate->timer.counter);
+    lockstep_add(mismatch, "boot", 0, reference->boot, candidate->boot);
+
+    //The ROM cannot change, the echo RAM is the work RAM
+    if(memory){
+        for(size_t i = 0; i < GB_NB_COMPONENTS; ++i){
+            lockstep_compare_component(mismatch, &reference->components[i], &candidate->components[i]);
+        }
+        lockstep_compare_component(mismatch, &r->high_ram, &c->high_ram);
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Replays both gameboys from the last cycle their states were identical, comparing them after every cycle,
+ *        to find the first cycle after which they differ.
+ *        A difference that does not show up again (because a state was changed from outside) stays as it was seen.
+ */
+static int lockstep_minimize(lockstep_t* lockstep, lockstep_mismatch_t* mismatch){
+
+    const uint64_t seen = mismatch->cycle;
+    M_EXIT_IF_ERR(lockstep_restart(lockstep, lockstep->verified));
+
+    gameboy_t* const reference = &lockstep->gameboys[LOCKSTEP_REFERENCE];
+    gameboy_t* const candidate = &lockstep->gameboys[LOCKSTEP_CANDIDATE];
+    for(uint64_t cycle = lockstep->verified + 1; cycle <= seen; ++cycle){
+        const addr_t last_PC = reference->cpu.PC;
+        M_EXIT_IF_ERR(gameboy_run_until(reference, cycle));
+        M_EXIT_IF_ERR(gameboy_run_until(candidate, cycle));
+        lockstep_mismatch_t replayed;
+        M_EXIT_IF_ERR(lockstep_compare(reference, candidate, 1, &replayed));
+        if(replayed.found){
+            *mismatch = replayed;
+            mismatch->minimized = 1;
+            mismatch->last_PC = last_PC;
+            return ERR_NONE;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+int lockstep_run(lockstep_t* lockstep, uint64_t cycle, lockstep_mismatch_t* mismatch){
+
+    M_REQUIRE_NON_NULL(lockstep);
+    M_REQUIRE_NON_NULL(mismatch);
+
+    zero_init_ptr(mismatch);
+    gameboy_t* const reference = &lockstep->gameboys[LOCKSTEP_REFERENCE];
+    gameboy_t* const candidate = &lockstep->gameboys[LOCKSTEP_CANDIDATE];
+    while(reference->cycles < cycle){
+        const uint64_t previous = reference->cycles;
+        const addr_t previous_PC = reference->cpu.PC;
+        const uint64_t next = cycle - previous > lockstep->period ? previous + lockstep->period : cycle;
+        M_EXIT_IF_ERR(gameboy_run_until(reference, next));
+        M_EXIT_IF_ERR(gameboy_run_until(candidate, next));
+
+        ++lockstep->comparisons;
+        const bit_t memory = lockstep->comparisons % lockstep->memory_period == 0 || next == cycle;
+        M_EXIT_IF_ERR(lockstep_compare(reference, candidate, memory, mismatch));
+        if(mismatch->found){
+            //Already the first cycle if everything was compared the cycle before
+            if(memory && previous + 1 == next && previous == lockstep->verified){
+                mismatch->minimized = 1;
+                mismatch->last_PC = previous_PC;
+                return ERR_NONE;
+            }
+            return lockstep_minimize(lockstep, mismatch);
+        }
+        if(memory){
+            lockstep->verified = next;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+void lockstep_mismatch_print(FILE* output, const lockstep_mismatch_t* mismatch){
+
+    if(output == NULL || mismatch == NULL){
+        return;
+    }
+    if(!mismatch->found){
+        fprintf(output, "no mismatch\n");
+        return;
+    }
+
+    fprintf(output, "mismatch after cycle %" PRIu64 " (instruction %" PRIu64 "", mismatch->cycle, mismatch->instruction);
+    if(mismatch->minimized){
+        fprintf(output, ", last PC 0x%04" PRIX16 ")\n", mismatch->last_PC);
+    }
+    else{
+        fprintf(output, ", seen at a comparison but not reproduced cycle by cycle)\n");
+    }
+
+    for(size_t i = 0; i < mismatch->count && i < LOCKSTEP_MAX_DIFFERENCES; ++i){
+        const lockstep_difference_t* const difference = &mismatch->differences[i];
+        if(difference->name == NULL){
+            fprintf(output, "  memory 0x%04" PRIX16, difference->address);
+        }
+        else if(difference->address != 0){
+            fprintf(output, "  %s 0x%04" PRIX16, difference->name, difference->address);
+        }
+        else{
+            fprintf(output, "  %s", difference->name);
+        }
+        fprintf(output, ": reference 0x%" PRIX64 ", candidate 0x%" PRIX64 "\n", difference->reference,
+                difference->candidate);
+    }
+    if(mismatch->count > LOCKSTEP_MAX_DIFFERENCES){
+        fprintf(output, "  and %zu more differences\n", mismatch->count - LOCKSTEP_MAX_DIFFERENCES);
+    }
+}
+
+void lockstep_free(lockstep_t* lockstep){
+    if(lockstep != NULL){
+        lockstep_free_gameboys(lockstep);
+    }
+}
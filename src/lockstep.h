@@ -0,0 +1,131 @@
+#pragma once
+
+/**
+ * @file lockstep.h
+ * @brief Differential runs: a reference gameboy and a candidate one run the same ROM side by side,
+ *        their states being compared regularly, down to the first cycle where they differ
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+#include <stdio.h>//FILE
+
+#include "gameboy.h"//gameboy_t
+#include "movie.h"//movie_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOCKSTEP_REFERENCE 0
+#define LOCKSTEP_CANDIDATE 1
+#define LOCKSTEP_GAMEBOYS 2
+
+#define LOCKSTEP_MAX_DIFFERENCES 8
+#define LOCKSTEP_DEFAULT_MEMORY_PERIOD 4096
+
+/**
+ * @brief Engine options of a gameboy, none of which may change the emulated state
+ */
+typedef struct {
+    unsigned int render_period; //see gameboy_set_render_period()
+    bit_t bulk_DMA; //see lcdc_t
+    gameboy_accuracy_t accuracy; //see gameboy_create()
+} lockstep_config_t;
+
+/**
+ * @brief A difference between the two states: a register (name not empty) or a byte of memory
+ */
+typedef struct {
+    const char* name; //name of the register, NULL for memory
+    addr_t address; //address of the byte of memory
+    uint64_t reference;
+    uint64_t candidate;
+} lockstep_difference_t;
+
+/**
+ * @brief First difference found between the two gameboys
+ */
+typedef struct {
+    bit_t found;
+    bit_t minimized; //cycle is the first cycle after which the states differ, not just the comparison that saw it
+    uint64_t cycle; //cycle of the gameboys when the difference was seen
+    uint64_t instruction; //instructions the reference had executed by then
+    addr_t last_PC; //PC of the reference one cycle earlier (if minimized)
+    size_t count; //number of differences
+    lockstep_difference_t differences[LOCKSTEP_MAX_DIFFERENCES]; //the first ones
+} lockstep_mismatch_t;
+
+/**
+ * @brief Lockstep run data structure.
+ */
+typedef struct {
+    const char* rom;
+    const char* movie; //movie both gameboys play (NULL for none)
+    lockstep_config_t configs[LOCKSTEP_GAMEBOYS];
+    uint64_t period; //cycles between two comparisons of the cpus (may change between two runs)
+    uint64_t memory_period; //comparisons of the cpus between two comparisons of the memory (idem)
+    gameboy_t gameboys[LOCKSTEP_GAMEBOYS];
+    movie_t movies[LOCKSTEP_GAMEBOYS];
+    uint64_t verified; //last cycle at which the cpus and the memory were identical
+    uint64_t comparisons; //comparisons of the cpus done
+} lockstep_t;
+
+/**
+ * @brief Creates the two gameboys of a lockstep run
+ *
+ * @param lockstep lockstep run to create
+ * @param rom ROM both gameboys run
+ * @param movie movie both gameboys play (NULL for none)
+ * @param configs options of the reference and of the candidate
+ * @param period cycles between two comparisons of the cpus (1 to compare them after every cycle)
+ * @param memory_period comparisons of the cpus between two comparisons of the memory (1 for every time)
+ * @return error code
+ */
+int lockstep_create(lockstep_t* lockstep, const char* rom, const char* movie,
+                    const lockstep_config_t configs[LOCKSTEP_GAMEBOYS], uint64_t period, uint64_t memory_period);
+
+/**
+ * @brief Runs both gameboys until a given cycle, or until their states differ.
+ *        A difference seen at a comparison is minimized: both gameboys are replayed from the last cycle
+ *        their whole states were identical, comparing them after every cycle.
+ *
+ * @param lockstep the lockstep run
+ * @param cycle cycle to run until
+ * @param mismatch (output) the first difference, found is 0 if there is none
+ * @return error code
+ */
+int lockstep_run(lockstep_t* lockstep, uint64_t cycle, lockstep_mismatch_t* mismatch);
+
+/**
+ * @brief Compares the states of two gameboys
+ *
+ * @param reference a gameboy
+ * @param candidate a gameboy
+ * @param memory 1 to compare the memory too (RAMs and registers), 0 for the cpus only
+ * @param mismatch (output) the differences, found is 0 if there is none
+ * @return error code
+ */
+int lockstep_compare(const gameboy_t* reference, const gameboy_t* candidate, bit_t memory,
+                     lockstep_mismatch_t* mismatch);
+
+/**
+ * @brief Prints a mismatch
+ *
+ * @param output where to print
+ * @param mismatch the mismatch
+ */
+void lockstep_mismatch_print(FILE* output, const lockstep_mismatch_t* mismatch);
+
+/**
+ * @brief Frees the gameboys of a lockstep run
+ *
+ * @param lockstep lockstep run to free
+ */
+void lockstep_free(lockstep_t* lockstep);
+
+#ifdef __cplusplus
+}
+#endif
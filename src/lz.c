@@ -0,0 +1,176 @@
+#include <string.h>
+#include "lz.h"
+#include "error.h"
+#include "util.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 5 //the last bytes of a block are always literals
+#define LZ_MATCH_LIMIT 12 //no match starts in the last bytes of a block
+#define LZ_TOKEN_MAX 15 //lengths from 15 on continue in extra bytes
+#define LZ_HASH_BITS 12
+
+/**
+ * @brief Reads 4 bytes (unaligned)
+ */
+static uint32_t lz_read32(const uint8_t* p){
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Hash of 4 bytes, index of the table of the last positions they were seen at
+ */
+static size_t lz_hash(uint32_t value){
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * @brief Writes the extra bytes of a length of at least LZ_TOKEN_MAX
+ */
+static int lz_write_length(uint8_t** out, const uint8_t* end, size_t length){
+
+    length -= LZ_TOKEN_MAX;
+    for(; length >= 255; length -= 255){
+        M_REQUIRE(*out < end, ERR_MEM, "Compressed block larger than %s", "its buffer");
+        *(*out)++ = 255;
+    }
+    M_REQUIRE(*out < end, ERR_MEM, "Compressed block larger than %s", "its buffer");
+    *(*out)++ = (uint8_t) length;
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writes a sequence: the literals, then the match (none if its length is 0, for the last sequence)
+ */
+static int lz_write_sequence(uint8_t** out, const uint8_t* end, const uint8_t* literals, size_t literals_size,
+                             size_t offset, size_t match){
+
+    M_REQUIRE(*out < end, ERR_MEM, "Compressed block larger than %s", "its buffer");
+    uint8_t* const token = (*out)++;
+    *token = (uint8_t) ((literals_size < LZ_TOKEN_MAX ? literals_size : LZ_TOKEN_MAX) << 4);
+    if(literals_size >= LZ_TOKEN_MAX){
+        M_EXIT_IF_ERR(lz_write_length(out, end, literals_size));
+    }
+    M_REQUIRE((size_t) (end - *out) >= literals_size, ERR_MEM, "Compressed block larger than %s", "its buffer");
+    memcpy(*out, literals, literals_size);
+    *out += literals_size;
+
+    if(match > 0){
+        M_REQUIRE(end - *out >= 2, ERR_MEM, "Compressed block larger than %s", "its buffer");
+        *(*out)++ = (uint8_t) offset;
+        *(*out)++ = (uint8_t) (offset >> 8);
+        match -= LZ_MIN_MATCH;
+        *token |= (uint8_t) (match < LZ_TOKEN_MAX ? match : LZ_TOKEN_MAX);
+        if(match >= LZ_TOKEN_MAX){
+            M_EXIT_IF_ERR(lz_write_length(out, end, match));
+        }
+    }
+
+    return ERR_NONE;
+}
+
+int lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, size_t* compressed){
+
+    M_REQUIRE_NON_NULL(src);
+    M_REQUIRE_NON_NULL(dst);
+    M_REQUIRE_NON_NULL(compressed);
+
+    uint32_t last_seen[1 << LZ_HASH_BITS];
+    zero_init_var(last_seen);
+
+    uint8_t* out = dst;
+    const uint8_t* const end = dst + capacity;
+    size_t anchor = 0; //start of the pending literals
+    //Greedy: each position takes the last one with the same 4 bytes, if it is close enough
+    for(size_t pos = 0; pos + LZ_MATCH_LIMIT <= size;){
+        const uint32_t bytes = lz_read32(src + pos);
+        const size_t h = lz_hash(bytes);
+        const size_t candidate = last_seen[h];
+        last_seen[h] = (uint32_t) pos;
+
+        if(candidate < pos && pos - candidate <= LZ_MAX_OFFSET && lz_read32(src + candidate) == bytes){
+            size_t match = LZ_MIN_MATCH;
+            while(pos + match < size - LZ_LAST_LITERALS && src[candidate + match] == src[pos + match]){
+                ++match;
+            }
+            M_EXIT_IF_ERR(lz_write_sequence(&out, end, src + anchor, pos - anchor, pos - candidate, match));
+            pos += match;
+            anchor = pos;
+        }
+        else{
+            ++pos;
+        }
+    }
+    M_EXIT_IF_ERR(lz_write_sequence(&out, end, src + anchor, size - anchor, 0, 0));
+
+    *compressed = (size_t) (out - dst);
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reads the extra bytes of a length, adding them to it
+ */
+static int lz_read_length(const uint8_t** in, const uint8_t* end, size_t* length){
+
+    uint8_t byte = 255;
+    while(byte == 255){
+        M_REQUIRE(*in < end, ERR_BAD_PARAMETER, "Truncated %s", "length");
+        byte = *(*in)++;
+        *length += byte;
+    }
+
+    return ERR_NONE;
+}
+
+int lz_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, size_t* decompressed){
+
+    M_REQUIRE_NON_NULL(src);
+    M_REQUIRE_NON_NULL(dst);
+    M_REQUIRE_NON_NULL(decompressed);
+
+    const uint8_t* in = src;
+    const uint8_t* const in_end = src + size;
+    uint8_t* out = dst;
+    const uint8_t* const out_end = dst + capacity;
+
+    while(in < in_end){
+        const uint8_t token = *in++;
+
+        size_t literals = token >> 4;
+        if(literals == LZ_TOKEN_MAX){
+            M_EXIT_IF_ERR(lz_read_length(&in, in_end, &literals));
+        }
+        M_REQUIRE((size_t) (in_end - in) >= literals && (size_t) (out_end - out) >= literals, ERR_BAD_PARAMETER,
+                  "Bad literals length %zu", literals);
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+
+        //The last sequence has no match
+        if(in == in_end){
+            break;
+        }
+
+        M_REQUIRE(in_end - in >= 2, ERR_BAD_PARAMETER, "Truncated %s", "offset");
+        const size_t offset = (size_t) in[0] | ((size_t) in[1] << 8);
+        in += 2;
+        M_REQUIRE(offset > 0 && offset <= (size_t) (out - dst), ERR_BAD_PARAMETER, "Bad offset %zu", offset);
+
+        size_t match = token & LZ_TOKEN_MAX;
+        if(match == LZ_TOKEN_MAX){
+            M_EXIT_IF_ERR(lz_read_length(&in, in_end, &match));
+        }
+        match += LZ_MIN_MATCH;
+        M_REQUIRE((size_t) (out_end - out) >= match, ERR_BAD_PARAMETER, "Bad match length %zu", match);
+        //Byte per byte: the match may overlap the bytes it produces
+        for(const uint8_t* from = out - offset; match > 0; --match){
+            *out++ = *from++;
+        }
+    }
+
+    *decompressed = (size_t) (out - dst);
+    return ERR_NONE;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+/**
+ * @file lz.h
+ * @brief Fast LZ77 block compression, in the block format of LZ4
+ *        (sequences of a token, literals, a 16 bits offset and a match length)
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint8_t
+#include <stddef.h>//size_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Largest size of the compression of size bytes (incompressible data)
+ */
+#define LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+/**
+ * @brief Compresses a block
+ *
+ * @param src data to compress
+ * @param size size in bytes of the data
+ * @param dst (output) the compressed block
+ * @param capacity size in bytes of dst
+ * @param compressed (output) size in bytes of the compressed block
+ * @return error code (ERR_MEM if the block does not fit in dst, which cannot happen with LZ_BOUND(size) bytes)
+ */
+int lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, size_t* compressed);
+
+/**
+ * @brief Decompresses a block
+ *
+ * @param src the compressed block
+ * @param size size in bytes of the compressed block
+ * @param dst (output) the data
+ * @param capacity size in bytes of dst
+ * @param decompressed (output) size in bytes of the data
+ * @return error code (ERR_BAD_PARAMETER if the block is corrupted or does not fit in dst)
+ */
+int lz_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, size_t* decompressed);
+
+#ifdef __cplusplus
+}
+#endif
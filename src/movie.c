@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>//PRIu64, SCNu64
+#include "movie.h"
+#include "error.h"
+#include "util.h"
+
+static const char* const key_names[NB_GB_KEYS] = {
+    "RIGHT", "LEFT", "UP", "DOWN", "A", "B", "SELECT", "START"
+};
+
+int movie_init(movie_t* movie){
+
+    M_REQUIRE_NON_NULL(movie);
+
+    zero_init_ptr(movie);
+    movie->events = calloc(MOVIE_INITIAL_SIZE, sizeof(input_event_t));
+    M_EXIT_IF_NULL(movie->events, MOVIE_INITIAL_SIZE * sizeof(input_event_t));
+    movie->allocated = MOVIE_INITIAL_SIZE;
+
+    return ERR_NONE;
+}
+
+int movie_record(movie_t* movie, input_event_t event){
+
+    M_REQUIRE_NON_NULL(movie);
+    M_REQUIRE_NON_NULL(movie->events);
+    M_REQUIRE(event.key < NB_GB_KEYS, ERR_BAD_PARAMETER, "Unknown key (%d)", (int) event.key);
+    M_REQUIRE(movie->size == 0 || movie->events[movie->size - 1].cycle <= event.cycle, ERR_BAD_PARAMETER,
+              "Event at cycle %" PRIu64 " recorded after cycle %" PRIu64, event.cycle, movie->events[movie->size - 1].cycle);
+
+    if(movie->size == movie->allocated){
+        input_event_t* const events = realloc(movie->events, 2 * movie->allocated * sizeof(input_event_t));
+        M_EXIT_IF_NULL(events, 2 * movie->allocated * sizeof(input_event_t));
+        movie->events = events;
+        movie->allocated *= 2;
+    }
+
+    movie->events[movie->size] = event;
+    ++movie->size;
+
+    return ERR_NONE;
+}
+
+int movie_next_cycle(const movie_t* movie, uint64_t* cycle){
+
+    if(movie == NULL || cycle == NULL || movie->next >= movie->size){
+        return 0;
+    }
+
+    *cycle = movie->events[movie->next].cycle;
+    return 1;
+}
+
+int movie_play(movie_t* movie, joypad_t* pad, uint64_t cycle){
+
+    M_REQUIRE_NON_NULL(movie);
+    M_REQUIRE_NON_NULL(pad);
+
+    while(movie->next < movie->size && movie->events[movie->next].cycle <= cycle){
+        const input_event_t* const event = &movie->events[movie->next];
+        if(event->pressed){
+            M_EXIT_IF_ERR(joypad_key_pressed(pad, event->key));
+        }
+        else{
+            M_EXIT_IF_ERR(joypad_key_released(pad, event->key));
+        }
+        ++movie->next;
+    }
+
+    return ERR_NONE;
+}
+
+int movie_seek(movie_t* movie, uint64_t cycle){
+
+    M_REQUIRE_NON_NULL(movie);
+
+    //The events are sorted by cycle
+    size_t low = 0;
+    size_t high = movie->size;
+    while(low < high){
+        const size_t middle = low + (high - low) / 2;
+        if(movie->events[middle].cycle < cycle){
+            low = middle + 1;
+        }
+        else{
+            high = middle;
+        }
+    }
+    movie->next = low;
+
+    return ERR_NONE;
+}
+
+int movie_truncate(movie_t* movie, uint64_t cycle){
+
+    M_REQUIRE_NON_NULL(movie);
+
+    const size_t next = movie->next;
+    M_EXIT_IF_ERR(movie_seek(movie, cycle));
+    movie->size = movie->next;
+    movie->next = next < movie->size ? next : movie->size;
+
+    return ERR_NONE;
+}
+
+int movie_save(const movie_t* movie, const char* filename){
+
+    M_REQUIRE_NON_NULL(movie);
+    M_REQUIRE_NON_NULL(filename);
+
+    FILE* file = fopen(filename, "w");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for writing\n", filename);
+
+    int written = fprintf(file, MOVIE_HEADER "\n") > 0;
+    for(size_t i = 0; written && i < movie->size; ++i){
+        written = fprintf(file, "%" PRIu64 " %s %s\n", movie->events[i].cycle, key_names[movie->events[i].key],
+                          movie->events[i].pressed ? "press" : "release") > 0;
+    }
+    written = (fclose(file) == 0) && written;
+
+    M_EXIT_IF(!written, ERR_IO, "was unable to write the movie in file \"%s\"\n", filename);
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reports a bad line, returns ERR_BAD_PARAMETER
+ */
+static int movie_line_error(const char** reason, const char* why){
+    if(reason != NULL){
+        *reason = why;
+    }
+    return ERR_BAD_PARAMETER;
+}
+
+int movie_parse_line(const char* line, input_event_t* event, bit_t* found, const char** reason){
+
+    M_REQUIRE_NON_NULL(line);
+    M_REQUIRE_NON_NULL(event);
+    M_REQUIRE_NON_NULL(found);
+
+    *found = 0;
+    const char* const start = line + strspn(line, " \t\r\n");
+    if(*start == '\0' || *start == '#'){
+        return ERR_NONE;
+    }
+
+    char key[MOVIE_LINE_SIZE];
+    char action[MOVIE_LINE_SIZE];
+    char extra = '\0';
+    if(*start < '0' || *start > '9'
+       || sscanf(start, "%" SCNu64 " %63s %63s %c", &event->cycle, key, action, &extra) != 3){
+        return movie_line_error(reason, "expected <number> <key> press|release");
+    }
+    if(strcmp(action, "press") && strcmp(action, "release")){
+        return movie_line_error(reason, "unknown action");
+    }
+    if(movie_key_from_name(key, &event->key) != ERR_NONE){
+        return movie_line_error(reason, "unknown key");
+    }
+    event->pressed = !strcmp(action, "press");
+
+    *found = 1;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reads the events of a movie file, after its header
+ */
+static int movie_read_events(movie_t* movie, FILE* file){
+
+    char line[MOVIE_LINE_SIZE];
+    while(fgets(line, sizeof(line), file) != NULL){
+        M_REQUIRE(line[strlen(line) - 1] == '\n' || feof(file), ERR_BAD_PARAMETER, "Movie line too long \"%s\"", line);
+
+        input_event_t event;
+        bit_t found = 0;
+        M_EXIT_IF_ERR(movie_parse_line(line, &event, &found, NULL));
+        if(found){
+            M_EXIT_IF_ERR(movie_record(movie, event));
+        }
+    }
+
+    return ERR_NONE;
+}
+
+int movie_load(movie_t* movie, const char* filename){
+
+    M_REQUIRE_NON_NULL(movie);
+    M_REQUIRE_NON_NULL(filename);
+
+    FILE* file = fopen(filename, "r");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for reading\n", filename);
+
+    char header[MOVIE_LINE_SIZE];
+    if(fgets(header, sizeof(header), file) == NULL || strncmp(header, MOVIE_HEADER "\n", sizeof(MOVIE_HEADER))){
+        fclose(file);
+        M_EXIT_ERR(ERR_BAD_PARAMETER, "\"%s\" is not a movie", filename);
+    }
+
+    M_EXIT_IF_ERR_DO_SOMETHING(movie_init(movie), fclose(file));
+    const int err = movie_read_events(movie, file);
+    fclose(file);
+    if(err != ERR_NONE){
+        movie_free(movie);
+    }
+
+    return err;
+}
+
+void movie_free(movie_t* movie){
+
+    if(movie != NULL){
+        free(movie->events);
+        zero_init_ptr(movie);
+    }
+}
+
+const char* movie_key_name(gb_key_t key){
+    return key < NB_GB_KEYS ? key_names[key] : NULL;
+}
+
+int movie_key_from_name(const char* name, gb_key_t* key){
+
+    M_REQUIRE_NON_NULL(name);
+    M_REQUIRE_NON_NULL(key);
+
+    for(size_t k = 0; k < NB_GB_KEYS; ++k){
+        if(!strcmp(name, key_names[k])){
+            *key = (gb_key_t) k;
+            return ERR_NONE;
+        }
+    }
+
+    M_EXIT_ERR(ERR_BAD_PARAMETER, "Unknown key \"%s\"", name);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+/**
+ * @file movie.h
+ * @brief Joypad movies: the key events of a run, stamped with the guest cycle they happen at, to replay it exactly
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+
+#include "bit.h"//bit_t
+#include "joypad.h"//gb_key_t
+#include "input_queue.h"//input_event_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief First line of a movie file (followed by one "<cycle> <key> press|release" line per event)
+ */
+#define MOVIE_HEADER "GBMOVIE 1"
+
+#define MOVIE_INITIAL_SIZE 64
+
+/**
+ * @brief Size of a line of a movie file or of an input script, end of line included
+ */
+#define MOVIE_LINE_SIZE 64
+
+/**
+ * @brief Movie data structure.
+ *        The events are sorted by cycle, events of the same cycle are played in the order they were recorded.
+ */
+typedef struct {
+    input_event_t* events;
+    size_t size; //number of events
+    size_t allocated; //capacity of events
+    size_t next; //index of the next event to play
+} movie_t;
+
+/**
+ * @brief Initializes an empty movie
+ *
+ * @param movie movie to initialize
+ * @return error code
+ */
+int movie_init(movie_t* movie);
+
+/**
+ * @brief Adds an event at the end of a movie
+ *
+ * @param movie the movie
+ * @param event the event (not before the last event of the movie)
+ * @return error code
+ */
+int movie_record(movie_t* movie, input_event_t event);
+
+/**
+ * @brief Gives the cycle of the next event to play
+ *
+ * @param movie the movie
+ * @param cycle (output) cycle of the next event
+ * @return 1 if there is an event left to play, 0 otherwise (or if a parameter is NULL)
+ */
+int movie_next_cycle(const movie_t* movie, uint64_t* cycle);
+
+/**
+ * @brief Gives the joypad the events of a movie due at a cycle, i.e. the ones stamped with this cycle or before
+ *
+ * @param movie the movie
+ * @param pad the joypad
+ * @param cycle the current cycle
+ * @return error code
+ */
+int movie_play(movie_t* movie, joypad_t* pad, uint64_t cycle);
+
+/**
+ * @brief Moves the next event to play to the first one stamped with a cycle or after,
+ *        e.g. to play the movie from a saved state (see savestate.h)
+ *
+ * @param movie the movie
+ * @param cycle the cycle
+ * @return error code
+ */
+int movie_seek(movie_t* movie, uint64_t cycle);
+
+/**
+ * @brief Drops the events stamped with a cycle or after, e.g. to record again from a former state
+ *
+ * @param movie the movie
+ * @param cycle the cycle
+ * @return error code
+ */
+int movie_truncate(movie_t* movie, uint64_t cycle);
+
+/**
+ * @brief Writes a movie to a (text) file
+ *
+ * @param movie the movie
+ * @param filename the file
+ * @return error code
+ */
+int movie_save(const movie_t* movie, const char* filename);
+
+/**
+ * @brief Reads a movie from a file written by movie_save(), ready to be played from the start
+ *
+ * @param movie movie to initialize
+ * @param filename the file
+ * @return error code
+ */
+int movie_load(movie_t* movie, const char* filename);
+
+/**
+ * @brief Parses a line of a movie file or of an input script: "<stamp> <key> press|release", the stamp being a decimal
+ *        number (a cycle in movies), with nothing else but blanks. Blank lines and comments (starting with #) have no event.
+ *
+ * @param line the line (at most MOVIE_LINE_SIZE - 1 characters, its end of line included or not)
+ * @param event (output) the event, its cycle being the stamp
+ * @param found (output) whether the line has an event
+ * @param reason (output, may be NULL) what is wrong with a bad line
+ * @return error code (ERR_BAD_PARAMETER if the line is bad)
+ */
+int movie_parse_line(const char* line, input_event_t* event, bit_t* found, const char** reason);
+
+/**
+ * @brief Frees a movie
+ *
+ * @param movie movie to free
+ */
+void movie_free(movie_t* movie);
+
+/**
+ * @brief Name of a key in movie files ("RIGHT", "LEFT", "UP", "DOWN", "A", "B", "SELECT", "START")
+ *
+ * @param key the key
+ * @return the name, NULL if the key does not exist
+ */
+const char* movie_key_name(gb_key_t key);
+
+/**
+ * @brief Key of a name in movie files
+ *
+ * @param name the name
+ * @param key (output) the key
+ * @return error code (ERR_BAD_PARAMETER if no key has this name)
+ */
+int movie_key_from_name(const char* name, gb_key_t* key);
+
+#ifdef __cplusplus
+}
+#endif
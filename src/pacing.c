@@ -0,0 +1,120 @@
+#include <time.h>//clock_gettime, clock_nanosleep
+#include <errno.h>//EINTR
+#include <inttypes.h>//PRIu64
+#include "pacing.h"
+#include "error.h"
+#include "util.h"
+
+#define NANOSECONDS_IN_MILLISECONDS 1000000.0
+
+uint64_t pacing_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * PACING_NANOSECONDS_IN_SECONDS + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Sleeps until a time of the monotonic clock (absolute, so that the time of the call does not matter)
+ */
+static void pacing_sleep_until(uint64_t time){
+    const struct timespec until = { (time_t) (time / PACING_NANOSECONDS_IN_SECONDS), (long) (time % PACING_NANOSECONDS_IN_SECONDS) };
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+}
+
+void pacing_sleep(uint64_t time){
+    pacing_sleep_until(pacing_now() + time);
+}
+
+int pacer_init(pacer_t* pacer, uint64_t period, unsigned int catch_up){
+
+    M_REQUIRE_NON_NULL(pacer);
+    M_REQUIRE(period != 0, ERR_BAD_PARAMETER, "Period (%" PRIu64 ") is 0", period);
+
+    zero_init_ptr(pacer);
+    pacer->period = period;
+    pacer->catch_up = catch_up;
+    pacer->deadline = pacing_now();
+    pacer->work_start = pacer->deadline;
+
+    return ERR_NONE;
+}
+
+int pacer_frame_start(pacer_t* pacer){
+
+    M_REQUIRE_NON_NULL(pacer);
+
+    pacer->work_start = pacing_now();
+
+    return ERR_NONE;
+}
+
+int pacer_frame_end(pacer_t* pacer){
+
+    M_REQUIRE_NON_NULL(pacer);
+
+    const uint64_t now = pacing_now();
+    pacer->work = now - pacer->work_start;
+    pacer->total_work += pacer->work;
+    if(pacer->work > pacer->max_work){
+        pacer->max_work = pacer->work;
+    }
+    ++pacer->frames;
+
+    if(pacer->period == PACING_UNLIMITED){
+        pacer->deadline = now;
+        return ERR_NONE;
+    }
+
+    pacer->deadline += pacer->period;
+    if(now <= pacer->deadline){
+        pacing_sleep_until(pacer->deadline);
+        pacer->drift = (int64_t) (pacing_now() - pacer->deadline);
+        if(pacer->drift > pacer->max_drift){
+            pacer->max_drift = pacer->drift;
+        }
+    }
+    else{
+        ++pacer->late;
+        //Too late to catch up: the next frames are due from now on
+        if(now - pacer->deadline > (uint64_t) pacer->catch_up * pacer->period){
+            pacer->deadline = now;
+            ++pacer->resyncs;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+int pacer_restart(pacer_t* pacer){
+
+    M_REQUIRE_NON_NULL(pacer);
+
+    pacer->deadline = pacing_now();
+
+    return ERR_NONE;
+}
+
+int pacer_set_period(pacer_t* pacer, uint64_t period){
+
+    M_REQUIRE_NON_NULL(pacer);
+
+    pacer->period = period;
+    pacer->deadline = pacing_now();
+
+    return ERR_NONE;
+}
+
+int pacer_print(const pacer_t* pacer, FILE* output){
+
+    M_REQUIRE_NON_NULL(pacer);
+    M_REQUIRE_NON_NULL(output);
+
+    fprintf(output, "frames %" PRIu64 ", late %" PRIu64 ", resyncs %" PRIu64
+            ", drift %.3f ms (max %.3f ms), emulation %.3f ms/frame (max %.3f ms)\n",
+            pacer->frames, pacer->late, pacer->resyncs,
+            pacer->drift / NANOSECONDS_IN_MILLISECONDS, pacer->max_drift / NANOSECONDS_IN_MILLISECONDS,
+            pacer->frames == 0 ? 0.0 : pacer->total_work / NANOSECONDS_IN_MILLISECONDS / pacer->frames,
+            pacer->max_work / NANOSECONDS_IN_MILLISECONDS);
+
+    return ERR_NONE;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+/**
+ * @file pacing.h
+ * @brief Frame pacing on the monotonic clock: one frame per deadline, with a bounded catch up after stalls
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t, int64_t
+#include <stdio.h>//FILE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACING_NANOSECONDS_IN_SECONDS 1000000000
+
+/**
+ * @brief Frames a pacer emulates without waiting after a stall before giving up the late deadlines
+ */
+#define PACING_DEFAULT_CATCH_UP 4
+
+/**
+ * @brief Period of a pacer that does not wait at all (frames as fast as possible)
+ */
+#define PACING_UNLIMITED 0
+
+/**
+ * @brief Pacer data structure.
+ *        Frame n is due period nanoseconds after frame n-1, whatever the time the frames took.
+ *        All times are in nanoseconds on CLOCK_MONOTONIC.
+ */
+typedef struct {
+    uint64_t period; //time between two frames (PACING_UNLIMITED for no wait)
+    unsigned int catch_up; //frames late (at most) that are emulated without waiting
+    uint64_t deadline; //time of the next frame
+    uint64_t work_start; //time the current frame started to be emulated
+
+    //Statistics
+    uint64_t frames; //frames paced
+    uint64_t late; //frames that ended after their deadline
+    uint64_t resyncs; //times deadlines were given up after a stall
+    int64_t drift; //time between the deadline and the actual wake up of the last wait
+    int64_t max_drift;
+    uint64_t work; //time spent emulating the last frame
+    uint64_t max_work;
+    uint64_t total_work;
+} pacer_t;
+
+/**
+ * @brief Gives the time of the monotonic clock
+ *
+ * @return the time in nanoseconds
+ */
+uint64_t pacing_now(void);
+
+/**
+ * @brief Sleeps for a given time
+ *
+ * @param time the time in nanoseconds
+ */
+void pacing_sleep(uint64_t time);
+
+/**
+ * @brief Initializes a pacer, the first frame being due now
+ *
+ * @param pacer pacer to initialize
+ * @param period time between two frames (in nanoseconds)
+ * @param catch_up frames late (at most) that are emulated without waiting
+ * @return error code
+ */
+int pacer_init(pacer_t* pacer, uint64_t period, unsigned int catch_up);
+
+/**
+ * @brief Starts emulating a frame
+ *
+ * @param pacer the pacer
+ * @return error code
+ */
+int pacer_frame_start(pacer_t* pacer);
+
+/**
+ * @brief Ends emulating a frame and sleeps until the next deadline.
+ *        If the frame is late by more than catch_up periods, the next frame is due now.
+ *
+ * @param pacer the pacer
+ * @return error code
+ */
+int pacer_frame_end(pacer_t* pacer);
+
+/**
+ * @brief Makes the next frame due now (e.g. after a pause), without counting it late
+ *
+ * @param pacer the pacer
+ * @return error code
+ */
+int pacer_restart(pacer_t* pacer);
+
+/**
+ * @brief Changes the time between two frames, the next frame being due now
+ *
+ * @param pacer the pacer
+ * @param period time between two frames (in nanoseconds), PACING_UNLIMITED for no wait at all
+ * @return error code
+ */
+int pacer_set_period(pacer_t* pacer, uint64_t period);
+
+/**
+ * @brief Prints the statistics of a pacer on one line
+ *
+ * @param pacer the pacer
+ * @param output where to print
+ * @return error code
+ */
+int pacer_print(const pacer_t* pacer, FILE* output);
+
+#ifdef __cplusplus
+}
+#endif
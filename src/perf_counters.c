@@ -0,0 +1,170 @@
+#include <string.h>
+#include <errno.h>
+#ifdef __linux__
+#include <unistd.h>//syscall, read, close
+#include <sys/syscall.h>//__NR_perf_event_open
+#include <sys/ioctl.h>//ioctl
+#include <linux/perf_event.h>
+#endif
+#include "perf_counters.h"
+#include "error.h"
+#include "util.h"
+
+static const char* const counter_names[PERF_COUNTERS] = {
+    "instructions", "cycles", "branch-misses", "L1D-misses", "LLC-misses"
+};
+
+#ifdef __linux__
+
+#define PERF_CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/**
+ * @brief Opens one counter of the calling thread, stopped; -1 if the system refuses it
+ */
+static int perf_counter_open(perf_counter_t counter){
+
+    struct perf_event_attr attr;
+    zero_init_var(attr);
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    //Only the user space, which unprivileged users are allowed to count
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    //To scale the counts if the counters have to share the hardware
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch(counter){
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D);
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL);
+            break;
+        default:
+            return -1;
+    }
+
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief Reads a counter, with the times it was enabled and running
+ */
+static int perf_counter_read(int fd, perf_reading_t* reading){
+    M_REQUIRE(read(fd, reading, sizeof(*reading)) == (ssize_t) sizeof(*reading), ERR_IO, "Cannot read counter %d", fd);
+    return ERR_NONE;
+}
+
+#endif
+
+int perf_counters_open(perf_counters_t* counters){
+
+    M_REQUIRE_NON_NULL(counters);
+
+    zero_init_ptr(counters);
+    for(size_t c = 0; c < PERF_COUNTERS; ++c){
+#ifdef __linux__
+        counters->fd[c] = perf_counter_open((perf_counter_t) c);
+        if(counters->fd[c] < 0 && counters->error == 0){
+            counters->error = errno;
+        }
+#else
+        counters->fd[c] = -1;
+        counters->error = ENOSYS;
+#endif
+    }
+
+    return ERR_NONE;
+}
+
+bit_t perf_counters_available(const perf_counters_t* counters, perf_counter_t counter){
+    return counters != NULL && counter < PERF_COUNTERS && counters->fd[counter] >= 0;
+}
+
+int perf_counters_start(perf_counters_t* counters){
+
+    M_REQUIRE_NON_NULL(counters);
+
+#ifdef __linux__
+    for(size_t c = 0; c < PERF_COUNTERS; ++c){
+        //Not reset: the times enabled and running could not be, and the scaling needs those of this run only
+        if(counters->fd[c] >= 0){
+            M_EXIT_IF_ERR(perf_counter_read(counters->fd[c], &counters->started[c]));
+            M_REQUIRE(ioctl(counters->fd[c], PERF_EVENT_IOC_ENABLE, 0) == 0, ERR_IO,
+                      "Cannot start counter %s", counter_names[c]);
+        }
+    }
+#endif
+
+    return ERR_NONE;
+}
+
+int perf_counters_stop(perf_counters_t* counters){
+
+    M_REQUIRE_NON_NULL(counters);
+
+#ifdef __linux__
+    for(size_t c = 0; c < PERF_COUNTERS; ++c){
+        if(counters->fd[c] >= 0){
+            M_REQUIRE(ioctl(counters->fd[c], PERF_EVENT_IOC_DISABLE, 0) == 0, ERR_IO,
+                      "Cannot stop counter %s", counter_names[c]);
+        }
+    }
+    for(size_t c = 0; c < PERF_COUNTERS; ++c){
+        if(counters->fd[c] >= 0){
+            perf_reading_t reading;
+            M_EXIT_IF_ERR(perf_counter_read(counters->fd[c], &reading));
+            counters->values[c] += perf_reading_scale(&counters->started[c], &reading);
+        }
+    }
+#endif
+
+    return ERR_NONE;
+}
+
+uint64_t perf_reading_scale(const perf_reading_t* from, const perf_reading_t* to){
+
+    if(from == NULL || to == NULL || to->running <= from->running){
+        return 0;
+    }
+
+    const uint64_t value = to->value - from->value;
+    const uint64_t enabled = to->enabled - from->enabled;
+    const uint64_t running = to->running - from->running;
+    return running >= enabled ? value : (uint64_t) ((double) value * (double) enabled / (double) running);
+}
+
+void perf_counters_close(perf_counters_t* counters){
+
+    if(counters == NULL){
+        return;
+    }
+
+    for(size_t c = 0; c < PERF_COUNTERS; ++c){
+#ifdef __linux__
+        if(counters->fd[c] >= 0){
+            close(counters->fd[c]);
+        }
+#endif
+        counters->fd[c] = -1;
+    }
+}
+
+const char* perf_counter_name(perf_counter_t counter){
+    return counter < PERF_COUNTERS ? counter_names[counter] : NULL;
+}
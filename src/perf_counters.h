@@ -0,0 +1,107 @@
+#pragma once
+
+/**
+ * @file perf_counters.h
+ * @brief Hardware performance counters of the current thread (Linux perf_event_open),
+ *        each one optional: the ones the kernel refuses (e.g. in containers) are simply not counted
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+
+#include "bit.h"//bit_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Counted hardware events
+ */
+typedef enum {
+    PERF_INSTRUCTIONS, PERF_CYCLES, PERF_BRANCH_MISSES, PERF_L1D_MISSES, PERF_LLC_MISSES,
+    PERF_COUNTERS
+} perf_counter_t;
+
+/**
+ * @brief Raw reading of a counter, as the kernel gives it (its fields never go back)
+ */
+typedef struct {
+    uint64_t value; //events counted since the counter was opened
+    uint64_t enabled; //nanoseconds the counter was enabled
+    uint64_t running; //nanoseconds it was actually counting (less if it had to share the hardware)
+} perf_reading_t;
+
+/**
+ * @brief Performance counters data structure.
+ */
+typedef struct {
+    int fd[PERF_COUNTERS]; //-1 if the counter is not available
+    uint64_t values[PERF_COUNTERS]; //events counted while the counters were started (scaled if multiplexed)
+    perf_reading_t started[PERF_COUNTERS]; //readings at the last perf_counters_start()
+    int error; //errno of the first counter that could not be opened (0 if all were)
+} perf_counters_t;
+
+/**
+ * @brief Opens the counters the system allows, stopped and at 0
+ *
+ * @param counters counters to open
+ * @return error code (ERR_NONE even if no counter is available)
+ */
+int perf_counters_open(perf_counters_t* counters);
+
+/**
+ * @brief Tells whether a counter is counted
+ *
+ * @param counters the counters
+ * @param counter the counter
+ * @return 1 if it is, 0 otherwise
+ */
+bit_t perf_counters_available(const perf_counters_t* counters, perf_counter_t counter);
+
+/**
+ * @brief Starts counting (the counts add to the values of the former runs)
+ *
+ * @param counters the counters
+ * @return error code
+ */
+int perf_counters_start(perf_counters_t* counters);
+
+/**
+ * @brief Stops counting, and adds the events counted since perf_counters_start() to the values
+ *
+ * @param counters the counters
+ * @return error code
+ */
+int perf_counters_stop(perf_counters_t* counters);
+
+/**
+ * @brief Events counted between two readings of a counter, scaled to the time it was enabled in between
+ *        if it was only counting part of it
+ *
+ * @param from the first reading
+ * @param to the second reading
+ * @return the events (0 if the counter never counted in between, or if a reading is NULL)
+ */
+uint64_t perf_reading_scale(const perf_reading_t* from, const perf_reading_t* to);
+
+/**
+ * @brief Closes the counters
+ *
+ * @param counters counters to close
+ */
+void perf_counters_close(perf_counters_t* counters);
+
+/**
+ * @brief Name of a counter
+ *
+ * @param counter the counter
+ * @return the name, NULL if there is no such counter
+ */
+const char* perf_counter_name(perf_counter_t counter);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,144 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>//__rdtsc
+#define PROFILE_RDTSC
+#endif
+#include <inttypes.h>//PRIu64
+#include "profile.h"
+#include "pacing.h"
+#include "error.h"
+#include "util.h"
+
+#define PROFILE_CALIBRATION_SAMPLES 1000
+
+static const char* const subsystem_names[PROFILE_SUBSYSTEMS] = {
+    "lcdc_cycle", "timer_cycle", "cpu_cycle", "bus listeners"
+};
+
+uint64_t profile_ticks(void){
+#ifdef PROFILE_RDTSC
+    return __rdtsc();
+#else
+    return pacing_now();
+#endif
+}
+
+int profile_init(profile_t* profile){
+
+    M_REQUIRE_NON_NULL(profile);
+
+    zero_init_ptr(profile);
+
+    //A timestamp measures its own cost in the subsystem it ends
+    profile_t scratch;
+    zero_init_var(scratch);
+    const uint64_t start = profile_ticks();
+    uint64_t now = start;
+    for(size_t i = 0; i < PROFILE_CALIBRATION_SAMPLES; ++i){
+        now = profile_add(&scratch, (profile_subsystem_t) (i % PROFILE_SUBSYSTEMS), now);
+    }
+    profile->sample_cost = (double) (now - start) / PROFILE_CALIBRATION_SAMPLES;
+
+    profile->start_ticks = profile_ticks();
+    profile->start_ns = pacing_now();
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Number of bits of a time
+ */
+static size_t profile_bits(uint64_t ticks){
+    size_t bits = 0;
+    while(ticks > 0){
+        ticks >>= 1;
+        ++bits;
+    }
+    return bits;
+}
+
+/**
+ * @brief Bucket of a time: the octave it is in, and the 2 bits after its leading one
+ */
+static size_t profile_bucket(uint64_t ticks){
+    if(ticks < PROFILE_BUCKETS_PER_OCTAVE){
+        return (size_t) ticks;
+    }
+    const size_t bits = profile_bits(ticks);
+    const size_t bucket = PROFILE_BUCKETS_PER_OCTAVE * (bits - 2) + ((ticks >> (bits - 3)) & 3);
+    return bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1;
+}
+
+/**
+ * @brief First time after a bucket
+ */
+static uint64_t profile_bucket_end(size_t bucket){
+    if(bucket < PROFILE_BUCKETS_PER_OCTAVE){
+        return bucket + 1;
+    }
+    const size_t bits = bucket / PROFILE_BUCKETS_PER_OCTAVE + 2;
+    return (uint64_t) (PROFILE_BUCKETS_PER_OCTAVE + 1 + bucket % PROFILE_BUCKETS_PER_OCTAVE) << (bits - 3);
+}
+
+void profile_end_frame(profile_t* profile){
+
+    if(profile == NULL){
+        return;
+    }
+
+    for(size_t s = 0; s < PROFILE_SUBSYSTEMS; ++s){
+        profile->total[s] += profile->frame[s];
+        ++profile->histogram[s][profile_bucket(profile->frame[s])];
+        profile->frame[s] = 0;
+    }
+    ++profile->frames;
+}
+
+/**
+ * @brief Upper bound of the bucket the given fraction of the frames are at or below
+ */
+static uint64_t profile_percentile(const uint64_t histogram[PROFILE_BUCKETS], uint64_t frames, double fraction){
+    const uint64_t rank = (uint64_t) (fraction * (double) frames + 0.5);
+    uint64_t seen = 0;
+    for(size_t b = 0; b < PROFILE_BUCKETS; ++b){
+        seen += histogram[b];
+        if(seen >= rank && seen > 0){
+            return profile_bucket_end(b);
+        }
+    }
+    return profile_bucket_end(PROFILE_BUCKETS - 1);
+}
+
+int profile_print(const profile_t* profile, FILE* output){
+
+    M_REQUIRE_NON_NULL(profile);
+    M_REQUIRE_NON_NULL(output);
+
+    //Ticks per nanosecond since the initialization (1 without a time stamp counter)
+    const uint64_t elapsed_ns = pacing_now() - profile->start_ns;
+    const double ticks_per_ns = elapsed_ns > 0 ? (double) (profile_ticks() - profile->start_ticks) / (double) elapsed_ns : 1;
+
+    uint64_t total = 0;
+    for(size_t s = 0; s < PROFILE_SUBSYSTEMS; ++s){
+        total += profile->total[s];
+    }
+    const double overhead = profile->sample_cost * (double) profile->samples;
+
+    fprintf(output, "profile of %" PRIu64 " frames (%.2f ticks/ns):\n", profile->frames, ticks_per_ns);
+    for(size_t s = 0; s < PROFILE_SUBSYSTEMS; ++s){
+        const uint64_t p50 = profile_percentile(profile->histogram[s], profile->frames, 0.5);
+        const uint64_t p95 = profile_percentile(profile->histogram[s], profile->frames, 0.95);
+        const double frames = profile->frames > 0 ? (double) profile->frames : 1;
+        fprintf(output, "  %-14s %5.1f%%  %9.1f us/frame  (p50 < %.1f us, p95 < %.1f us)\n", subsystem_names[s],
+                total > 0 ? 100.0 * (double) profile->total[s] / (double) total : 0,
+                (double) profile->total[s] / frames / ticks_per_ns / 1000,
+                (double) p50 / ticks_per_ns / 1000, (double) p95 / ticks_per_ns / 1000);
+    }
+    fprintf(output, "  overhead: %" PRIu64 " timestamps of %.1f ticks, about %.1f%% of the measured time\n",
+            profile->samples, profile->sample_cost, total > 0 ? 100.0 * overhead / (double) total : 0);
+
+    return ERR_NONE;
+}
+
+const char* profile_subsystem_name(profile_subsystem_t subsystem){
+    return subsystem < PROFILE_SUBSYSTEMS ? subsystem_names[subsystem] : NULL;
+}
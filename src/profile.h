@@ -0,0 +1,107 @@
+#pragma once
+
+/**
+ * @file profile.h
+ * @brief Instrumentation of the time the subsystems of the gameboy take at each cycle,
+ *        aggregated per frame (gameboy.c only uses it when compiled with -DPROFILE)
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stdio.h>//FILE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Subsystems timed at each cycle
+ */
+typedef enum {
+    PROFILE_LCDC, PROFILE_TIMER, PROFILE_CPU, PROFILE_LISTENERS,
+    PROFILE_SUBSYSTEMS
+} profile_subsystem_t;
+
+/**
+ * @brief Buckets of the histograms, a quarter of octave wide: times below 4 ticks have their own bucket,
+ *        then each power of 2 is split in 4 (4, 5, 6, 7, 8-9, 10-11, 12-13, 14-15, 16-19...)
+ */
+#define PROFILE_BUCKETS_PER_OCTAVE 4
+#define PROFILE_BUCKETS (PROFILE_BUCKETS_PER_OCTAVE * 48)
+
+/**
+ * @brief Profile data structure.
+ *        Times are in ticks of profile_ticks(), converted to nanoseconds when printed.
+ */
+typedef struct {
+    uint64_t frame[PROFILE_SUBSYSTEMS]; //ticks of the current frame
+    uint64_t total[PROFILE_SUBSYSTEMS]; //ticks of the completed frames
+    uint64_t histogram[PROFILE_SUBSYSTEMS][PROFILE_BUCKETS]; //ticks per frame
+    uint64_t frames; //completed frames
+    uint64_t samples; //timestamps taken (all subsystems)
+
+    //Calibration
+    uint64_t start_ticks; //ticks and time at the initialization, to convert ticks to nanoseconds
+    uint64_t start_ns;
+    double sample_cost; //ticks a timestamp adds to the time it measures
+} profile_t;
+
+/**
+ * @brief Gives the current time in ticks (the time stamp counter on x86, nanoseconds elsewhere)
+ *
+ * @return the time in ticks
+ */
+uint64_t profile_ticks(void);
+
+/**
+ * @brief Initializes a profile, and measures the cost of a timestamp
+ *
+ * @param profile profile to initialize
+ * @return error code
+ */
+int profile_init(profile_t* profile);
+
+/**
+ * @brief Adds the time since a timestamp to a subsystem
+ *
+ * @param profile the profile
+ * @param subsystem the subsystem
+ * @param start ticks at the start of the subsystem
+ * @return ticks now, the start of the next subsystem
+ */
+static inline uint64_t profile_add(profile_t* profile, profile_subsystem_t subsystem, uint64_t start)
+{
+    const uint64_t now = profile_ticks();
+    profile->frame[subsystem] += now - start;
+    ++profile->samples;
+    return now;
+}
+
+/**
+ * @brief Ends a frame: its times go to the totals and the histograms
+ *
+ * @param profile the profile
+ */
+void profile_end_frame(profile_t* profile);
+
+/**
+ * @brief Prints the share of each subsystem, the distribution of their time per frame and the overhead of the profile
+ *
+ * @param profile the profile
+ * @param output where to print
+ * @return error code
+ */
+int profile_print(const profile_t* profile, FILE* output);
+
+/**
+ * @brief Name of a subsystem
+ *
+ * @param subsystem the subsystem
+ * @return the name, NULL if there is no such subsystem
+ */
+const char* profile_subsystem_name(profile_subsystem_t subsystem);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>//memcpy, memset
+
+#include "rewind.h"
+#include "savestate.h"
+#include "error.h"
+#include "util.h"
+
+_Static_assert(sizeof(gameboy_state_t) % REWIND_WORD_BYTES == 0, "Save states not made of whole words");
+
+/**
+ * @brief Reads a word of a state or of a code
+ */
+static inline uint64_t rewind_word(const uint8_t* bytes){
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/**
+ * @brief Writes a word of a state or of a code
+ */
+static inline void rewind_set_word(uint8_t* bytes, uint64_t word){
+    memcpy(bytes, &word, sizeof(word));
+}
+
+/**
+ * @brief Encodes a state against a reference (NULL for a state of zeros), gives the size of the code
+ *        (at most REWIND_CODE_BOUND)
+ */
+static size_t rewind_encode(const gameboy_state_t* state, const gameboy_state_t* reference, uint8_t* code){
+
+    const uint8_t* const words = (const uint8_t*) state;
+    const uint8_t* const references = (const uint8_t*) reference;
+    size_t size = 0;
+    size_t w = 0;
+    while(w < REWIND_STATE_WORDS){
+        const size_t skip_start = w;
+        while(w < REWIND_STATE_WORDS && rewind_word(words + w * REWIND_WORD_BYTES)
+              == (references == NULL ? 0 : rewind_word(references + w * REWIND_WORD_BYTES))){
+            ++w;
+        }
+        uint8_t* const header = code + size;
+        size += REWIND_RUN_HEADER_BYTES;
+
+        const size_t literal_start = w;
+        while(w < REWIND_STATE_WORDS){
+            const uint64_t delta = rewind_word(words + w * REWIND_WORD_BYTES)
+                                   ^ (references == NULL ? 0 : rewind_word(references + w * REWIND_WORD_BYTES));
+            if(delta == 0){
+                break;
+            }
+            rewind_set_word(code + size, delta);
+            size += REWIND_WORD_BYTES;
+            ++w;
+        }
+
+        const uint32_t counts[2] = { (uint32_t) (literal_start - skip_start), (uint32_t) (w - literal_start) };
+        memcpy(header, counts, sizeof(counts));
+    }
+
+    return size;
+}
+
+/**
+ * @brief XORs a code into a state: gives the state it was encoded from if the state is its reference
+ *        (and the reference if it is the state it was encoded from)
+ */
+static int rewind_apply(gameboy_state_t* state, const uint8_t* code, size_t size){
+
+    uint8_t* const words = (uint8_t*) state;
+    size_t w = 0;
+    size_t position = 0;
+    while(position < size){
+        uint32_t counts[2];
+        memcpy(counts, code + position, sizeof(counts));
+        position += REWIND_RUN_HEADER_BYTES;
+        w += counts[0];
+        M_REQUIRE(w + counts[1] <= REWIND_STATE_WORDS && position + counts[1] * REWIND_WORD_BYTES <= size,
+                  ERR_BAD_PARAMETER, "Bad run of %u words at word %zu", counts[1], w);
+        for(uint32_t i = 0; i < counts[1]; ++i, ++w, position += REWIND_WORD_BYTES){
+            uint8_t* const word = words + w * REWIND_WORD_BYTES;
+            rewind_set_word(word, rewind_word(word) ^ rewind_word(code + position));
+        }
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Index in the ring of frames of the frame n frames after the oldest one
+ */
+static inline size_t rewind_index(const rewind_t* rewind, size_t n){
+    return (rewind->first + n) % rewind->capacity;
+}
+
+/**
+ * @brief Drops the oldest keyframe and the deltas that follow it
+ */
+static void rewind_drop_oldest(rewind_t* rewind){
+
+    do{
+        rewind->first = rewind_index(rewind, 1);
+        --rewind->count;
+        ++rewind->dropped;
+    } while(rewind->count > 0 && !rewind->frames[rewind->first].keyframe);
+}
+
+/**
+ * @brief Finds room for a code of a given size after the newest frame, if there is some
+ */
+static bit_t rewind_room(const rewind_t* rewind, size_t size, size_t* offset){
+
+    if(rewind->count == 0){
+        *offset = 0;
+        return size <= rewind->budget;
+    }
+
+    const size_t head = rewind->frames[rewind->first].offset;
+    const rewind_frame_t* const newest = &rewind->frames[rewind_index(rewind, rewind->count - 1)];
+    const size_t tail = newest->offset + newest->size;
+    if(tail > head){
+        //The codes are not wrapped around: room after them, or else at the start
+        if(tail + size <= rewind->budget){
+            *offset = tail;
+            return 1;
+        }
+        *offset = 0;
+        return size <= head;
+    }
+
+    *offset = tail;
+    return tail + size <= head;
+}
+
+int rewind_create(rewind_t* rewind, size_t frames, size_t keyframe_period, size_t budget){
+
+    M_REQUIRE_NON_NULL(rewind);
+    M_REQUIRE(frames >= 2, ERR_BAD_PARAMETER, "Cannot rewind with %zu frames", frames);
+    M_REQUIRE(keyframe_period >= 1, ERR_BAD_PARAMETER, "Bad keyframe period %zu", keyframe_period);
+    M_REQUIRE(budget >= REWIND_MIN_BUDGET, ERR_BAD_PARAMETER, "Budget of %zu bytes, below %zu", budget, REWIND_MIN_BUDGET);
+
+    zero_init_ptr(rewind);
+    rewind->ring = malloc(budget);
+    rewind->frames = calloc(frames, sizeof(rewind_frame_t));
+    rewind->current = malloc(sizeof(gameboy_state_t));
+    rewind->scratch = malloc(sizeof(gameboy_state_t));
+    rewind->code = malloc(REWIND_CODE_BOUND);
+    if(rewind->ring == NULL || rewind->frames == NULL || rewind->current == NULL || rewind->scratch == NULL
+       || rewind->code == NULL){
+        rewind_free(rewind);
+        M_EXIT_ERR(ERR_MEM, "Cannot allocate a rewind buffer of %zu bytes", budget);
+    }
+    rewind->budget = budget;
+    rewind->capacity = frames;
+    rewind->keyframe_period = keyframe_period;
+
+    return ERR_NONE;
+}
+
+void rewind_free(rewind_t* rewind){
+
+    if(rewind != NULL){
+        free(rewind->ring);
+        free(rewind->frames);
+        free(rewind->current);
+        free(rewind->scratch);
+        free(rewind->code);
+        zero_init_ptr(rewind);
+    }
+}
+
+int rewind_push(rewind_t* rewind, const gameboy_t* gameboy){
+
+    M_REQUIRE_NON_NULL(rewind);
+    M_REQUIRE_NON_NULL(rewind->ring);
+    M_REQUIRE_NON_NULL(gameboy);
+
+    M_EXIT_IF_ERR(gameboy_save_state(gameboy, rewind->scratch));
+    if(rewind->count == rewind->capacity){
+        rewind_drop_oldest(rewind);
+    }
+
+    bit_t keyframe = rewind->count == 0 || rewind->since_keyframe + 1 >= rewind->keyframe_period;
+    size_t size = rewind_encode(rewind->scratch, keyframe ? NULL : rewind->current, rewind->code);
+    size_t offset = 0;
+    while(!rewind_room(rewind, size, &offset)){
+        rewind_drop_oldest(rewind);
+        if(rewind->count == 0 && !keyframe){
+            //The frame before went too
+            keyframe = 1;
+            size = rewind_encode(rewind->scratch, NULL, rewind->code);
+        }
+    }
+
+    memcpy(rewind->ring + offset, rewind->code, size);
+    rewind_frame_t* const frame = &rewind->frames[rewind_index(rewind, rewind->count)];
+    frame->offset = offset;
+    frame->size = size;
+    frame->keyframe = keyframe;
+    ++rewind->count;
+    rewind->since_keyframe = keyframe ? 0 : rewind->since_keyframe + 1;
+
+    gameboy_state_t* const previous = rewind->current;
+    rewind->current = rewind->scratch;
+    rewind->scratch = previous;
+
+    ++rewind->pushed;
+    rewind->bytes += size;
+
+    return ERR_NONE;
+}
+
+int rewind_step_back(rewind_t* rewind, gameboy_t* gameboy){
+
+    M_REQUIRE_NON_NULL(rewind);
+    M_REQUIRE_NON_NULL(rewind->ring);
+    M_REQUIRE_NON_NULL(gameboy);
+    M_REQUIRE(rewind->count >= 2, ERR_BAD_PARAMETER, "No frame to step back to (%zu kept)", rewind->count);
+
+    const rewind_frame_t* const newest = &rewind->frames[rewind_index(rewind, rewind->count - 1)];
+    if(!newest->keyframe){
+        //The delta goes both ways
+        M_EXIT_IF_ERR(rewind_apply(rewind->current, rewind->ring + newest->offset, newest->size));
+        --rewind->since_keyframe;
+    }
+    else{
+        //From the keyframe before (the oldest frame is one), through the deltas that follow it
+        size_t key = rewind->count - 2;
+        while(!rewind->frames[rewind_index(rewind, key)].keyframe){
+            --key;
+        }
+        memset(rewind->scratch, 0, sizeof(gameboy_state_t));
+        for(size_t n = key; n < rewind->count - 1; ++n){
+            const rewind_frame_t* const frame = &rewind->frames[rewind_index(rewind, n)];
+            M_EXIT_IF_ERR(rewind_apply(rewind->scratch, rewind->ring + frame->offset, frame->size));
+        }
+        gameboy_state_t* const newest_state = rewind->current;
+        rewind->current = rewind->scratch;
+        rewind->scratch = newest_state;
+        rewind->since_keyframe = rewind->count - 2 - key;
+    }
+    --rewind->count;
+
+    return gameboy_load_state(gameboy, rewind->current);
+}
+
+size_t rewind_available(const rewind_t* rewind){
+    return rewind != NULL && rewind->count > 0 ? rewind->count - 1 : 0;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+/**
+ * @file rewind.h
+ * @brief Rewind buffer: the save states of the last frames (see savestate.h),
+ *        a keyframe every few frames and XOR deltas run-length encoded in between,
+ *        in a ring of bytes of a fixed budget
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+
+#include "bit.h"//bit_t
+#include "gameboy.h"//gameboy_t
+#include "savestate.h"//gameboy_state_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The states are encoded as runs of words: a header (words equal to the reference, words that differ)
+ *        followed by the XOR of the words that differ.
+ *        A keyframe is encoded against a state of zeros, a delta against the state of the frame before.
+ */
+#define REWIND_WORD_BYTES 8
+#define REWIND_STATE_WORDS (sizeof(gameboy_state_t) / REWIND_WORD_BYTES)
+#define REWIND_RUN_HEADER_BYTES 8
+//A run (but the first) skips at least one word, so there are at most REWIND_STATE_WORDS / 2 + 1 runs
+#define REWIND_CODE_BOUND (sizeof(gameboy_state_t) + (REWIND_STATE_WORDS / 2 + 1) * REWIND_RUN_HEADER_BYTES)
+
+#define REWIND_MIN_BUDGET (2 * REWIND_CODE_BOUND)
+
+/**
+ * @brief Frame kept in the buffer
+ */
+typedef struct {
+    size_t offset; //position of its code in the ring
+    size_t size; //size of its code (a multiple of REWIND_WORD_BYTES)
+    bit_t keyframe; //encoded against zeros (otherwise against the frame before)
+} rewind_frame_t;
+
+/**
+ * @brief Rewind buffer data structure.
+ *        The frames are kept from the oldest to the newest, the oldest one is always a keyframe:
+ *        when the frames or the bytes run out, the oldest keyframe goes with the deltas that follow it.
+ */
+typedef struct {
+    uint8_t* ring; //codes of the frames
+    size_t budget; //size of ring in bytes
+    rewind_frame_t* frames; //ring of capacity frames
+    size_t capacity;
+    size_t first; //index in frames of the oldest frame
+    size_t count; //frames kept
+    size_t keyframe_period; //a keyframe every keyframe_period frames
+    size_t since_keyframe; //frames pushed since the newest keyframe
+    gameboy_state_t* current; //state of the newest frame
+    gameboy_state_t* scratch; //state being pushed, or rebuilt from a keyframe
+    uint8_t* code; //code being pushed (REWIND_CODE_BOUND bytes)
+
+    //Statistics
+    uint64_t pushed; //frames pushed
+    uint64_t dropped; //frames dropped to make room
+    uint64_t bytes; //bytes of the codes of the frames pushed
+} rewind_t;
+
+/**
+ * @brief Creates an empty rewind buffer
+ *
+ * @param rewind buffer to create
+ * @param frames maximum number of frames kept (at least 2)
+ * @param keyframe_period a keyframe every keyframe_period frames (at least 1)
+ * @param budget bytes of the codes of the frames (at least REWIND_MIN_BUDGET)
+ * @return error code
+ */
+int rewind_create(rewind_t* rewind, size_t frames, size_t keyframe_period, size_t budget);
+
+/**
+ * @brief Frees a rewind buffer
+ *
+ * @param rewind buffer to free
+ */
+void rewind_free(rewind_t* rewind);
+
+/**
+ * @brief Keeps the state of a gameboy as the newest frame, making room if needed
+ *        (the time it takes does not depend on the number of frames kept)
+ *
+ * @param rewind the buffer
+ * @param gameboy the gameboy, between two runs
+ * @return error code
+ */
+int rewind_push(rewind_t* rewind, const gameboy_t* gameboy);
+
+/**
+ * @brief Drops the newest frame, and puts the gameboy back in the state of the frame before
+ *
+ * @param rewind the buffer
+ * @param gameboy the gameboy
+ * @return error code (ERR_BAD_PARAMETER if there is no frame before the newest one)
+ */
+int rewind_step_back(rewind_t* rewind, gameboy_t* gameboy);
+
+/**
+ * @brief Gives the number of frames the buffer can step back
+ *
+ * @param rewind the buffer
+ * @return the number of frames (0 if rewind is NULL)
+ */
+size_t rewind_available(const rewind_t* rewind);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <string.h>//memcpy, memcmp
+#include <stddef.h>//offsetof
+
+#include "savestate.h"
+#include "gameboy.h"
+#include "bootrom.h"
+#include "cartridge.h"
+#include "component.h"
+#include "error.h"
+#include "util.h"
+
+//The layout is the one of the file format: any change must come with a new GB_STATE_VERSION
+_Static_assert(GB_STATE_LINE_WORDS * IMAGE_LINE_WORD_BITS == LCD_WIDTH, "Lines of the display not made of whole words");
+_Static_assert(offsetof(gameboy_state_t, display_msb) == 80, "Padding before the display in gameboy_state_t");
+_Static_assert(offsetof(gameboy_state_t, AF) == 5840, "Padding before the 16 bits fields of gameboy_state_t");
+_Static_assert(offsetof(gameboy_state_t, alu_flags) == 5862, "Padding before the 8 bits fields of gameboy_state_t");
+_Static_assert(offsetof(gameboy_state_t, cartridge) == 5877, "Padding before the memories of gameboy_state_t");
+_Static_assert(sizeof(gameboy_state_t) == 65720, "Padding at the end of gameboy_state_t");
+
+/**
+ * @brief Checks that a state is of the layout of this version
+ */
+static int state_check(const gameboy_state_t* state){
+
+    M_REQUIRE(!memcmp(state->magic, GB_STATE_MAGIC, sizeof(GB_STATE_MAGIC)), ERR_BAD_PARAMETER, "Not a save state%s", "");
+    M_REQUIRE(state->version == GB_STATE_VERSION && state->size == sizeof(gameboy_state_t), ERR_BAD_PARAMETER,
+              "Save state of version %u (%u bytes) instead of %u (%zu bytes)",
+              state->version, state->size, GB_STATE_VERSION, sizeof(gameboy_state_t));
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Gives the memory of a component, checking it has the size of its copy in the state
+ */
+static int state_memory(const component_t* c, size_t size, data_t** memory){
+
+    M_REQUIRE_NON_NULL(c->mem);
+    M_REQUIRE_NON_NULL(c->mem->memory);
+    M_REQUIRE(c->mem->size == size, ERR_BAD_PARAMETER, "Memory of %zu bytes instead of %zu", c->mem->size, size);
+    *memory = c->mem->memory;
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Copies the memory of a component to its copy in the state
+ */
+#define SAVE_MEMORY(c, array) \
+    do { \
+        data_t* memory = NULL; \
+        M_EXIT_IF_ERR(state_memory(c, sizeof(array), &memory)); \
+        memcpy(array, memory, sizeof(array)); \
+    } while(0)
+
+/**
+ * @brief Copies a memory of the state back to its component
+ */
+#define LOAD_MEMORY(c, array) \
+    do { \
+        data_t* memory = NULL; \
+        M_EXIT_IF_ERR(state_memory(c, sizeof(array), &memory)); \
+        memcpy(memory, array, sizeof(array)); \
+    } while(0)
+
+int gameboy_save_state(const gameboy_t* gameboy, gameboy_state_t* state){
+
+    M_REQUIRE_NON_NULL(gameboy);
+    M_REQUIRE_NON_NULL(state);
+    M_REQUIRE_NON_NULL(gameboy->screen.display.content);
+    M_REQUIRE(gameboy->screen.display.height == LCD_HEIGHT, ERR_BAD_PARAMETER, "Display of %zu lines", gameboy->screen.display.height);
+
+    memcpy(state->magic, GB_STATE_MAGIC, sizeof(GB_STATE_MAGIC));
+    state->version = GB_STATE_VERSION;
+    state->size = sizeof(gameboy_state_t);
+
+    state->cycles = gameboy->cycles;
+    state->frames = gameboy->frames;
+    state->boot = gameboy->boot;
+    state->last_ly = gameboy->last_ly;
+
+    const cpu_t* const cpu = &gameboy->cpu;
+    state->instructions = cpu->instructions;
+    state->AF = cpu->AF;
+    state->BC = cpu->BC;
+    state->DE = cpu->DE;
+    state->HL = cpu->HL;
+    state->PC = cpu->PC;
+    state->SP = cpu->SP;
+    state->alu_value = cpu->alu.value;
+    state->alu_flags = cpu->alu.flags;
+    state->write_listener = cpu->write_listener;
+    state->write_listener16 = cpu->write_listener16;
+    state->IME = cpu->IME;
+    state->IE = cpu->IE;
+    state->IF = cpu->IF;
+    state->HALT = cpu->HALT;
+    state->idle_time = cpu->idle_time;
+
+    state->timer_counter = gameboy->timer.counter;
+
+    const lcdc_t* const lcd = &gameboy->screen;
+    state->lcdc_next_cycle = lcd->next_cycle;
+    state->lcdc_on_cycle = lcd->on_cycle;
+    state->lcdc_DMA_end = lcd->DMA_end;
+    state->lcdc_cycle = lcd->cycle;
+    state->lcdc_frames = lcd->frames;
+    state->lcdc_DMA_from = lcd->DMA_from;
+    state->lcdc_DMA_to = lcd->DMA_to;
+    state->lcdc_on = lcd->on;
+    state->lcdc_window_y = lcd->window_y;
+    memcpy(state->lcdc_line_regs, lcd->line_regs, sizeof(state->lcdc_line_regs));
+    for(size_t y = 0; y < LCD_HEIGHT; ++y){
+        const image_line_t line = lcd->display.content[y];
+        M_REQUIRE(line.msb != NULL && line.lsb != NULL && line.msb->size == LCD_WIDTH && line.lsb->size == LCD_WIDTH,
+                  ERR_BAD_PARAMETER, "Bad line %zu of the display", y);
+        memcpy(state->display_msb[y], line.msb->content, sizeof(state->display_msb[y]));
+        memcpy(state->display_lsb[y], line.lsb->content, sizeof(state->display_lsb[y]));
+    }
+
+    state->pad_intern = gameboy->pad.intern;
+    state->pad_old_state = gameboy->pad.old_state;
+    memcpy(state->pad_keys, gameboy->pad.keys_state, sizeof(state->pad_keys));
+
+    SAVE_MEMORY(&gameboy->cartridge.c, state->cartridge);
+    if(gameboy->boot){
+        SAVE_MEMORY(&gameboy->bootrom, state->bootrom);
+    }
+    else{
+        zero_init_var(state->bootrom);
+    }
+    SAVE_MEMORY(&gameboy->components[WORK_RAM_INDEX], state->work_ram);
+    SAVE_MEMORY(&gameboy->components[EXTERN_RAM_INDEX], state->extern_ram);
+    SAVE_MEMORY(&gameboy->components[VIDEO_RAM_INDEX], state->video_ram);
+    SAVE_MEMORY(&gameboy->components[REGISTERS_INDEX], state->registers);
+    SAVE_MEMORY(&gameboy->components[GRAPH_RAM_INDEX], state->graph_ram);
+    SAVE_MEMORY(&gameboy->components[USELESS_INDEX], state->useless);
+    SAVE_MEMORY(&cpu->high_ram, state->high_ram);
+    zero_init_var(state->reserved);
+
+    return ERR_NONE;
+}
+
+int gameboy_load_state(gameboy_t* gameboy, const gameboy_state_t* state){
+
+    M_REQUIRE_NON_NULL(gameboy);
+    M_REQUIRE_NON_NULL(state);
+    M_REQUIRE_NON_NULL(gameboy->screen.display.content);
+    M_REQUIRE(gameboy->screen.display.height == LCD_HEIGHT, ERR_BAD_PARAMETER, "Display of %zu lines", gameboy->screen.display.height);
+    M_EXIT_IF_ERR(state_check(state));
+
+    M_EXIT_IF_ERR(bootrom_map(gameboy, state->boot));
+
+    LOAD_MEMORY(&gameboy->cartridge.c, state->cartridge);
+    if(state->boot){
+        LOAD_MEMORY(&gameboy->bootrom, state->bootrom);
+    }
+    LOAD_MEMORY(&gameboy->components[WORK_RAM_INDEX], state->work_ram);
+    LOAD_MEMORY(&gameboy->components[EXTERN_RAM_INDEX], state->extern_ram);
+    LOAD_MEMORY(&gameboy->components[VIDEO_RAM_INDEX], state->video_ram);
+    LOAD_MEMORY(&gameboy->components[REGISTERS_INDEX], state->registers);
+    LOAD_MEMORY(&gameboy->components[GRAPH_RAM_INDEX], state->graph_ram);
+    LOAD_MEMORY(&gameboy->components[USELESS_INDEX], state->useless);
+    LOAD_MEMORY(&gameboy->cpu.high_ram, state->high_ram);
+    dirty_mark_all(&gameboy->cpu.dirty);
+
+    gameboy->cycles = state->cycles;
+    gameboy->frames = state->frames;
+    gameboy->last_ly = state->last_ly;
+
+    cpu_t* const cpu = &gameboy->cpu;
+    cpu->instructions = state->instructions;
+    cpu->AF = state->AF;
+    cpu->BC = state->BC;
+    cpu->DE = state->DE;
+    cpu->HL = state->HL;
+    cpu->PC = state->PC;
+    cpu->SP = state->SP;
+    cpu->alu.value = state->alu_value;
+    cpu->alu.flags = state->alu_flags;
+    cpu->write_listener = state->write_listener;
+    cpu->write_listener16 = state->write_listener16;
+    cpu->IME = state->IME;
+    cpu->IE = state->IE;
+    cpu->IF = state->IF;
+    cpu->HALT = state->HALT;
+    cpu->idle_time = state->idle_time;
+
+    gameboy->timer.counter = state->timer_counter;
+
+    lcdc_t* const lcd = &gameboy->screen;
+    lcd->next_cycle = state->lcdc_next_cycle;
+    lcd->on_cycle = state->lcdc_on_cycle;
+    lcd->DMA_end = state->lcdc_DMA_end;
+    lcd->cycle = state->lcdc_cycle;
+    lcd->frames = state->lcdc_frames;
+    lcd->DMA_from = state->lcdc_DMA_from;
+    lcd->DMA_to = state->lcdc_DMA_to;
+    lcd->on = state->lcdc_on;
+    lcd->window_y = state->lcdc_window_y;
+    memcpy(lcd->line_regs, state->lcdc_line_regs, sizeof(lcd->line_regs));
+    for(size_t y = 0; y < LCD_HEIGHT; ++y){
+        for(size_t w = 0; w < GB_STATE_LINE_WORDS; ++w){
+            M_EXIT_IF_ERR(image_line_set_word(&lcd->display.content[y], w, state->display_msb[y][w], state->display_lsb[y][w]));
+        }
+    }
+    //The caches were filled from the former memories
+    lcdc_invalidate_tiles(lcd);
+
+    gameboy->pad.intern = state->pad_intern;
+    gameboy->pad.old_state = state->pad_old_state;
+    memcpy(gameboy->pad.keys_state, state->pad_keys, sizeof(state->pad_keys));
+
+    return ERR_NONE;
+}
+
+int gameboy_state_write(const gameboy_state_t* state, const char* filename){
+
+    M_REQUIRE_NON_NULL(state);
+    M_REQUIRE_NON_NULL(filename);
+
+    FILE* file = fopen(filename, "wb");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for writing\n", filename);
+
+    int written = fwrite(state, sizeof(gameboy_state_t), 1, file) == 1;
+    written = (fclose(file) == 0) && written;
+
+    M_EXIT_IF(!written, ERR_IO, "was unable to write the state in file \"%s\"\n", filename);
+
+    return ERR_NONE;
+}
+
+int gameboy_state_read(gameboy_state_t* state, const char* filename){
+
+    M_REQUIRE_NON_NULL(state);
+    M_REQUIRE_NON_NULL(filename);
+
+    FILE* file = fopen(filename, "rb");
+    M_EXIT_IF(file == NULL, ERR_IO, "cannot open file \"%s\" for reading\n", filename);
+
+    const int read = fread(state, sizeof(gameboy_state_t), 1, file) == 1;
+    fclose(file);
+    M_REQUIRE(read, ERR_BAD_PARAMETER, "\"%s\" is not a save state", filename);
+
+    return state_check(state);
+}
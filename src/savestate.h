@@ -0,0 +1,152 @@
+#pragma once
+
+/**
+ * @file savestate.h
+ * @brief Save states: a snapshot of everything a running gameboy depends on, in a fixed layout
+ *        copied as is (no pointer, no padding) to and from memory or a file
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+
+#include "gameboy.h"//gameboy_t
+#include "cartridge.h"//BANK_ROM_SIZE
+#include "bootrom.h"//GAMEBOY_BOOT_ROM_SIZE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief First bytes of a save state, followed by its version.
+ *        The version changes with the layout: a state of another version is refused.
+ */
+#define GB_STATE_MAGIC "GBSTATE"
+#define GB_STATE_MAGIC_SIZE 8
+#define GB_STATE_VERSION 3
+
+#define GB_STATE_LINE_WORDS (LCD_WIDTH / IMAGE_LINE_WORD_BITS)
+
+/**
+ * @brief Save state data structure.
+ *        The fields go from the widest to the narrowest, so that the layout has no padding,
+ *        and the integers are in the byte order of the host.
+ *        The caches of the screen are not saved, they are rebuilt after a load;
+ *        neither is the configuration of the gameboy (accuracy, rendering, serial log, movie, trace).
+ */
+typedef struct {
+    char magic[GB_STATE_MAGIC_SIZE]; //GB_STATE_MAGIC
+    uint32_t version; //GB_STATE_VERSION
+    uint32_t size; //sizeof(gameboy_state_t)
+
+    //Gameboy
+    uint64_t cycles;
+    uint64_t frames;
+
+    //CPU
+    uint64_t instructions;
+
+    //LCD controler
+    uint64_t lcdc_next_cycle;
+    uint64_t lcdc_on_cycle;
+    uint64_t lcdc_DMA_end;
+    uint64_t lcdc_cycle;
+    uint64_t lcdc_frames;
+    uint32_t display_msb[LCD_HEIGHT][GB_STATE_LINE_WORDS]; //lines already drawn in the current frame
+    uint32_t display_lsb[LCD_HEIGHT][GB_STATE_LINE_WORDS];
+
+    //CPU
+    uint16_t AF;
+    uint16_t BC;
+    uint16_t DE;
+    uint16_t HL;
+    uint16_t PC;
+    uint16_t SP;
+    uint16_t alu_value;
+    uint16_t write_listener;
+
+    //Timer
+    uint16_t timer_counter;
+
+    //LCD controler
+    uint16_t lcdc_DMA_from;
+    uint16_t lcdc_DMA_to;
+
+    //CPU
+    uint8_t alu_flags;
+    uint8_t IME;
+    uint8_t IE;
+    uint8_t IF;
+    uint8_t HALT;
+    uint8_t idle_time;
+    uint8_t write_listener16;
+
+    //LCD controler
+    uint8_t lcdc_on;
+    uint8_t lcdc_window_y;
+
+    //Joypad
+    uint8_t pad_intern;
+    uint8_t pad_old_state;
+    uint8_t pad_keys[NB_GB_KEY_ROWS];
+
+    //Gameboy
+    uint8_t boot; //the boot ROM is still mapped
+    uint8_t last_ly;
+
+    //Memories (the cartridge too: the bus lets the games write to it)
+    uint8_t cartridge[BANK_ROM_SIZE];
+    uint8_t bootrom[GAMEBOY_BOOT_ROM_SIZE]; //only meaningful while boot is set
+    uint8_t work_ram[MEM_SIZE(WORK_RAM)];
+    uint8_t extern_ram[MEM_SIZE(EXTERN_RAM)];
+    uint8_t video_ram[MEM_SIZE(VIDEO_RAM)];
+    uint8_t registers[MEM_SIZE(REGISTERS)];
+    uint8_t graph_ram[MEM_SIZE(GRAPH_RAM)];
+    uint8_t useless[MEM_SIZE(USELESS)];
+    uint8_t high_ram[HIGH_RAM_SIZE];
+    uint8_t lcdc_line_regs[LCD_HEIGHT][LCDC_LINE_REGS]; //LCD controler: registers of the lines waiting for VBlank (scanline accuracy)
+    uint8_t reserved[4]; //makes the size a multiple of 8, as the compiler would (always 0)
+} gameboy_state_t;
+
+/**
+ * @brief Takes a snapshot of a gameboy, between two runs
+ *
+ * @param gameboy the gameboy
+ * @param state (output) the state
+ * @return error code
+ */
+int gameboy_save_state(const gameboy_t* gameboy, gameboy_state_t* state);
+
+/**
+ * @brief Puts a gameboy back in a saved state: it then runs exactly as the gameboy the state was taken from.
+ *        The bus is mapped again as the state says (boot ROM or cartridge),
+ *        and the caches of the screen are invalidated.
+ *
+ * @param gameboy the gameboy (created, of any ROM)
+ * @param state the state
+ * @return error code (ERR_BAD_PARAMETER if the state is not of this version)
+ */
+int gameboy_load_state(gameboy_t* gameboy, const gameboy_state_t* state);
+
+/**
+ * @brief Writes a state to a file
+ *
+ * @param state the state
+ * @param filename the file
+ * @return error code
+ */
+int gameboy_state_write(const gameboy_state_t* state, const char* filename);
+
+/**
+ * @brief Reads a state from a file
+ *
+ * @param state (output) the state
+ * @param filename the file
+ * @return error code (ERR_BAD_PARAMETER if the file is not a state of this version)
+ */
+int gameboy_state_read(gameboy_state_t* state, const char* filename);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,327 @@
+/**
+ * @file test-blargg.c
+ * @brief Runs the blargg test ROMs headless in parallel worker processes,
+ *        each one stopping as soon as its ROM prints "Passed" or "Failed"
+ *        (the parallel front end of "test-gameboy rom.gb --blargg", which runs one)
+ *
+ * @date 2021
+ */
+
+#include "blargg.h"
+#include "gameboy.h" // for GB_CYCLES_PER_S
+#include "util.h"  // for zero_init_var()
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // for PRIu64
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define TEST_BLARGG_DIR "tests/data/blargg_roms/"
+#define TEST_BLARGG_MAX_ROMS 64
+#define TEST_BLARGG_PATH_SIZE 512
+#define TEST_BLARGG_OUTPUT_SIZE 4096 // output of a test kept for the report
+
+/**
+ * @brief Options of a run
+ */
+typedef struct {
+    const char* roms[TEST_BLARGG_MAX_ROMS];
+    size_t count;
+    double timeout; //in guest seconds
+    long jobs; //worker processes at a time
+    gameboy_accuracy_t accuracy;
+} test_blargg_options_t;
+
+/**
+ * @brief A test being run (or run) by a worker
+ */
+typedef struct {
+    const char* rom;
+    pid_t pid; //0 while not started or once reported
+    int pipe; //read end of the pipe of the worker
+    int status; //error code of the worker
+    blargg_result_t result;
+    char output[TEST_BLARGG_OUTPUT_SIZE];
+} test_blargg_job_t;
+
+// ======================================================================
+static void usage(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s [--timeout guest-seconds] [--jobs N] [--accuracy cycle|instruction|scanline] [rom.gb...]\n", pgm);
+    fprintf(stderr, "          (all the ROMs of " TEST_BLARGG_DIR " by default, timeout of %.0f s, one job per CPU)\n",
+            (double) BLARGG_DEFAULT_MAX_CYCLES / GB_CYCLES_PER_S);
+    fprintf(stderr, "examples: %s --jobs 4\n", pgm);
+    fprintf(stderr, "          %s --timeout 10 \"" TEST_BLARGG_DIR "09-op r,r.gb\"\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Compares two strings for qsort()
+ */
+static int compare_names(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+// ======================================================================
+/**
+ * @brief Lists the ROMs of the test directory, sorted
+ */
+static int list_roms(test_blargg_options_t* options, char paths[][TEST_BLARGG_PATH_SIZE])
+{
+    DIR* dir = opendir(TEST_BLARGG_DIR);
+    M_REQUIRE(dir != NULL, ERR_IO, "cannot open " TEST_BLARGG_DIR "%s", "");
+
+    struct dirent* entry = NULL;
+    while ((entry = readdir(dir)) != NULL && options->count < TEST_BLARGG_MAX_ROMS) {
+        const size_t length = strlen(entry->d_name);
+        if (length > 3 && !strcmp(entry->d_name + length - 3, ".gb")) {
+            snprintf(paths[options->count], TEST_BLARGG_PATH_SIZE, TEST_BLARGG_DIR "%s", entry->d_name);
+            options->roms[options->count] = paths[options->count];
+            ++options->count;
+        }
+    }
+    closedir(dir);
+
+    qsort(options->roms, options->count, sizeof(options->roms[0]), compare_names);
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Parses the command line, returns ERR_BAD_PARAMETER on misuse
+ */
+static int parse_options(int argc, char* argv[], test_blargg_options_t* options)
+{
+    zero_init_ptr(options);
+    options->timeout = (double) BLARGG_DEFAULT_MAX_CYCLES / GB_CYCLES_PER_S;
+    options->jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            M_REQUIRE(options->count < TEST_BLARGG_MAX_ROMS, ERR_BAD_PARAMETER, "too many ROMs (%s)", arg);
+            options->roms[options->count++] = arg;
+        } else {
+            M_REQUIRE(i + 1 < argc, ERR_BAD_PARAMETER, "missing value of option %s", arg);
+            const char* value = argv[++i];
+            if (!strcmp(arg, "--timeout")) {
+                options->timeout = strtod(value, NULL);
+                M_REQUIRE(options->timeout > 0, ERR_BAD_PARAMETER, "bad timeout (%s)", value);
+            } else if (!strcmp(arg, "--accuracy")) {
+                M_EXIT_IF_ERR(gameboy_accuracy_parse(value, &options->accuracy));
+            } else if (!strcmp(arg, "--jobs")) {
+                options->jobs = strtol(value, NULL, 10);
+                M_REQUIRE(options->jobs > 0, ERR_BAD_PARAMETER, "bad number of jobs (%s)", value);
+            } else {
+                M_EXIT_ERR(ERR_BAD_PARAMETER, "unknown option %s", arg);
+            }
+        }
+    }
+
+    if (options->jobs < 1) {
+        options->jobs = 1;
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Body of a worker: runs its test and writes to the pipe
+ *        the error code, the verdict, the cycles and the time, then the output
+ */
+static int work(const char* rom, gameboy_accuracy_t accuracy, uint64_t max_cycles, int fd)
+{
+    blargg_result_t result;
+    const int err = blargg_run(rom, accuracy, max_cycles, &result);
+
+    FILE* pipe = fdopen(fd, "w");
+    M_REQUIRE(pipe != NULL, ERR_IO, "cannot write the result of %s", rom);
+    if (err == ERR_NONE) {
+        fprintf(pipe, "%d %d %" PRIu64 " %.6f\n", err, (int) result.verdict, result.cycles, result.seconds);
+        // at most what fits in the pipe, for the worker to end without waiting for its result to be read
+        fwrite(result.output, 1, result.size < TEST_BLARGG_OUTPUT_SIZE ? result.size : TEST_BLARGG_OUTPUT_SIZE - 1, pipe);
+    } else {
+        fprintf(pipe, "%d 0 0 0\n", err);
+    }
+    fclose(pipe);
+
+    blargg_result_free(&result);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Starts the worker of a test
+ */
+static int start(test_blargg_job_t* job, gameboy_accuracy_t accuracy, uint64_t max_cycles)
+{
+    int fds[2];
+    M_REQUIRE(pipe(fds) == 0, ERR_IO, "cannot create the pipe of %s", job->rom);
+
+    fflush(stdout);
+    fflush(stderr);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(work(job->rom, accuracy, max_cycles, fds[1]) == ERR_NONE ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        M_EXIT_ERR(ERR_IO, "cannot start the worker of %s", job->rom);
+    }
+
+    job->pid = pid;
+    job->pipe = fds[0];
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Reads the result of a worker that ended
+ */
+static void collect(test_blargg_job_t* job)
+{
+    job->status = ERR_IO;
+    FILE* pipe = fdopen(job->pipe, "r");
+    if (pipe != NULL) {
+        int verdict = BLARGG_TIMEOUT;
+        if (fscanf(pipe, "%d %d %" SCNu64 " %lf", &job->status, &verdict, &job->result.cycles,
+                   &job->result.seconds) == 4 && fgetc(pipe) == '\n') {
+            job->result.verdict = (blargg_verdict_t) verdict;
+            job->result.size = fread(job->output, 1, sizeof(job->output) - 1, pipe);
+        } else {
+            job->status = ERR_IO;
+        }
+        fclose(pipe);
+    } else {
+        close(job->pipe);
+    }
+    job->output[job->result.size] = '\0';
+    job->pid = 0;
+}
+
+// ======================================================================
+/**
+ * @brief Waits for the end of any worker, and collects its result
+ */
+static int wait_any(test_blargg_job_t* jobs, size_t count)
+{
+    int status = 0;
+    const pid_t pid = wait(&status);
+    M_REQUIRE(pid > 0, ERR_IO, "cannot wait for the workers%s", "");
+
+    for (size_t i = 0; i < count; ++i) {
+        if (jobs[i].pid == pid) {
+            collect(&jobs[i]);
+        }
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Prints the line of a test, and its output if it did not pass
+ */
+static void report(const test_blargg_job_t* job)
+{
+    if (job->status != ERR_NONE) {
+        printf("%-7s %s: %s\n", "ERROR", job->rom, ERR_MESSAGES[job->status - ERR_NONE]);
+        return;
+    }
+
+    printf("%-7s %6.2f guest s in %6.3f s  %s\n", blargg_verdict_name(job->result.verdict),
+           (double) job->result.cycles / GB_CYCLES_PER_S, job->result.seconds, job->rom);
+    if (job->result.verdict != BLARGG_PASSED) {
+        printf("%s%s", job->output, job->result.size > 0 && job->output[job->result.size - 1] != '\n' ? "\n" : "");
+    }
+}
+
+// ======================================================================
+/**
+ * @brief Runs the tests, at most options->jobs at a time, reporting them in order as soon as they are known
+ */
+static int run(const test_blargg_options_t* options, test_blargg_job_t* jobs)
+{
+    const uint64_t max_cycles = (uint64_t) (options->timeout * GB_CYCLES_PER_S);
+
+    size_t started = 0;
+    size_t running = 0;
+    size_t reported = 0;
+    size_t failures = 0;
+    while (reported < options->count) {
+        while (started < options->count && running < (size_t) options->jobs) {
+            M_EXIT_IF_ERR(start(&jobs[started], options->accuracy, max_cycles));
+            ++started;
+            ++running;
+        }
+        M_EXIT_IF_ERR(wait_any(jobs, started));
+        --running;
+        for (; reported < started && jobs[reported].pid == 0; ++reported) {
+            report(&jobs[reported]);
+            if (jobs[reported].status != ERR_NONE || jobs[reported].result.verdict != BLARGG_PASSED) {
+                ++failures;
+            }
+        }
+    }
+
+    size_t counts[BLARGG_VERDICTS] = { 0 };
+    double seconds = 0;
+    for (size_t i = 0; i < options->count; ++i) {
+        if (jobs[i].status == ERR_NONE) {
+            ++counts[jobs[i].result.verdict];
+            seconds += jobs[i].result.seconds;
+        }
+    }
+    printf("%zu ROMs: %zu passed, %zu failed, %zu timed out, %zu errors (%.3f s of emulation, %ld workers)\n",
+           options->count, counts[BLARGG_PASSED], counts[BLARGG_FAILED], counts[BLARGG_TIMEOUT],
+           options->count - counts[BLARGG_PASSED] - counts[BLARGG_FAILED] - counts[BLARGG_TIMEOUT],
+           seconds, options->jobs);
+
+    return failures > 0;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    test_blargg_options_t options;
+    if (parse_options(argc, argv, &options) != ERR_NONE) {
+        usage(argv[0], "bad arguments");
+        return ERR_BAD_PARAMETER;
+    }
+
+    char paths[TEST_BLARGG_MAX_ROMS][TEST_BLARGG_PATH_SIZE];
+    if (options.count == 0) {
+        M_EXIT_IF_ERR(list_roms(&options, paths));
+        if (options.count == 0) {
+            usage(argv[0], "no ROM found");
+            return ERR_BAD_PARAMETER;
+        }
+    }
+
+    test_blargg_job_t* jobs = calloc(options.count, sizeof(test_blargg_job_t));
+    M_EXIT_IF_NULL(jobs, options.count * sizeof(test_blargg_job_t));
+    for (size_t i = 0; i < options.count; ++i) {
+        jobs[i].rom = options.roms[i];
+    }
+
+    const int err = run(&options, jobs);
+
+    // workers still running after an error
+    for (size_t i = 0; i < options.count; ++i) {
+        if (jobs[i].pid > 0) {
+            waitpid(jobs[i].pid, NULL, 0);
+            close(jobs[i].pipe);
+        }
+    }
+    free(jobs);
+
+    return err;
+}
@@ -7,6 +7,7 @@
  */
 
 #include "gameboy.h"
+#include "blargg.h"
 #include "util.h"  // for zero_init_var()
 #include "error.h"
 
@@ -23,8 +24,30 @@ static void error(const char* pgm, const char* msg)
     fputs("ERROR: ", stderr);
     if (msg != NULL) fputs(msg, stderr);
     fprintf(stderr, "\nusage:    %s input_file [iterations]\n", pgm);
+    fprintf(stderr, "          %s input_file --blargg [max_cycles]\n", pgm);
+    fprintf(stderr, "          (runs a blargg test ROM headless until it prints its verdict, see test-blargg to run many)\n");
     fprintf(stderr, "examples: %s rom.gb 1000\n", pgm);
     fprintf(stderr, "          %s game.gb\n", pgm);
+    fprintf(stderr, "          %s cpu_instrs.gb --blargg\n", pgm);
+}
+
+// ======================================================================
+/**
+ * @brief Runs a blargg test ROM until its verdict, printing its serial output;
+ *        returns an error code, or 1 if the test did not pass
+ */
+static int run_blargg(const char* filename, uint64_t max_cycles)
+{
+    blargg_result_t result;
+    M_EXIT_IF_ERR(blargg_run(filename, GB_ACCURACY_CYCLE, max_cycles, &result));
+
+    fwrite(result.output, 1, result.size, stdout);
+    printf("\n%s after %" PRIu64 " cycles (%.1f guest seconds)\n", blargg_verdict_name(result.verdict),
+           result.cycles, (double) result.cycles / GB_CYCLES_PER_S);
+    const int status = result.verdict != BLARGG_PASSED;
+    blargg_result_free(&result);
+
+    return status;
 }
 
 // ======================================================================
@@ -93,9 +116,13 @@ int main(int argc, char* argv[])
 
     const char* const filename = argv[1];
 
+    if (argc > 2 && !strcmp(argv[2], "--blargg")) {
+        return run_blargg(filename, argc > 3 ? (uint64_t) atoll(argv[3]) : BLARGG_DEFAULT_MAX_CYCLES);
+    }
+
     gameboy_t gb;
     zero_init_var(gb);
-    int err = gameboy_create(&gb, filename);
+    int err = gameboy_create(&gb, filename, GB_ACCURACY_CYCLE);
     if (err != ERR_NONE) {
         gameboy_free(&gb);
         return err;
@@ -106,6 +133,13 @@ int main(int argc, char* argv[])
         cycle = (uint64_t) atoll(argv[2]);
     }
 
+    // only the cpu and the memory are dumped: no need to render the screen
+    err = gameboy_set_render_period(&gb, LCDC_RENDER_OFF);
+    if (err != ERR_NONE) {
+        gameboy_free(&gb);
+        return err;
+    }
+
     err = gameboy_run_until(&gb, cycle);
     if (err == ERR_NONE) {
         cpu_dump_to_file("dump_cpu.txt", &(gb.cpu));
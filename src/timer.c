@@ -41,6 +41,56 @@ int timer_cycle(gbtimer_t* timer){
     return ERR_NONE;
 }
 
+int timer_advance(gbtimer_t* timer, uint64_t cycles){
+    
+    M_REQUIRE_NON_NULL(timer);
+    
+    //The secondary timer is incremented each time the bit it looks at falls,
+    //i.e. each time the counter reaches a multiple of twice its weight (the counter only moves by GB_TICS_PER_CYCLE)
+    const data_t TAC = cpu_read_at_idx(timer->cpu, REG_TAC);
+    const uint64_t start = timer->counter;
+    const uint64_t end = start + cycles * GB_TICS_PER_CYCLE;
+    uint64_t increments = 0;
+    if(bit_get(TAC, TIMER_ACTIVE_BIT)){
+        const uint8_t shift = (uint8_t)(getTIMAIncrementIndex(TAC) + 1);
+        increments = (end >> shift) - (start >> shift);
+    }
+    
+    timer->counter = (uint16_t) end;
+    M_EXIT_IF_ERR(cpu_write_at_idx(timer->cpu, REG_DIV, msb8(timer->counter)));
+    
+    if(increments > 0){
+        data_t secondaryCounter = cpu_read_at_idx(timer->cpu, REG_TIMA);
+        for(; increments > 0; --increments){
+            secondaryCounter+=1;
+            if(secondaryCounter == 0){//The counter has overflowed => launch Exception
+                cpu_request_interrupt(timer->cpu, TIMER);
+                secondaryCounter = cpu_read_at_idx(timer->cpu, REG_TMA);
+            }
+        }
+        M_EXIT_IF_ERR(cpu_write_at_idx(timer->cpu, REG_TIMA, secondaryCounter));
+    }
+    
+    return ERR_NONE;
+}
+
+uint64_t timer_idle_cycles(const gbtimer_t* timer){
+    
+    if(timer == NULL){
+        return 0;
+    }
+    
+    const data_t TAC = cpu_read_at_idx(timer->cpu, REG_TAC);
+    if(!bit_get(TAC, TIMER_ACTIVE_BIT)){
+        return UINT64_MAX;
+    }
+    
+    //Cycles until the counter reaches the next multiple of twice the weight of the bit looked at (see timer_advance)
+    const uint32_t period = (uint32_t) 1 << (getTIMAIncrementIndex(TAC) + 1);
+    const uint32_t ticks = period - timer->counter % period;
+    return (ticks + GB_TICS_PER_CYCLE - 1) / GB_TICS_PER_CYCLE - 1;
+}
+
 int timer_bus_listener(gbtimer_t* timer, addr_t addr){
     
     M_REQUIRE_NON_NULL(timer);
@@ -56,6 +56,26 @@ int timer_init(gbtimer_t* timer, cpu_t* cpu);
 int timer_cycle(gbtimer_t* timer);
 
 
+/**
+ * @brief Runs Timer cycles at once, as that many calls to timer_cycle() would
+ *
+ * @param timer timer to cycle
+ * @param cycles number of cycles
+ * @return error code
+ */
+int timer_advance(gbtimer_t* timer, uint64_t cycles);
+
+
+/**
+ * @brief Number of the next cycles in which the secondary timer (TIMA) does not change
+ *        (provided its configuration does not change)
+ *
+ * @param timer the timer
+ * @return the number of cycles (UINT64_MAX if the timer is stopped, 0 if timer is NULL)
+ */
+uint64_t timer_idle_cycles(const gbtimer_t* timer);
+
+
 /**
  * @brief Timer bus listening handler
  *
@@ -0,0 +1,460 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>//PRIu64, PRIX16
+#include "trace.h"
+#include "lz.h"
+#include "error.h"
+#include "util.h"
+
+#define TRACE_BLOCK_RAW 0
+#define TRACE_BLOCK_LZ 1
+#define TRACE_BLOCK_HEADER_SIZE 9 //method, size and stored size
+#define TRACE_VARINT_MAX_SIZE 10
+#define TRACE_ENTRY_MAX_SIZE (1 + 3 + 1 + TRACE_VARINT_MAX_SIZE + 5 * 2) //flags, PC, opcode, cycle, registers
+#define TRACE_BLOCK_MAX_SIZE (TRACE_CHUNK_ENTRIES * TRACE_ENTRY_MAX_SIZE)
+
+//Flags of the registers that changed since the last entry
+#define TRACE_AF 0
+#define TRACE_BC 1
+#define TRACE_DE 2
+#define TRACE_HL 3
+#define TRACE_SP 4
+
+// ======================================================================
+// Encoding of the entries: each entry is encoded relatively to the last one of its block
+// (the first one relatively to an entry at 0), as
+//   flags of the changed registers, zigzag varint of the PC delta, opcode, varint of the cycle delta,
+//   then the changed registers (little endian)
+
+/**
+ * @brief Writes an unsigned LEB128 varint, returns its size
+ */
+static size_t trace_put_varint(uint8_t* out, uint64_t value){
+    size_t size = 0;
+    for(; value >= 0x80; value >>= 7){
+        out[size++] = (uint8_t) (value | 0x80);
+    }
+    out[size++] = (uint8_t) value;
+    return size;
+}
+
+/**
+ * @brief Reads an unsigned LEB128 varint
+ */
+static int trace_get_varint(const uint8_t** in, const uint8_t* end, uint64_t* value){
+    *value = 0;
+    for(unsigned int shift = 0; shift < 7 * TRACE_VARINT_MAX_SIZE; shift += 7){
+        M_REQUIRE(*in < end, ERR_BAD_PARAMETER, "Truncated %s", "varint");
+        const uint8_t byte = *(*in)++;
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80)){
+            return ERR_NONE;
+        }
+    }
+    M_EXIT_ERR(ERR_BAD_PARAMETER, "Varint longer than %d bytes", TRACE_VARINT_MAX_SIZE);
+}
+
+/**
+ * @brief Writes a register if it changed, returns the size written
+ */
+static size_t trace_put_register(uint8_t* out, uint8_t* flags, unsigned int flag, uint16_t value, uint16_t last){
+    if(value == last){
+        return 0;
+    }
+    bit_set(flags, flag);
+    out[0] = (uint8_t) value;
+    out[1] = (uint8_t) (value >> 8);
+    return 2;
+}
+
+/**
+ * @brief Reads a register if it changed (it keeps its last value otherwise)
+ */
+static int trace_get_register(const uint8_t** in, const uint8_t* end, uint8_t flags, unsigned int flag, uint16_t* value){
+    if(bit_get(flags, flag)){
+        M_REQUIRE(end - *in >= 2, ERR_BAD_PARAMETER, "Truncated %s", "register");
+        *value = (uint16_t) ((*in)[0] | ((*in)[1] << 8));
+        *in += 2;
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Encodes an entry relatively to the last one, returns the size written (at most TRACE_ENTRY_MAX_SIZE)
+ */
+static size_t trace_encode(uint8_t* out, const trace_entry_t* entry, const trace_entry_t* last){
+
+    uint8_t flags = 0;
+    size_t size = 1;
+    const int32_t pc_delta = (int32_t) entry->PC - (int32_t) last->PC;
+    size += trace_put_varint(out + size, pc_delta < 0 ? ((uint64_t) -pc_delta << 1) - 1 : (uint64_t) pc_delta << 1);
+    out[size++] = entry->opcode;
+    size += trace_put_varint(out + size, entry->cycle - last->cycle);
+    size += trace_put_register(out + size, &flags, TRACE_AF, entry->AF, last->AF);
+    size += trace_put_register(out + size, &flags, TRACE_BC, entry->BC, last->BC);
+    size += trace_put_register(out + size, &flags, TRACE_DE, entry->DE, last->DE);
+    size += trace_put_register(out + size, &flags, TRACE_HL, entry->HL, last->HL);
+    size += trace_put_register(out + size, &flags, TRACE_SP, entry->SP, last->SP);
+    out[0] = flags;
+
+    return size;
+}
+
+/**
+ * @brief Decodes an entry relatively to the last one (which it replaces)
+ */
+static int trace_decode(const uint8_t** in, const uint8_t* end, trace_entry_t* last){
+
+    M_REQUIRE(*in < end, ERR_BAD_PARAMETER, "Truncated %s", "entry");
+    const uint8_t flags = *(*in)++;
+
+    uint64_t pc_delta = 0;
+    M_EXIT_IF_ERR(trace_get_varint(in, end, &pc_delta));
+    last->PC = (addr_t) (pc_delta & 1 ? last->PC - ((pc_delta + 1) >> 1) : last->PC + (pc_delta >> 1));
+    M_REQUIRE(*in < end, ERR_BAD_PARAMETER, "Truncated %s", "opcode");
+    last->opcode = *(*in)++;
+    uint64_t cycle_delta = 0;
+    M_EXIT_IF_ERR(trace_get_varint(in, end, &cycle_delta));
+    last->cycle += cycle_delta;
+    M_EXIT_IF_ERR(trace_get_register(in, end, flags, TRACE_AF, &last->AF));
+    M_EXIT_IF_ERR(trace_get_register(in, end, flags, TRACE_BC, &last->BC));
+    M_EXIT_IF_ERR(trace_get_register(in, end, flags, TRACE_DE, &last->DE));
+    M_EXIT_IF_ERR(trace_get_register(in, end, flags, TRACE_HL, &last->HL));
+    M_EXIT_IF_ERR(trace_get_register(in, end, flags, TRACE_SP, &last->SP));
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writes a 32 bits little endian integer
+ */
+static void trace_put32(uint8_t* out, uint32_t value){
+    for(size_t i = 0; i < 4; ++i){
+        out[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Reads a 32 bits little endian integer
+ */
+static uint32_t trace_get32(const uint8_t* in){
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+// ======================================================================
+// Writer
+
+/**
+ * @brief Encodes a chunk as a block (compressed if asked and smaller) and writes it (writer only)
+ */
+static int trace_write_block(trace_t* trace, const trace_entry_t* entries, size_t count){
+
+    trace_entry_t last;
+    zero_init_var(last);
+    size_t size = 0;
+    for(size_t i = 0; i < count; ++i){
+        size += trace_encode(trace->block + size, &entries[i], &last);
+        last = entries[i];
+    }
+
+    uint8_t header[TRACE_BLOCK_HEADER_SIZE];
+    const uint8_t* stored = trace->block;
+    size_t stored_size = size;
+    header[0] = TRACE_BLOCK_RAW;
+    if(trace->compress){
+        size_t compressed = 0;
+        M_EXIT_IF_ERR(lz_compress(trace->block, size, trace->compressed, LZ_BOUND(TRACE_BLOCK_MAX_SIZE), &compressed));
+        if(compressed < size){
+            header[0] = TRACE_BLOCK_LZ;
+            stored = trace->compressed;
+            stored_size = compressed;
+        }
+    }
+    trace_put32(header + 1, (uint32_t) size);
+    trace_put32(header + 5, (uint32_t) stored_size);
+
+    M_REQUIRE(fwrite(header, 1, sizeof(header), trace->file) == sizeof(header)
+              && fwrite(stored, 1, stored_size, trace->file) == stored_size, ERR_IO,
+              "Cannot write a block of %zu bytes", stored_size);
+    trace->bytes += sizeof(header) + stored_size;
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writer thread: writes the chunks as they are handed over, until the trace is closed.
+ *        After an error it keeps taking the chunks (without writing them), so that the emulation never blocks.
+ */
+static void* trace_writer(void* arg){
+
+    trace_t* const trace = arg;
+
+    pthread_mutex_lock(&trace->lock);
+    for(;;){
+        while(trace->written == trace->handed && !trace->closing){
+            pthread_cond_wait(&trace->changed, &trace->lock);
+        }
+        if(trace->written == trace->handed){
+            break;
+        }
+        const size_t chunk = trace->written % TRACE_CHUNKS;
+        const size_t count = trace->sizes[chunk];
+        const bit_t failed = trace->error != ERR_NONE;
+        pthread_mutex_unlock(&trace->lock);
+
+        const int err = failed ? ERR_NONE : trace_write_block(trace, trace->chunks + chunk * TRACE_CHUNK_ENTRIES, count);
+
+        pthread_mutex_lock(&trace->lock);
+        if(trace->error == ERR_NONE){
+            trace->error = err;
+        }
+        ++trace->written;
+        pthread_cond_broadcast(&trace->changed);
+    }
+    pthread_mutex_unlock(&trace->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Frees the buffers of a trace and closes its file
+ */
+static void trace_free(trace_t* trace){
+    if(trace->file != NULL){
+        fclose(trace->file);
+    }
+    trace->file = NULL;
+    free(trace->chunks);
+    trace->chunks = NULL;
+    free(trace->block);
+    trace->block = NULL;
+    free(trace->compressed);
+    trace->compressed = NULL;
+}
+
+int trace_open(trace_t* trace, const char* filename, bit_t compress){
+
+    M_REQUIRE_NON_NULL(trace);
+    M_REQUIRE_NON_NULL(filename);
+
+    zero_init_ptr(trace);
+    trace->compress = compress;
+    trace->chunks = calloc(TRACE_CHUNKS * TRACE_CHUNK_ENTRIES, sizeof(trace_entry_t));
+    trace->block = malloc(TRACE_BLOCK_MAX_SIZE);
+    trace->compressed = malloc(LZ_BOUND(TRACE_BLOCK_MAX_SIZE));
+    if(trace->chunks == NULL || trace->block == NULL || trace->compressed == NULL){
+        trace_free(trace);
+        M_EXIT_ERR(ERR_MEM, "Cannot allocate the buffers of trace %s", filename);
+    }
+
+    trace->file = fopen(filename, "wb");
+    if(trace->file == NULL || fprintf(trace->file, TRACE_HEADER "\n") < 0){
+        trace_free(trace);
+        M_EXIT_ERR(ERR_IO, "cannot open file \"%s\" for writing\n", filename);
+    }
+
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->changed, NULL);
+    if(pthread_create(&trace->writer, NULL, trace_writer, trace) != 0){
+        pthread_cond_destroy(&trace->changed);
+        pthread_mutex_destroy(&trace->lock);
+        trace_free(trace);
+        M_EXIT_ERR(ERR_MEM, "Cannot start the writer of trace %s", filename);
+    }
+
+    return ERR_NONE;
+}
+
+int trace_flush(trace_t* trace){
+
+    M_REQUIRE_NON_NULL(trace);
+    M_REQUIRE_NON_NULL(trace->chunks);
+
+    pthread_mutex_lock(&trace->lock);
+    if(trace->fill > 0){
+        trace->sizes[trace->handed % TRACE_CHUNKS] = trace->fill;
+        ++trace->handed;
+        trace->fill = 0;
+        pthread_cond_broadcast(&trace->changed);
+    }
+    //The next chunk to fill must have been written
+    if(trace->handed - trace->written >= TRACE_CHUNKS){
+        ++trace->waits;
+    }
+    while(trace->handed - trace->written >= TRACE_CHUNKS){
+        pthread_cond_wait(&trace->changed, &trace->lock);
+    }
+    const int err = trace->error;
+    pthread_mutex_unlock(&trace->lock);
+
+    return err;
+}
+
+int trace_close(trace_t* trace){
+
+    M_REQUIRE_NON_NULL(trace);
+    M_REQUIRE_NON_NULL(trace->chunks);
+
+    int err = trace_flush(trace);
+
+    pthread_mutex_lock(&trace->lock);
+    trace->closing = 1;
+    pthread_cond_broadcast(&trace->changed);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->writer, NULL);
+
+    if(err == ERR_NONE){
+        err = trace->error;
+    }
+    if(fclose(trace->file) != 0 && err == ERR_NONE){
+        err = ERR_IO;
+    }
+    trace->file = NULL;
+    pthread_cond_destroy(&trace->changed);
+    pthread_mutex_destroy(&trace->lock);
+    trace_free(trace);
+
+    return err;
+}
+
+// ======================================================================
+// Reader
+
+int trace_reader_open(trace_reader_t* reader, const char* filename){
+
+    M_REQUIRE_NON_NULL(reader);
+    M_REQUIRE_NON_NULL(filename);
+
+    zero_init_ptr(reader);
+    reader->file = fopen(filename, "rb");
+    M_EXIT_IF(reader->file == NULL, ERR_IO, "cannot open file \"%s\" for reading\n", filename);
+
+    char header[sizeof(TRACE_HEADER) + 1];
+    zero_init_var(header);
+    if(fgets(header, sizeof(header), reader->file) == NULL || strcmp(header, TRACE_HEADER "\n")){
+        trace_reader_close(reader);
+        M_EXIT_ERR(ERR_BAD_PARAMETER, "\"%s\" is not a trace", filename);
+    }
+
+    reader->block = malloc(TRACE_BLOCK_MAX_SIZE);
+    reader->stored = malloc(TRACE_BLOCK_MAX_SIZE);
+    if(reader->block == NULL || reader->stored == NULL){
+        trace_reader_close(reader);
+        M_EXIT_ERR(ERR_MEM, "Cannot allocate the buffers of trace %s", filename);
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reads the next block of a trace
+ */
+static int trace_reader_block(trace_reader_t* reader, bit_t* end){
+
+    uint8_t header[TRACE_BLOCK_HEADER_SIZE];
+    const size_t read = fread(header, 1, sizeof(header), reader->file);
+    if(read == 0 && feof(reader->file)){
+        *end = 1;
+        return ERR_NONE;
+    }
+    M_REQUIRE(read == sizeof(header), ERR_IO, "Truncated block header after entry %" PRIu64, reader->index);
+
+    const size_t size = trace_get32(header + 1);
+    const size_t stored_size = trace_get32(header + 5);
+    M_REQUIRE((header[0] == TRACE_BLOCK_RAW && stored_size == size) || header[0] == TRACE_BLOCK_LZ,
+              ERR_BAD_PARAMETER, "Bad block after entry %" PRIu64, reader->index);
+    M_REQUIRE(size <= TRACE_BLOCK_MAX_SIZE && stored_size <= TRACE_BLOCK_MAX_SIZE, ERR_BAD_PARAMETER,
+              "Block too large after entry %" PRIu64, reader->index);
+
+    uint8_t* const stored = header[0] == TRACE_BLOCK_RAW ? reader->block : reader->stored;
+    M_REQUIRE(fread(stored, 1, stored_size, reader->file) == stored_size, ERR_IO,
+              "Truncated block after entry %" PRIu64, reader->index);
+    if(header[0] == TRACE_BLOCK_LZ){
+        size_t decompressed = 0;
+        M_EXIT_IF_ERR(lz_decompress(reader->stored, stored_size, reader->block, TRACE_BLOCK_MAX_SIZE, &decompressed));
+        M_REQUIRE(decompressed == size, ERR_BAD_PARAMETER, "Bad block size after entry %" PRIu64, reader->index);
+    }
+
+    reader->size = size;
+    reader->position = 0;
+    zero_init_var(reader->last);
+
+    return ERR_NONE;
+}
+
+int trace_reader_next(trace_reader_t* reader, trace_entry_t* entry, bit_t* end){
+
+    M_REQUIRE_NON_NULL(reader);
+    M_REQUIRE_NON_NULL(reader->file);
+    M_REQUIRE_NON_NULL(entry);
+    M_REQUIRE_NON_NULL(end);
+
+    *end = 0;
+    while(reader->position == reader->size){
+        M_EXIT_IF_ERR(trace_reader_block(reader, end));
+        if(*end){
+            return ERR_NONE;
+        }
+    }
+
+    const uint8_t* in = reader->block + reader->position;
+    M_EXIT_IF_ERR(trace_decode(&in, reader->block + reader->size, &reader->last));
+    reader->position = (size_t) (in - reader->block);
+    ++reader->index;
+    *entry = reader->last;
+
+    return ERR_NONE;
+}
+
+void trace_reader_close(trace_reader_t* reader){
+
+    if(reader == NULL){
+        return;
+    }
+
+    if(reader->file != NULL){
+        fclose(reader->file);
+    }
+    free(reader->block);
+    free(reader->stored);
+    zero_init_ptr(reader);
+}
+
+// ======================================================================
+int trace_diff(trace_reader_t* first, trace_reader_t* second, trace_divergence_t* divergence){
+
+    M_REQUIRE_NON_NULL(first);
+    M_REQUIRE_NON_NULL(second);
+    M_REQUIRE_NON_NULL(divergence);
+
+    zero_init_ptr(divergence);
+    for(;;){
+        M_EXIT_IF_ERR(trace_reader_next(first, &divergence->first, &divergence->first_ended));
+        M_EXIT_IF_ERR(trace_reader_next(second, &divergence->second, &divergence->second_ended));
+        if(divergence->first_ended && divergence->second_ended){
+            return ERR_NONE;
+        }
+        if(divergence->first_ended || divergence->second_ended
+           || !trace_entry_equal(&divergence->first, &divergence->second)){
+            divergence->diverged = 1;
+            return ERR_NONE;
+        }
+        divergence->common = divergence->first;
+        divergence->has_common = 1;
+        ++divergence->index;
+    }
+}
+
+bit_t trace_entry_equal(const trace_entry_t* first, const trace_entry_t* second){
+    return first != NULL && second != NULL && first->cycle == second->cycle && first->PC == second->PC
+           && first->opcode == second->opcode && first->AF == second->AF && first->BC == second->BC
+           && first->DE == second->DE && first->HL == second->HL && first->SP == second->SP;
+}
+
+void trace_entry_print(FILE* output, const trace_entry_t* entry){
+    if(output != NULL && entry != NULL){
+        fprintf(output, "cycle %" PRIu64 " PC 0x%04" PRIX16 " opcode 0x%02" PRIX8 " AF 0x%04" PRIX16 " BC 0x%04" PRIX16
+                " DE 0x%04" PRIX16 " HL 0x%04" PRIX16 " SP 0x%04" PRIX16 "\n", entry->cycle, entry->PC, entry->opcode,
+                entry->AF, entry->BC, entry->DE, entry->HL, entry->SP);
+    }
+}
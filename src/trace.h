@@ -0,0 +1,197 @@
+#pragma once
+
+/**
+ * @file trace.h
+ * @brief Instruction trace: the PC, opcode, registers and cycle of each instruction,
+ *        delta-encoded in blocks (optionally compressed, see lz.h) and written by a background thread
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint64_t
+#include <stddef.h>//size_t
+#include <stdio.h>//FILE
+#include <pthread.h>
+
+#include "bit.h"//bit_t
+#include "memory.h"//addr_t, data_t
+#include "error.h"//ERR_NONE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_HEADER "GBTRACE 1"
+
+/**
+ * @brief The emulation fills chunks of entries, that the writer encodes as blocks.
+ *        When the TRACE_CHUNKS chunks are all waiting to be written, the emulation waits for the writer.
+ */
+#define TRACE_CHUNK_ENTRIES 4096
+#define TRACE_CHUNKS 8
+
+/**
+ * @brief State of the CPU when an instruction starts
+ */
+typedef struct {
+    uint64_t cycle; //cycle of the gameboy at which the instruction starts
+    addr_t PC;
+    data_t opcode;
+    uint16_t AF;
+    uint16_t BC;
+    uint16_t DE;
+    uint16_t HL;
+    addr_t SP;
+} trace_entry_t;
+
+/**
+ * @brief Trace writer data structure.
+ *        Only one thread records entries, the writer thread encodes and writes them.
+ */
+typedef struct {
+    FILE* file;
+    bit_t compress; //blocks are compressed
+    trace_entry_t* chunks; //TRACE_CHUNKS chunks of TRACE_CHUNK_ENTRIES entries
+    size_t sizes[TRACE_CHUNKS]; //entries of the chunks handed over to the writer
+    size_t fill; //entries of the chunk being filled (the one after the handed over chunks)
+    uint8_t* block; //encoded block (writer only)
+    uint8_t* compressed; //compressed block (writer only)
+
+    pthread_mutex_t lock; //protects what follows
+    pthread_cond_t changed; //a chunk was handed over or written, or the trace is closing
+    uint64_t handed; //chunks handed over to the writer
+    uint64_t written; //chunks written
+    bit_t closing;
+    int error; //first error of the writer
+    pthread_t writer;
+
+    //Statistics
+    uint64_t entries; //entries recorded
+    uint64_t bytes; //bytes written (writer only until the trace is closed)
+    uint64_t waits; //times the emulation had to wait for the writer
+} trace_t;
+
+/**
+ * @brief Trace reader data structure.
+ */
+typedef struct {
+    FILE* file;
+    uint8_t* block; //decoded block
+    uint8_t* stored; //block as stored in the file
+    size_t size; //size in bytes of the decoded block
+    size_t position; //position of the next entry in the block
+    trace_entry_t last; //last entry read in the block, the entries are encoded relatively to it
+    uint64_t index; //entries read
+} trace_reader_t;
+
+/**
+ * @brief First difference between two traces
+ */
+typedef struct {
+    bit_t diverged; //0 if the traces are identical
+    uint64_t index; //index of the first different entry (or of the first entry missing in one of the traces)
+    bit_t first_ended; //the first trace has no entry index
+    bit_t second_ended; //the second trace has no entry index
+    trace_entry_t first; //entry index of each trace
+    trace_entry_t second;
+    bit_t has_common; //there is an entry before the divergence
+    trace_entry_t common; //last identical entry
+} trace_divergence_t;
+
+/**
+ * @brief Creates a trace file, and starts its writer thread
+ *
+ * @param trace trace to open
+ * @param filename name of the file
+ * @param compress 1 to compress the blocks
+ * @return error code
+ */
+int trace_open(trace_t* trace, const char* filename, bit_t compress);
+
+/**
+ * @brief Hands the chunk being filled over to the writer (waiting for a free chunk if there is none)
+ *
+ * @param trace the trace
+ * @return error code (the first error of the writer, if any)
+ */
+int trace_flush(trace_t* trace);
+
+/**
+ * @brief Records an entry
+ *
+ * @param trace the trace
+ * @param entry the entry
+ * @return error code
+ */
+static inline int trace_record(trace_t* trace, const trace_entry_t* entry)
+{
+    trace->chunks[(trace->handed % TRACE_CHUNKS) * TRACE_CHUNK_ENTRIES + trace->fill] = *entry;
+    ++trace->fill;
+    ++trace->entries;
+    return trace->fill == TRACE_CHUNK_ENTRIES ? trace_flush(trace) : ERR_NONE;
+}
+
+/**
+ * @brief Writes the recorded entries, stops the writer thread and closes the file
+ *
+ * @param trace trace to close
+ * @return error code (ERR_IO if some entries could not be written)
+ */
+int trace_close(trace_t* trace);
+
+/**
+ * @brief Opens a trace file
+ *
+ * @param reader reader to open
+ * @param filename name of the file
+ * @return error code
+ */
+int trace_reader_open(trace_reader_t* reader, const char* filename);
+
+/**
+ * @brief Reads the next entry of a trace
+ *
+ * @param reader the reader
+ * @param entry (output) the entry
+ * @param end (output) 1 if the trace has no more entries (entry is then unchanged)
+ * @return error code
+ */
+int trace_reader_next(trace_reader_t* reader, trace_entry_t* entry, bit_t* end);
+
+/**
+ * @brief Closes a trace file
+ *
+ * @param reader reader to close
+ */
+void trace_reader_close(trace_reader_t* reader);
+
+/**
+ * @brief Finds the first entry where two traces differ
+ *
+ * @param first reader of the first trace, at its start
+ * @param second reader of the second trace, at its start
+ * @param divergence (output) the first difference
+ * @return error code
+ */
+int trace_diff(trace_reader_t* first, trace_reader_t* second, trace_divergence_t* divergence);
+
+/**
+ * @brief Tells whether two entries are identical
+ *
+ * @param first an entry
+ * @param second an entry
+ * @return 1 if they are, 0 otherwise
+ */
+bit_t trace_entry_equal(const trace_entry_t* first, const trace_entry_t* second);
+
+/**
+ * @brief Prints an entry on one line
+ *
+ * @param output where to print
+ * @param entry the entry
+ */
+void trace_entry_print(FILE* output, const trace_entry_t* entry);
+
+#ifdef __cplusplus
+}
+#endif
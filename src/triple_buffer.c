@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include "triple_buffer.h"
+#include "error.h"
+#include "util.h"
+
+/**
+ * @brief Flag of middle telling that it was published and not taken yet
+ */
+#define TRIPLE_BUFFER_FRESH 0x4u
+#define TRIPLE_BUFFER_INDEX_MASK 0x3u
+
+int triple_buffer_create(triple_buffer_t* buffer, size_t size){
+
+    M_REQUIRE_NON_NULL(buffer);
+    M_REQUIRE(size != 0, ERR_BAD_PARAMETER, "Size (%zu) is 0", size);
+
+    zero_init_ptr(buffer);
+
+    for(size_t i = 0; i < TRIPLE_BUFFER_SLOTS; ++i){
+        buffer->slots[i] = calloc(1, size);
+        if(buffer->slots[i] == NULL){
+            triple_buffer_free(buffer);
+            return ERR_MEM;
+        }
+    }
+    buffer->size = size;
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+
+    return ERR_NONE;
+}
+
+uint8_t* triple_buffer_back(triple_buffer_t* buffer){
+    return buffer == NULL ? NULL : buffer->slots[buffer->back];
+}
+
+int triple_buffer_publish(triple_buffer_t* buffer){
+
+    M_REQUIRE_NON_NULL(buffer);
+
+    //Release: the content of the slot is visible to the consumer once it sees the new middle
+    const unsigned int previous = atomic_exchange_explicit(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+    buffer->back = previous & TRIPLE_BUFFER_INDEX_MASK;
+    ++buffer->published;
+
+    return ERR_NONE;
+}
+
+const uint8_t* triple_buffer_front(triple_buffer_t* buffer, int* fresh){
+
+    if(buffer == NULL){
+        return NULL;
+    }
+
+    const int is_fresh = (atomic_load_explicit(&buffer->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH) != 0;
+    if(is_fresh){
+        //Only the consumer clears the flag: the slot taken is the last one published
+        const unsigned int previous = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+        buffer->front = previous & TRIPLE_BUFFER_INDEX_MASK;
+        ++buffer->taken;
+    }
+    if(fresh != NULL){
+        *fresh = is_fresh;
+    }
+
+    return buffer->slots[buffer->front];
+}
+
+void triple_buffer_free(triple_buffer_t* buffer){
+    if(buffer != NULL){
+        for(size_t i = 0; i < TRIPLE_BUFFER_SLOTS; ++i){
+            free(buffer->slots[i]);
+            buffer->slots[i] = NULL;
+        }
+        buffer->size = 0;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/**
+ * @file triple_buffer.h
+ * @brief Lock-free triple buffer, to hand over the last complete frame from one thread to another
+ *
+ * @date 2021
+ */
+
+#include <stdint.h>//uint8_t, uint64_t
+#include <stddef.h>//size_t
+#include <stdatomic.h>//atomic_uint
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRIPLE_BUFFER_SLOTS 3
+
+/**
+ * @brief Triple buffer data structure.
+ *        The producer fills back and publishes it as middle, the consumer takes middle as front:
+ *        neither of them ever waits for the other, and the consumer always gets the last published slot.
+ */
+typedef struct {
+    uint8_t* slots[TRIPLE_BUFFER_SLOTS];
+    size_t size; //size in bytes of each slot
+    unsigned int back; //slot written by the producer
+    unsigned int front; //slot read by the consumer
+    atomic_uint middle; //last published slot, with TRIPLE_BUFFER_FRESH if the consumer did not take it yet
+
+    //Statistics
+    uint64_t published; //slots published (producer only)
+    uint64_t taken; //slots taken (consumer only)
+} triple_buffer_t;
+
+/**
+ * @brief Creates a triple buffer (with all slots filled with 0)
+ *
+ * @param buffer triple buffer to create
+ * @param size size in bytes of each slot
+ * @return error code
+ */
+int triple_buffer_create(triple_buffer_t* buffer, size_t size);
+
+/**
+ * @brief Gives the slot the producer has to fill (producer only)
+ *
+ * @param buffer the triple buffer
+ * @return the back slot, NULL if buffer is NULL
+ */
+uint8_t* triple_buffer_back(triple_buffer_t* buffer);
+
+/**
+ * @brief Publishes the back slot, the producer getting a new one (producer only)
+ *
+ * @param buffer the triple buffer
+ * @return error code
+ */
+int triple_buffer_publish(triple_buffer_t* buffer);
+
+/**
+ * @brief Gives the last published slot (consumer only)
+ *
+ * @param buffer the triple buffer
+ * @param fresh (output, may be NULL) 1 if the slot was published since the last call, 0 if it is the same slot again
+ * @return the front slot, NULL if buffer is NULL
+ */
+const uint8_t* triple_buffer_front(triple_buffer_t* buffer, int* fresh);
+
+/**
+ * @brief Frees a triple buffer
+ *
+ * @param buffer triple buffer to free
+ */
+void triple_buffer_free(triple_buffer_t* buffer);
+
+#ifdef __cplusplus
+}
+#endif
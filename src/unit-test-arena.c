@@ -0,0 +1,222 @@
+/**
+ * @file unit-test-arena.c
+ * @brief Unit test code for arena and its use by bit vectors and images
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "arena.h"
+#include "bit_vector.h"
+#include "image.h"
+
+#define ARENA_TEST_SIZE 1024
+
+START_TEST(arena_create_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    arena_t arena;
+    ck_assert_bad_param(arena_create(NULL, ARENA_TEST_SIZE));
+    ck_assert_bad_param(arena_create(&arena, 0));
+    ck_assert_bad_param(arena_reset(NULL));
+    ck_assert_ptr_null(arena_alloc(NULL, 8));
+    ck_assert_int_eq(arena_contains(NULL, &arena), 0);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(arena_alloc_reset_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    arena_t arena;
+    ck_assert_err_none(arena_create(&arena, ARENA_TEST_SIZE));
+    // nothing allocated until the first block, not even by a block that does not fit
+    ck_assert_ptr_null(arena.memory);
+    ck_assert_ptr_null(arena_alloc(&arena, 2 * ARENA_TEST_SIZE));
+    ck_assert_ptr_null(arena.memory);
+    ck_assert_int_eq(arena_contains(&arena, &arena), 0);
+    ck_assert_uint_eq(arena.fallbacks, 1);
+
+    uint8_t* p1 = arena_alloc(&arena, 3);
+    uint8_t* p2 = arena_alloc(&arena, 40);
+    ck_assert_ptr_nonnull(p1);
+    ck_assert_ptr_nonnull(p2);
+    ck_assert(p2 > p1);
+    ck_assert_int_eq(((uintptr_t) p2) % sizeof(size_t), 0);
+    ck_assert_int_eq(arena_contains(&arena, p1), 1);
+    ck_assert_int_eq(arena_contains(&arena, p2 + 39), 1);
+    ck_assert_int_eq(arena.live, 2);
+    ck_assert_uint_eq(arena.allocations, 2);
+
+    // blocks still in use: reset refused
+    ck_assert_bad_param(arena_reset(&arena));
+    ck_assert_uint_eq(arena.failed_resets, 1);
+    arena_release(&arena, p1);
+    arena_release(&arena, p2);
+    ck_assert_int_eq(arena.live, 0);
+
+    const size_t high_water = arena.high_water;
+    ck_assert_uint_ge(high_water, 43);
+    ck_assert_err_none(arena_reset(&arena));
+    ck_assert_uint_eq(arena.top, 0);
+    ck_assert_uint_eq(arena.resets, 1);
+    ck_assert_uint_eq(arena.high_water, high_water);
+
+    // memory is reused after a reset
+    ck_assert_ptr_eq(arena_alloc(&arena, 3), p1);
+
+    // too big: fallback
+    ck_assert_ptr_null(arena_alloc(&arena, ARENA_TEST_SIZE));
+    ck_assert_uint_eq(arena.fallbacks, 2);
+
+    arena_free(&arena);
+    ck_assert_ptr_null(arena.memory);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(bit_vector_arena_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    arena_t arena;
+    ck_assert_err_none(arena_create(&arena, ARENA_TEST_SIZE));
+
+    bit_vector_t* heap = bit_vector_create(100, 1);
+    ck_assert_ptr_null(bit_vector_use_arena(&arena));
+
+    bit_vector_t* temp = bit_vector_cpy(heap);
+    ck_assert_ptr_nonnull(temp);
+    ck_assert_int_eq(bit_vector_in_arena(temp), 1);
+    ck_assert_int_eq(bit_vector_in_arena(heap), 0);
+    ck_assert_int_eq(temp->content[0], 0xFFFFFFFF);
+    ck_assert_int_eq(temp->content[3], 0xF);
+
+    // bigger than the arena: comes from malloc
+    bit_vector_t* big = bit_vector_create(ARENA_TEST_SIZE * 8, 0);
+    ck_assert_ptr_nonnull(big);
+    ck_assert_int_eq(bit_vector_in_arena(big), 0);
+
+    bit_vector_free(&temp);
+    bit_vector_free(&big);
+    ck_assert_ptr_null(temp);
+    ck_assert_int_eq(arena.live, 0);
+
+    ck_assert_ptr_eq(bit_vector_use_arena(NULL), &arena);
+    bit_vector_free(&heap);
+    arena_free(&arena);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(bit_vector_arena_owner_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    arena_t arenas[2];
+    ck_assert_err_none(arena_create(&arenas[0], ARENA_TEST_SIZE));
+    ck_assert_err_none(arena_create(&arenas[1], ARENA_TEST_SIZE));
+
+    bit_vector_use_arena(&arenas[0]);
+    bit_vector_t* first = bit_vector_create(64, 1);
+    bit_vector_t* second = bit_vector_create(64, 0);
+    ck_assert_int_eq(arenas[0].live, 2);
+
+    // given back to the arena they come from, whichever arena is in use (or none)
+    bit_vector_use_arena(&arenas[1]);
+    ck_assert_int_eq(bit_vector_in_arena(first), 1);
+    bit_vector_free(&first);
+    ck_assert_ptr_null(first);
+    ck_assert_int_eq(arenas[0].live, 1);
+    bit_vector_use_arena(NULL);
+    bit_vector_free(&second);
+    ck_assert_int_eq(arenas[0].live, 0);
+    ck_assert_int_eq(arenas[1].live, 0);
+    ck_assert_err_none(arena_reset(&arenas[0]));
+    bit_vector_free(&second);
+    ck_assert_int_eq(bit_vector_in_arena(NULL), 0);
+
+    arena_free(&arenas[0]);
+    arena_free(&arenas[1]);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(image_own_arena_line_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    arena_t arena;
+    image_t image;
+    ck_assert_err_none(arena_create(&arena, ARENA_TEST_SIZE));
+    ck_assert_err_none(image_create(&image, 64, 2));
+
+    bit_vector_use_arena(&arena);
+    image_line_t line;
+    ck_assert_err_none(image_line_create(&line, 64));
+    ck_assert_err_none(image_line_set_word(&line, 1, 0xDEADB055, 0x12345678));
+    ck_assert_err_none(image_own_line_content(&image, 1, line));
+
+    // the image kept its own vectors, the arena line has been given back
+    ck_assert_int_eq(bit_vector_in_arena(image.content[1].msb), 0);
+    ck_assert_int_eq(arena.live, 0);
+    ck_assert_err_none(arena_reset(&arena));
+    bit_vector_use_arena(NULL);
+
+    ck_assert_int_eq(image.content[1].msb->content[1], 0xDEADB055);
+    ck_assert_int_eq(image.content[1].lsb->content[1], 0x12345678);
+    ck_assert_int_eq(image.content[1].opacity->content[1], 0xDEADB055 | 0x12345678);
+
+    image_free(&image);
+    arena_free(&arena);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* arena_test_suite()
+{
+    Suite* s = suite_create("arena.c Tests");
+
+    Add_Case(s, tc1, "Arena Tests");
+    tcase_add_test(tc1, arena_create_err);
+    tcase_add_test(tc1, arena_alloc_reset_exec);
+    tcase_add_test(tc1, bit_vector_arena_exec);
+    tcase_add_test(tc1, bit_vector_arena_owner_exec);
+    tcase_add_test(tc1, image_own_arena_line_exec);
+
+    return s;
+}
+
+TEST_SUITE(arena_test_suite)
@@ -0,0 +1,192 @@
+/**
+ * @file unit-test-batch.c
+ * @brief Unit test code for the batch executor
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+
+#include "tests.h"
+#include "util.h"
+#include "batch.h"
+#include "savestate.h"
+
+#define BATCH_TEST_ROM "../games/tetris.gb"
+#define BATCH_TEST_INSTANCES 4
+#define BATCH_TEST_THREADS 3
+#define BATCH_TEST_FRAMES 20
+
+/**
+ * @brief Input of the tests: instance i presses A at frame 10 + i, and releases it at frame 20 + i if i is even.
+ *        It counts its calls in data.
+ */
+static int batch_test_input(gameboy_t* gameboy, size_t index, uint64_t frame, void* data)
+{
+    uint64_t* const calls = data;
+    ++calls[index];
+    if (frame == 10 + index) {
+        return joypad_key_pressed(&gameboy->pad, A_KEY);
+    }
+    if (frame == 20 + index && index % 2 == 0) {
+        return joypad_key_released(&gameboy->pad, A_KEY);
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Input stopping the instance at the frame data points to
+ */
+static int batch_test_failing_input(gameboy_t* gameboy, size_t index, uint64_t frame, void* data)
+{
+    (void) gameboy;
+    (void) index;
+    return frame == *(const uint64_t*) data ? ERR_BAD_PARAMETER : ERR_NONE;
+}
+
+START_TEST(batch_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    batch_t batch;
+    zero_init_var(batch);
+
+    ck_assert_bad_param(batch_create(NULL, BATCH_TEST_ROM, GB_ACCURACY_CYCLE, 1, 1));
+    ck_assert_bad_param(batch_create(&batch, NULL, GB_ACCURACY_CYCLE, 1, 1));
+    ck_assert_bad_param(batch_create(&batch, BATCH_TEST_ROM, GB_ACCURACY_CYCLE, 0, 1));
+    ck_assert_bad_param(batch_create(&batch, BATCH_TEST_ROM, GB_ACCURACY_CYCLE, 1, BATCH_MAX_THREADS + 1));
+    ck_assert_int_eq(batch_create(&batch, "no such file.gb", GB_ACCURACY_CYCLE, 2, 2), ERR_IO);
+    ck_assert_ptr_null(batch.instances);
+
+    // one thread per core
+    ck_assert_err_none(batch_create(&batch, BATCH_TEST_ROM, GB_ACCURACY_CYCLE, 2, 0));
+    ck_assert_uint_ge(batch.nb_workers, 1);
+
+    ck_assert_ptr_null(batch_gameboy(NULL, 0));
+    ck_assert_ptr_null(batch_gameboy(&batch, 2));
+    ck_assert_bad_param(batch_set_input(NULL, 0, NULL, NULL));
+    ck_assert_bad_param(batch_set_input(&batch, 2, NULL, NULL));
+    ck_assert_bad_param(batch_submit(NULL, 0, 1, NULL));
+    ck_assert_bad_param(batch_submit(&batch, 2, 1, NULL));
+    ck_assert_bad_param(batch_submit(&batch, 0, 0, NULL));
+    ck_assert_bad_param(batch_future_wait(NULL));
+    ck_assert_int_eq(batch_future_done(NULL), 1);
+    ck_assert_bad_param(batch_run_all(NULL, 1));
+
+    batch_free(&batch);
+    ck_assert_ptr_null(batch.instances);
+    batch_free(&batch);
+    batch_free(NULL);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(batch_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    batch_t batch;
+    uint64_t calls[BATCH_TEST_INSTANCES];
+    uint64_t reference_calls[BATCH_TEST_INSTANCES];
+    zero_init_var(calls);
+    zero_init_var(reference_calls);
+    gameboy_t* reference = calloc(1, sizeof(gameboy_t));
+    gameboy_state_t* states = calloc(2, sizeof(gameboy_state_t));
+    ck_assert_ptr_nonnull(reference);
+    ck_assert_ptr_nonnull(states);
+
+    ck_assert_err_none(batch_create(&batch, BATCH_TEST_ROM, GB_ACCURACY_CYCLE, BATCH_TEST_INSTANCES, BATCH_TEST_THREADS));
+    ck_assert_uint_eq(batch.nb_workers, BATCH_TEST_THREADS);
+
+    // one future per instance
+    batch_future_t* futures[BATCH_TEST_INSTANCES];
+    for (size_t i = 0; i < BATCH_TEST_INSTANCES; ++i) {
+        ck_assert_err_none(batch_set_input(&batch, i, batch_test_input, calls));
+        ck_assert_err_none(batch_submit(&batch, i, BATCH_TEST_FRAMES, &futures[i]));
+    }
+    for (size_t i = 0; i < BATCH_TEST_INSTANCES; ++i) {
+        ck_assert_err_none(batch_future_wait(futures[i]));
+        ck_assert_int_eq(batch_future_done(futures[i]), 1);
+        ck_assert_uint_eq(batch_gameboy(&batch, i)->cycles, BATCH_TEST_FRAMES * FRAME_TOTAL_CYCLES);
+        ck_assert_uint_eq(calls[i], BATCH_TEST_FRAMES);
+    }
+
+    // and all of them at once
+    ck_assert_err_none(batch_run_all(&batch, BATCH_TEST_FRAMES));
+    uint64_t frames = 0;
+    for (size_t w = 0; w < batch.nb_workers; ++w) {
+        frames += batch.workers[w].frames;
+    }
+    ck_assert_uint_eq(frames, 2 * BATCH_TEST_INSTANCES * BATCH_TEST_FRAMES);
+
+    // the rendering temporaries all came from the arenas of the workers, left empty
+    uint64_t allocations = 0;
+    for (size_t w = 0; w < batch.nb_workers; ++w) {
+        allocations += batch.workers[w].arena.allocations;
+        ck_assert_uint_eq(batch.workers[w].arena.live, 0);
+        ck_assert_uint_eq(batch.workers[w].arena.top, 0);
+    }
+    ck_assert_uint_gt(allocations, 0);
+    for (size_t i = 0; i < BATCH_TEST_INSTANCES; ++i) {
+        ck_assert_ptr_null(batch_gameboy(&batch, i)->arena.memory);
+        ck_assert_ptr_null(batch_gameboy(&batch, i)->shared_arena);
+    }
+
+    // each instance is where the same gameboy run alone with the same inputs is
+    for (size_t i = 0; i < BATCH_TEST_INSTANCES; ++i) {
+        ck_assert_err_none(gameboy_create(reference, BATCH_TEST_ROM, GB_ACCURACY_CYCLE));
+        for (uint64_t frame = 0; frame < 2 * BATCH_TEST_FRAMES; ++frame) {
+            ck_assert_err_none(batch_test_input(reference, i, frame, reference_calls));
+            ck_assert_err_none(gameboy_run_until(reference, (frame + 1) * FRAME_TOTAL_CYCLES));
+        }
+        ck_assert_err_none(gameboy_save_state(reference, &states[0]));
+        ck_assert_err_none(gameboy_save_state(batch_gameboy(&batch, i), &states[1]));
+        ck_assert_int_eq(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+        gameboy_free(reference);
+    }
+    // and their inputs made them differ
+    ck_assert_err_none(gameboy_save_state(batch_gameboy(&batch, 0), &states[1]));
+    ck_assert_int_ne(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+
+    // an input error stops its instance only
+    uint64_t failing = 2 * BATCH_TEST_FRAMES + 5;
+    ck_assert_err_none(batch_set_input(&batch, 0, batch_test_failing_input, &failing));
+    ck_assert_int_eq(batch_run_all(&batch, BATCH_TEST_FRAMES), ERR_BAD_PARAMETER);
+    ck_assert_uint_eq(batch_gameboy(&batch, 0)->cycles, failing * FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(batch_gameboy(&batch, 1)->cycles, 3 * BATCH_TEST_FRAMES * FRAME_TOTAL_CYCLES);
+    ck_assert_err_none(batch_set_input(&batch, 0, NULL, NULL));
+    ck_assert_err_none(batch_submit(&batch, 0, 1, &futures[0]));
+    ck_assert_err_none(batch_future_wait(futures[0]));
+
+    batch_free(&batch);
+    free(reference);
+    free(states);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* batch_test_suite()
+{
+    Suite* s = suite_create("batch.c Tests");
+
+    Add_Case(s, tc1, "Batch Tests");
+    tcase_add_test(tc1, batch_err);
+    tcase_add_test(tc1, batch_exec);
+
+    return s;
+}
+
+TEST_SUITE(batch_test_suite)
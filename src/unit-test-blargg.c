@@ -0,0 +1,117 @@
+/**
+ * @file unit-test-blargg.c
+ * @brief Unit test code for the runs of the blargg test ROMs
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "blargg.h"
+#include "gameboy.h"
+
+#define BLARGG_TEST_ROM "tests/data/blargg_roms/01-special.gb"
+#define BLARGG_TEST_FIBONACCI "tests/data/fibonacci.gb" //never prints anything
+#define BLARGG_TEST_CYCLES (10 * GB_CYCLES_PER_S)
+
+START_TEST(blargg_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    blargg_result_t result;
+    ck_assert_bad_param(blargg_run(NULL, GB_ACCURACY_CYCLE, BLARGG_TEST_CYCLES, &result));
+    ck_assert_bad_param(blargg_run(BLARGG_TEST_ROM, GB_ACCURACY_CYCLE, BLARGG_TEST_CYCLES, NULL));
+    ck_assert_int_ne(blargg_run("tests/data/no such rom.gb", GB_ACCURACY_CYCLE, BLARGG_TEST_CYCLES, &result), ERR_NONE);
+    ck_assert_ptr_null(result.output);
+    ck_assert_bad_param(blargg_run(BLARGG_TEST_ROM, GB_ACCURACIES, BLARGG_TEST_CYCLES, &result));
+    blargg_result_free(NULL);
+    ck_assert_ptr_null(blargg_verdict_name(BLARGG_VERDICTS));
+
+    gameboy_accuracy_t accuracy = GB_ACCURACY_CYCLE;
+    ck_assert_bad_param(gameboy_accuracy_parse(NULL, &accuracy));
+    ck_assert_bad_param(gameboy_accuracy_parse("cycle", NULL));
+    ck_assert_bad_param(gameboy_accuracy_parse("exact", &accuracy));
+    ck_assert_ptr_null(gameboy_accuracy_name(GB_ACCURACIES));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(blargg_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    blargg_result_t result;
+
+    // stops at the verdict, long before the timeout
+    ck_assert_err_none(blargg_run(BLARGG_TEST_ROM, GB_ACCURACY_CYCLE, BLARGG_TEST_CYCLES, &result));
+    ck_assert_int_eq(result.verdict, BLARGG_PASSED);
+    ck_assert_uint_lt(result.cycles, BLARGG_TEST_CYCLES);
+    ck_assert_uint_eq(result.cycles % FRAME_TOTAL_CYCLES, 0);
+    ck_assert_ptr_nonnull(result.output);
+    ck_assert_uint_eq(strlen(result.output), result.size);
+    ck_assert_ptr_nonnull(strstr(result.output, "01-special"));
+    ck_assert_ptr_nonnull(strstr(result.output, "Passed"));
+    ck_assert_str_eq(blargg_verdict_name(result.verdict), "PASSED");
+#ifdef WITH_PRINT
+    printf("%s in %" PRIu64 " cycles\n", result.output, result.cycles);
+#endif
+    const uint64_t cycles = result.cycles;
+    blargg_result_free(&result);
+    ck_assert_ptr_null(result.output);
+
+    // times out one frame before
+    ck_assert_err_none(blargg_run(BLARGG_TEST_ROM, GB_ACCURACY_CYCLE, cycles - FRAME_TOTAL_CYCLES, &result));
+    ck_assert_int_eq(result.verdict, BLARGG_TIMEOUT);
+    ck_assert_uint_eq(result.cycles, cycles - FRAME_TOTAL_CYCLES);
+    ck_assert_ptr_null(strstr(result.output, "Passed"));
+    blargg_result_free(&result);
+
+    // a ROM without serial output, to the timeout
+    ck_assert_err_none(blargg_run(BLARGG_TEST_FIBONACCI, GB_ACCURACY_CYCLE, FRAME_TOTAL_CYCLES + 1, &result));
+    ck_assert_int_eq(result.verdict, BLARGG_TIMEOUT);
+    ck_assert_uint_eq(result.cycles, FRAME_TOTAL_CYCLES + 1);
+    ck_assert_uint_eq(result.size, 0);
+    blargg_result_free(&result);
+
+    // every accuracy tier passes
+    for (gameboy_accuracy_t accuracy = GB_ACCURACY_CYCLE; accuracy < GB_ACCURACIES; ++accuracy) {
+        gameboy_accuracy_t parsed = GB_ACCURACIES;
+        ck_assert_err_none(gameboy_accuracy_parse(gameboy_accuracy_name(accuracy), &parsed));
+        ck_assert_int_eq(parsed, accuracy);
+        ck_assert_err_none(blargg_run(BLARGG_TEST_ROM, accuracy, BLARGG_TEST_CYCLES, &result));
+        ck_assert_int_eq(result.verdict, BLARGG_PASSED);
+        ck_assert_uint_eq(result.cycles, cycles);
+        blargg_result_free(&result);
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* blargg_test_suite()
+{
+    Suite* s = suite_create("blargg.c Tests");
+
+    Add_Case(s, tc1, "Blargg Tests");
+    tcase_add_test(tc1, blargg_err);
+    tcase_add_test(tc1, blargg_exec);
+
+    return s;
+}
+
+TEST_SUITE(blargg_test_suite)
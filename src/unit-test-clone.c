@@ -0,0 +1,235 @@
+/**
+ * @file unit-test-clone.c
+ * @brief Unit test code for the clones of gameboys
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "clone.h"
+#include "savestate.h"
+#include "pacing.h"
+
+#define CLONE_TEST_ROM "../games/tetris.gb"
+#define CLONE_TEST_BOOT_CYCLES (40 * FRAME_TOTAL_CYCLES + 123) //in the middle of a line of the boot ROM logo
+#define CLONE_TEST_GAME_CYCLES (300 * FRAME_TOTAL_CYCLES + 4567) //on the title screen, the boot ROM disabled
+#define CLONE_TEST_CONTINUATION (60 * FRAME_TOTAL_CYCLES)
+#define CLONE_TEST_ROUNDS 1000
+#define CLONE_TEST_FRAMES 60
+
+/**
+ * @brief Checks that a gameboy and its clone (or copy) are in the same state, then run exactly the same
+ */
+static void clone_test_continuation(gameboy_t* gameboy, gameboy_t* clone, gameboy_state_t* states)
+{
+    ck_assert_uint_eq(clone->boot, gameboy->boot);
+    ck_assert_err_none(gameboy_save_state(gameboy, &states[0]));
+    ck_assert_err_none(gameboy_save_state(clone, &states[1]));
+    ck_assert_int_eq(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+
+    const uint64_t end = gameboy->cycles + CLONE_TEST_CONTINUATION;
+    ck_assert_err_none(gameboy_run_until(gameboy, end));
+    ck_assert_err_none(gameboy_run_until(clone, end));
+    ck_assert_err_none(gameboy_save_state(gameboy, &states[0]));
+    ck_assert_err_none(gameboy_save_state(clone, &states[1]));
+    ck_assert_int_eq(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+
+    uint64_t hash = 0;
+    uint64_t clone_hash = 0;
+    ck_assert_err_none(image_hash(&gameboy->screen.display, &hash));
+    ck_assert_err_none(image_hash(&clone->screen.display, &clone_hash));
+    ck_assert_uint_eq(hash, clone_hash);
+}
+
+START_TEST(clone_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gameboys = calloc(2, sizeof(gameboy_t));
+    ck_assert_ptr_nonnull(gameboys);
+    ck_assert_err_none(gameboy_create(&gameboys[0], CLONE_TEST_ROM, GB_ACCURACY_CYCLE));
+
+    ck_assert_bad_param(gameboy_clone(NULL, &gameboys[0]));
+    ck_assert_bad_param(gameboy_clone(&gameboys[1], NULL));
+    ck_assert_bad_param(gameboy_clone(&gameboys[0], &gameboys[0]));
+    ck_assert_bad_param(gameboy_copy(NULL, &gameboys[0]));
+    ck_assert_bad_param(gameboy_copy(&gameboys[0], NULL));
+    ck_assert_err_none(gameboy_copy(&gameboys[0], &gameboys[0]));
+    ck_assert_uint_eq(gameboy_clone_bytes(NULL), 0);
+
+    // not created
+    ck_assert_bad_param(gameboy_clone(&gameboys[0], &gameboys[1]));
+    ck_assert_bad_param(gameboy_copy(&gameboys[1], &gameboys[0]));
+
+    gameboy_free(&gameboys[0]);
+    free(gameboys);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(clone_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gameboys = calloc(2, sizeof(gameboy_t));
+    gameboy_state_t* states = calloc(2, sizeof(gameboy_state_t));
+    ck_assert_ptr_nonnull(gameboys);
+    ck_assert_ptr_nonnull(states);
+    ck_assert_err_none(gameboy_create(&gameboys[0], CLONE_TEST_ROM, GB_ACCURACY_CYCLE));
+
+    // during the boot ROM
+    ck_assert_err_none(gameboy_run_until(&gameboys[0], CLONE_TEST_BOOT_CYCLES));
+    ck_assert_err_none(gameboy_clone(&gameboys[1], &gameboys[0]));
+    ck_assert_int_eq(gameboys[1].boot, 1);
+    clone_test_continuation(&gameboys[0], &gameboys[1], states);
+
+    // nothing shared: a write to the clone is not seen by the gameboy
+    ck_assert_ptr_eq(gameboys[1].cpu.bus, &gameboys[1].bus);
+    ck_assert_ptr_eq(gameboys[1].bus[REG_IE], &gameboys[1].cpu.IE);
+    ck_assert_ptr_eq(gameboys[1].bus[ECHO_RAM_START], gameboys[1].bus[WORK_RAM_START]);
+    const data_t byte = *gameboys[0].bus[WORK_RAM_START];
+    *gameboys[1].bus[ECHO_RAM_START] = (data_t) ~byte;
+    ck_assert_uint_eq(*gameboys[0].bus[WORK_RAM_START], byte);
+    gameboy_free(&gameboys[1]);
+
+    // after it
+    ck_assert_err_none(gameboy_run_until(&gameboys[0], CLONE_TEST_GAME_CYCLES));
+    ck_assert_err_none(gameboy_clone(&gameboys[1], &gameboys[0]));
+    ck_assert_int_eq(gameboys[1].boot, 0);
+    ck_assert_ptr_null(gameboys[1].bootrom.mem);
+    clone_test_continuation(&gameboys[0], &gameboys[1], states);
+    gameboy_free(&gameboys[1]);
+
+    // copied in a gameboy still booting, and back to the boot ROM
+    ck_assert_err_none(gameboy_create(&gameboys[1], CLONE_TEST_ROM, GB_ACCURACY_SCANLINE));
+    ck_assert_err_none(gameboy_run_until(&gameboys[1], CLONE_TEST_BOOT_CYCLES));
+    ck_assert_err_none(gameboy_copy(&gameboys[1], &gameboys[0]));
+    ck_assert_int_eq(gameboys[1].accuracy, GB_ACCURACY_CYCLE);
+    clone_test_continuation(&gameboys[0], &gameboys[1], states);
+    gameboy_free(&gameboys[0]);
+    ck_assert_err_none(gameboy_create(&gameboys[0], CLONE_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(gameboy_run_until(&gameboys[0], CLONE_TEST_BOOT_CYCLES));
+    ck_assert_err_none(gameboy_copy(&gameboys[1], &gameboys[0]));
+    clone_test_continuation(&gameboys[0], &gameboys[1], states);
+    gameboy_free(&gameboys[1]);
+
+    // a clone takes microseconds
+    const size_t bytes = gameboy_clone_bytes(&gameboys[0]);
+    ck_assert_uint_gt(bytes, sizeof(gameboy_t));
+    const uint64_t start = pacing_now();
+    for (size_t round = 0; round < CLONE_TEST_ROUNDS; ++round) {
+        ck_assert_err_none(gameboy_clone(&gameboys[1], &gameboys[0]));
+        gameboy_free(&gameboys[1]);
+    }
+    const uint64_t nanoseconds = (pacing_now() - start) / CLONE_TEST_ROUNDS;
+    ck_assert_uint_lt(nanoseconds, 1000000);
+
+    gameboy_free(&gameboys[0]);
+    free(gameboys);
+    free(states);
+
+#ifdef WITH_PRINT
+    printf("clone: %" PRIu64 " ns, %zu bytes\n", nanoseconds, bytes);
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+/**
+ * @brief Checks that two gameboys are in the same state
+ */
+static void clone_test_same(const gameboy_t* gameboy, const gameboy_t* other, gameboy_state_t* states)
+{
+    ck_assert_err_none(gameboy_save_state(gameboy, &states[0]));
+    ck_assert_err_none(gameboy_save_state(other, &states[1]));
+    ck_assert_int_eq(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+}
+
+START_TEST(clone_dirty)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gameboys = calloc(2, sizeof(gameboy_t));
+    gameboy_state_t* states = calloc(2, sizeof(gameboy_state_t));
+    ck_assert_ptr_nonnull(gameboys);
+    ck_assert_ptr_nonnull(states);
+    gameboy_t* const gameboy = &gameboys[0];
+    gameboy_t* const snapshot = &gameboys[1];
+
+    ck_assert_bad_param(gameboy_copy_dirty(NULL, gameboy));
+    ck_assert_bad_param(gameboy_copy_dirty(snapshot, NULL));
+
+    // a snapshot kept up to date frame by frame
+    ck_assert_err_none(gameboy_create(gameboy, CLONE_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(gameboy_run_until(gameboy, CLONE_TEST_GAME_CYCLES));
+    ck_assert_err_none(gameboy_clone(snapshot, gameboy));
+    dirty_clear(&gameboy->cpu.dirty);
+    dirty_clear(&snapshot->cpu.dirty);
+    size_t bytes = 0;
+    for (size_t f = 1; f <= CLONE_TEST_FRAMES; ++f) {
+        ck_assert_err_none(gameboy_run_until(gameboy, CLONE_TEST_GAME_CYCLES + f * FRAME_TOTAL_CYCLES));
+        bytes += dirty_count(&gameboy->cpu.dirty) * DIRTY_BLOCK_SIZE;
+        ck_assert_err_none(gameboy_copy_dirty(snapshot, gameboy));
+        clone_test_same(gameboy, snapshot, states);
+        dirty_clear(&gameboy->cpu.dirty);
+        dirty_clear(&snapshot->cpu.dirty);
+    }
+    // a frame writes a small part of the memory
+    ck_assert_uint_lt(bytes / CLONE_TEST_FRAMES, BUS_SIZE / 4);
+
+    // back to a root in the boot ROM, from after it
+    gameboy_free(gameboy);
+    gameboy_free(snapshot);
+    ck_assert_err_none(gameboy_create(gameboy, CLONE_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(gameboy_run_until(gameboy, CLONE_TEST_BOOT_CYCLES));
+    ck_assert_err_none(gameboy_clone(snapshot, gameboy));
+    dirty_clear(&gameboy->cpu.dirty);
+    dirty_clear(&snapshot->cpu.dirty);
+    ck_assert_err_none(gameboy_run_until(snapshot, CLONE_TEST_GAME_CYCLES));
+    ck_assert_int_eq(snapshot->boot, 0);
+    ck_assert_err_none(gameboy_copy_dirty(snapshot, gameboy));
+    ck_assert_int_eq(snapshot->boot, 1);
+    clone_test_same(gameboy, snapshot, states);
+    clone_test_continuation(gameboy, snapshot, states);
+
+    gameboy_free(gameboy);
+    gameboy_free(snapshot);
+    free(gameboys);
+    free(states);
+
+#ifdef WITH_PRINT
+    printf("dirty: %zu bytes per frame\n", bytes / CLONE_TEST_FRAMES);
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* clone_test_suite()
+{
+    Suite* s = suite_create("clone.c Tests");
+
+    Add_Case(s, tc1, "Clone Tests");
+    tcase_add_test(tc1, clone_err);
+    tcase_add_test(tc1, clone_exec);
+    tcase_add_test(tc1, clone_dirty);
+
+    return s;
+}
+
+TEST_SUITE(clone_test_suite)
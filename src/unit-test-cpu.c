@@ -393,7 +393,59 @@ START_TEST(test_cpu_write16_at_idx)
         ck_assert_int_eq(cpu_write16_at_idx(&cpu, (addr_t)i, 0xdead), ERR_NONE);
         ck_assert_int_eq(CPU_BUS_V_AT(cpu, i), 0xad);
         ck_assert_int_eq(CPU_BUS_V_AT(cpu, i + 1), 0xde);
+        // both bytes are reported to the listeners
+        ck_assert_int_eq(cpu.write_listener, i);
+        ck_assert_int_eq(cpu.write_listener16, 1);
     }
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, 0x10, 0x12), ERR_NONE);
+    ck_assert_int_eq(cpu.write_listener, 0x10);
+    ck_assert_int_eq(cpu.write_listener16, 0);
+
+    finish();
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(test_cpu_DMA_bus)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    size_t size = 255;
+    add_bus(cpu, size);
+
+    CPU_BUS_V_AT(cpu, 0x10) = 0x12;
+    CPU_BUS_V_AT(cpu, 0x11) = 0x34;
+    CPU_BUS_V_AT(cpu, 0xA0) = 0x56;
+
+    // during a bulk OAM DMA from 0x0000, its source (and OAM) read 0xFF and writes there are dropped
+    cpu.DMA_running = 1;
+    cpu.DMA_from = 0x0000;
+    ck_assert_int_eq(cpu_read_at_idx(&cpu, 0x10), 0xFF);
+    ck_assert_int_eq(cpu_read16_at_idx(&cpu, 0x10), 0xFFFF);
+    ck_assert_int_eq(cpu_read16_at_idx(&cpu, 0x9F), 0x56FF);
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, 0x10, 0xAB), ERR_NONE);
+    ck_assert_int_eq(cpu_write16_at_idx(&cpu, 0x11, 0xCDEF), ERR_NONE);
+    ck_assert_int_eq(cpu.write_listener, 0);
+
+    // the rest of the bus is reached
+    ck_assert_int_eq(cpu_read_at_idx(&cpu, 0xA0), 0x56);
+    ck_assert_int_eq(cpu_write16_at_idx(&cpu, 0x9F, 0x789A), ERR_NONE);
+    ck_assert_int_eq(CPU_BUS_V_AT(cpu, 0xA0), 0x78);
+    ck_assert_int_eq(cpu.write_listener, 0xA0);
+    ck_assert_int_eq(cpu.write_listener16, 0);
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, HIGH_RAM_START, 0x9A), ERR_NONE);
+    ck_assert_int_eq(cpu_read_at_idx(&cpu, HIGH_RAM_START), 0x9A);
+
+    // the bus is released with the DMA
+    cpu.DMA_running = 0;
+    ck_assert_int_eq(CPU_BUS_V_AT(cpu, 0x10), 0x12);
+    ck_assert_int_eq(CPU_BUS_V_AT(cpu, 0x11), 0x34);
+    ck_assert_int_eq(cpu_read16_at_idx(&cpu, 0x10), 0x3412);
 
     finish();
 #ifdef WITH_PRINT
@@ -531,6 +583,46 @@ START_TEST(test_cpu_cycle_exec)
 }
 END_TEST
 
+START_TEST(test_cpu_skip_cycles)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    size_t size = 255;
+    add_bus(cpu, size);
+
+    ck_assert_int_eq(cpu_idle_cycles(NULL), 0);
+    ck_assert_int_eq(cpu_skip_cycles(NULL, 0), ERR_BAD_PARAMETER);
+
+    // the rest of an instruction
+    cpu.idle_time = 3;
+    cpu.write_listener = 0x12;
+    ck_assert_int_eq(cpu_idle_cycles(&cpu), 3);
+    ck_assert_int_eq(cpu_skip_cycles(&cpu, 4), ERR_BAD_PARAMETER);
+    ck_assert_int_eq(cpu_skip_cycles(&cpu, 2), ERR_NONE);
+    ck_assert_int_eq(cpu.idle_time, 1);
+    ck_assert_int_eq(cpu.write_listener, 0);
+    ck_assert_int_eq(cpu_skip_cycles(&cpu, 1), ERR_NONE);
+    ck_assert_int_eq(cpu_idle_cycles(&cpu), 0);
+
+    // halted until an interrupt is pending
+    cpu.HALT = 1;
+    ck_assert(cpu_idle_cycles(&cpu) == CPU_IDLE_FOREVER);
+    ck_assert_int_eq(cpu_skip_cycles(&cpu, 1000), ERR_NONE);
+    ck_assert_int_eq(cpu.HALT, 1);
+    cpu.IE = 0x01;
+    cpu_request_interrupt(&cpu, VBLANK);
+    ck_assert_int_eq(cpu_idle_cycles(&cpu), 0);
+
+    finish();
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
 
 Suite* cpu_test_suite()
 {
@@ -562,6 +654,7 @@ Suite* cpu_test_suite()
     tcase_add_test(tc4, test_cpu_read16_at_idx);
     tcase_add_test(tc4, test_cpu_write_at_idx);
     tcase_add_test(tc4, test_cpu_write16_at_idx);
+    tcase_add_test(tc4, test_cpu_DMA_bus);
     tcase_add_test(tc4, test_cpu_bus_HL_macro);
     tcase_add_test(tc4, test_cpu_bus_after_op_macro);
     tcase_add_test(tc4, test_cpu_sp_exec);
@@ -570,6 +663,7 @@ Suite* cpu_test_suite()
     Add_Case(s, tc5, "Cpu Cycle Tests");
     tcase_add_test(tc5, test_cpu_cycle_err);
     tcase_add_test(tc5, test_cpu_cycle_exec);
+    tcase_add_test(tc5, test_cpu_skip_cycles);
 
     return s;
 }
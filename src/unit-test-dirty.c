@@ -0,0 +1,104 @@
+/**
+ * @file unit-test-dirty.c
+ * @brief Unit test code for the dirty maps of the bus
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <check.h>
+
+#include "tests.h"
+#include "util.h"
+#include "dirty.h"
+
+START_TEST(dirty_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    dirty_map_t map;
+    dirty_clear(&map);
+
+    ck_assert_bad_param(dirty_mark_range(NULL, 0, 1));
+    ck_assert_bad_param(dirty_merge(NULL, &map));
+    ck_assert_bad_param(dirty_merge(&map, NULL));
+    ck_assert_uint_eq(dirty_count(NULL), 0);
+    dirty_clear(NULL);
+    dirty_mark_all(NULL);
+
+    // beyond the bus
+    ck_assert_int_eq(dirty_mark_range(&map, 0xFFFF, 2), ERR_ADDRESS);
+    ck_assert_int_eq(dirty_mark_range(&map, 0, BUS_SIZE + 1), ERR_ADDRESS);
+    ck_assert_uint_eq(dirty_count(&map), 0);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(dirty_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    dirty_map_t map;
+    dirty_map_t other;
+    dirty_clear(&map);
+    dirty_clear(&other);
+    ck_assert_uint_eq(dirty_count(&map), 0);
+
+    // a block per address, whatever its place in the block
+    dirty_mark(&map, 0x0000);
+    dirty_mark(&map, DIRTY_BLOCK_SIZE - 1);
+    ck_assert_uint_eq(dirty_count(&map), 1);
+    dirty_mark(&map, 0xFFFF);
+    ck_assert_uint_eq(dirty_count(&map), 2);
+    ck_assert_uint_eq(dirty_block(&map, 0), 1);
+    ck_assert_uint_eq(dirty_block(&map, 1), 0);
+    ck_assert_uint_eq(dirty_block(&map, DIRTY_BLOCKS - 1), 1);
+
+    // ranges across blocks and words
+    ck_assert_err_none(dirty_mark_range(&other, 0xC000, 0));
+    ck_assert_uint_eq(dirty_count(&other), 0);
+    ck_assert_err_none(dirty_mark_range(&other, DIRTY_BLOCK_SIZE - 1, 2));
+    ck_assert_uint_eq(dirty_count(&other), 2);
+    ck_assert_err_none(dirty_mark_range(&other, 0xFE00, 0xA0));
+    ck_assert_uint_eq(dirty_count(&other), 2 + 3);
+    ck_assert_err_none(dirty_mark_range(&other, 0xFFFF, 1));
+    ck_assert_uint_eq(dirty_count(&other), 2 + 3 + 1);
+
+    // block 0 and the last one in both
+    ck_assert_err_none(dirty_merge(&map, &other));
+    ck_assert_uint_eq(dirty_count(&map), 2 + 3 + 1);
+    ck_assert_uint_eq(dirty_block(&map, 1), 1);
+
+    dirty_mark_all(&map);
+    ck_assert_uint_eq(dirty_count(&map), DIRTY_BLOCKS);
+    dirty_clear(&map);
+    ck_assert_uint_eq(dirty_count(&map), 0);
+    ck_assert_err_none(dirty_mark_range(&map, 0, BUS_SIZE));
+    ck_assert_uint_eq(dirty_count(&map), DIRTY_BLOCKS);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* dirty_test_suite()
+{
+    Suite* s = suite_create("dirty.c Tests");
+
+    Add_Case(s, tc1, "Dirty Tests");
+    tcase_add_test(tc1, dirty_err);
+    tcase_add_test(tc1, dirty_exec);
+
+    return s;
+}
+
+TEST_SUITE(dirty_test_suite)
@@ -0,0 +1,169 @@
+/**
+ * @file unit-test-image.c
+ * @brief Unit test code for the export and the hash of images
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "image.h"
+
+#define IMAGE_TEST_WIDTH  160
+#define IMAGE_TEST_HEIGHT 7
+#define IMAGE_TEST_MARGIN 5 // bytes at the end of each row, left untouched
+
+/**
+ * @brief Image with random pixels
+ */
+static void image_test_random(image_t* im)
+{
+    ck_assert_err_none(image_create(im, IMAGE_TEST_WIDTH, IMAGE_TEST_HEIGHT));
+    for (size_t y = 0; y < IMAGE_TEST_HEIGHT; ++y) {
+        for (size_t w = 0; w < IMAGE_TEST_WIDTH / IMAGE_LINE_WORD_BITS; ++w) {
+            ck_assert_err_none(image_line_set_word(im->content + y, w, (uint32_t) rand(), (uint32_t) rand()));
+        }
+    }
+}
+
+START_TEST(image_export_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    image_t im;
+    image_test_random(&im);
+    uint8_t pixels[IMAGE_TEST_WIDTH * IMAGE_TEST_HEIGHT * IMAGE_RGBA];
+
+    ck_assert_bad_param(image_export(NULL, pixels, IMAGE_TEST_WIDTH, IMAGE_GREY, 1, NULL));
+    ck_assert_bad_param(image_export(&im, NULL, IMAGE_TEST_WIDTH, IMAGE_GREY, 1, NULL));
+    ck_assert_bad_param(image_export(&im, pixels, IMAGE_TEST_WIDTH, 2, 1, NULL));
+    ck_assert_bad_param(image_export(&im, pixels, IMAGE_TEST_WIDTH, IMAGE_GREY, 0, NULL));
+    ck_assert_bad_param(image_export(&im, pixels, IMAGE_TEST_WIDTH, IMAGE_GREY, IMAGE_EXPORT_MAX_SCALE + 1, NULL));
+    ck_assert_bad_param(image_export(&im, pixels, IMAGE_TEST_WIDTH - 1, IMAGE_GREY, 1, NULL));
+    ck_assert_bad_param(image_export(&im, pixels, IMAGE_TEST_WIDTH, IMAGE_RGB, 1, NULL));
+
+    image_free(&im);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(image_export_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    const image_format_t formats[] = { IMAGE_GREY, IMAGE_RGB, IMAGE_RGBA };
+    const uint32_t colors[PALETTE_COLOR_COUNT] = { 0xE0F8D0, 0x88C070, 0x346856, 0x081820 };
+    const uint8_t greys[PALETTE_COLOR_COUNT] = { 255, 170, 85, 0 };
+
+    srand(212);
+    image_t im;
+    image_test_random(&im);
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+        for (unsigned int scale = 1; scale <= IMAGE_EXPORT_MAX_SCALE; ++scale) {
+            for (int custom = 0; custom <= 1; ++custom) {
+                const size_t bpp = formats[f];
+                const size_t stride = IMAGE_TEST_WIDTH * scale * bpp + IMAGE_TEST_MARGIN;
+                uint8_t* pixels = calloc(IMAGE_TEST_HEIGHT * scale, stride);
+                ck_assert_ptr_nonnull(pixels);
+
+                ck_assert_err_none(image_export(&im, pixels, stride, formats[f], scale, custom ? colors : NULL));
+
+                for (size_t y = 0; y < IMAGE_TEST_HEIGHT * scale; ++y) {
+                    for (size_t x = 0; x < IMAGE_TEST_WIDTH * scale; ++x) {
+                        uint8_t pixel = 0;
+                        ck_assert_err_none(image_get_pixel(&pixel, &im, x / scale, y / scale));
+                        const uint8_t* out = pixels + y * stride + x * bpp;
+                        const uint32_t color = custom ? colors[pixel] : (uint32_t) greys[pixel] * 0x010101;
+                        const uint8_t r = (uint8_t) (color >> 16), g = (uint8_t) (color >> 8), b = (uint8_t) color;
+                        if (formats[f] == IMAGE_GREY) {
+                            ck_assert_int_eq(out[0], custom ? (77 * r + 150 * g + 29 * b) >> 8 : greys[pixel]);
+                        } else {
+                            ck_assert_int_eq(out[0], r);
+                            ck_assert_int_eq(out[1], g);
+                            ck_assert_int_eq(out[2], b);
+                            if (formats[f] == IMAGE_RGBA) ck_assert_int_eq(out[3], 0xFF);
+                        }
+                    }
+                    for (size_t i = IMAGE_TEST_WIDTH * scale * bpp; i < stride; ++i) {
+                        ck_assert_int_eq(pixels[y * stride + i], 0);
+                    }
+                }
+                free(pixels);
+            }
+        }
+    }
+
+    image_free(&im);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(image_hash_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    image_t im1, im2;
+    uint64_t hash1 = 0, hash2 = 0;
+
+    srand(212);
+    image_test_random(&im1);
+    srand(212);
+    image_test_random(&im2);
+
+    ck_assert_bad_param(image_hash(NULL, &hash1));
+    ck_assert_bad_param(image_hash(&im1, NULL));
+
+    ck_assert_err_none(image_hash(&im1, &hash1));
+    ck_assert_err_none(image_hash(&im2, &hash2));
+    ck_assert_uint_eq(hash1, hash2);
+
+    // a single pixel
+    im2.content[IMAGE_TEST_HEIGHT - 1].lsb->content[0] ^= 1;
+    ck_assert_err_none(image_hash(&im2, &hash2));
+    ck_assert_uint_ne(hash1, hash2);
+
+    // the opacity is not part of the pixels
+    im2.content[IMAGE_TEST_HEIGHT - 1].lsb->content[0] ^= 1;
+    im2.content[0].opacity->content[0] ^= 1;
+    ck_assert_err_none(image_hash(&im2, &hash2));
+    ck_assert_uint_eq(hash1, hash2);
+
+    image_free(&im1);
+    image_free(&im2);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* image_test_suite()
+{
+    Suite* s = suite_create("image.c Tests");
+
+    Add_Case(s, tc1, "Image Export Tests");
+    tcase_add_test(tc1, image_export_err);
+    tcase_add_test(tc1, image_export_exec);
+    tcase_add_test(tc1, image_hash_exec);
+
+    return s;
+}
+
+TEST_SUITE(image_test_suite)
@@ -0,0 +1,136 @@
+/**
+ * @file unit-test-input-queue.c
+ * @brief Unit test code for the queue of joypad events
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <check.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "tests.h"
+#include "util.h"
+#include "input_queue.h"
+
+#define IQ_TEST_EVENTS 200000
+
+START_TEST(input_queue_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    input_queue_t queue;
+    input_event_t event = { 0, A_KEY, 1 };
+    ck_assert_bad_param(input_queue_init(NULL));
+    ck_assert_bad_param(input_queue_push(NULL, event));
+    ck_assert_err_none(input_queue_init(&queue));
+    ck_assert_int_eq(input_queue_pop(NULL, &event), 0);
+    ck_assert_int_eq(input_queue_pop(&queue, NULL), 0);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(input_queue_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    input_queue_t queue;
+    input_event_t event;
+    ck_assert_err_none(input_queue_init(&queue));
+    ck_assert_int_eq(input_queue_pop(&queue, &event), 0);
+
+    // full queue: the event is dropped
+    for (uint64_t i = 0; i < INPUT_QUEUE_SIZE; ++i) {
+        const input_event_t pushed = { i, (gb_key_t) (i % NB_GB_KEYS), (bit_t) (i % 2) };
+        ck_assert_err_none(input_queue_push(&queue, pushed));
+    }
+    const input_event_t extra = { INPUT_QUEUE_SIZE, START_KEY, 1 };
+    ck_assert_err_mem(input_queue_push(&queue, extra));
+
+    // first in, first out
+    for (uint64_t i = 0; i < INPUT_QUEUE_SIZE; ++i) {
+        ck_assert_int_eq(input_queue_pop(&queue, &event), 1);
+        ck_assert_uint_eq(event.cycle, i);
+        ck_assert_int_eq(event.key, i % NB_GB_KEYS);
+        ck_assert_int_eq(event.pressed, i % 2);
+    }
+    ck_assert_int_eq(input_queue_pop(&queue, &event), 0);
+
+    // wrapping around
+    ck_assert_err_none(input_queue_push(&queue, extra));
+    ck_assert_int_eq(input_queue_pop(&queue, &event), 1);
+    ck_assert_uint_eq(event.cycle, INPUT_QUEUE_SIZE);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+/**
+ * @brief Pushes IQ_TEST_EVENTS events, event n happening at cycle n
+ */
+static void* input_queue_test_producer(void* arg)
+{
+    input_queue_t* queue = arg;
+    for (uint64_t n = 0; n < IQ_TEST_EVENTS; ++n) {
+        const input_event_t event = { n, (gb_key_t) (n % NB_GB_KEYS), (bit_t) (n % 2) };
+        while (input_queue_push(queue, event) == ERR_MEM);
+    }
+    return NULL;
+}
+
+START_TEST(input_queue_threads_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    input_queue_t queue;
+    ck_assert_err_none(input_queue_init(&queue));
+
+    pthread_t producer;
+    ck_assert_int_eq(pthread_create(&producer, NULL, input_queue_test_producer, &queue), 0);
+
+    // every event, once, in order
+    size_t wrong = 0;
+    for (uint64_t n = 0; n < IQ_TEST_EVENTS; ) {
+        input_event_t event;
+        if (input_queue_pop(&queue, &event)) {
+            wrong += event.cycle != n || event.key != (gb_key_t) (n % NB_GB_KEYS) || event.pressed != n % 2;
+            ++n;
+        }
+    }
+    ck_assert_int_eq(pthread_join(producer, NULL), 0);
+
+    ck_assert_uint_eq(wrong, 0);
+    input_event_t event;
+    ck_assert_int_eq(input_queue_pop(&queue, &event), 0);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* input_queue_test_suite()
+{
+    Suite* s = suite_create("input_queue.c Tests");
+
+    Add_Case(s, tc1, "Input Queue Tests");
+    tcase_add_test(tc1, input_queue_err);
+    tcase_add_test(tc1, input_queue_exec);
+    tcase_add_test(tc1, input_queue_threads_exec);
+
+    return s;
+}
+
+TEST_SUITE(input_queue_test_suite)
@@ -0,0 +1,429 @@
+/**
+ * @file unit-test-lcdc.c
+ * @brief Unit test code for the LCD controller (tile cache, dirty lines, rendering period, sprites of the lines, OAM DMA)
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <check.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "tests.h"
+#include "util.h"
+#include "gameboy.h"
+#include "lcdc.h"
+#include "cpu-storage.h"
+#include "image.h"
+
+static data_t vram[MEM_SIZE(VIDEO_RAM)];
+static data_t oam[MEM_SIZE(GRAPH_RAM)];
+static data_t regs[MEM_SIZE(REGISTERS)];
+
+/**
+ * @brief Gameboy with only the memories the LCD controller uses, screen on and background with tile 1 at (0, 0)
+ */
+static gameboy_t* lcdc_test_gameboy(void)
+{
+    gameboy_t* gb = calloc(1, sizeof(gameboy_t));
+    ck_assert_ptr_nonnull(gb);
+    zero_init_var(vram);
+    zero_init_var(oam);
+    zero_init_var(regs);
+
+    for (size_t i = 0; i < MEM_SIZE(VIDEO_RAM); ++i) gb->bus[VIDEO_RAM_START + i] = vram + i;
+    for (size_t i = 0; i < MEM_SIZE(GRAPH_RAM); ++i) gb->bus[GRAPH_RAM_START + i] = oam + i;
+    for (size_t i = 0; i < MEM_SIZE(REGISTERS); ++i) gb->bus[REGISTERS_START + i] = regs + i;
+    gb->bus[REG_IF] = &gb->cpu.IF;
+    gb->cpu.bus = &gb->bus;
+
+    regs[REG_LCDC - REGISTERS_START] = LCDC_REG_LCD_STATUS_MASK | LCDC_REG_TILE_SOURCE_MASK | LCDC_REG_BG_MASK;
+    regs[REG_BGP - REGISTERS_START] = DEFAULT_PALETTE;
+
+    // tile 1: color 1 everywhere
+    for (size_t row = 0; row < TILE_ROWS; ++row) {
+        vram[TILE_SIZE + 2 * row] = 0xFF;
+    }
+    vram[TILE_ADDR_BASE_LOW - VIDEO_RAM_START] = 1;
+
+    ck_assert_err_none(lcdc_init(gb));
+    return gb;
+}
+
+static void lcdc_test_run(gameboy_t* gb, uint64_t from, uint64_t to)
+{
+    for (uint64_t c = from; c < to; ++c) {
+        ck_assert_err_none(lcdc_cycle(&gb->screen, c));
+    }
+}
+
+static uint8_t lcdc_test_pixel(gameboy_t* gb, size_t x, size_t y)
+{
+    uint8_t pixel = 0;
+    ck_assert_err_none(image_get_pixel(&pixel, &gb->screen.display, x, y));
+    return pixel;
+}
+
+/**
+ * @brief Sprites of a line selected from the whole OAM (first 10 in OAM, then by x coordinate and index)
+ */
+static size_t lcdc_test_line_sprites(data_t ly, data_t sprites[SPRITES_PER_LINE])
+{
+    const int height = SPRITE_HEIGHT(regs[REG_LCDC - REGISTERS_START]);
+    size_t count = 0;
+    for (size_t s = 0; s < SPRITE_COUNT && count < SPRITES_PER_LINE; ++s) {
+        const data_t y = (data_t) (oam[s * SPRITE_SIZE] - SPRITE_Y_OFFSET);
+        if (y <= ly && ly < y + height) {
+            sprites[count++] = (data_t) s;
+        }
+    }
+    // insertion sort
+    for (size_t i = 1; i < count; ++i) {
+        for (size_t j = i; j > 0 && oam[sprites[j - 1] * SPRITE_SIZE + 1] > oam[sprites[j] * SPRITE_SIZE + 1]; --j) {
+            const data_t tmp = sprites[j];
+            sprites[j] = sprites[j - 1];
+            sprites[j - 1] = tmp;
+        }
+    }
+    return count;
+}
+
+static void lcdc_test_check_sprites(gameboy_t* gb)
+{
+    for (data_t ly = 0; ly < LCD_HEIGHT; ++ly) {
+        data_t expected[SPRITES_PER_LINE];
+        data_t sprites[SPRITES_PER_LINE];
+        size_t count = 0;
+        const size_t expected_count = lcdc_test_line_sprites(ly, expected);
+        ck_assert_err_none(lcdc_line_sprites(&gb->screen, ly, sprites, &count));
+        ck_assert_uint_eq(count, expected_count);
+        for (size_t i = 0; i < count; ++i) {
+            ck_assert_int_eq(sprites[i], expected[i]);
+        }
+    }
+}
+
+START_TEST(lcdc_tile_cache_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gb = lcdc_test_gameboy();
+    const tile_cache_t* tiles = &gb->screen.tiles;
+
+    lcdc_test_run(gb, 0, LINE_MODE_0_START_CYCLE);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 0, 0), 1);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 7, 0), 1);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 8, 0), 0);
+    // tiles 0 and 1
+    ck_assert_uint_eq(tiles->misses, 2);
+    ck_assert_int_eq(tiles->valid[1], 1);
+
+    // steady state: no more decoding
+    lcdc_test_run(gb, LINE_MODE_0_START_CYCLE, FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(tiles->misses, 2);
+    ck_assert_uint_eq(tiles->hits, LCD_HEIGHT * TILE_LINE_SIZE - 2);
+
+    // writing row 0 of tile 1 only changes row 0
+    ck_assert_err_none(cpu_write_at_idx(&gb->cpu, TILE_SRC_ADDR_LOW + TILE_SIZE, 0x0F));
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, TILE_SRC_ADDR_LOW + TILE_SIZE));
+    ck_assert_int_eq(tiles->valid[1], 0);
+    ck_assert_int_eq(tiles->valid[0], 1);
+    ck_assert_uint_eq(tiles->invalidations, 1);
+
+    lcdc_test_run(gb, FRAME_TOTAL_CYCLES, FRAME_TOTAL_CYCLES + LINE_TOTAL_CYCLES + LINE_MODE_0_START_CYCLE);
+    ck_assert_uint_eq(tiles->misses, 3);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 0, 0), 0);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 4, 0), 1);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 0, 1), 1);
+
+    // writes outside of the tiles are ignored
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, TILE_ADDR_BASE_LOW));
+    ck_assert_int_eq(tiles->valid[0], 1);
+
+    // writing the last byte of a tile leaves the next one alone (the gameboy reports both bytes of a 16 bits write)
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, TILE_SRC_ADDR_LOW + TILE_SIZE - 1));
+    ck_assert_int_eq(tiles->valid[0], 0);
+    ck_assert_int_eq(tiles->valid[1], 1);
+    ck_assert_uint_eq(tiles->invalidations, 2);
+
+    lcdc_invalidate_tiles(&gb->screen);
+    ck_assert_int_eq(tiles->valid[1], 0);
+    ck_assert_uint_eq(tiles->invalidations, 3);
+
+    lcdc_free(&gb->screen);
+    free(gb);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_high_source_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gb = lcdc_test_gameboy();
+
+    // tile numbers are signed with the high source: tile 1 is at 0x9010
+    regs[REG_LCDC - REGISTERS_START] &= (data_t) ~LCDC_REG_TILE_SOURCE_MASK;
+    vram[0x1010] = 0xF0;
+    vram[0x1011] = 0xF0;
+
+    lcdc_test_run(gb, 0, LINE_MODE_0_START_CYCLE);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 0, 0), 3);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 4, 0), 0);
+    ck_assert_int_eq(gb->screen.tiles.valid[0x101], 1);
+
+    // tile 0x101 of the cache
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, 0x9011));
+    ck_assert_int_eq(gb->screen.tiles.valid[0x101], 0);
+
+    lcdc_free(&gb->screen);
+    free(gb);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_dirty_lines_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gb = lcdc_test_gameboy();
+    const line_tracker_t* lines = &gb->screen.lines;
+
+    lcdc_test_run(gb, 0, FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(lines->rendered, LCD_HEIGHT);
+    ck_assert_uint_eq(lines->skipped, 0);
+
+    // nothing changed
+    lcdc_test_run(gb, FRAME_TOTAL_CYCLES, 2 * FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(lines->rendered, LCD_HEIGHT);
+    ck_assert_uint_eq(lines->skipped, LCD_HEIGHT);
+
+    // one row of the map: its 8 lines
+    ck_assert_err_none(cpu_write_at_idx(&gb->cpu, TILE_ADDR_BASE_LOW + TILE_LINE_SIZE + 3, 1));
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, TILE_ADDR_BASE_LOW + TILE_LINE_SIZE + 3));
+    lcdc_test_run(gb, 2 * FRAME_TOTAL_CYCLES, 3 * FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(lines->rendered, LCD_HEIGHT + TILE_ROWS);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 3 * 8, 8), 1);
+
+    // a register: every line
+    regs[REG_SCX - REGISTERS_START] = 1;
+    lcdc_test_run(gb, 3 * FRAME_TOTAL_CYCLES, 4 * FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(lines->rendered, 2 * LCD_HEIGHT + TILE_ROWS);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 3 * 8 - 1, 8), 1);
+
+    // a write the lcdc did not see (first row of the map): found in verify mode only
+    vram[TILE_ADDR_BASE_LOW - VIDEO_RAM_START + 2] = 1;
+    gb->screen.lines.verify = 1;
+    lcdc_test_run(gb, 4 * FRAME_TOTAL_CYCLES, 5 * FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(lines->mismatches, TILE_ROWS);
+    ck_assert_uint_eq(lines->skipped, 3 * LCD_HEIGHT - TILE_ROWS);
+    ck_assert_uint_eq(lines->rendered, 3 * LCD_HEIGHT + TILE_ROWS);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 2 * 8 - 1, 0), 1);
+
+    lcdc_free(&gb->screen);
+    free(gb);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_render_period_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gb = lcdc_test_gameboy();
+    gb->screen.render_period = LCDC_RENDER_OFF;
+
+    // headless: same timing and interrupts, nothing rendered
+    lcdc_test_run(gb, 0, LCD_HEIGHT * LINE_TOTAL_CYCLES + 1);
+    ck_assert_int_eq(regs[REG_LY - REGISTERS_START], LCD_HEIGHT);
+    ck_assert_int_eq(regs[REG_STAT - REGISTERS_START] & STAT_REG_MODE_MASK, 1);
+    ck_assert_int_eq(gb->cpu.IF & 1, 1);
+    ck_assert_uint_eq(gb->screen.lines.rendered, 0);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 0, 0), 0);
+
+    // one frame out of 2: of frames 2 and 3, only the third one
+    gb->screen.render_period = 2;
+    lcdc_test_run(gb, LCD_HEIGHT * LINE_TOTAL_CYCLES + 1, 3 * FRAME_TOTAL_CYCLES);
+    ck_assert_uint_eq(gb->screen.frames, 3);
+    ck_assert_uint_eq(gb->screen.lines.rendered, LCD_HEIGHT);
+    ck_assert_int_eq(lcdc_test_pixel(gb, 0, 0), 1);
+
+    lcdc_free(&gb->screen);
+    free(gb);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_line_sprites_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gb = lcdc_test_gameboy();
+    const sprite_lists_t* lists = &gb->screen.sprites;
+    data_t sprites[SPRITES_PER_LINE];
+    size_t count = 0;
+
+    ck_assert_bad_param(lcdc_line_sprites(NULL, 0, sprites, &count));
+    ck_assert_bad_param(lcdc_line_sprites(&gb->screen, LCD_HEIGHT, sprites, &count));
+
+    // empty OAM: every sprite is above the display
+    lcdc_test_check_sprites(gb);
+    ck_assert_uint_eq(lists->rebuilds, LCD_HEIGHT);
+
+    // nothing changed: no list computed again
+    lcdc_test_check_sprites(gb);
+    ck_assert_uint_eq(lists->rebuilds, LCD_HEIGHT);
+
+    // moving sprite 3 to line 20 only changes lines 20 to 27
+    ck_assert_err_none(cpu_write_at_idx(&gb->cpu, GRAPH_RAM_START + 3 * SPRITE_SIZE, 20 + SPRITE_Y_OFFSET));
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, GRAPH_RAM_START + 3 * SPRITE_SIZE));
+    lcdc_test_check_sprites(gb);
+    ck_assert_uint_eq(lists->rebuilds, LCD_HEIGHT + TILE_ROWS);
+
+    // tiles and attributes do not change the lists
+    ck_assert_err_none(cpu_write_at_idx(&gb->cpu, GRAPH_RAM_START + 3 * SPRITE_SIZE + 2, 0x12));
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, GRAPH_RAM_START + 3 * SPRITE_SIZE + 2));
+    lcdc_test_check_sprites(gb);
+    ck_assert_uint_eq(lists->rebuilds, LCD_HEIGHT + TILE_ROWS);
+
+    // random writes through the bus, with every other write of LCDC changing the size of the sprites
+    srand(212);
+    for (size_t round = 0; round < 200; ++round) {
+        for (size_t w = 0; w < 8; ++w) {
+            const addr_t addr = (addr_t) (GRAPH_RAM_START + rand() % (SPRITE_COUNT * SPRITE_SIZE));
+            // mostly on the display, and many sprites on the same lines
+            const data_t data = (data_t) (addr % SPRITE_SIZE == 0 ? rand() % 64 + 8 : rand());
+            ck_assert_err_none(cpu_write_at_idx(&gb->cpu, addr, data));
+            ck_assert_err_none(lcdc_bus_listener(&gb->screen, addr));
+        }
+        if (round % 50 == 49) {
+            regs[REG_LCDC - REGISTERS_START] ^= LCDC_REG_OBJ_SIZE_MASK;
+        }
+        lcdc_test_check_sprites(gb);
+    }
+
+    // DMA from video RAM
+    for (size_t i = 0; i < SPRITE_COUNT * SPRITE_SIZE; ++i) {
+        vram[i] = (data_t) (i % SPRITE_SIZE == 0 ? i % 150 : 0xA0 - i);
+    }
+    ck_assert_err_none(cpu_write_at_idx(&gb->cpu, REG_DMA, VIDEO_RAM_START >> 8));
+    ck_assert_err_none(lcdc_bus_listener(&gb->screen, REG_DMA));
+    lcdc_test_run(gb, 0, SPRITE_COUNT * SPRITE_SIZE);
+    ck_assert_int_eq(oam[SPRITE_SIZE], SPRITE_SIZE % 150);
+    lcdc_test_check_sprites(gb);
+
+    // OAM written without going through the cpu
+    oam[0] = 100;
+    lcdc_invalidate_tiles(&gb->screen);
+    lcdc_test_check_sprites(gb);
+
+    lcdc_free(&gb->screen);
+    free(gb);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_bulk_DMA_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gb = lcdc_test_gameboy();
+    lcdc_t* lcd = &gb->screen;
+    data_t expected[DMA_SIZE];
+
+    for (size_t i = 0; i < DMA_SIZE; ++i) {
+        vram[0x1000 + i] = (data_t) (i % SPRITE_SIZE == 0 ? i % 150 : 3 * i);
+    }
+    lcdc_test_check_sprites(gb);
+
+    // step by step: one byte per cycle after the write
+    lcdc_test_run(gb, 0, 100);
+    ck_assert_err_none(cpu_write_at_idx(&gb->cpu, REG_DMA, 0x90));
+    ck_assert_err_none(lcdc_bus_listener(lcd, REG_DMA));
+    ck_assert_int_eq(lcdc_DMA_running(lcd, 99 + DMA_SIZE - 1), 1);
+    ck_assert_int_eq(lcdc_DMA_running(lcd, 99 + DMA_SIZE), 0);
+    lcdc_test_run(gb, 100, 100 + DMA_SIZE);
+    memcpy(expected, oam, DMA_SIZE);
+    ck_assert_int_eq(expected[DMA_SIZE - 1], vram[0x1000 + DMA_SIZE - 1]);
+
+    // at once: same OAM and same sprites right after the write, same bus restriction
+    zero_init_var(oam);
+    lcdc_invalidate_tiles(lcd);
+    const uint32_t oam_version = lcd->lines.oam_version;
+    lcd->bulk_DMA = 1;
+    ck_assert_err_none(lcdc_bus_listener(lcd, REG_DMA));
+    ck_assert_int_eq(memcmp(oam, expected, DMA_SIZE), 0);
+    ck_assert_uint_eq(lcd->lines.oam_version, oam_version + 1);
+    ck_assert_int_eq(lcd->DMA_to, GRAPH_RAM_END + 1);
+    ck_assert_int_eq(lcdc_DMA_running(lcd, 99 + DMA_SIZE + DMA_SIZE - 1), 1);
+    ck_assert_int_eq(lcdc_DMA_running(lcd, 99 + DMA_SIZE + DMA_SIZE), 0);
+    lcdc_test_check_sprites(gb);
+
+    // copying the same sprites again changes nothing
+    ck_assert_err_none(lcdc_bus_listener(lcd, REG_DMA));
+    ck_assert_uint_eq(lcd->lines.oam_version, oam_version + 1);
+
+    // source page in two parts: copied byte by byte
+    static data_t other[DMA_SIZE];
+    for (size_t i = 0; i < DMA_SIZE; ++i) {
+        other[i] = (data_t) (i % SPRITE_SIZE == 0 ? 100 - i / 2 : i);
+        expected[i] = i < DMA_SIZE / 2 ? vram[0x1000 + i] : other[i];
+        if (i >= DMA_SIZE / 2) gb->bus[0x9000 + i] = other + i;
+    }
+    ck_assert_err_none(lcdc_bus_listener(lcd, REG_DMA));
+    ck_assert_int_eq(memcmp(oam, expected, DMA_SIZE), 0);
+    lcdc_test_check_sprites(gb);
+
+    lcdc_free(lcd);
+    free(gb);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* lcdc_test_suite()
+{
+    Suite* s = suite_create("lcdc.c Tests");
+
+    Add_Case(s, tc1, "LCDC Tests");
+    tcase_add_test(tc1, lcdc_tile_cache_exec);
+    tcase_add_test(tc1, lcdc_high_source_exec);
+    tcase_add_test(tc1, lcdc_dirty_lines_exec);
+    tcase_add_test(tc1, lcdc_render_period_exec);
+    tcase_add_test(tc1, lcdc_line_sprites_exec);
+    tcase_add_test(tc1, lcdc_bulk_DMA_exec);
+
+    return s;
+}
+
+TEST_SUITE(lcdc_test_suite)
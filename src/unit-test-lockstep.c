@@ -0,0 +1,298 @@
+/**
+ * @file unit-test-lockstep.c
+ * @brief Unit test code for the differential runs
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "lockstep.h"
+#include "image.h"
+
+#define LOCKSTEP_TEST_ROM "../games/tetris.gb"
+#define LOCKSTEP_TEST_CYCLES (10 * FRAME_TOTAL_CYCLES)
+#define LOCKSTEP_TEST_DMA_CYCLES (265 * FRAME_TOTAL_CYCLES) //tetris changes its sprites for the first time in the next frame
+#define LOCKSTEP_TEST_OUTPUT_SIZE 2048
+#define LOCKSTEP_TEST_FRAMES_ROM "../games/flappyboy.gb"
+#define LOCKSTEP_TEST_FRAMES 600
+
+static const lockstep_config_t accurate = { LCDC_RENDER_ALL, 0, GB_ACCURACY_CYCLE };
+static const lockstep_config_t headless = { LCDC_RENDER_OFF, 0, GB_ACCURACY_CYCLE };
+static const lockstep_config_t bulk = { LCDC_RENDER_ALL, 1, GB_ACCURACY_CYCLE };
+static const lockstep_config_t instruction = { LCDC_RENDER_ALL, 0, GB_ACCURACY_INSTRUCTION };
+static const lockstep_config_t scanline = { LCDC_RENDER_ALL, 0, GB_ACCURACY_SCANLINE };
+
+START_TEST(lockstep_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    const lockstep_config_t configs[LOCKSTEP_GAMEBOYS] = { accurate, accurate };
+    lockstep_t* lockstep = calloc(1, sizeof(lockstep_t));
+    ck_assert_ptr_nonnull(lockstep);
+    lockstep_mismatch_t mismatch;
+
+    ck_assert_bad_param(lockstep_create(NULL, LOCKSTEP_TEST_ROM, NULL, configs, 1, 1));
+    ck_assert_bad_param(lockstep_create(lockstep, NULL, NULL, configs, 1, 1));
+    ck_assert_bad_param(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, NULL, 1, 1));
+    ck_assert_bad_param(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, configs, 0, 1));
+    ck_assert_bad_param(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, configs, 1, 0));
+    ck_assert_bad_param(lockstep_run(NULL, 1, &mismatch));
+    ck_assert_bad_param(lockstep_run(lockstep, 1, NULL));
+    ck_assert_bad_param(lockstep_compare(NULL, &lockstep->gameboys[0], 1, &mismatch));
+    ck_assert_bad_param(lockstep_compare(&lockstep->gameboys[0], NULL, 1, &mismatch));
+    ck_assert_bad_param(lockstep_compare(&lockstep->gameboys[0], &lockstep->gameboys[0], 1, NULL));
+    lockstep_mismatch_print(NULL, &mismatch);
+    lockstep_free(NULL);
+    free(lockstep);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lockstep_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    lockstep_t* lockstep = calloc(1, sizeof(lockstep_t));
+    ck_assert_ptr_nonnull(lockstep);
+    lockstep_mismatch_t mismatch;
+
+    // rendering or not does not change the emulation
+    const lockstep_config_t same[LOCKSTEP_GAMEBOYS] = { accurate, headless };
+    ck_assert_err_none(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, same, 1, 64));
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_CYCLES, &mismatch));
+    ck_assert(!mismatch.found);
+    ck_assert_uint_eq(lockstep->gameboys[LOCKSTEP_CANDIDATE].cycles, LOCKSTEP_TEST_CYCLES);
+    ck_assert_uint_eq(lockstep->comparisons, LOCKSTEP_TEST_CYCLES);
+    ck_assert_uint_eq(lockstep->verified, LOCKSTEP_TEST_CYCLES);
+
+    // a change from outside is seen at the next comparison of the memory (one cpu comparison out of 64),
+    // but cannot be replayed
+    ++lockstep->gameboys[LOCKSTEP_CANDIDATE].components[WORK_RAM_INDEX].mem->memory[0x123];
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_CYCLES + 1000, &mismatch));
+    ck_assert(mismatch.found && !mismatch.minimized);
+    ck_assert_uint_eq(mismatch.cycle, (LOCKSTEP_TEST_CYCLES / 64 + 1) * 64);
+    lockstep_free(lockstep);
+
+    // bulk DMAs copy OAM before the cycle by cycle copy does: OAM differs during the first DMA that changes it,
+    // for as many cycles as bytes changed (fast-forward to it, comparing rarely)
+    const lockstep_config_t bulk_configs[LOCKSTEP_GAMEBOYS] = { accurate, bulk };
+    ck_assert_err_none(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, bulk_configs, 1000, 1));
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_DMA_CYCLES, &mismatch));
+    ck_assert(!mismatch.found);
+    lockstep->period = 1;
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_DMA_CYCLES + FRAME_TOTAL_CYCLES, &mismatch));
+    ck_assert(mismatch.found && mismatch.minimized);
+    ck_assert_uint_ge(mismatch.differences[0].address, GRAPH_RAM_START);
+    ck_assert_uint_le(mismatch.differences[0].address, GRAPH_RAM_END);
+    const uint64_t first = mismatch.cycle;
+    lockstep_free(lockstep);
+
+    // seen when comparing the memory one cycle out of 2, then replayed from the start to the first cycle
+    ck_assert_err_none(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, bulk_configs, 1000, 1));
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_DMA_CYCLES, &mismatch));
+    lockstep->period = 1;
+    lockstep->memory_period = 2;
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_DMA_CYCLES + FRAME_TOTAL_CYCLES, &mismatch));
+    ck_assert(mismatch.found && mismatch.minimized);
+    ck_assert_uint_eq(mismatch.cycle, first);
+    ck_assert_uint_eq(lockstep->gameboys[LOCKSTEP_REFERENCE].cycles, first);
+
+    char output[LOCKSTEP_TEST_OUTPUT_SIZE];
+    zero_init_var(output);
+    FILE* file = fmemopen(output, sizeof(output) - 1, "w");
+    ck_assert_ptr_nonnull(file);
+    lockstep_mismatch_print(file, &mismatch);
+    fclose(file);
+    ck_assert_ptr_nonnull(strstr(output, "memory 0xFE"));
+#ifdef WITH_PRINT
+    printf("%s", output);
+#endif
+
+    lockstep_free(lockstep);
+    free(lockstep);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lockstep_accuracy)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    lockstep_t* lockstep = calloc(1, sizeof(lockstep_t));
+    ck_assert_ptr_nonnull(lockstep);
+    lockstep_mismatch_t mismatch;
+
+    // the instruction tier goes through the same states at every cycle
+    const lockstep_config_t same[LOCKSTEP_GAMEBOYS] = { accurate, instruction };
+    ck_assert_err_none(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, same, 1, 64));
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_CYCLES, &mismatch));
+    ck_assert(!mismatch.found);
+    // and between longer runs, which it batches more
+    lockstep->period = 997;
+    lockstep->memory_period = 1;
+    ck_assert_err_none(lockstep_run(lockstep, 6 * LOCKSTEP_TEST_CYCLES, &mismatch));
+    ck_assert(!mismatch.found);
+    lockstep_free(lockstep);
+
+    // the scanline tier goes through the same states as the cycle tier with bulk DMAs: the modes of a line
+    // start at their cycles, only the drawing is delayed
+    const lockstep_config_t lines[LOCKSTEP_GAMEBOYS] = { bulk, scanline };
+    ck_assert_err_none(lockstep_create(lockstep, LOCKSTEP_TEST_ROM, NULL, lines, 1, 1));
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_CYCLES, &mismatch));
+    ck_assert(!mismatch.found);
+    // including through the first DMA that changes the sprites
+    lockstep->period = 997;
+    ck_assert_err_none(lockstep_run(lockstep, LOCKSTEP_TEST_DMA_CYCLES + FRAME_TOTAL_CYCLES, &mismatch));
+    ck_assert(!mismatch.found);
+    lockstep_free(lockstep);
+    free(lockstep);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lockstep_scanline_frames)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    lockstep_t* lockstep = calloc(1, sizeof(lockstep_t));
+    ck_assert_ptr_nonnull(lockstep);
+    lockstep_mismatch_t mismatch;
+
+    // flappyboy changes the LCDC registers in the middle of its frames: the scanline tier draws each line with the
+    // registers it had, so that the frames are the same as in the cycle tier, and so is the game
+    const lockstep_config_t lines[LOCKSTEP_GAMEBOYS] = { accurate, scanline };
+    ck_assert_err_none(lockstep_create(lockstep, LOCKSTEP_TEST_FRAMES_ROM, NULL, lines, FRAME_TOTAL_CYCLES, 1));
+    for(unsigned int frame = 0; frame < LOCKSTEP_TEST_FRAMES; ++frame){
+        // just after a frame of the screen starts, both displays hold the whole previous one
+        const gameboy_t* reference = &lockstep->gameboys[LOCKSTEP_REFERENCE];
+        const uint64_t next = reference->cycles + FRAME_TOTAL_CYCLES;
+        ck_assert_err_none(lockstep_run(lockstep, next - (next - reference->screen.on_cycle) % FRAME_TOTAL_CYCLES + 1, &mismatch));
+        ck_assert(!mismatch.found);
+
+        // (unless the screen was switched on since the previous one: only the cycle tier started drawing it)
+        if(reference->screen.on_cycle + FRAME_TOTAL_CYCLES >= reference->cycles){
+            continue;
+        }
+        uint64_t hashes[LOCKSTEP_GAMEBOYS];
+        for(size_t i = 0; i < LOCKSTEP_GAMEBOYS; ++i){
+            ck_assert_err_none(image_hash(&lockstep->gameboys[i].screen.display, &hashes[i]));
+        }
+        ck_assert_msg(hashes[0] == hashes[1], "frame %u differs", frame);
+    }
+    lockstep_free(lockstep);
+    free(lockstep);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lockstep_DMA_bus)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // in high RAM, as games do
+    static const data_t program[] = {
+        0x3E, 0xC0,       // LD A, 0xC0
+        0xE0, 0x46,       // LDH (DMA), A: OAM DMA from 0xC000
+        0x21, 0x00, 0xFE, // LD HL, 0xFE00
+        0x7E,             // LD A, (HL)
+        0x47,             // LD B, A
+        0x36, 0x12,       // LD (HL), 0x12
+        0x3E, 0x5A,       // LD A, 0x5A
+        0xE0, 0x43,       // LDH (SCX), A
+        0x18, 0xFE,       // JR -2
+        0x7E,             // (0xFF91) LD A, (HL)
+        0x4F,             // LD C, A
+        0x18, 0xFE        // JR -2
+    };
+    gameboy_t* gameboy = calloc(1, sizeof(gameboy_t));
+    ck_assert_ptr_nonnull(gameboy);
+
+    for (bit_t bulk_DMA = 0; bulk_DMA <= 1; ++bulk_DMA) {
+        ck_assert_err_none(gameboy_create(gameboy, LOCKSTEP_TEST_ROM, GB_ACCURACY_CYCLE));
+        gameboy->screen.bulk_DMA = bulk_DMA;
+        ck_assert_err_none(gameboy_run_until(gameboy, LOCKSTEP_TEST_CYCLES));
+
+        *gameboy->bus[0xC000] = 0x34;
+        for (size_t i = 0; i < sizeof(program); ++i) {
+            *gameboy->bus[HIGH_RAM_START + i] = program[i];
+        }
+        gameboy->cpu.PC = HIGH_RAM_START;
+        gameboy->cpu.IME = 0;
+        gameboy->cpu.HALT = 0;
+        gameboy->cpu.idle_time = 0;
+
+        // the I/O registers are reached during the DMA, whether it is copied at once or not
+        ck_assert_err_none(gameboy_run_until(gameboy, LOCKSTEP_TEST_CYCLES + 40));
+        ck_assert(lcdc_DMA_running(&gameboy->screen, gameboy->cycles));
+        ck_assert_int_eq(*gameboy->bus[REG_SCX], 0x5A);
+        ck_assert_int_eq(gameboy->cpu.DMA_running, 0);
+        if (bulk_DMA) {
+            // OAM, copied ahead of time, is neither read nor written until the DMA would be over
+            ck_assert_int_eq(gameboy->cpu.B, 0xFF);
+        } else {
+            // cycle by cycle, as before: the first byte is copied already, and then overwritten
+            ck_assert_int_eq(gameboy->cpu.B, 0x34);
+        }
+
+        ck_assert_err_none(gameboy_run_until(gameboy, LOCKSTEP_TEST_CYCLES + 40 + DMA_SIZE));
+        ck_assert(!lcdc_DMA_running(&gameboy->screen, gameboy->cycles));
+        const data_t expected = bulk_DMA ? 0x34 : 0x12;
+        ck_assert_int_eq(*gameboy->bus[GRAPH_RAM_START], expected);
+        gameboy->cpu.PC = HIGH_RAM_START + 17;
+        ck_assert_err_none(gameboy_run_until(gameboy, LOCKSTEP_TEST_CYCLES + 60 + DMA_SIZE));
+        ck_assert_int_eq(gameboy->cpu.C, expected);
+
+        gameboy_free(gameboy);
+    }
+    free(gameboy);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* lockstep_test_suite()
+{
+    Suite* s = suite_create("lockstep.c Tests");
+
+    Add_Case(s, tc1, "Lockstep Tests");
+    tcase_add_test(tc1, lockstep_err);
+    tcase_add_test(tc1, lockstep_exec);
+    tcase_add_test(tc1, lockstep_accuracy);
+    tcase_add_test(tc1, lockstep_scanline_frames);
+    tcase_add_test(tc1, lockstep_DMA_bus);
+
+    return s;
+}
+
+TEST_SUITE(lockstep_test_suite)
@@ -0,0 +1,136 @@
+/**
+ * @file unit-test-lz.c
+ * @brief Unit test code for the block compression
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+
+#include "tests.h"
+#include "util.h"
+#include "lz.h"
+
+#define LZ_TEST_SIZE 70000 //more than the largest offset
+
+/**
+ * @brief Compresses and decompresses size bytes, returns the size of the compressed block (0 on failure)
+ */
+static size_t lz_round_trip(const uint8_t* data, size_t size)
+{
+    uint8_t* const compressed = malloc(LZ_BOUND(size));
+    uint8_t* const decompressed = malloc(size + 1);
+    size_t compressed_size = 0;
+    size_t decompressed_size = 0;
+    const int ok = compressed != NULL && decompressed != NULL
+                   && lz_compress(data, size, compressed, LZ_BOUND(size), &compressed_size) == ERR_NONE
+                   && lz_decompress(compressed, compressed_size, decompressed, size + 1, &decompressed_size) == ERR_NONE
+                   && decompressed_size == size && !memcmp(data, decompressed, size);
+    free(compressed);
+    free(decompressed);
+    return ok ? compressed_size : 0;
+}
+
+START_TEST(lz_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    uint8_t data[64];
+    zero_init_var(data);
+    uint8_t out[64];
+    size_t size = 0;
+    ck_assert_bad_param(lz_compress(NULL, 0, out, sizeof(out), &size));
+    ck_assert_bad_param(lz_compress(data, sizeof(data), NULL, sizeof(out), &size));
+    ck_assert_bad_param(lz_compress(data, sizeof(data), out, sizeof(out), NULL));
+    ck_assert_bad_param(lz_decompress(NULL, 0, out, sizeof(out), &size));
+    ck_assert_bad_param(lz_decompress(data, sizeof(data), NULL, sizeof(out), &size));
+    ck_assert_bad_param(lz_decompress(data, sizeof(data), out, sizeof(out), NULL));
+
+    // too small an output
+    ck_assert_err_mem(lz_compress(data, sizeof(data), out, 4, &size));
+    ck_assert_err_none(lz_compress(data, sizeof(data), out, sizeof(out), &size));
+    ck_assert_bad_param(lz_decompress(out, size, data, sizeof(data) - 1, &size));
+
+    // corrupted blocks: match before the start, null offset, truncated literals, offset and length
+    const uint8_t bad[][4] = { { 0x00, 0x01, 0x00, 0x00 }, { 0x10, 'a', 0x00, 0x00 },
+                               { 0x30, 'a', 'b', 0x00 }, { 0x10, 'a', 0x01, 0x00 }, { 0xF0, 0xFF, 0xFF, 0xFF } };
+    const size_t bad_sizes[] = { 3, 4, 3, 3, 4 };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        ck_assert_bad_param(lz_decompress(bad[i], bad_sizes[i], out, sizeof(out), &size));
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lz_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    uint8_t* const data = calloc(LZ_TEST_SIZE, 1);
+    ck_assert_ptr_nonnull(data);
+
+    // empty and short blocks are only literals
+    ck_assert_uint_eq(lz_round_trip(data, 0), 1);
+    ck_assert_uint_eq(lz_round_trip(data, 11), 12);
+
+    // zeros: long overlapping matches
+    const size_t zeros = lz_round_trip(data, LZ_TEST_SIZE);
+    ck_assert_uint_gt(zeros, 0);
+    ck_assert_uint_lt(zeros, LZ_TEST_SIZE / 200);
+
+    // random bytes: incompressible, long literals
+    srand(42);
+    for (size_t i = 0; i < LZ_TEST_SIZE; ++i) {
+        data[i] = (uint8_t) rand();
+    }
+    const size_t random = lz_round_trip(data, LZ_TEST_SIZE);
+    ck_assert_uint_gt(random, 0);
+    ck_assert_uint_le(random, LZ_BOUND(LZ_TEST_SIZE));
+
+    // a random pattern repeated far away, and short repetitions
+    memcpy(data + LZ_TEST_SIZE - 1000, data, 1000);
+    for (size_t i = 20000; i < 30000; ++i) {
+        data[i] = data[i % 7];
+    }
+    const size_t repeated = lz_round_trip(data, LZ_TEST_SIZE);
+    ck_assert_uint_gt(repeated, 0);
+    ck_assert_uint_lt(repeated, random);
+
+    // every small size
+    for (size_t size = 1; size < 300; ++size) {
+        ck_assert_uint_gt(lz_round_trip(data + 20000, size), 0);
+    }
+
+#ifdef WITH_PRINT
+    printf("compressed: zeros %zu, random %zu, repeated %zu bytes (of %d)\n", zeros, random, repeated, LZ_TEST_SIZE);
+#endif
+    free(data);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* lz_test_suite()
+{
+    Suite* s = suite_create("lz.c Tests");
+
+    Add_Case(s, tc1, "Compression Tests");
+    tcase_add_test(tc1, lz_err);
+    tcase_add_test(tc1, lz_exec);
+
+    return s;
+}
+
+TEST_SUITE(lz_test_suite)
@@ -0,0 +1,280 @@
+/**
+ * @file unit-test-movie.c
+ * @brief Unit test code for the joypad movies
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <check.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "tests.h"
+#include "util.h"
+#include "movie.h"
+
+#define MOVIE_TEST_EVENTS 1000
+#define MOVIE_TEST_FILE "unit-test-movie.tmp"
+
+/**
+ * @brief Keys given to the joypad, instead of the real joypad (movie.c is tested alone)
+ */
+static input_event_t played[MOVIE_TEST_EVENTS];
+static size_t played_count = 0;
+
+int joypad_key_pressed(joypad_t* pad, gb_key_t key)
+{
+    (void) pad;
+    const input_event_t event = { 0, key, 1 };
+    played[played_count++] = event;
+    return ERR_NONE;
+}
+
+int joypad_key_released(joypad_t* pad, gb_key_t key)
+{
+    (void) pad;
+    const input_event_t event = { 0, key, 0 };
+    played[played_count++] = event;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Movie of MOVIE_TEST_EVENTS events, event n happening at cycle 10 * (n / 3)
+ */
+static void movie_test_fill(movie_t* movie)
+{
+    ck_assert_err_none(movie_init(movie));
+    for (uint64_t i = 0; i < MOVIE_TEST_EVENTS; ++i) {
+        const input_event_t event = { 10 * (i / 3), (gb_key_t) (i % NB_GB_KEYS), (bit_t) (i % 2) };
+        ck_assert_err_none(movie_record(movie, event));
+    }
+}
+
+START_TEST(movie_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    movie_t movie;
+    joypad_t pad;
+    uint64_t cycle = 0;
+    gb_key_t key = A_KEY;
+    input_event_t event = { 10, A_KEY, 1 };
+
+    ck_assert_bad_param(movie_init(NULL));
+    ck_assert_bad_param(movie_record(NULL, event));
+    ck_assert_bad_param(movie_play(NULL, &pad, 0));
+    ck_assert_bad_param(movie_seek(NULL, 0));
+    ck_assert_bad_param(movie_truncate(NULL, 0));
+    ck_assert_bad_param(movie_save(NULL, MOVIE_TEST_FILE));
+    ck_assert_bad_param(movie_load(NULL, MOVIE_TEST_FILE));
+    ck_assert_bad_param(movie_key_from_name(NULL, &key));
+    ck_assert_bad_param(movie_key_from_name("A", NULL));
+    ck_assert_bad_param(movie_key_from_name("Z", &key));
+    bit_t found = 0;
+    ck_assert_bad_param(movie_parse_line(NULL, &event, &found, NULL));
+    ck_assert_bad_param(movie_parse_line("10 A press", NULL, &found, NULL));
+    ck_assert_bad_param(movie_parse_line("10 A press", &event, NULL, NULL));
+    ck_assert_ptr_null(movie_key_name(NB_GB_KEYS));
+    ck_assert_int_eq(movie_next_cycle(NULL, &cycle), 0);
+
+    ck_assert_err_none(movie_init(&movie));
+    ck_assert_int_eq(movie_next_cycle(&movie, NULL), 0);
+    ck_assert_bad_param(movie_play(&movie, NULL, 0));
+    ck_assert_bad_param(movie_save(&movie, NULL));
+
+    // events out of order, unknown key
+    ck_assert_err_none(movie_record(&movie, event));
+    event.cycle = 9;
+    ck_assert_bad_param(movie_record(&movie, event));
+    event.cycle = 10;
+    event.key = NB_GB_KEYS;
+    ck_assert_bad_param(movie_record(&movie, event));
+    ck_assert_uint_eq(movie.size, 1);
+
+    movie_free(&movie);
+    movie_free(NULL);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(movie_play_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    movie_t movie;
+    joypad_t pad;
+    uint64_t cycle = 0;
+    movie_test_fill(&movie);
+    played_count = 0;
+
+    // nothing due yet
+    ck_assert_int_eq(movie_next_cycle(&movie, &cycle), 1);
+    ck_assert_uint_eq(cycle, 0);
+    ck_assert_err_none(movie_play(&movie, &pad, 0));
+    ck_assert_uint_eq(played_count, 3);
+    ck_assert_int_eq(movie_next_cycle(&movie, &cycle), 1);
+    ck_assert_uint_eq(cycle, 10);
+    ck_assert_err_none(movie_play(&movie, &pad, 9));
+    ck_assert_uint_eq(played_count, 3);
+
+    // late events are all played, in order
+    ck_assert_err_none(movie_play(&movie, &pad, 25));
+    ck_assert_uint_eq(played_count, 9);
+    ck_assert_err_none(movie_play(&movie, &pad, UINT64_MAX));
+    ck_assert_uint_eq(played_count, MOVIE_TEST_EVENTS);
+    ck_assert_int_eq(movie_next_cycle(&movie, &cycle), 0);
+
+    for (size_t i = 0; i < MOVIE_TEST_EVENTS; ++i) {
+        ck_assert_int_eq(played[i].key, movie.events[i].key);
+        ck_assert_int_eq(played[i].pressed, movie.events[i].pressed);
+    }
+
+    // seeking goes to the first event of the cycle, or of the cycles after
+    ck_assert_err_none(movie_seek(&movie, 20));
+    ck_assert_uint_eq(movie.next, 6);
+    ck_assert_err_none(movie_seek(&movie, 21));
+    ck_assert_uint_eq(movie.next, 9);
+    ck_assert_err_none(movie_seek(&movie, 0));
+    ck_assert_uint_eq(movie.next, 0);
+    ck_assert_err_none(movie_seek(&movie, UINT64_MAX));
+    ck_assert_int_eq(movie_next_cycle(&movie, &cycle), 0);
+
+    // truncating keeps the events before the cycle, and new events can follow them
+    ck_assert_err_none(movie_truncate(&movie, 21));
+    ck_assert_uint_eq(movie.size, 9);
+    ck_assert_uint_eq(movie.next, 9);
+    const input_event_t event = { 21, A_KEY, 1 };
+    ck_assert_err_none(movie_record(&movie, event));
+    ck_assert_err_none(movie_seek(&movie, 0));
+    ck_assert_err_none(movie_truncate(&movie, 10));
+    ck_assert_uint_eq(movie.size, 3);
+    ck_assert_uint_eq(movie.next, 0);
+
+    movie_free(&movie);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(movie_save_load_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    movie_t movie, loaded;
+    movie_test_fill(&movie);
+
+    ck_assert_err_none(movie_save(&movie, MOVIE_TEST_FILE));
+    ck_assert_err_none(movie_load(&loaded, MOVIE_TEST_FILE));
+    ck_assert_uint_eq(loaded.size, movie.size);
+    ck_assert_uint_eq(loaded.next, 0);
+    for (size_t i = 0; i < movie.size; ++i) {
+        ck_assert_uint_eq(loaded.events[i].cycle, movie.events[i].cycle);
+        ck_assert_int_eq(loaded.events[i].key, movie.events[i].key);
+        ck_assert_int_eq(loaded.events[i].pressed, movie.events[i].pressed);
+    }
+    movie_free(&loaded);
+
+    for (gb_key_t key = RIGHT_KEY; key < NB_GB_KEYS; ++key) {
+        gb_key_t read = NB_GB_KEYS;
+        ck_assert_err_none(movie_key_from_name(movie_key_name(key), &read));
+        ck_assert_int_eq(read, key);
+    }
+
+    // blank lines and comments are skipped
+    FILE* file = fopen(MOVIE_TEST_FILE, "w");
+    ck_assert_ptr_nonnull(file);
+    fputs("GBMOVIE 1\n# comment\n\n  \t\n10 A press\n  # indented comment\n20 A release", file);
+    fclose(file);
+    ck_assert_err_none(movie_load(&loaded, MOVIE_TEST_FILE));
+    ck_assert_uint_eq(loaded.size, 2);
+    ck_assert_uint_eq(loaded.events[1].cycle, 20);
+    movie_free(&loaded);
+
+    // not a movie, bad events, malformed lines
+    const char* const bad[] = { "", "GBMOVIE 2\n", "GBMOVIE 1\n10 A hold\n", "GBMOVIE 1\n10 X press\n",
+                                "GBMOVIE 1\n10 A press\n5 A release\n", "GBMOVIE 1\nA press\n",
+                                "GBMOVIE 1\n100 A press garbage\n", "GBMOVIE 1\n-10 A press\n", "GBMOVIE 1\n10 A\n",
+                                "GBMOVIE 1\n10 A press                                                              \n"
+                              };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        file = fopen(MOVIE_TEST_FILE, "w");
+        ck_assert_ptr_nonnull(file);
+        fputs(bad[i], file);
+        fclose(file);
+        ck_assert_bad_param(movie_load(&loaded, MOVIE_TEST_FILE));
+    }
+
+    unlink(MOVIE_TEST_FILE);
+    ck_assert_int_eq(movie_load(&loaded, MOVIE_TEST_FILE), ERR_IO);
+
+    movie_free(&movie);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(movie_parse_line_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    input_event_t event;
+    bit_t found = 0;
+    const char* reason = NULL;
+
+    ck_assert_err_none(movie_parse_line(" 42\tSTART  release \r\n", &event, &found, &reason));
+    ck_assert_int_eq(found, 1);
+    ck_assert_uint_eq(event.cycle, 42);
+    ck_assert_int_eq(event.key, START_KEY);
+    ck_assert_int_eq(event.pressed, 0);
+
+    ck_assert_err_none(movie_parse_line("\n", &event, &found, &reason));
+    ck_assert_int_eq(found, 0);
+    ck_assert_err_none(movie_parse_line(" # 10 A press", &event, &found, &reason));
+    ck_assert_int_eq(found, 0);
+
+    // what is wrong is told
+    ck_assert_bad_param(movie_parse_line("100 A press garbage", &event, &found, &reason));
+    ck_assert_int_eq(found, 0);
+    ck_assert_str_eq(reason, "expected <number> <key> press|release");
+    ck_assert_bad_param(movie_parse_line("+100 A press", &event, &found, &reason));
+    ck_assert_bad_param(movie_parse_line("100 A hold", &event, &found, &reason));
+    ck_assert_str_eq(reason, "unknown action");
+    ck_assert_bad_param(movie_parse_line("100 Z press", &event, &found, NULL));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* movie_test_suite()
+{
+    Suite* s = suite_create("movie.c Tests");
+
+    Add_Case(s, tc1, "Movie Tests");
+    tcase_add_test(tc1, movie_err);
+    tcase_add_test(tc1, movie_play_exec);
+    tcase_add_test(tc1, movie_save_load_exec);
+    tcase_add_test(tc1, movie_parse_line_exec);
+
+    return s;
+}
+
+TEST_SUITE(movie_test_suite)
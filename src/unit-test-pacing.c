@@ -0,0 +1,182 @@
+/**
+ * @file unit-test-pacing.c
+ * @brief Unit test code for frame pacing
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <check.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "tests.h"
+#include "util.h"
+#include "pacing.h"
+
+#define PACING_TEST_PERIOD 2000000 // 2 ms
+#define PACING_TEST_FRAMES 50
+
+/**
+ * @brief Busy for a given time (in nanoseconds), as an emulated frame would be
+ */
+static void pacing_test_work(uint64_t time)
+{
+    const uint64_t end = pacing_now() + time;
+    while (pacing_now() < end);
+}
+
+START_TEST(pacing_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    pacer_t pacer;
+    ck_assert_bad_param(pacer_init(NULL, PACING_TEST_PERIOD, 1));
+    ck_assert_bad_param(pacer_init(&pacer, 0, 1));
+    ck_assert_bad_param(pacer_frame_start(NULL));
+    ck_assert_bad_param(pacer_frame_end(NULL));
+    ck_assert_bad_param(pacer_restart(NULL));
+    ck_assert_bad_param(pacer_set_period(NULL, PACING_TEST_PERIOD));
+    ck_assert_bad_param(pacer_print(NULL, stdout));
+    ck_assert_err_none(pacer_init(&pacer, PACING_TEST_PERIOD, 1));
+    ck_assert_bad_param(pacer_print(&pacer, NULL));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(pacing_deadlines_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    pacer_t pacer;
+    ck_assert_err_none(pacer_init(&pacer, PACING_TEST_PERIOD, PACING_DEFAULT_CATCH_UP));
+    const uint64_t start = pacing_now();
+
+    // the time of the frames does not add up: deadlines are absolute
+    for (size_t i = 0; i < PACING_TEST_FRAMES; ++i) {
+        ck_assert_err_none(pacer_frame_start(&pacer));
+        pacing_test_work(PACING_TEST_PERIOD / 4 * (i % 3));
+        ck_assert_err_none(pacer_frame_end(&pacer));
+    }
+    const uint64_t elapsed = pacing_now() - start;
+
+    ck_assert_uint_ge(elapsed, PACING_TEST_FRAMES * PACING_TEST_PERIOD);
+    ck_assert_uint_lt(elapsed, PACING_TEST_FRAMES * PACING_TEST_PERIOD + 10 * PACING_TEST_PERIOD);
+    ck_assert_uint_eq(pacer.frames, PACING_TEST_FRAMES);
+    ck_assert_uint_ge(pacer.max_work, PACING_TEST_PERIOD / 2);
+    ck_assert_int_ge(pacer.max_drift, 0);
+#ifdef WITH_PRINT
+    pacer_print(&pacer, stdout);
+#endif
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(pacing_catch_up_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    pacer_t pacer;
+    ck_assert_err_none(pacer_init(&pacer, PACING_TEST_PERIOD, PACING_DEFAULT_CATCH_UP));
+
+    // short stall: the next frames are emulated without waiting until the deadlines are met again
+    ck_assert_err_none(pacer_frame_start(&pacer));
+    pacing_test_work(3 * PACING_TEST_PERIOD);
+    ck_assert_err_none(pacer_frame_end(&pacer));
+    ck_assert_uint_eq(pacer.late, 1);
+    ck_assert_uint_eq(pacer.resyncs, 0);
+    const uint64_t catching_up = pacing_now();
+    ck_assert_err_none(pacer_frame_end(&pacer));
+    ck_assert_uint_lt(pacing_now() - catching_up, PACING_TEST_PERIOD);
+    ck_assert_uint_eq(pacer.late, 2);
+    for (size_t i = 0; i < 3; ++i) {
+        ck_assert_err_none(pacer_frame_end(&pacer));
+    }
+    ck_assert_uint_le(pacer.late, 3);
+
+    // long stall: the late frames are given up
+    const uint64_t late = pacer.late;
+    ck_assert_err_none(pacer_frame_start(&pacer));
+    pacing_test_work((PACING_DEFAULT_CATCH_UP + 3) * PACING_TEST_PERIOD);
+    ck_assert_err_none(pacer_frame_end(&pacer));
+    ck_assert_uint_eq(pacer.late, late + 1);
+    ck_assert_uint_eq(pacer.resyncs, 1);
+    const uint64_t resync = pacing_now();
+    ck_assert_err_none(pacer_frame_end(&pacer));
+    ck_assert_uint_ge(pacing_now() - resync, PACING_TEST_PERIOD / 2);
+    ck_assert_uint_eq(pacer.late, late + 1);
+
+    // a pause is not late
+    pacing_test_work(3 * PACING_TEST_PERIOD);
+    ck_assert_err_none(pacer_restart(&pacer));
+    ck_assert_err_none(pacer_frame_end(&pacer));
+    ck_assert_uint_eq(pacer.late, late + 1);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(pacing_period_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    pacer_t pacer;
+    ck_assert_err_none(pacer_init(&pacer, PACING_TEST_PERIOD, PACING_DEFAULT_CATCH_UP));
+
+    // twice as fast
+    ck_assert_err_none(pacer_set_period(&pacer, PACING_TEST_PERIOD / 2));
+    uint64_t start = pacing_now();
+    for (size_t i = 0; i < PACING_TEST_FRAMES; ++i) {
+        ck_assert_err_none(pacer_frame_end(&pacer));
+    }
+    ck_assert_uint_ge(pacing_now() - start, PACING_TEST_FRAMES * PACING_TEST_PERIOD / 2);
+    ck_assert_uint_lt(pacing_now() - start, PACING_TEST_FRAMES * PACING_TEST_PERIOD);
+
+    // no wait, and never late
+    ck_assert_err_none(pacer_set_period(&pacer, PACING_UNLIMITED));
+    start = pacing_now();
+    for (size_t i = 0; i < PACING_TEST_FRAMES; ++i) {
+        ck_assert_err_none(pacer_frame_start(&pacer));
+        pacing_test_work(PACING_TEST_PERIOD / 10);
+        ck_assert_err_none(pacer_frame_end(&pacer));
+    }
+    ck_assert_uint_lt(pacing_now() - start, PACING_TEST_FRAMES * PACING_TEST_PERIOD / 2);
+    ck_assert_uint_eq(pacer.late, 0);
+    ck_assert_uint_eq(pacer.frames, 2 * PACING_TEST_FRAMES);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* pacing_test_suite()
+{
+    Suite* s = suite_create("pacing.c Tests");
+
+    Add_Case(s, tc1, "Pacing Tests");
+    tcase_add_test(tc1, pacing_err);
+    tcase_add_test(tc1, pacing_deadlines_exec);
+    tcase_add_test(tc1, pacing_catch_up_exec);
+    tcase_add_test(tc1, pacing_period_exec);
+
+    return s;
+}
+
+TEST_SUITE(pacing_test_suite)
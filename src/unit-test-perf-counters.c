@@ -0,0 +1,127 @@
+/**
+ * @file unit-test-perf-counters.c
+ * @brief Unit test code for the hardware performance counters
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "perf_counters.h"
+
+#define PERF_TEST_LOOP ((uint64_t) 100000)
+
+START_TEST(perf_counters_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_bad_param(perf_counters_open(NULL));
+    ck_assert_bad_param(perf_counters_start(NULL));
+    ck_assert_bad_param(perf_counters_stop(NULL));
+    perf_counters_close(NULL);
+    ck_assert(!perf_counters_available(NULL, PERF_INSTRUCTIONS));
+    ck_assert_ptr_null(perf_counter_name(PERF_COUNTERS));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(perf_counters_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // opening succeeds whether the system gives counters or not
+    perf_counters_t counters;
+    ck_assert_err_none(perf_counters_open(&counters));
+    ck_assert(!perf_counters_available(&counters, PERF_COUNTERS));
+
+    volatile uint64_t sum = 0;
+    ck_assert_err_none(perf_counters_start(&counters));
+    for (uint64_t i = 0; i < PERF_TEST_LOOP; ++i) {
+        sum += i;
+    }
+    ck_assert_err_none(perf_counters_stop(&counters));
+    ck_assert_uint_eq(sum, PERF_TEST_LOOP * (PERF_TEST_LOOP - 1) / 2);
+
+    for (perf_counter_t c = PERF_INSTRUCTIONS; c < PERF_COUNTERS; ++c) {
+        ck_assert_ptr_nonnull(perf_counter_name(c));
+        if (!perf_counters_available(&counters, c)) {
+            ck_assert_uint_eq(counters.values[c], 0);
+        }
+#ifdef WITH_PRINT
+        printf("%s: %" PRIu64 "%s\n", perf_counter_name(c), counters.values[c],
+               perf_counters_available(&counters, c) ? "" : " (unavailable)");
+#endif
+    }
+    if (perf_counters_available(&counters, PERF_INSTRUCTIONS)) {
+        ck_assert_uint_ge(counters.values[PERF_INSTRUCTIONS], PERF_TEST_LOOP);
+    }
+
+    // the counts of the runs add up
+    const uint64_t first = counters.values[PERF_INSTRUCTIONS];
+    ck_assert_err_none(perf_counters_start(&counters));
+    ck_assert_err_none(perf_counters_stop(&counters));
+    ck_assert_uint_ge(counters.values[PERF_INSTRUCTIONS], first);
+
+    perf_counters_close(&counters);
+    ck_assert(!perf_counters_available(&counters, PERF_INSTRUCTIONS));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(perf_reading_scale_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    const perf_reading_t opened = { 0, 0, 0 };
+    const perf_reading_t alone = { 100, 1000, 1000 };
+    const perf_reading_t shared = { 150, 3000, 1500 };
+    const perf_reading_t idle = { 150, 4000, 1500 };
+
+    ck_assert_uint_eq(perf_reading_scale(NULL, &alone), 0);
+    ck_assert_uint_eq(perf_reading_scale(&opened, NULL), 0);
+
+    // counting all the time: not scaled
+    ck_assert_uint_eq(perf_reading_scale(&opened, &alone), 100);
+    // counting a quarter of the time between the readings: scaled by their times only, not the times since opened
+    ck_assert_uint_eq(perf_reading_scale(&alone, &shared), 200);
+    // never counting in between
+    ck_assert_uint_eq(perf_reading_scale(&shared, &idle), 0);
+    ck_assert_uint_eq(perf_reading_scale(&shared, &shared), 0);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* perf_counters_test_suite()
+{
+    Suite* s = suite_create("perf_counters.c Tests");
+
+    Add_Case(s, tc1, "Performance Counters Tests");
+    tcase_add_test(tc1, perf_counters_err);
+    tcase_add_test(tc1, perf_counters_exec);
+    tcase_add_test(tc1, perf_reading_scale_exec);
+
+    return s;
+}
+
+TEST_SUITE(perf_counters_test_suite)
@@ -0,0 +1,109 @@
+/**
+ * @file unit-test-profile.c
+ * @brief Unit test code for the instrumentation of the subsystems
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "profile.h"
+
+#define PROFILE_TEST_FRAMES 100
+#define PROFILE_TEST_OUTPUT_SIZE 2048
+
+START_TEST(profile_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    profile_t profile;
+    ck_assert_bad_param(profile_init(NULL));
+    ck_assert_err_none(profile_init(&profile));
+    ck_assert_bad_param(profile_print(NULL, stderr));
+    ck_assert_bad_param(profile_print(&profile, NULL));
+    profile_end_frame(NULL);
+    ck_assert_ptr_null(profile_subsystem_name(PROFILE_SUBSYSTEMS));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(profile_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    profile_t profile;
+    ck_assert_err_none(profile_init(&profile));
+    ck_assert(profile.sample_cost > 0);
+
+    // time goes to the subsystem it is added to
+    const uint64_t start = profile_ticks();
+    const uint64_t now = profile_add(&profile, PROFILE_CPU, start);
+    ck_assert_uint_ge(now, start);
+    ck_assert_uint_eq(profile.frame[PROFILE_CPU], now - start);
+    ck_assert_uint_eq(profile.frame[PROFILE_LCDC], 0);
+    ck_assert_uint_eq(profile.samples, 1);
+
+    // frame n takes n ticks in the LCDC and 1000 in the CPU
+    profile.frame[PROFILE_CPU] = 0;
+    for (uint64_t n = 1; n <= PROFILE_TEST_FRAMES; ++n) {
+        profile.frame[PROFILE_LCDC] = n;
+        profile.frame[PROFILE_CPU] = 1000;
+        profile_end_frame(&profile);
+        ck_assert_uint_eq(profile.frame[PROFILE_LCDC], 0);
+    }
+    ck_assert_uint_eq(profile.frames, PROFILE_TEST_FRAMES);
+    ck_assert_uint_eq(profile.total[PROFILE_LCDC], PROFILE_TEST_FRAMES * (PROFILE_TEST_FRAMES + 1) / 2);
+    ck_assert_uint_eq(profile.total[PROFILE_CPU], PROFILE_TEST_FRAMES * 1000);
+    ck_assert_uint_eq(profile.histogram[PROFILE_TIMER][0], PROFILE_TEST_FRAMES);
+    ck_assert_uint_eq(profile.histogram[PROFILE_CPU][35], PROFILE_TEST_FRAMES); // 896 <= 1000 < 1024
+    ck_assert_uint_eq(profile.histogram[PROFILE_LCDC][1], 1); // 1
+    ck_assert_uint_eq(profile.histogram[PROFILE_LCDC][7], 1); // 7
+    ck_assert_uint_eq(profile.histogram[PROFILE_LCDC][8], 2); // 8, 9
+    ck_assert_uint_eq(profile.histogram[PROFILE_LCDC][20], 16); // 64 to 79
+    ck_assert_uint_eq(profile.histogram[PROFILE_LCDC][22], PROFILE_TEST_FRAMES - 95); // 96 to 100
+    ck_assert_uint_eq(profile.histogram[PROFILE_LCDC][23], 0);
+
+    // every subsystem is printed
+    char output[PROFILE_TEST_OUTPUT_SIZE];
+    zero_init_var(output);
+    FILE* file = fmemopen(output, sizeof(output) - 1, "w");
+    ck_assert_ptr_nonnull(file);
+    ck_assert_err_none(profile_print(&profile, file));
+    fclose(file);
+    for (profile_subsystem_t s = PROFILE_LCDC; s < PROFILE_SUBSYSTEMS; ++s) {
+        ck_assert_ptr_nonnull(strstr(output, profile_subsystem_name(s)));
+    }
+    ck_assert_ptr_nonnull(strstr(output, "overhead"));
+
+#ifdef WITH_PRINT
+    printf("%s", output);
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* profile_test_suite()
+{
+    Suite* s = suite_create("profile.c Tests");
+
+    Add_Case(s, tc1, "Profile Tests");
+    tcase_add_test(tc1, profile_err);
+    tcase_add_test(tc1, profile_exec);
+
+    return s;
+}
+
+TEST_SUITE(profile_test_suite)
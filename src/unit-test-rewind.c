@@ -0,0 +1,163 @@
+/**
+ * @file unit-test-rewind.c
+ * @brief Unit test code for the rewind buffer
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "rewind.h"
+
+#define REWIND_TEST_ROM "../games/tetris.gb"
+#define REWIND_TEST_START_FRAME 200
+#define REWIND_TEST_FRAMES 40
+
+/**
+ * @brief Runs the gameboy REWIND_TEST_FRAMES frames, pushing each one and keeping its state
+ */
+static void rewind_test_push(rewind_t* rewind, gameboy_t* gameboy, gameboy_state_t* states)
+{
+    for (size_t f = 0; f < REWIND_TEST_FRAMES; ++f) {
+        ck_assert_err_none(gameboy_run_until(gameboy, (REWIND_TEST_START_FRAME + f) * FRAME_TOTAL_CYCLES));
+        ck_assert_err_none(rewind_push(rewind, gameboy));
+        ck_assert_err_none(gameboy_save_state(gameboy, &states[f]));
+    }
+}
+
+/**
+ * @brief Steps back through all the frames available, checking the gameboy is in the state of each one
+ */
+static void rewind_test_step_back(rewind_t* rewind, gameboy_t* gameboy, const gameboy_state_t* states,
+                                  gameboy_state_t* state)
+{
+    const size_t available = rewind_available(rewind);
+    for (size_t back = 1; back <= available; ++back) {
+        ck_assert_err_none(rewind_step_back(rewind, gameboy));
+        ck_assert_err_none(gameboy_save_state(gameboy, state));
+        ck_assert_int_eq(memcmp(state, &states[REWIND_TEST_FRAMES - 1 - back], sizeof(gameboy_state_t)), 0);
+        ck_assert_uint_eq(rewind_available(rewind), available - back);
+    }
+    ck_assert_bad_param(rewind_step_back(rewind, gameboy));
+}
+
+START_TEST(rewind_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    rewind_t rewind;
+    gameboy_t* gameboy = calloc(1, sizeof(gameboy_t));
+    ck_assert_ptr_nonnull(gameboy);
+    ck_assert_err_none(gameboy_create(gameboy, REWIND_TEST_ROM, GB_ACCURACY_CYCLE));
+
+    ck_assert_bad_param(rewind_create(NULL, 10, 2, REWIND_MIN_BUDGET));
+    ck_assert_bad_param(rewind_create(&rewind, 1, 2, REWIND_MIN_BUDGET));
+    ck_assert_bad_param(rewind_create(&rewind, 10, 0, REWIND_MIN_BUDGET));
+    ck_assert_bad_param(rewind_create(&rewind, 10, 2, REWIND_MIN_BUDGET - 1));
+    ck_assert_err_none(rewind_create(&rewind, 10, 2, REWIND_MIN_BUDGET));
+
+    ck_assert_bad_param(rewind_push(NULL, gameboy));
+    ck_assert_bad_param(rewind_push(&rewind, NULL));
+    ck_assert_bad_param(rewind_step_back(NULL, gameboy));
+    ck_assert_bad_param(rewind_step_back(&rewind, NULL));
+    ck_assert_uint_eq(rewind_available(NULL), 0);
+
+    // nothing to step back to
+    ck_assert_bad_param(rewind_step_back(&rewind, gameboy));
+    ck_assert_err_none(rewind_push(&rewind, gameboy));
+    ck_assert_uint_eq(rewind_available(&rewind), 0);
+    ck_assert_bad_param(rewind_step_back(&rewind, gameboy));
+
+    rewind_free(&rewind);
+    rewind_free(NULL);
+    gameboy_free(gameboy);
+    free(gameboy);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(rewind_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    rewind_t rewind;
+    gameboy_t* gameboy = calloc(1, sizeof(gameboy_t));
+    gameboy_state_t* states = calloc(REWIND_TEST_FRAMES + 1, sizeof(gameboy_state_t));
+    ck_assert_ptr_nonnull(gameboy);
+    ck_assert_ptr_nonnull(states);
+    gameboy_state_t* const state = &states[REWIND_TEST_FRAMES];
+
+    // every frame kept, back across the keyframes
+    ck_assert_err_none(gameboy_create(gameboy, REWIND_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(rewind_create(&rewind, REWIND_TEST_FRAMES, 8, 100 * REWIND_MIN_BUDGET));
+    rewind_test_push(&rewind, gameboy, states);
+    ck_assert_uint_eq(rewind_available(&rewind), REWIND_TEST_FRAMES - 1);
+    ck_assert_uint_eq(rewind.dropped, 0);
+    // the deltas of a frame are much smaller than a state
+    ck_assert_uint_lt(rewind.bytes, REWIND_TEST_FRAMES / 8 * sizeof(gameboy_state_t));
+    rewind_test_step_back(&rewind, gameboy, states, state);
+
+    // and forward again from there
+    ck_assert_err_none(rewind_push(&rewind, gameboy));
+    ck_assert_err_none(gameboy_run_until(gameboy, (REWIND_TEST_START_FRAME + 1) * FRAME_TOTAL_CYCLES));
+    ck_assert_err_none(gameboy_save_state(gameboy, state));
+    ck_assert_int_eq(memcmp(state, &states[1], sizeof(gameboy_state_t)), 0);
+    rewind_free(&rewind);
+    gameboy_free(gameboy);
+
+    // out of frames: the oldest keyframes go with their deltas
+    ck_assert_err_none(gameboy_create(gameboy, REWIND_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(rewind_create(&rewind, 10, 4, 100 * REWIND_MIN_BUDGET));
+    rewind_test_push(&rewind, gameboy, states);
+    ck_assert_uint_le(rewind.count, 10);
+    ck_assert_uint_gt(rewind.count, 10 - 4);
+    ck_assert(rewind.frames[rewind.first].keyframe);
+    rewind_test_step_back(&rewind, gameboy, states, state);
+    rewind_free(&rewind);
+    gameboy_free(gameboy);
+
+    // out of bytes
+    ck_assert_err_none(gameboy_create(gameboy, REWIND_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(rewind_create(&rewind, REWIND_TEST_FRAMES, 4, REWIND_MIN_BUDGET));
+    rewind_test_push(&rewind, gameboy, states);
+    ck_assert_uint_gt(rewind.dropped, 0);
+    ck_assert_uint_ge(rewind_available(&rewind), 1);
+    ck_assert(rewind.frames[rewind.first].keyframe);
+    rewind_test_step_back(&rewind, gameboy, states, state);
+    rewind_free(&rewind);
+    gameboy_free(gameboy);
+
+    free(states);
+    free(gameboy);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* rewind_test_suite()
+{
+    Suite* s = suite_create("rewind.c Tests");
+
+    Add_Case(s, tc1, "Rewind Tests");
+    tcase_add_test(tc1, rewind_err);
+    tcase_add_test(tc1, rewind_exec);
+
+    return s;
+}
+
+TEST_SUITE(rewind_test_suite)
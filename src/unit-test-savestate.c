@@ -0,0 +1,174 @@
+/**
+ * @file unit-test-savestate.c
+ * @brief Unit test code for the save states
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "util.h"
+#include "savestate.h"
+#include "pacing.h"
+
+#define SAVESTATE_TEST_ROM "../games/tetris.gb"
+#define SAVESTATE_TEST_FILE "unit-test-savestate.tmp"
+#define SAVESTATE_TEST_BOOT_CYCLES (40 * FRAME_TOTAL_CYCLES + 123) //in the middle of a line of the boot ROM logo
+#define SAVESTATE_TEST_GAME_CYCLES (300 * FRAME_TOTAL_CYCLES + 4567) //on the title screen, the boot ROM disabled
+#define SAVESTATE_TEST_CONTINUATION (60 * FRAME_TOTAL_CYCLES)
+#define SAVESTATE_TEST_ROUNDS 1000
+
+/**
+ * @brief Saves the state of gameboy, loads it in a gameboy at another point of the run,
+ *        then checks both run exactly the same
+ */
+static void savestate_test_continuation(gameboy_t* gameboy, gameboy_t* other, gameboy_state_t* states)
+{
+    ck_assert_err_none(gameboy_save_state(gameboy, &states[0]));
+    ck_assert_err_none(gameboy_load_state(other, &states[0]));
+    ck_assert_uint_eq(other->boot, gameboy->boot);
+    ck_assert_err_none(gameboy_save_state(other, &states[1]));
+    ck_assert_int_eq(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+
+    // the frames are drawn from the caches of the loaded gameboy
+    const uint64_t end = gameboy->cycles + SAVESTATE_TEST_CONTINUATION;
+    ck_assert_err_none(gameboy_run_until(gameboy, end));
+    ck_assert_err_none(gameboy_run_until(other, end));
+    ck_assert_err_none(gameboy_save_state(gameboy, &states[0]));
+    ck_assert_err_none(gameboy_save_state(other, &states[1]));
+    ck_assert_int_eq(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+
+    uint64_t hash = 0;
+    uint64_t other_hash = 0;
+    ck_assert_err_none(image_hash(&gameboy->screen.display, &hash));
+    ck_assert_err_none(image_hash(&other->screen.display, &other_hash));
+    ck_assert_uint_eq(hash, other_hash);
+}
+
+START_TEST(savestate_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gameboy = calloc(1, sizeof(gameboy_t));
+    gameboy_state_t* state = calloc(1, sizeof(gameboy_state_t));
+    ck_assert_ptr_nonnull(gameboy);
+    ck_assert_ptr_nonnull(state);
+    ck_assert_err_none(gameboy_create(gameboy, SAVESTATE_TEST_ROM, GB_ACCURACY_CYCLE));
+
+    ck_assert_bad_param(gameboy_save_state(NULL, state));
+    ck_assert_bad_param(gameboy_save_state(gameboy, NULL));
+    ck_assert_bad_param(gameboy_load_state(NULL, state));
+    ck_assert_bad_param(gameboy_load_state(gameboy, NULL));
+    ck_assert_bad_param(gameboy_state_write(NULL, SAVESTATE_TEST_FILE));
+    ck_assert_bad_param(gameboy_state_write(state, NULL));
+    ck_assert_bad_param(gameboy_state_read(NULL, SAVESTATE_TEST_FILE));
+    ck_assert_bad_param(gameboy_state_read(state, NULL));
+
+    // not a state, or of another version
+    ck_assert_bad_param(gameboy_load_state(gameboy, state));
+    ck_assert_err_none(gameboy_save_state(gameboy, state));
+    ++state->version;
+    ck_assert_bad_param(gameboy_load_state(gameboy, state));
+    --state->version;
+    state->size /= 2;
+    ck_assert_bad_param(gameboy_load_state(gameboy, state));
+
+    // truncated file
+    FILE* file = fopen(SAVESTATE_TEST_FILE, "wb");
+    ck_assert_ptr_nonnull(file);
+    ck_assert_uint_eq(fwrite(state, 1, sizeof(gameboy_state_t) / 2, file), sizeof(gameboy_state_t) / 2);
+    fclose(file);
+    ck_assert_bad_param(gameboy_state_read(state, SAVESTATE_TEST_FILE));
+    remove(SAVESTATE_TEST_FILE);
+    ck_assert_int_eq(gameboy_state_read(state, SAVESTATE_TEST_FILE), ERR_IO);
+
+    gameboy_free(gameboy);
+    free(gameboy);
+    free(state);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(savestate_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    gameboy_t* gameboys = calloc(2, sizeof(gameboy_t));
+    gameboy_state_t* states = calloc(2, sizeof(gameboy_state_t));
+    ck_assert_ptr_nonnull(gameboys);
+    ck_assert_ptr_nonnull(states);
+    ck_assert_err_none(gameboy_create(&gameboys[0], SAVESTATE_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(gameboy_create(&gameboys[1], SAVESTATE_TEST_ROM, GB_ACCURACY_CYCLE));
+
+    // during the boot ROM, loaded in a gameboy that has not started
+    ck_assert_err_none(gameboy_run_until(&gameboys[0], SAVESTATE_TEST_BOOT_CYCLES));
+    ck_assert_int_eq(gameboys[0].boot, 1);
+    savestate_test_continuation(&gameboys[0], &gameboys[1], states);
+
+    // after it, loaded in a gameboy still booting
+    gameboy_free(&gameboys[1]);
+    ck_assert_err_none(gameboy_create(&gameboys[1], SAVESTATE_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(gameboy_run_until(&gameboys[1], SAVESTATE_TEST_BOOT_CYCLES));
+    ck_assert_err_none(gameboy_run_until(&gameboys[0], SAVESTATE_TEST_GAME_CYCLES));
+    ck_assert_int_eq(gameboys[0].boot, 0);
+    ck_assert_int_eq(gameboys[1].boot, 1);
+    savestate_test_continuation(&gameboys[0], &gameboys[1], states);
+
+    // back to the boot ROM
+    gameboy_free(&gameboys[0]);
+    ck_assert_err_none(gameboy_create(&gameboys[0], SAVESTATE_TEST_ROM, GB_ACCURACY_CYCLE));
+    ck_assert_err_none(gameboy_run_until(&gameboys[0], SAVESTATE_TEST_BOOT_CYCLES));
+    savestate_test_continuation(&gameboys[0], &gameboys[1], states);
+
+    // through a file
+    ck_assert_err_none(gameboy_save_state(&gameboys[0], &states[0]));
+    ck_assert_err_none(gameboy_state_write(&states[0], SAVESTATE_TEST_FILE));
+    ck_assert_err_none(gameboy_state_read(&states[1], SAVESTATE_TEST_FILE));
+    ck_assert_int_eq(memcmp(&states[0], &states[1], sizeof(gameboy_state_t)), 0);
+    remove(SAVESTATE_TEST_FILE);
+
+    // a save and a load take microseconds
+    const uint64_t start = pacing_now();
+    for (size_t round = 0; round < SAVESTATE_TEST_ROUNDS; ++round) {
+        ck_assert_err_none(gameboy_save_state(&gameboys[0], &states[0]));
+        ck_assert_err_none(gameboy_load_state(&gameboys[1], &states[0]));
+    }
+    const uint64_t nanoseconds = (pacing_now() - start) / SAVESTATE_TEST_ROUNDS;
+    ck_assert_uint_lt(nanoseconds, 1000000);
+
+    gameboy_free(&gameboys[0]);
+    gameboy_free(&gameboys[1]);
+    free(gameboys);
+    free(states);
+
+#ifdef WITH_PRINT
+    printf("save and load: %" PRIu64 " ns\n", nanoseconds);
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* savestate_test_suite()
+{
+    Suite* s = suite_create("savestate.c Tests");
+
+    Add_Case(s, tc1, "Save State Tests");
+    tcase_add_test(tc1, savestate_err);
+    tcase_add_test(tc1, savestate_exec);
+
+    return s;
+}
+
+TEST_SUITE(savestate_test_suite)
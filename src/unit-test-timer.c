@@ -133,6 +133,85 @@ START_TEST(timer_cycle_exec)
 }
 END_TEST
 
+START_TEST(timer_advance_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_bad_param(timer_advance(NULL, 1));
+    ck_assert_int_eq(timer_idle_cycles(NULL), 0);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+#define ADVANCE_MAX_CYCLES 1500
+
+START_TEST(timer_advance_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // the same as cycling the timer one cycle at a time, whatever the configuration
+    for (data_t TAC = 0; TAC < 8; ++TAC) {
+        for (size_t cycles = 1; cycles <= ADVANCE_MAX_CYCLES; cycles += 1 + cycles / 4) {
+            INIT;
+            ck_assert_err_none(timer_init(&timer, &cpu));
+            INIT_BUS;
+            gbtimer_t other;
+            cpu_t other_cpu;
+            zero_init_var(other_cpu);
+            bus_t other_bus;
+            zero_init_var(other_bus);
+            data_t other_regs[TIMER_SIZE];
+            zero_init_var(other_regs);
+            for (addr_t a = TIMER_START; a <= TIMER_END; ++a) {
+                other_bus[a] = &other_regs[a - TIMER_START];
+            }
+            other_cpu.bus = &other_bus;
+            ck_assert_err_none(timer_init(&other, &other_cpu));
+
+            const uint16_t counter = (uint16_t) (0xFFF0 - 4 * cycles);
+            timer.counter = other.counter = counter;
+            *bus[REG_TAC] = *other_bus[REG_TAC] = TAC;
+            *bus[REG_TIMA] = *other_bus[REG_TIMA] = 0xFE;
+            *bus[REG_TMA] = *other_bus[REG_TMA] = 0xF0;
+
+            // TIMA does not change during the idle cycles
+            const uint64_t idle = timer_idle_cycles(&timer);
+            if (TAC & 0x4) {
+                ck_assert_uint_lt(idle, 512);
+            } else {
+                ck_assert_uint_eq(idle, UINT64_MAX);
+            }
+
+            for (size_t i = 0; i < cycles; ++i) {
+                ck_assert_err_none(timer_cycle(&timer));
+                if (i < idle) {
+                    ck_assert_int_eq(*bus[REG_TIMA], 0xFE);
+                } else if (i == idle) {
+                    ck_assert_int_eq(*bus[REG_TIMA], 0xFF);
+                }
+            }
+            ck_assert_err_none(timer_advance(&other, cycles));
+
+            ck_assert_int_eq(timer.counter, other.counter);
+            ck_assert_int_eq(*bus[REG_DIV], *other_bus[REG_DIV]);
+            ck_assert_int_eq(*bus[REG_TIMA], *other_bus[REG_TIMA]);
+            ck_assert_int_eq(cpu.IF, other_cpu.IF);
+        }
+    }
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
 START_TEST(timer_listener_err)
 {
 // ------------------------------------------------------------
@@ -193,6 +272,8 @@ Suite* timer_test_suite()
 
     tcase_add_test(tc1, timer_cycle_err);
     tcase_add_test(tc1, timer_cycle_exec);
+    tcase_add_test(tc1, timer_advance_err);
+    tcase_add_test(tc1, timer_advance_exec);
     tcase_add_test(tc1, timer_listener_err);
     tcase_add_test(tc1, timer_listener_exec);
 
@@ -0,0 +1,219 @@
+/**
+ * @file unit-test-trace.c
+ * @brief Unit test code for the instruction traces
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "tests.h"
+#include "util.h"
+#include "trace.h"
+
+#define TRACE_TEST_FILE "unit-test-trace.tmp"
+#define TRACE_TEST_OTHER_FILE "unit-test-trace-other.tmp"
+#define TRACE_TEST_ENTRIES (TRACE_CHUNKS * TRACE_CHUNK_ENTRIES * 3 + 123) //more than the chunks, with a partial one
+#define TRACE_TEST_DIVERGENCE 40000
+
+/**
+ * @brief Entry i of the test traces: a loop that moves some registers, with jumps back and forth
+ */
+static trace_entry_t test_entry(uint64_t i)
+{
+    trace_entry_t entry;
+    zero_init_var(entry);
+    entry.cycle = 3 * i + (i % 5);
+    entry.PC = (addr_t) (i % 1000 == 0 ? 0x0150 : 0xC000 + (i % 97) * 3);
+    entry.opcode = (data_t) (i * 13);
+    entry.AF = (uint16_t) (i / 3);
+    entry.BC = 0x1234;
+    entry.DE = (uint16_t) (i % 100 == 0 ? i : 0);
+    entry.HL = (uint16_t) (0x8000 + i / 7);
+    entry.SP = 0xFFFE;
+    return entry;
+}
+
+/**
+ * @brief Writes the test trace, up to count entries, with entry divergence changed if it is lower
+ */
+static int write_test_trace(const char* filename, bit_t compress, uint64_t count, uint64_t divergence)
+{
+    trace_t trace;
+    M_EXIT_IF_ERR(trace_open(&trace, filename, compress));
+    for (uint64_t i = 0; i < count; ++i) {
+        trace_entry_t entry = test_entry(i);
+        if (i == divergence) {
+            ++entry.HL;
+        }
+        M_EXIT_IF_ERR_DO_SOMETHING(trace_record(&trace, &entry), trace_close(&trace));
+    }
+    M_EXIT_IF_ERR(trace_close(&trace));
+    return trace.entries == count ? ERR_NONE : ERR_IO;
+}
+
+/**
+ * @brief Diffs two trace files
+ */
+static int diff_files(const char* first_name, const char* second_name, trace_divergence_t* divergence)
+{
+    trace_reader_t first;
+    trace_reader_t second;
+    M_EXIT_IF_ERR(trace_reader_open(&first, first_name));
+    M_EXIT_IF_ERR_DO_SOMETHING(trace_reader_open(&second, second_name), trace_reader_close(&first));
+    const int err = trace_diff(&first, &second, divergence);
+    trace_reader_close(&first);
+    trace_reader_close(&second);
+    return err;
+}
+
+START_TEST(trace_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    trace_t trace;
+    zero_init_var(trace);
+    trace_reader_t reader;
+    zero_init_var(reader);
+    trace_entry_t entry;
+    zero_init_var(entry);
+    trace_divergence_t divergence;
+    bit_t end = 0;
+
+    ck_assert_bad_param(trace_open(NULL, TRACE_TEST_FILE, 0));
+    ck_assert_bad_param(trace_open(&trace, NULL, 0));
+    ck_assert_bad_param(trace_flush(NULL));
+    ck_assert_bad_param(trace_close(NULL));
+    ck_assert_bad_param(trace_close(&trace));
+    ck_assert_bad_param(trace_reader_open(NULL, TRACE_TEST_FILE));
+    ck_assert_bad_param(trace_reader_open(&reader, NULL));
+    ck_assert_bad_param(trace_reader_next(NULL, &entry, &end));
+    ck_assert_bad_param(trace_reader_next(&reader, &entry, &end));
+    ck_assert_bad_param(trace_diff(NULL, &reader, &divergence));
+    ck_assert_bad_param(trace_diff(&reader, NULL, &divergence));
+    ck_assert_bad_param(trace_diff(&reader, &reader, NULL));
+    trace_reader_close(NULL);
+    ck_assert(!trace_entry_equal(NULL, &entry));
+    trace_entry_print(NULL, &entry);
+
+    // not a trace, truncated, unknown block
+    const char* const bad[] = { "", "GBTRACE 2\n", "GBTRACE 1\n\x00\x05", "GBTRACE 1\n\x07\x00\x00\x00\x00\x00\x00\x00\x00",
+                                "GBTRACE 1\n\x00\x02\x00\x00\x00\x02\x00\x00\x00\x00"
+                              };
+    const size_t bad_sizes[] = { 0, 10, 12, 19, 21 };
+    const int bad_errors[] = { ERR_BAD_PARAMETER, ERR_BAD_PARAMETER, ERR_IO, ERR_BAD_PARAMETER, ERR_BAD_PARAMETER };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        FILE* file = fopen(TRACE_TEST_FILE, "wb");
+        ck_assert_ptr_nonnull(file);
+        fwrite(bad[i], 1, bad_sizes[i], file);
+        fclose(file);
+        int err = trace_reader_open(&reader, TRACE_TEST_FILE);
+        if (err == ERR_NONE) {
+            err = trace_reader_next(&reader, &entry, &end);
+            trace_reader_close(&reader);
+        }
+        ck_assert_int_eq(err, bad_errors[i]);
+    }
+
+    unlink(TRACE_TEST_FILE);
+    ck_assert_int_eq(trace_reader_open(&reader, TRACE_TEST_FILE), ERR_IO);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(trace_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    for (bit_t compress = 0; compress <= 1; ++compress) {
+        ck_assert_err_none(write_test_trace(TRACE_TEST_FILE, compress, TRACE_TEST_ENTRIES, TRACE_TEST_ENTRIES));
+
+        // every entry is read back
+        trace_reader_t reader;
+        ck_assert_err_none(trace_reader_open(&reader, TRACE_TEST_FILE));
+        bit_t end = 0;
+        for (uint64_t i = 0; i < TRACE_TEST_ENTRIES; ++i) {
+            trace_entry_t entry;
+            ck_assert_err_none(trace_reader_next(&reader, &entry, &end));
+            ck_assert(!end);
+            const trace_entry_t expected = test_entry(i);
+            ck_assert(trace_entry_equal(&entry, &expected));
+        }
+        trace_entry_t entry;
+        ck_assert_err_none(trace_reader_next(&reader, &entry, &end));
+        ck_assert(end);
+        ck_assert_uint_eq(reader.index, TRACE_TEST_ENTRIES);
+        trace_reader_close(&reader);
+
+#ifdef WITH_PRINT
+        FILE* file = fopen(TRACE_TEST_FILE, "rb");
+        fseek(file, 0, SEEK_END);
+        printf("%s: %ld bytes for %d entries\n", compress ? "compressed" : "raw", ftell(file), TRACE_TEST_ENTRIES);
+        fclose(file);
+#endif
+    }
+
+    // identical traces, whether compressed or not
+    trace_divergence_t divergence;
+    ck_assert_err_none(write_test_trace(TRACE_TEST_OTHER_FILE, 0, TRACE_TEST_ENTRIES, TRACE_TEST_ENTRIES));
+    ck_assert_err_none(diff_files(TRACE_TEST_FILE, TRACE_TEST_OTHER_FILE, &divergence));
+    ck_assert(!divergence.diverged);
+    ck_assert_uint_eq(divergence.index, TRACE_TEST_ENTRIES);
+
+    // a register differs
+    ck_assert_err_none(write_test_trace(TRACE_TEST_OTHER_FILE, 1, TRACE_TEST_ENTRIES, TRACE_TEST_DIVERGENCE));
+    ck_assert_err_none(diff_files(TRACE_TEST_FILE, TRACE_TEST_OTHER_FILE, &divergence));
+    ck_assert(divergence.diverged);
+    ck_assert_uint_eq(divergence.index, TRACE_TEST_DIVERGENCE);
+    ck_assert(!divergence.first_ended && !divergence.second_ended);
+    ck_assert_uint_eq(divergence.second.HL, divergence.first.HL + 1);
+    ck_assert(divergence.has_common);
+    const trace_entry_t common = test_entry(TRACE_TEST_DIVERGENCE - 1);
+    ck_assert(trace_entry_equal(&divergence.common, &common));
+
+    // a trace stops earlier
+    ck_assert_err_none(write_test_trace(TRACE_TEST_OTHER_FILE, 1, TRACE_TEST_DIVERGENCE, TRACE_TEST_ENTRIES));
+    ck_assert_err_none(diff_files(TRACE_TEST_OTHER_FILE, TRACE_TEST_FILE, &divergence));
+    ck_assert(divergence.diverged);
+    ck_assert_uint_eq(divergence.index, TRACE_TEST_DIVERGENCE);
+    ck_assert(divergence.first_ended && !divergence.second_ended);
+
+    // empty trace
+    ck_assert_err_none(write_test_trace(TRACE_TEST_OTHER_FILE, 0, 0, 0));
+    ck_assert_err_none(diff_files(TRACE_TEST_OTHER_FILE, TRACE_TEST_FILE, &divergence));
+    ck_assert(divergence.diverged && !divergence.has_common);
+    ck_assert_uint_eq(divergence.index, 0);
+
+    unlink(TRACE_TEST_FILE);
+    unlink(TRACE_TEST_OTHER_FILE);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* trace_test_suite()
+{
+    Suite* s = suite_create("trace.c Tests");
+
+    Add_Case(s, tc1, "Trace Tests");
+    tcase_add_test(tc1, trace_err);
+    tcase_add_test(tc1, trace_exec);
+
+    return s;
+}
+
+TEST_SUITE(trace_test_suite)
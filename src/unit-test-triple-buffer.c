@@ -0,0 +1,147 @@
+/**
+ * @file unit-test-triple-buffer.c
+ * @brief Unit test code for the triple buffer
+ *
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <check.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "tests.h"
+#include "util.h"
+#include "triple_buffer.h"
+
+#define TB_TEST_SIZE 4096
+#define TB_TEST_FRAMES 20000
+
+START_TEST(triple_buffer_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    triple_buffer_t buffer;
+    ck_assert_bad_param(triple_buffer_create(NULL, TB_TEST_SIZE));
+    ck_assert_bad_param(triple_buffer_create(&buffer, 0));
+    ck_assert_bad_param(triple_buffer_publish(NULL));
+    ck_assert_ptr_null(triple_buffer_back(NULL));
+    ck_assert_ptr_null(triple_buffer_front(NULL, NULL));
+    triple_buffer_free(NULL);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(triple_buffer_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    triple_buffer_t buffer;
+    int fresh = 1;
+    ck_assert_err_none(triple_buffer_create(&buffer, TB_TEST_SIZE));
+
+    // nothing published yet: an empty slot
+    const uint8_t* front = triple_buffer_front(&buffer, &fresh);
+    ck_assert_int_eq(fresh, 0);
+    ck_assert_int_eq(front[0], 0);
+
+    triple_buffer_back(&buffer)[0] = 1;
+    ck_assert_err_none(triple_buffer_publish(&buffer));
+    ck_assert_int_eq(triple_buffer_front(&buffer, &fresh)[0], 1);
+    ck_assert_int_eq(fresh, 1);
+    ck_assert_int_eq(triple_buffer_front(&buffer, &fresh)[0], 1);
+    ck_assert_int_eq(fresh, 0);
+
+    // only the last published slot is taken, and the producer never writes in the front slot
+    triple_buffer_back(&buffer)[0] = 2;
+    ck_assert_err_none(triple_buffer_publish(&buffer));
+    triple_buffer_back(&buffer)[0] = 3;
+    ck_assert_err_none(triple_buffer_publish(&buffer));
+    front = triple_buffer_front(&buffer, &fresh);
+    ck_assert_int_eq(front[0], 3);
+    ck_assert_ptr_ne(triple_buffer_back(&buffer), front);
+    ck_assert_uint_eq(buffer.published, 3);
+    ck_assert_uint_eq(buffer.taken, 2);
+
+    triple_buffer_free(&buffer);
+    ck_assert_ptr_null(buffer.slots[0]);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+/**
+ * @brief Publishes TB_TEST_FRAMES slots, slot n being filled with n
+ */
+static void* triple_buffer_test_producer(void* arg)
+{
+    triple_buffer_t* buffer = arg;
+    for (uint32_t n = 1; n <= TB_TEST_FRAMES; ++n) {
+        uint32_t* slot = (uint32_t*) triple_buffer_back(buffer);
+        for (size_t i = 0; i < TB_TEST_SIZE / sizeof(uint32_t); ++i) {
+            slot[i] = n;
+        }
+        triple_buffer_publish(buffer);
+    }
+    return NULL;
+}
+
+START_TEST(triple_buffer_threads_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    triple_buffer_t buffer;
+    ck_assert_err_none(triple_buffer_create(&buffer, TB_TEST_SIZE));
+
+    pthread_t producer;
+    ck_assert_int_eq(pthread_create(&producer, NULL, triple_buffer_test_producer, &buffer), 0);
+
+    // every slot taken is complete, and more recent than the previous one
+    uint32_t last = 0;
+    size_t torn = 0, older = 0;
+    while (last < TB_TEST_FRAMES) {
+        const uint32_t* slot = (const uint32_t*) triple_buffer_front(&buffer, NULL);
+        for (size_t i = 1; i < TB_TEST_SIZE / sizeof(uint32_t); ++i) {
+            torn += slot[i] != slot[0];
+        }
+        older += slot[0] < last;
+        last = slot[0];
+    }
+    ck_assert_int_eq(pthread_join(producer, NULL), 0);
+
+    ck_assert_uint_eq(torn, 0);
+    ck_assert_uint_eq(older, 0);
+    ck_assert_uint_le(buffer.taken, TB_TEST_FRAMES);
+
+    triple_buffer_free(&buffer);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* triple_buffer_test_suite()
+{
+    Suite* s = suite_create("triple_buffer.c Tests");
+
+    Add_Case(s, tc1, "Triple Buffer Tests");
+    tcase_add_test(tc1, triple_buffer_err);
+    tcase_add_test(tc1, triple_buffer_exec);
+    tcase_add_test(tc1, triple_buffer_threads_exec);
+
+    return s;
+}
+
+TEST_SUITE(triple_buffer_test_suite)